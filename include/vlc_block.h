@@ -81,6 +81,9 @@
 #define BLOCK_FLAG_TOP_FIELD_FIRST 0x2000
 /** This block contains an interlaced picture with bottom field first */
 #define BLOCK_FLAG_BOTTOM_FIELD_FIRST 0x4000
+/** This block starts a part of the muxed stream that can be cut out on its
+ * own, e.g. a movie fragment, after the header blocks */
+#define BLOCK_FLAG_SEGMENT_START 0x8000
 
 /** This block contains an interlaced picture */
 #define BLOCK_FLAG_INTERLACED_MASK \
@@ -171,6 +174,7 @@ VLC_API block_t *block_mmap_Alloc(void *addr, size_t length) VLC_USED VLC_MALLOC
 VLC_API block_t * block_shm_Alloc(void *addr, size_t length) VLC_USED VLC_MALLOC;
 VLC_API block_t *block_File(int fd) VLC_USED VLC_MALLOC;
 VLC_API block_t *block_FilePath(const char *) VLC_USED VLC_MALLOC;
+VLC_API int block_PoolStats(unsigned, size_t *, uint64_t *, uint64_t *);
 
 static inline void block_Cleanup (void *block)
 {
@@ -294,6 +298,8 @@ static inline block_t *block_ChainGather( block_t *p_list )
  * Fifos of blocks.
  ****************************************************************************
  * - block_FifoNew : create and init a new fifo
+ * - block_FifoNewSPSC : create a fifo with exactly one writer thread and one
+ *      reader thread, that can queue and dequeue without locking.
  * - block_FifoRelease : destroy a fifo and free all blocks in it.
  * - block_FifoPace : wait for a fifo to drain to a specified number of packets or total data size
  * - block_FifoEmpty : free all blocks in a fifo
@@ -308,6 +314,7 @@ static inline block_t *block_ChainGather( block_t *p_list )
  ****************************************************************************/
 
 VLC_API block_fifo_t *block_FifoNew( void ) VLC_USED VLC_MALLOC;
+VLC_API block_fifo_t *block_FifoNewSPSC( void ) VLC_USED VLC_MALLOC;
 VLC_API void block_FifoRelease( block_fifo_t * );
 VLC_API void block_FifoPace( block_fifo_t *fifo, size_t max_depth, size_t max_size );
 VLC_API void block_FifoEmpty( block_fifo_t * );
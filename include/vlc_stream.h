@@ -68,6 +68,8 @@ struct stream_t
     int      (*pf_read)   ( stream_t *, void *p_read, unsigned int i_read );
     int      (*pf_peek)   ( stream_t *, const uint8_t **pp_peek, unsigned int i_peek );
     int      (*pf_control)( stream_t *, int i_query, va_list );
+    /* Optional, for streams able to return blocks without copying */
+    block_t *(*pf_block)  ( stream_t *, unsigned int i_size );
 
     /* */
     void     (*pf_destroy)( stream_t *);
@@ -56,6 +56,9 @@
 
 #include <assert.h>
 #include <limits.h>
+#ifdef HAVE_POLL
+# include <poll.h>
+#endif
 
 /*****************************************************************************
  * Module descriptor
@@ -90,6 +93,19 @@ static void Close( vlc_object_t * );
 #define REFERER_TEXT N_("HTTP referer value")
 #define REFERER_LONGTEXT N_("Customize the HTTP referer, simulating a previous document")
 
+#define KEEPALIVE_TEXT N_("Reuse connections")
+#define KEEPALIVE_LONGTEXT N_("Keep HTTP/1.1 connections open once a " \
+    "response was read whole, and reuse them for the next requests to the " \
+    "same server, from any input.")
+
+#define KEEPALIVE_TIMEOUT_TEXT N_("Idle connections timeout (seconds)")
+#define KEEPALIVE_TIMEOUT_LONGTEXT N_("Time after which unused connections " \
+    "are closed.")
+
+#define KEEPALIVE_MAX_TEXT N_("Idle connections per server")
+#define KEEPALIVE_MAX_LONGTEXT N_("Maximum number of unused connections " \
+    "kept open to a single server.")
+
 #define UA_TEXT N_("User Agent")
 #define UA_LONGTEXT N_("The name and version of the program will be " \
     "provided to the HTTP server. They must be separated by a forward " \
@@ -120,6 +136,12 @@ vlc_module_begin ()
         change_safe()
     add_bool( "http-forward-cookies", true, FORWARD_COOKIES_TEXT,
               FORWARD_COOKIES_LONGTEXT, true )
+    add_bool( "http-keep-alive", true, KEEPALIVE_TEXT,
+              KEEPALIVE_LONGTEXT, true )
+    add_integer( "http-keep-alive-timeout", 15, KEEPALIVE_TIMEOUT_TEXT,
+                 KEEPALIVE_TIMEOUT_LONGTEXT, true )
+    add_integer_with_range( "http-keep-alive-max", 4, 1, 64,
+                            KEEPALIVE_MAX_TEXT, KEEPALIVE_MAX_LONGTEXT, true )
     /* 'itpc' = iTunes Podcast */
     add_shortcut( "http", "https", "unsv", "itpc", "icyx" )
     set_callbacks( Open, Close )
@@ -129,6 +151,8 @@ vlc_module_end ()
  * Local prototypes
  *****************************************************************************/
 
+typedef struct http_pool_t http_pool_t;
+
 struct access_sys_t
 {
     int fd;
@@ -136,6 +160,7 @@ struct access_sys_t
     vlc_tls_creds_t *p_creds;
     vlc_tls_t *p_tls;
     v_socket_t *p_vs;
+    vlc_tls_creds_t *p_conn_creds; /* owns p_tls if reused from the pool */
 
     /* From uri */
     vlc_url_t url;
@@ -186,6 +211,13 @@ struct access_sys_t
     bool b_persist;
     bool b_has_size;
 
+    /* Connection reuse */
+    bool b_keep_alive;
+    http_pool_t *p_pool;
+    bool b_reusable;    /* the server keeps the connection open */
+    mtime_t i_keep_alive_timeout;
+    int  i_keep_alive_max;
+
     vlc_array_t * cookies;
 };
 
@@ -203,6 +235,10 @@ static int Control( access_t *, int, va_list );
 static int Connect( access_t *, uint64_t );
 static int Request( access_t *p_access, uint64_t i_tell );
 static void Disconnect( access_t * );
+static http_pool_t *PoolHold( access_t * );
+static void PoolRelease( http_pool_t * );
+static bool PoolGet( access_t * );
+static void KeepAlive( access_t * );
 
 /* Small Cookie utilities. Cookies support is partial. */
 static char * cookie_get_content( const char * cookie );
@@ -275,6 +311,7 @@ static int OpenWithCookies( vlc_object_t *p_this, const char *psz_access,
 #endif
     p_sys->p_tls = NULL;
     p_sys->p_vs = NULL;
+    p_sys->p_conn_creds = NULL;
     p_sys->i_icy_meta = 0;
     p_sys->i_icy_offset = 0;
     p_sys->psz_icy_name = NULL;
@@ -283,6 +320,14 @@ static int OpenWithCookies( vlc_object_t *p_this, const char *psz_access,
     p_sys->i_remaining = 0;
     p_sys->b_persist = false;
     p_sys->b_has_size = false;
+    p_sys->b_keep_alive = var_InheritBool( p_access, "http-keep-alive" );
+    p_sys->p_pool = p_sys->b_keep_alive ? PoolHold( p_access ) : NULL;
+    if( p_sys->p_pool == NULL )
+        p_sys->b_keep_alive = false;
+    p_sys->b_reusable = false;
+    p_sys->i_keep_alive_timeout =
+        var_InheritInteger( p_access, "http-keep-alive-timeout" ) * CLOCK_FREQ;
+    p_sys->i_keep_alive_max = var_InheritInteger( p_access, "http-keep-alive-max" );
     p_access->info.i_size = 0;
     p_access->info.i_pos  = 0;
     p_access->info.b_eof  = false;
@@ -307,7 +352,9 @@ static int OpenWithCookies( vlc_object_t *p_this, const char *psz_access,
     if( !strncmp( psz_access, "https", 5 ) )
     {
         /* HTTP over SSL */
-        p_sys->p_creds = vlc_tls_ClientCreate( p_this );
+        /* Sessions may outlive this input in the connection pool */
+        p_sys->p_creds = vlc_tls_ClientCreate( p_sys->p_pool != NULL
+                                 ? (vlc_object_t *)p_sys->p_pool : p_this );
         if( p_sys->p_creds == NULL )
             goto error;
         if( p_sys->url.i_port <= 0 )
@@ -517,14 +564,18 @@ connect:
         Disconnect( p_access );
         vlc_tls_Delete( p_sys->p_creds );
         cookies = p_sys->cookies;
+        http_pool_t *p_pool = p_sys->p_pool;
 #ifdef HAVE_ZLIB_H
         inflateEnd( &p_sys->inflate.stream );
 #endif
         free( p_sys );
 
-        /* Do new Open() run with new data */
-        return OpenWithCookies( p_this, psz_protocol, i_redirect - 1,
-                                cookies );
+        /* Do new Open() run with new data, keeping the pool meanwhile */
+        int i_ret = OpenWithCookies( p_this, psz_protocol, i_redirect - 1,
+                                     cookies );
+        if( p_pool != NULL )
+            PoolRelease( p_pool );
+        return i_ret;
     }
 
     if( p_sys->b_mms )
@@ -609,6 +660,8 @@ error:
 
     Disconnect( p_access );
     vlc_tls_Delete( p_sys->p_creds );
+    if( p_sys->p_pool != NULL )
+        PoolRelease( p_sys->p_pool );
 
     if( p_sys->cookies )
     {
@@ -649,8 +702,10 @@ static void Close( vlc_object_t *p_this )
     free( p_sys->psz_user_agent );
     free( p_sys->psz_referrer );
 
-    Disconnect( p_access );
+    KeepAlive( p_access );
     vlc_tls_Delete( p_sys->p_creds );
+    if( p_sys->p_pool != NULL )
+        PoolRelease( p_sys->p_pool );
 
     if( p_sys->cookies )
     {
@@ -1066,6 +1121,18 @@ static int Connect( access_t *p_access, uint64_t i_tell )
 
     /* Open connection */
     assert( p_sys->fd == -1 ); /* No open sockets (leaking fds is BAD) */
+    if( p_sys->b_keep_alive && PoolGet( p_access ) )
+    {
+        if( Request( p_access, i_tell ) == VLC_SUCCESS )
+            return 0;
+        /* Without any answer, the server most likely closed the idle
+         * connection meanwhile: try again with a new one. */
+        if( p_sys->i_code != 0 || !vlc_object_alive( p_access ) )
+            return -2;
+        msg_Dbg( p_access, "reused connection failed, reconnecting" );
+        Disconnect( p_access );
+    }
+
     p_sys->fd = net_ConnectTCP( p_access, srv.psz_host, srv.i_port );
     if( p_sys->fd == -1 )
     {
@@ -1164,6 +1231,8 @@ static int Request( access_t *p_access, uint64_t i_tell )
     char           *psz ;
     v_socket_t     *pvs = p_sys->p_vs;
     p_sys->b_persist = false;
+    p_sys->b_reusable = false;
+    p_sys->i_code = 0;
 
     p_sys->i_remaining = 0;
 
@@ -1199,7 +1268,8 @@ static int Request( access_t *p_access, uint64_t i_tell )
         p_sys->b_persist = true;
         net_Printf( p_access, p_sys->fd, pvs,
                     "Range: bytes=%"PRIu64"-\r\n", i_tell );
-        net_Printf( p_access, p_sys->fd, pvs, "Connection: close\r\n" );
+        if( !p_sys->b_keep_alive )
+            net_Printf( p_access, p_sys->fd, pvs, "Connection: close\r\n" );
     }
 
     /* Cookies */
@@ -1257,6 +1327,9 @@ static int Request( access_t *p_access, uint64_t i_tell )
     {
         p_sys->psz_protocol = "HTTP";
         p_sys->i_code = atoi( &psz[9] );
+        /* persistent by default since HTTP/1.1 */
+        p_sys->b_reusable = p_sys->b_keep_alive && p_sys->b_persist
+                         && psz[7] == '1';
     }
     else if( !strncmp( psz, "ICY", 3 ) )
     {
@@ -1373,6 +1446,7 @@ static int Request( access_t *p_access, uint64_t i_tell )
             sscanf(p, "close%n",&i);
             if( i >= 0 ) {
                 p_sys->b_persist = false;
+                p_sys->b_reusable = false;
             }
         }
         else if( !strcasecmp( psz, "Location" ) )
@@ -1569,6 +1643,8 @@ static void Disconnect( access_t *p_access )
         p_sys->p_tls = NULL;
         p_sys->p_vs = NULL;
     }
+    vlc_tls_Delete( p_sys->p_conn_creds );
+    p_sys->p_conn_creds = NULL;
     if( p_sys->fd != -1)
     {
         net_Close(p_sys->fd);
@@ -1577,6 +1653,320 @@ static void Disconnect( access_t *p_access )
 
 }
 
+/*****************************************************************************
+ * Connection pool: idle connections kept open for later requests to the
+ * same server, across the inputs of a libvlc instance. The pool lives as
+ * long as some HTTP access of the instance is open, and its thread closes
+ * the connections as they expire.
+ *****************************************************************************/
+typedef struct http_conn_t http_conn_t;
+struct http_conn_t
+{
+    http_conn_t     *p_next;
+    char            *psz_key;
+    int              fd;
+    vlc_tls_t       *p_tls;
+    vlc_tls_creds_t *p_creds; /* owns p_tls */
+    mtime_t          i_expiry;
+};
+
+struct http_pool_t
+{
+    VLC_COMMON_MEMBERS
+
+    unsigned     i_users; /* open accesses, protected by pool_lock */
+
+    vlc_thread_t thread;
+    vlc_mutex_t  lock;
+    vlc_cond_t   wait;
+    http_conn_t *p_conns;
+    bool         b_exit;
+};
+
+/* Protects the "http-pool" variable of the libvlc instances */
+static vlc_mutex_t pool_lock = VLC_STATIC_MUTEX;
+
+/* Connections are shared only with the same server, proxy and security */
+static char *ConnKey( access_t *p_access )
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    const vlc_url_t *srv = p_sys->b_proxy ? &p_sys->proxy : &p_sys->url;
+    char *psz_key;
+
+    if( asprintf( &psz_key, "%s:%d %s:%d %d",
+                  srv->psz_host, srv->i_port,
+                  p_sys->url.psz_host, p_sys->url.i_port,
+                  p_sys->p_creds != NULL ) == -1 )
+        return NULL;
+    return psz_key;
+}
+
+static void ConnDelete( http_conn_t *conn )
+{
+    while( conn != NULL )
+    {
+        http_conn_t *p_next = conn->p_next;
+
+        if( conn->p_tls != NULL )
+            vlc_tls_SessionDelete( conn->p_tls );
+        vlc_tls_Delete( conn->p_creds );
+        net_Close( conn->fd );
+        free( conn->psz_key );
+        free( conn );
+        conn = p_next;
+    }
+}
+
+/* Unlinks the expired connections, must be called with the pool lock held */
+static http_conn_t *PoolExpire( http_pool_t *p_pool, mtime_t now )
+{
+    http_conn_t *expired = NULL, **pp = &p_pool->p_conns;
+
+    while( *pp != NULL )
+    {
+        http_conn_t *conn = *pp;
+
+        if( conn->i_expiry <= now )
+        {
+            *pp = conn->p_next;
+            conn->p_next = expired;
+            expired = conn;
+        }
+        else
+            pp = &conn->p_next;
+    }
+    return expired;
+}
+
+static void *PoolThread( void *data )
+{
+    http_pool_t *p_pool = (http_pool_t *)data;			// sunqueen modify
+
+    vlc_mutex_lock( &p_pool->lock );
+    while( !p_pool->b_exit )
+    {
+        mtime_t i_expiry = 0;
+
+        for( http_conn_t *p = p_pool->p_conns; p != NULL; p = p->p_next )
+            if( i_expiry == 0 || p->i_expiry < i_expiry )
+                i_expiry = p->i_expiry;
+
+        if( i_expiry == 0 )
+            vlc_cond_wait( &p_pool->wait, &p_pool->lock );
+        else
+            vlc_cond_timedwait( &p_pool->wait, &p_pool->lock, i_expiry );
+
+        http_conn_t *expired = PoolExpire( p_pool, mdate() );
+        if( expired != NULL )
+        {
+            vlc_mutex_unlock( &p_pool->lock );
+            ConnDelete( expired );
+            vlc_mutex_lock( &p_pool->lock );
+        }
+    }
+    vlc_mutex_unlock( &p_pool->lock );
+    return NULL;
+}
+
+/*****************************************************************************
+ * PoolHold: gets the pool of the libvlc instance, creating it if needed
+ *****************************************************************************/
+static http_pool_t *PoolHold( access_t *p_access )
+{
+    vlc_object_t *p_libvlc = VLC_OBJECT(p_access->p_libvlc);
+    http_pool_t *p_pool;
+
+    vlc_mutex_lock( &pool_lock );
+    var_Create( p_libvlc, "http-pool", VLC_VAR_ADDRESS );
+    p_pool = (http_pool_t *)var_GetAddress( p_libvlc, "http-pool" );			// sunqueen modify
+    if( p_pool == NULL )
+    {
+        p_pool = (http_pool_t *)vlc_object_create( p_libvlc, sizeof( *p_pool ) );			// sunqueen modify
+        if( likely(p_pool != NULL) )
+        {
+            p_pool->i_users = 0;
+            p_pool->p_conns = NULL;
+            p_pool->b_exit = false;
+            vlc_mutex_init( &p_pool->lock );
+            vlc_cond_init( &p_pool->wait );
+            if( vlc_clone( &p_pool->thread, PoolThread, p_pool,
+                           VLC_THREAD_PRIORITY_LOW ) )
+            {
+                vlc_cond_destroy( &p_pool->wait );
+                vlc_mutex_destroy( &p_pool->lock );
+                vlc_object_release( p_pool );
+                p_pool = NULL;
+            }
+            else
+                var_SetAddress( p_libvlc, "http-pool", p_pool );
+        }
+    }
+    if( p_pool != NULL )
+        p_pool->i_users++;
+    else
+        var_Destroy( p_libvlc, "http-pool" );
+    vlc_mutex_unlock( &pool_lock );
+    return p_pool;
+}
+
+/*****************************************************************************
+ * PoolRelease: closes the idle connections and destroys the pool when the
+ * last access of the instance is closed
+ *****************************************************************************/
+static void PoolRelease( http_pool_t *p_pool )
+{
+    vlc_mutex_lock( &pool_lock );
+    bool b_last = --p_pool->i_users == 0;
+    var_Destroy( p_pool->p_libvlc, "http-pool" );
+    vlc_mutex_unlock( &pool_lock );
+
+    if( !b_last )
+        return;
+
+    vlc_mutex_lock( &p_pool->lock );
+    p_pool->b_exit = true;
+    vlc_cond_signal( &p_pool->wait );
+    vlc_mutex_unlock( &p_pool->lock );
+    vlc_join( p_pool->thread, NULL );
+
+    ConnDelete( p_pool->p_conns );
+    vlc_cond_destroy( &p_pool->wait );
+    vlc_mutex_destroy( &p_pool->lock );
+    vlc_object_release( p_pool );
+}
+
+/*****************************************************************************
+ * PoolGet: takes an idle connection to the server, if there is one
+ *****************************************************************************/
+static bool PoolGet( access_t *p_access )
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    char *psz_key = ConnKey( p_access );
+    http_conn_t *conn;
+
+    if( psz_key == NULL )
+        return false;
+
+    for( ;; )
+    {
+        http_pool_t *p_pool = p_sys->p_pool;
+
+        vlc_mutex_lock( &p_pool->lock );
+        http_conn_t *expired = PoolExpire( p_pool, mdate() );
+        http_conn_t **pp = &p_pool->p_conns;
+        while( (conn = *pp) != NULL && strcmp( conn->psz_key, psz_key ) )
+            pp = &conn->p_next;
+        if( conn != NULL )
+            *pp = conn->p_next;
+        vlc_mutex_unlock( &p_pool->lock );
+        ConnDelete( expired );
+
+        if( conn == NULL )
+            break;
+        conn->p_next = NULL;
+
+        /* Nothing may be received on an idle connection: the server closed
+         * it, or is out of sync */
+        struct pollfd ufd;
+        ufd.fd = conn->fd;
+        ufd.events = __POLLIN;			// sunqueen modify
+        if( poll( &ufd, 1, 0 ) == 0 )
+            break;
+        ConnDelete( conn );
+    }
+    free( psz_key );
+
+    if( conn == NULL )
+        return false;
+
+    msg_Dbg( p_access, "reusing connection" );
+    p_sys->fd = conn->fd;
+    p_sys->p_tls = conn->p_tls;
+    p_sys->p_vs = (conn->p_tls != NULL) ? &conn->p_tls->sock : NULL;
+    p_sys->p_conn_creds = conn->p_creds;
+    free( conn->psz_key );
+    free( conn );
+    return true;
+}
+
+/*****************************************************************************
+ * KeepAlive: puts the connection in the pool if the response was read
+ * whole, disconnects otherwise. TLS credentials may go along, so this is only
+ * for Close().
+ *****************************************************************************/
+static void KeepAlive( access_t *p_access )
+{
+    access_sys_t *p_sys = p_access->p_sys;
+
+    if( p_sys->fd == -1 || !p_sys->b_reusable || p_sys->b_chunked
+     || !p_sys->b_has_size || p_sys->i_remaining > 0
+     || p_sys->i_code / 100 != 2 )
+    {
+        Disconnect( p_access );
+        return;
+    }
+
+    http_conn_t *conn = (http_conn_t *)malloc( sizeof( *conn ) );			// sunqueen modify
+    if( unlikely(conn == NULL) )
+    {
+        Disconnect( p_access );
+        return;
+    }
+    conn->psz_key = ConnKey( p_access );
+    if( unlikely(conn->psz_key == NULL) )
+    {
+        free( conn );
+        Disconnect( p_access );
+        return;
+    }
+
+    mtime_t now = mdate();
+    conn->i_expiry = now + p_sys->i_keep_alive_timeout;
+
+    http_pool_t *p_pool = p_sys->p_pool;
+
+    vlc_mutex_lock( &p_pool->lock );
+    http_conn_t *expired = PoolExpire( p_pool, now );
+    int i_idle = 0;
+    for( http_conn_t *p = p_pool->p_conns; p != NULL; p = p->p_next )
+        if( !strcmp( p->psz_key, conn->psz_key ) )
+            i_idle++;
+    if( i_idle < p_sys->i_keep_alive_max )
+    {
+        conn->fd = p_sys->fd;
+        conn->p_tls = p_sys->p_tls;
+        conn->p_creds = NULL;
+        if( p_sys->p_tls != NULL )
+        {   /* the credentials go along with the session */
+            if( p_sys->p_conn_creds != NULL )
+                conn->p_creds = p_sys->p_conn_creds;
+            else
+            {
+                conn->p_creds = p_sys->p_creds;
+                p_sys->p_creds = NULL;
+            }
+        }
+        conn->p_next = p_pool->p_conns;
+        p_pool->p_conns = conn;
+        vlc_cond_signal( &p_pool->wait ); /* new expiry for the pool thread */
+
+        p_sys->fd = -1;
+        p_sys->p_tls = NULL;
+        p_sys->p_vs = NULL;
+        p_sys->p_conn_creds = NULL;
+        conn = NULL;
+    }
+    vlc_mutex_unlock( &p_pool->lock );
+    ConnDelete( expired );
+
+    if( conn != NULL )
+    {   /* enough idle connections to this server already */
+        free( conn->psz_key );
+        free( conn );
+        Disconnect( p_access );
+    }
+}
+
 /*****************************************************************************
  * Cookies (FIXME: we may want to rewrite that using a nice structure to hold
  * them) (FIXME: only support the "domain=" param)
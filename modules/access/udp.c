@@ -42,9 +42,19 @@
 #include <vlc_plugin.h>
 #include <vlc_access.h>
 #include <vlc_network.h>
+#include <vlc_block.h>
+
+#if defined( __linux__ ) && defined( MSG_WAITFORONE )
+/* recvmmsg() is declared along MSG_WAITFORONE */
+# define UDP_MMSG 1
+#endif
 
 #define MTU 65535
 
+/* datagrams fetched at once, and smallest size of their buffers */
+#define UDP_BATCH     64
+#define UDP_SLOT_SIZE 2048
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -71,6 +81,18 @@ vlc_module_end ()
 static block_t *BlockUDP( access_t * );
 static int Control( access_t *, int, va_list );
 
+struct access_sys_t
+{
+    int fd;
+#ifdef UDP_MMSG
+    /* blocks ready for the next recvmmsg() */
+    size_t         i_slot_size;
+    block_t        *pp_slot[UDP_BATCH];
+    struct mmsghdr msgs[UDP_BATCH];
+    struct iovec   iov[UDP_BATCH];
+#endif
+};
+
 /*****************************************************************************
  * Open: open the socket
  *****************************************************************************/
@@ -138,7 +160,20 @@ static int Open( vlc_object_t *p_this )
         msg_Err( p_access, "cannot open socket" );
         return VLC_EGENERIC;
     }
-    p_access->p_sys = (access_sys_t *)(intptr_t)fd;			// sunqueen modify
+
+    access_sys_t *p_sys = (access_sys_t *)calloc( 1, sizeof( *p_sys ) );			// sunqueen modify
+    if( unlikely(p_sys == NULL) )
+    {
+        net_Close( fd );
+        return VLC_ENOMEM;
+    }
+    p_sys->fd = fd;
+#ifdef UDP_MMSG
+    /* Datagrams up to the configured MTU fit from the start */
+    p_sys->i_slot_size = VLC_CLIP( var_InheritInteger( p_access, "mtu" ),
+                                   UDP_SLOT_SIZE, MTU );
+#endif
+    p_access->p_sys = p_sys;
 
     return VLC_SUCCESS;
 }
@@ -149,8 +184,15 @@ static int Open( vlc_object_t *p_this )
 static void Close( vlc_object_t *p_this )
 {
     access_t     *p_access = (access_t*)p_this;
+    access_sys_t *p_sys = p_access->p_sys;
 
-    net_Close( (intptr_t)p_access->p_sys );
+#ifdef UDP_MMSG
+    for( unsigned i = 0; i < UDP_BATCH; i++ )
+        if( p_sys->pp_slot[i] != NULL )
+            block_Release( p_sys->pp_slot[i] );
+#endif
+    net_Close( p_sys->fd );
+    free( p_sys );
 }
 
 /*****************************************************************************
@@ -195,12 +237,85 @@ static int Control( access_t *p_access, int i_query, va_list args )
     return VLC_SUCCESS;
 }
 
+#ifdef UDP_MMSG
+/*****************************************************************************
+ * BlockMMSG: fetch all the queued datagrams with a single system call
+ *****************************************************************************/
+static block_t *BlockMMSG( access_t *p_access )
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    unsigned i_slots;
+
+    for( i_slots = 0; i_slots < UDP_BATCH; i_slots++ )
+    {
+        block_t *p_slot = p_sys->pp_slot[i_slots];
+
+        if( p_slot != NULL && p_slot->i_buffer < p_sys->i_slot_size )
+        {
+            /* allocated before the slots grew */
+            block_Release( p_slot );
+            p_slot = NULL;
+        }
+        if( p_slot == NULL )
+        {
+            p_slot = block_Alloc( p_sys->i_slot_size );
+            if( unlikely(p_slot == NULL) )
+                break;
+            p_sys->pp_slot[i_slots] = p_slot;
+        }
+
+        struct msghdr *p_hdr = &p_sys->msgs[i_slots].msg_hdr;
+        memset( p_hdr, 0, sizeof( *p_hdr ) );
+        p_sys->iov[i_slots].iov_base = p_slot->p_buffer;
+        p_sys->iov[i_slots].iov_len  = p_slot->i_buffer;
+        p_hdr->msg_iov    = &p_sys->iov[i_slots];
+        p_hdr->msg_iovlen = 1;
+    }
+    if( i_slots == 0 )
+        return NULL;
+
+    int i_count = recvmmsg( p_sys->fd, p_sys->msgs, i_slots, MSG_DONTWAIT,
+                            NULL );
+    if( i_count <= 0 )
+        return NULL; /* nothing queued, let BlockUDP() wait */
+
+    block_t *p_chain = NULL, **pp_last = &p_chain;
+    for( int i = 0; i < i_count; i++ )
+    {
+        block_t *p_block = p_sys->pp_slot[i];
+        p_sys->pp_slot[i] = NULL;
+
+        /* Slots only grow after a truncated datagram, which is lost */
+        if( p_sys->msgs[i].msg_hdr.msg_flags & MSG_TRUNC )
+        {
+            msg_Warn( p_access, "datagram larger than %zu bytes dropped",
+                      p_sys->i_slot_size );
+            p_sys->i_slot_size = MTU;
+            block_Release( p_block );
+            continue;
+        }
+        p_block->i_buffer = p_sys->msgs[i].msg_len;
+        *pp_last = p_block;
+        pp_last = &p_block->p_next;
+    }
+    return p_chain;
+}
+#endif
+
 /*****************************************************************************
  * BlockUDP:
  *****************************************************************************/
 static block_t *BlockUDP( access_t *p_access )
 {
-    int fd = (intptr_t)p_access->p_sys;
+    access_sys_t *p_sys = p_access->p_sys;
+    int fd = p_sys->fd;
+
+#ifdef UDP_MMSG
+    /* Under load, return a chain of all the pending datagrams */
+    block_t *p_chain = BlockMMSG( p_access );
+    if( p_chain != NULL )
+        return p_chain;
+#endif
 
     /* Read data */
     block_t *p_block = block_Alloc( MTU );
@@ -214,6 +329,10 @@ static block_t *BlockUDP( access_t *p_access )
         block_Release( p_block );
         return NULL;
     }
+#ifdef UDP_MMSG
+    if( (size_t)len > p_sys->i_slot_size )
+        p_sys->i_slot_size = len;
+#endif
 
     return block_Realloc( p_block, 0, len );
 }
@@ -907,7 +907,8 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
 
     while( p_buffer )
     {
-        if ( ( p_sys->b_splitanywhere || ( p_buffer->i_flags & BLOCK_FLAG_HEADER ) ) )
+        if ( ( p_sys->b_splitanywhere ||
+               ( p_buffer->i_flags & ( BLOCK_FLAG_HEADER | BLOCK_FLAG_SEGMENT_START ) ) ) )
         {
             bool crypted = false;
             block_t *output = p_sys->block_buffer;
@@ -53,7 +53,18 @@
 
 #include <vlc_network.h>
 
+#if defined( __linux__ ) && defined( MSG_WAITFORONE )
+/* sendmmsg() is declared along MSG_WAITFORONE */
+# define UDP_MMSG 1
+# if defined( SO_TXTIME ) && defined( SCM_TXTIME )
+#  include <linux/net_tstamp.h>
+#  define UDP_TXTIME 1
+# endif
+#endif
+
 #define MAX_EMPTY_BLOCKS 200
+/* packets due at the same time are sent together, up to that many */
+#define UDP_BATCH 64
 
 /*****************************************************************************
  * Module descriptor
@@ -75,6 +86,13 @@ static void Close( vlc_object_t * );
                           "helps reducing the scheduling load on " \
                           "heavily-loaded systems." )
 
+#define TXTIME_TEXT N_("Kernel pacing lead (ms)")
+#define TXTIME_LONGTEXT N_( \
+    "Hand the departure time of each packet to the kernel (SO_TXTIME) " \
+    "and send packets in bursts that much ahead of time, instead of " \
+    "waking up for every packet. This needs the fq queuing discipline on " \
+    "the outgoing interface. 0 disables it." )
+
 vlc_module_begin ()
     set_description( N_("UDP stream output") )
     set_shortname( "UDP" )
@@ -83,6 +101,9 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "caching", DEFAULT_PTS_DELAY / 1000, CACHING_TEXT, CACHING_LONGTEXT, true )
     add_integer( SOUT_CFG_PREFIX "group", 1, GROUP_TEXT, GROUP_LONGTEXT,
                                  true )
+    add_integer( SOUT_CFG_PREFIX "txtime", 0, TXTIME_TEXT, TXTIME_LONGTEXT,
+                 true )
+        change_integer_range( 0, 1000 )
 
     set_capability( "sout access", 0 )
     add_shortcut( "udp" )
@@ -96,6 +117,7 @@ vlc_module_end ()
 static const char *const ppsz_sout_options[] = {
     "caching",
     "group",
+    "txtime",
     NULL
 };
 
@@ -117,6 +139,7 @@ static block_t *NewUDPPacket( sout_access_out_t *, mtime_t );
 struct sout_access_out_sys_t
 {
     mtime_t       i_caching;
+    mtime_t       i_txtime_lead; /* 0 unless the kernel paces packets */
     int           i_handle;
     bool          b_mtu_warning;
     size_t        i_mtu;
@@ -126,6 +149,21 @@ struct sout_access_out_sys_t
     block_t      *p_buffer;
 
     vlc_thread_t  thread;
+
+    /* packets being sent by ThreadWrite() */
+    unsigned      i_batch;
+    block_t      *pp_batch[UDP_BATCH];
+#ifdef UDP_MMSG
+    struct mmsghdr msgs[UDP_BATCH];
+    struct iovec   iov[UDP_BATCH];
+#endif
+#ifdef UDP_TXTIME
+    union
+    {
+        char           buf[CMSG_SPACE(sizeof (uint64_t))];
+        struct cmsghdr align;
+    } control[UDP_BATCH];
+#endif
 };
 
 #define DEFAULT_PORT 1234
@@ -214,9 +252,31 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_handle = i_handle;
     p_sys->i_mtu = var_CreateGetInteger( p_this, "mtu" );
     p_sys->b_mtu_warning = false;
-    p_sys->p_fifo = block_FifoNew();
-    p_sys->p_empty_blocks = block_FifoNew();
+    /* Write() and ThreadWrite() are the only users of both queues */
+    p_sys->p_fifo = block_FifoNewSPSC();
+    p_sys->p_empty_blocks = block_FifoNewSPSC();
     p_sys->p_buffer = NULL;
+    p_sys->i_batch = 0;
+
+    p_sys->i_txtime_lead = UINT64_C(1000)
+                     * var_GetInteger( p_access, SOUT_CFG_PREFIX "txtime" );
+    if( p_sys->i_txtime_lead > 0 )
+    {
+#ifdef UDP_TXTIME
+        /* mdate() runs on the monotonic clock, as fq expects */
+        struct sock_txtime txtime = { CLOCK_MONOTONIC, 0 };
+
+        if( setsockopt( i_handle, SOL_SOCKET, SO_TXTIME, &txtime,
+                        sizeof( txtime ) ) )
+        {
+            msg_Warn( p_access, "kernel pacing not available (%m)" );
+            p_sys->i_txtime_lead = 0;
+        }
+#else
+        msg_Warn( p_access, "kernel pacing not supported" );
+        p_sys->i_txtime_lead = 0;
+#endif
+    }
 
     if( vlc_clone( &p_sys->thread, ThreadWrite, p_access,
                            VLC_THREAD_PRIORITY_HIGHEST ) )
@@ -396,6 +456,78 @@ static block_t *NewUDPPacket( sout_access_out_t *p_access, mtime_t i_dts)
     return p_buffer;
 }
 
+/*****************************************************************************
+ * SendBatch: send the gathered packets and recycle them
+ *****************************************************************************/
+static void SendBatch( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+#ifdef UDP_MMSG
+    for( unsigned i = 0; i < p_sys->i_batch; i++ )
+    {
+        struct msghdr *p_hdr = &p_sys->msgs[i].msg_hdr;
+
+        memset( p_hdr, 0, sizeof( *p_hdr ) );
+        p_sys->iov[i].iov_base = p_sys->pp_batch[i]->p_buffer;
+        p_sys->iov[i].iov_len  = p_sys->pp_batch[i]->i_buffer;
+        p_hdr->msg_iov    = &p_sys->iov[i];
+        p_hdr->msg_iovlen = 1;
+#ifdef UDP_TXTIME
+        if( p_sys->i_txtime_lead > 0 )
+        {
+            /* departure time, in nanoseconds */
+            uint64_t i_txtime = UINT64_C(1000)
+                * ( p_sys->pp_batch[i]->i_dts + p_sys->i_caching );
+            struct cmsghdr *p_cmsg;
+
+            p_hdr->msg_control    = p_sys->control[i].buf;
+            p_hdr->msg_controllen = sizeof( p_sys->control[i].buf );
+            p_cmsg = CMSG_FIRSTHDR( p_hdr );
+            p_cmsg->cmsg_level = SOL_SOCKET;
+            p_cmsg->cmsg_type  = SCM_TXTIME;
+            p_cmsg->cmsg_len   = CMSG_LEN( sizeof( i_txtime ) );
+            memcpy( CMSG_DATA( p_cmsg ), &i_txtime, sizeof( i_txtime ) );
+        }
+#endif
+    }
+
+    for( unsigned i = 0; i < p_sys->i_batch; )
+    {
+        int i_ret = sendmmsg( p_sys->i_handle, &p_sys->msgs[i],
+                              p_sys->i_batch - i, 0 );
+        if( i_ret == -1 )
+        {
+            /* the error is about the first packet, skip it */
+            msg_Warn( p_access, "send error: %m" );
+            i_ret = 1;
+        }
+        i += i_ret;
+    }
+#else
+    for( unsigned i = 0; i < p_sys->i_batch; i++ )
+    {
+        block_t *p_pk = p_sys->pp_batch[i];
+
+        if ( send( p_sys->i_handle, (const char *)p_pk->p_buffer, p_pk->i_buffer, 0 ) == -1 )			// sunqueen modify
+            msg_Warn( p_access, "send error: %m" );
+    }
+#endif
+
+    for( unsigned i = 0; i < p_sys->i_batch; i++ )
+        block_FifoPut( p_sys->p_empty_blocks, p_sys->pp_batch[i] );
+    p_sys->i_batch = 0;
+}
+
+static void BatchCleanup( void *data )
+{
+    sout_access_out_sys_t *p_sys = (sout_access_out_sys_t *)data;			// sunqueen modify
+
+    for( unsigned i = 0; i < p_sys->i_batch; i++ )
+        block_Release( p_sys->pp_batch[i] );
+    p_sys->i_batch = 0;
+}
+
 /*****************************************************************************
  * ThreadWrite: Write a packet on the network at the good time.
  *****************************************************************************/
@@ -437,15 +569,50 @@ static void* ThreadWrite( void *data )
             }
         }
 
-        block_cleanup_push( p_pk );
+        p_sys->pp_batch[0] = p_pk;
+        p_sys->i_batch = 1;
+        vlc_cleanup_push( BatchCleanup, p_sys );
         i_to_send--;
-        if( !i_to_send || (p_pk->i_flags & BLOCK_FLAG_CLOCK) )
+        if( p_sys->i_txtime_lead > 0 )
+        {
+            /* The kernel holds each packet until its date */
+            mwait( i_date - p_sys->i_txtime_lead );
+        }
+        else if( !i_to_send || (p_pk->i_flags & BLOCK_FLAG_CLOCK) )
         {
             mwait( i_date );
             i_to_send = i_group;
         }
-        if ( send( p_sys->i_handle, (const char *)p_pk->p_buffer, p_pk->i_buffer, 0 ) == -1 )			// sunqueen modify
-            msg_Warn( p_access, "send error: %m" );
+        i_date_last = i_date;
+
+        /* Take along the next packets that would not wait anyway */
+        mtime_t now = mdate();
+        while( p_sys->i_batch < UDP_BATCH
+            && block_FifoCount( p_sys->p_fifo ) > 0 )
+        {
+            block_t *p_next = block_FifoShow( p_sys->p_fifo );
+            mtime_t i_next = p_sys->i_caching + p_next->i_dts;
+            bool b_wait = i_to_send == 1
+                       || (p_next->i_flags & BLOCK_FLAG_CLOCK);
+
+            /* holes and packets in the past go through the checks above */
+            if( i_next - i_date_last > 2000000 || i_next - i_date_last < -1000 )
+                break;
+            if( p_sys->i_txtime_lead > 0 )
+            {
+                if( i_next - p_sys->i_txtime_lead > now )
+                    break;
+                b_wait = false;
+            }
+            else if( b_wait && i_next > now )
+                break;
+
+            p_sys->pp_batch[p_sys->i_batch++] = block_FifoGet( p_sys->p_fifo );
+            i_to_send = b_wait ? i_group : i_to_send - 1;
+            i_date_last = i_next;
+        }
+
+        SendBatch( p_access );
         vlc_cleanup_pop();
 
         if( i_dropped_packets )
@@ -462,10 +629,6 @@ static void* ThreadWrite( void *data )
                      i_sent - i_date );
         }
 #endif
-
-        block_FifoPut( p_sys->p_empty_blocks, p_pk );
-
-        i_date_last = i_date;
     }
     return NULL;
 }
@@ -0,0 +1,474 @@
+/*****************************************************************************
+ * cluster_scanner.cpp : matroska demuxer
+ *****************************************************************************
+ * Copyright (C) 2003-2004 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "cluster_scanner.hpp"
+
+#include <vlc_fs.h>
+
+/* EBML IDs, with their length marker */
+#define MKV_ID_EBML             0x1A45DFA3
+#define MKV_ID_SEGMENT          0x18538067
+#define MKV_ID_SEEKHEAD         0x114D9B74
+#define MKV_ID_INFO             0x1549A966
+#define MKV_ID_TRACKS           0x1654AE6B
+#define MKV_ID_CUES             0x1C53BB6B
+#define MKV_ID_ATTACHMENTS      0x1941A469
+#define MKV_ID_CHAPTERS         0x1043A770
+#define MKV_ID_TAGS             0x1254C367
+#define MKV_ID_CLUSTER          0x1F43B675
+#define MKV_ID_TIMECODE         0xE7
+#define MKV_ID_SIMPLEBLOCK      0xA3
+#define MKV_ID_BLOCKGROUP       0xA0
+#define MKV_ID_BLOCK            0xA1
+#define MKV_ID_REFERENCEBLOCK   0xFB
+
+#define MKV_UNKNOWN_SIZE        UINT64_MAX
+
+/* cache file: magic, source size, timescale, count, then for each cluster
+ * its position, time and key flag, all big endian */
+#define CACHE_MAGIC             "VLCMKVIX"
+#define CACHE_HEADER_SIZE       28
+#define CACHE_ENTRY_SIZE        17
+
+static bool IsLevel1( uint32_t i_id )
+{
+    return i_id == MKV_ID_CLUSTER || i_id == MKV_ID_CUES ||
+           i_id == MKV_ID_SEEKHEAD || i_id == MKV_ID_INFO ||
+           i_id == MKV_ID_TRACKS || i_id == MKV_ID_ATTACHMENTS ||
+           i_id == MKV_ID_CHAPTERS || i_id == MKV_ID_TAGS ||
+           i_id == MKV_ID_SEGMENT || i_id == MKV_ID_EBML;
+}
+
+/* track number of a Block or SimpleBlock, which starts its content */
+static bool BlockTrack( const uint8_t *p_peek, int i_peek, unsigned *pi_track )
+{
+    int i_len;
+
+    if( i_peek < 1 )
+        return false;
+    for( i_len = 1; i_len <= 4 && !( p_peek[0] & ( 0x100 >> i_len ) ); i_len++ );
+    if( i_len > 4 || i_len > i_peek )
+        return false;
+
+    *pi_track = p_peek[0] & ( 0xff >> i_len );
+    for( int i = 1; i < i_len; i++ )
+        *pi_track = ( *pi_track << 8 ) | p_peek[i];
+    return true;
+}
+
+cluster_scanner_c::cluster_scanner_c( demux_t *p_demux_, int64_t i_start_, int64_t i_end_,
+                                      uint64_t i_timescale_, unsigned i_key_track_,
+                                      const EbmlBinary *p_uid, bool b_cache )
+    :p_demux(p_demux_)
+    ,s(NULL)
+    ,psz_url(NULL)
+    ,psz_cache(NULL)
+    ,i_start(i_start_)
+    ,i_end(i_end_)
+    ,i_file_size(stream_Size( p_demux_->s ))
+    ,i_timescale(i_timescale_)
+    ,i_key_track(i_key_track_)
+    ,is_running(false)
+    ,b_abort(false)
+    ,b_done(false)
+{
+    vlc_mutex_init( &lock );
+
+    if( asprintf( &psz_url, "%s://%s", p_demux->psz_access,
+                  p_demux->psz_location ) == -1 )
+        psz_url = NULL;
+
+    if( b_cache && p_uid != NULL && p_uid->GetSize() > 0 && i_file_size > 0 )
+    {
+        char *psz_dir = config_GetUserDir( VLC_CACHE_DIR );
+        std::string uid;
+
+        for( size_t i = 0; i < p_uid->GetSize(); i++ )
+        {
+            static const char hex[] = "0123456789abcdef";
+            uid += hex[p_uid->GetBuffer()[i] >> 4];
+            uid += hex[p_uid->GetBuffer()[i] & 0xf];
+        }
+        if( psz_dir == NULL ||
+            asprintf( &psz_cache, "%s" DIR_SEP "mkv-%s.idx", psz_dir,
+                      uid.c_str() ) == -1 )
+            psz_cache = NULL;
+        free( psz_dir );
+    }
+}
+
+cluster_scanner_c::~cluster_scanner_c()
+{
+    if( is_running )
+    {
+        vlc_mutex_lock( &lock );
+        b_abort = true;
+        vlc_mutex_unlock( &lock );
+
+        vlc_join( thread, NULL );
+    }
+    free( psz_cache );
+    free( psz_url );
+    vlc_mutex_destroy( &lock );
+}
+
+bool cluster_scanner_c::Start()
+{
+    if( psz_url != NULL && !is_running )
+        is_running = !vlc_clone( &thread, ScanThread, this, VLC_THREAD_PRIORITY_LOW );
+    return is_running;
+}
+
+bool cluster_scanner_c::Fetch( mkv_index_t * & p_indexes, int & i_index, int & i_index_max )
+{
+    vlc_mutex_locker l( &lock );
+
+    if( index.size() > (size_t)i_index )
+    {
+        /* keep room for one more, as IndexAppendCluster expects */
+        if( index.size() >= (size_t)i_index_max )
+        {
+            i_index_max = index.size() + 1024;
+            p_indexes = (mkv_index_t*)xrealloc( p_indexes,
+                                                sizeof( mkv_index_t ) * i_index_max );
+        }
+        memcpy( p_indexes, &index[0], sizeof( mkv_index_t ) * index.size() );
+        i_index = index.size();
+    }
+    return b_done;
+}
+
+bool cluster_scanner_c::ReadHeader( int64_t i_pos, uint32_t *pi_id, uint64_t *pi_size, int *pi_header )
+{
+    const uint8_t *p_peek;
+    int           i_peek, i_id_len, i_size_len;
+    bool          b_unknown;
+
+    if( stream_Tell( s ) != i_pos && stream_Seek( s, i_pos ) )
+        return false;
+    i_peek = stream_Peek( s, &p_peek, 12 );
+    if( i_peek < 2 )
+        return false;
+
+    /* IDs keep their length marker */
+    for( i_id_len = 1; i_id_len <= 4 && !( p_peek[0] & ( 0x100 >> i_id_len ) ); i_id_len++ );
+    if( i_id_len > 4 || i_id_len >= i_peek )
+        return false;
+    *pi_id = 0;
+    for( int i = 0; i < i_id_len; i++ )
+        *pi_id = ( *pi_id << 8 ) | p_peek[i];
+
+    /* sizes do not */
+    p_peek += i_id_len;
+    i_peek -= i_id_len;
+    for( i_size_len = 1; i_size_len <= 8 && !( p_peek[0] & ( 0x100 >> i_size_len ) ); i_size_len++ );
+    if( i_size_len > 8 || i_size_len > i_peek )
+        return false;
+    *pi_size = p_peek[0] & ( 0xff >> i_size_len );
+    b_unknown = *pi_size == (uint64_t)( 0xff >> i_size_len );
+    for( int i = 1; i < i_size_len; i++ )
+    {
+        *pi_size = ( *pi_size << 8 ) | p_peek[i];
+        b_unknown &= p_peek[i] == 0xff;
+    }
+    if( b_unknown )
+        *pi_size = MKV_UNKNOWN_SIZE;
+
+    *pi_header = i_id_len + i_size_len;
+    return true;
+}
+
+/* Reads the timecode of the cluster, and looks for a key frame of the key
+ * track. Returns the end of the cluster, or -1 on error. */
+int64_t cluster_scanner_c::ScanCluster( int64_t i_pos, int64_t i_cluster_end, mkv_index_t *p_idx )
+{
+    const uint8_t *p_peek;
+    uint32_t      i_id;
+    uint64_t      i_size;
+    int           i_header, i_peek;
+    unsigned      i_track;
+    bool          b_timecode = false;
+
+    p_idx->i_time = -1;
+    p_idx->b_key  = false;
+
+    while( i_cluster_end < 0 || i_pos < i_cluster_end )
+    {
+        if( !ReadHeader( i_pos, &i_id, &i_size, &i_header ) )
+        {
+            /* a cluster of unknown size can end the file */
+            if( i_cluster_end < 0 && i_pos >= i_file_size )
+                break;
+            return -1;
+        }
+        /* a cluster of unknown size ends with the next top level element */
+        if( i_cluster_end < 0 && IsLevel1( i_id ) )
+            break;
+        if( i_size == MKV_UNKNOWN_SIZE )
+            return -1;
+
+        if( i_id == MKV_ID_TIMECODE && i_size <= 8 )
+        {
+            if( stream_Peek( s, &p_peek, i_header + i_size ) < i_header + (int)i_size )
+                return -1;
+            p_idx->i_time = 0;
+            for( uint64_t i = 0; i < i_size; i++ )
+                p_idx->i_time = ( p_idx->i_time << 8 ) | p_peek[i_header + i];
+            p_idx->i_time = p_idx->i_time * i_timescale / (mtime_t)1000;
+            b_timecode = true;
+        }
+        else if( i_id == MKV_ID_SIMPLEBLOCK && !p_idx->b_key )
+        {
+            /* track number, timecode, then flags */
+            i_peek = stream_Peek( s, &p_peek, i_header + 8 ) - i_header;
+            if( i_peek > 0 && BlockTrack( &p_peek[i_header], i_peek, &i_track ) &&
+                ( i_key_track == 0 || i_track == i_key_track ) )
+            {
+                int i_len = 1;
+                while( !( p_peek[i_header] & ( 0x100 >> i_len ) ) )
+                    i_len++;
+                if( i_len + 2 < i_peek && ( p_peek[i_header + i_len + 2] & 0x80 ) )
+                    p_idx->b_key = true;
+            }
+        }
+        else if( i_id == MKV_ID_BLOCKGROUP && !p_idx->b_key )
+        {
+            /* key frames are the blocks without references */
+            int64_t  i_group = i_pos + i_header;
+            int64_t  i_group_end = i_group + i_size;
+            uint32_t i_child;
+            uint64_t i_child_size;
+            int      i_child_header;
+            bool     b_block = false, b_reference = false;
+
+            while( i_group < i_group_end )
+            {
+                if( !ReadHeader( i_group, &i_child, &i_child_size, &i_child_header ) ||
+                    i_child_size == MKV_UNKNOWN_SIZE )
+                    return -1;
+                if( i_child == MKV_ID_BLOCK )
+                {
+                    i_peek = stream_Peek( s, &p_peek, i_child_header + 4 ) - i_child_header;
+                    b_block = i_peek > 0 &&
+                              BlockTrack( &p_peek[i_child_header], i_peek, &i_track ) &&
+                              ( i_key_track == 0 || i_track == i_key_track );
+                }
+                else if( i_child == MKV_ID_REFERENCEBLOCK )
+                    b_reference = true;
+                i_group += i_child_header + i_child_size;
+            }
+            p_idx->b_key = b_block && !b_reference;
+        }
+
+        i_pos += i_header + i_size;
+
+        /* the rest of the cluster is not needed */
+        if( b_timecode && p_idx->b_key && i_cluster_end >= 0 )
+            break;
+    }
+    return i_cluster_end >= 0 ? i_cluster_end : i_pos;
+}
+
+void *cluster_scanner_c::ScanThread( void *data )
+{
+    cluster_scanner_c *p_this = (cluster_scanner_c *) data;
+    p_this->ScanThread();
+    return NULL;
+}
+
+void cluster_scanner_c::ScanThread()
+{
+    int64_t     i_pos = i_start;
+    bool        b_complete = false;
+    mkv_index_t idx;
+
+    if( CacheLoad() )
+    {
+        vlc_mutex_locker l( &lock );
+        b_done = true;
+        return;
+    }
+
+    /* the demuxer stream is not ours to move */
+    s = stream_UrlNew( p_demux, psz_url );
+    if( s == NULL )
+    {
+        msg_Warn( p_demux, "cannot open %s to index clusters", psz_url );
+        return;
+    }
+
+    idx.i_track        = -1;
+    idx.i_block_number = -1;
+
+    for( ;; )
+    {
+        uint32_t i_id;
+        uint64_t i_size;
+        int      i_header;
+
+        vlc_mutex_lock( &lock );
+        bool b_stop = b_abort;
+        vlc_mutex_unlock( &lock );
+        if( b_stop )
+            break;
+
+        if( i_end >= 0 && i_pos >= i_end )
+        {
+            b_complete = true;
+            break;
+        }
+        if( !ReadHeader( i_pos, &i_id, &i_size, &i_header ) )
+        {
+            b_complete = i_pos >= stream_Size( s );
+            break;
+        }
+
+        if( i_id == MKV_ID_CLUSTER )
+        {
+            idx.i_position = i_pos;
+            i_pos = ScanCluster( i_pos + i_header, i_size == MKV_UNKNOWN_SIZE ? -1 :
+                                 i_pos + i_header + (int64_t)i_size, &idx );
+            if( i_pos < 0 )
+                break;
+            if( idx.i_time >= 0 )
+            {
+                vlc_mutex_locker l( &lock );
+                index.push_back( idx );
+            }
+        }
+        else if( i_id == MKV_ID_EBML || i_id == MKV_ID_SEGMENT )
+        {
+            /* the next segment */
+            b_complete = true;
+            break;
+        }
+        else if( i_size == MKV_UNKNOWN_SIZE )
+            break;
+        else
+            i_pos += i_header + i_size;
+    }
+
+    stream_Delete( s );
+    s = NULL;
+
+    msg_Dbg( p_demux, "indexed %zu clusters%s", index.size(),
+             b_complete ? "" : " (incomplete)" );
+    if( !b_complete )
+        return;
+
+    if( psz_cache != NULL )
+        CacheSave();
+
+    vlc_mutex_locker l( &lock );
+    b_done = true;
+}
+
+bool cluster_scanner_c::CacheLoad()
+{
+    std::vector<mkv_index_t> loaded;
+    uint8_t     header[CACHE_HEADER_SIZE], entry[CACHE_ENTRY_SIZE];
+    mkv_index_t idx;
+    FILE        *file;
+    bool        b_ok;
+
+    if( psz_cache == NULL || ( file = vlc_fopen( psz_cache, "rb" ) ) == NULL )
+        return false;
+
+    /* an index of another version of the file is of no use */
+    b_ok = fread( header, 1, CACHE_HEADER_SIZE, file ) == CACHE_HEADER_SIZE &&
+           !memcmp( header, CACHE_MAGIC, 8 ) &&
+           GetQWBE( &header[8] ) == (uint64_t)i_file_size &&
+           GetQWBE( &header[16] ) == i_timescale;
+
+    idx.i_track        = -1;
+    idx.i_block_number = -1;
+    for( uint32_t i = 0; b_ok && i < GetDWBE( &header[24] ); i++ )
+    {
+        if( fread( entry, 1, CACHE_ENTRY_SIZE, file ) != CACHE_ENTRY_SIZE )
+        {
+            b_ok = false;
+            break;
+        }
+        idx.i_position = GetQWBE( &entry[0] );
+        idx.i_time     = GetQWBE( &entry[8] );
+        idx.b_key      = entry[16] != 0;
+        b_ok = idx.i_position >= i_start && idx.i_position < i_file_size;
+        loaded.push_back( idx );
+    }
+    fclose( file );
+
+    if( !b_ok )
+    {
+        msg_Dbg( p_demux, "ignoring cluster index %s", psz_cache );
+        return false;
+    }
+
+    msg_Dbg( p_demux, "loaded %zu clusters from %s", loaded.size(), psz_cache );
+    vlc_mutex_locker l( &lock );
+    index.swap( loaded );
+    return true;
+}
+
+void cluster_scanner_c::CacheSave()
+{
+    uint8_t header[CACHE_HEADER_SIZE], entry[CACHE_ENTRY_SIZE];
+    char    *psz_dir, *psz_tmp;
+    FILE    *file;
+    bool    b_ok;
+
+    psz_dir = config_GetUserDir( VLC_CACHE_DIR );
+    if( psz_dir != NULL )
+        vlc_mkdir( psz_dir, 0700 );
+    free( psz_dir );
+
+    /* written aside first, so that a reader never sees half of it */
+    if( asprintf( &psz_tmp, "%s.part", psz_cache ) == -1 )
+        return;
+    file = vlc_fopen( psz_tmp, "wb" );
+    if( file == NULL )
+    {
+        msg_Warn( p_demux, "cannot create %s", psz_tmp );
+        free( psz_tmp );
+        return;
+    }
+
+    memcpy( header, CACHE_MAGIC, 8 );
+    SetQWBE( &header[8], i_file_size );
+    SetQWBE( &header[16], i_timescale );
+    SetDWBE( &header[24], index.size() );
+    b_ok = fwrite( header, 1, CACHE_HEADER_SIZE, file ) == CACHE_HEADER_SIZE;
+
+    for( size_t i = 0; b_ok && i < index.size(); i++ )
+    {
+        SetQWBE( &entry[0], index[i].i_position );
+        SetQWBE( &entry[8], index[i].i_time );
+        entry[16] = index[i].b_key;
+        b_ok = fwrite( entry, 1, CACHE_ENTRY_SIZE, file ) == CACHE_ENTRY_SIZE;
+    }
+
+    if( fclose( file ) == 0 && b_ok && vlc_rename( psz_tmp, psz_cache ) == 0 )
+        msg_Dbg( p_demux, "saved cluster index to %s", psz_cache );
+    else
+    {
+        msg_Warn( p_demux, "cannot write %s", psz_cache );
+        vlc_unlink( psz_tmp );
+    }
+    free( psz_tmp );
+}
@@ -0,0 +1,78 @@
+/*****************************************************************************
+ * cluster_scanner.hpp : matroska demuxer
+ *****************************************************************************
+ * Copyright (C) 2003-2004 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef _CLUSTER_SCANNER_HPP_
+#define _CLUSTER_SCANNER_HPP_
+
+#include "mkv.hpp"
+
+#include <vector>
+
+/*****************************************************************************
+ * Cluster index of segments without cues
+ *****************************************************************************
+ * The clusters are walked from a stream of its own in a low priority thread,
+ * while the demuxer plays, and each of them is indexed with its timecode and
+ * whether it holds a key frame. The index can be kept in the cache directory,
+ * keyed by segment UID, so that the scan only happens once per file.
+ *****************************************************************************/
+class cluster_scanner_c
+{
+public:
+    cluster_scanner_c( demux_t *p_demux, int64_t i_start, int64_t i_end,
+                       uint64_t i_timescale, unsigned i_key_track,
+                       const EbmlBinary *p_uid, bool b_cache );
+    virtual ~cluster_scanner_c();
+
+    bool Start();
+
+    /* Replaces the given index by the clusters found so far, if there are
+     * more. Returns true once every cluster is known. */
+    bool Fetch( mkv_index_t * & p_indexes, int & i_index, int & i_index_max );
+
+private:
+    void ScanThread();
+    static void *ScanThread( void * );
+
+    bool    ReadHeader( int64_t i_pos, uint32_t *pi_id, uint64_t *pi_size, int *pi_header );
+    int64_t ScanCluster( int64_t i_pos, int64_t i_end, mkv_index_t *p_idx );
+    bool    CacheLoad();
+    void    CacheSave();
+
+    demux_t      *p_demux;
+    stream_t     *s;
+    char         *psz_url;
+    char         *psz_cache;
+    int64_t      i_start;
+    int64_t      i_end;
+    int64_t      i_file_size;
+    uint64_t     i_timescale;
+    unsigned     i_key_track;
+
+    bool         is_running;
+    vlc_thread_t thread;
+
+    vlc_mutex_t  lock;
+    bool         b_abort;
+    bool         b_done;
+    std::vector<mkv_index_t> index;
+};
+
+#endif
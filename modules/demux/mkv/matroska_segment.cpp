@@ -27,6 +27,7 @@
 #include "demux.hpp"
 #include "util.hpp"
 #include "Ebml_parser.hpp"
+#include "cluster_scanner.hpp"
 
 matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estream )
     :segment(NULL)
@@ -52,6 +53,7 @@ matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estr
     ,b_cues(false)
     ,i_index(0)
     ,i_index_max(1024)
+    ,p_scanner(NULL)
     ,psz_muxing_application(NULL)
     ,psz_writing_application(NULL)
     ,psz_segment_filename(NULL)
@@ -68,6 +70,8 @@ matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estr
 
 matroska_segment_c::~matroska_segment_c()
 {
+    delete p_scanner;
+
     for( size_t i_track = 0; i_track < tracks.size(); i_track++ )
     {
         delete tracks[i_track]->p_compression_data;
@@ -592,6 +596,22 @@ void matroska_segment_c::IndexAppendCluster( KaxCluster *cluster )
 #undef idx
 }
 
+/* Take the clusters indexed in the background, once they are all known
+ * they are as good as cues */
+void matroska_segment_c::IndexUpdate()
+{
+    if( p_scanner == NULL )
+        return;
+
+    if( p_scanner->Fetch( p_indexes, i_index, i_index_max ) )
+    {
+        msg_Dbg( &sys.demuxer, "all %d clusters are indexed", i_index );
+        delete p_scanner;
+        p_scanner = NULL;
+        b_cues = true;
+    }
+}
+
 bool matroska_segment_c::PreloadFamily( const matroska_segment_c & of_segment )
 {
     if ( b_preloaded )
@@ -849,6 +869,8 @@ void matroska_segment_c::Seek( mtime_t i_date, mtime_t i_time_offset, int64_t i_
     for( size_t i = 0; i < tracks.size(); i++)
         tracks[i]->i_last_dts = VLC_TS_INVALID;
 
+    IndexUpdate();
+
     if( i_global_position >= 0 )
     {
         /* Special case for seeking in files with no cues */
@@ -903,12 +925,19 @@ void matroska_segment_c::Seek( mtime_t i_date, mtime_t i_time_offset, int64_t i_
     int i_idx = 0;
     if ( i_index > 0 )
     {
+        /* last entry not after the date */
+        int i_high = i_index;
+        while( i_high - i_idx > 1 )
+        {
+            int i_mid = ( i_idx + i_high ) / 2;
+            if( p_indexes[i_mid].i_time + i_time_offset > i_date )
+                i_high = i_mid;
+            else
+                i_idx = i_mid;
+        }
 
-        for( ; i_idx < i_index; i_idx++ )
-            if( p_indexes[i_idx].i_time + i_time_offset > i_date )
-                break;
-
-        if( i_idx > 0 )
+        /* start from a cluster with a key frame, when known */
+        while( i_idx > 0 && !p_indexes[i_idx].b_key )
             i_idx--;
 
         i_seek_position = p_indexes[i_idx].i_position;
@@ -1080,6 +1109,52 @@ int matroska_segment_c::BlockFindTrackIndex( size_t *pi_track,
     return VLC_SUCCESS;
 }
 
+/* Reads the frames of a block of which only the header was parsed, straight
+ * from the stream, each into a block_t of its own with i_offset bytes free in
+ * front of it. The frames end the block, after its lacing. */
+block_t *matroska_segment_c::BlockFrames( KaxInternalBlock &block, size_t i_offset )
+{
+    block_t *p_frames = NULL, **pp_last = &p_frames;
+    int64_t i_total = 0;
+
+    for( unsigned i = 0; i < block.NumberFrames(); i++ )
+    {
+        int64_t i_frame = block.GetFrameSize( i );
+        if( i_frame < 0 || i_frame > (int64_t)block.GetSize() )
+            return NULL;
+        i_total += i_frame;
+    }
+    /* track number, timecode and flags come first */
+    if( block.NumberFrames() == 0 || i_total > (int64_t)block.GetSize() - 4 ||
+        (uint64_t)i_total > SIZE_MAX - i_offset )
+        return NULL;
+
+    IOCallback &io = es.I_O();
+    int64_t i_end = block.GetEndPosition();
+    int64_t i_pos = io.getFilePointer();
+
+    io.setFilePointer( i_end - i_total, seek_beginning );
+    for( unsigned i = 0; i < block.NumberFrames(); i++ )
+    {
+        size_t i_size = block.GetFrameSize( i );
+        block_t *p_block = block_Alloc( i_offset + i_size );
+        if( p_block == NULL )
+            break;
+        if( io.read( p_block->p_buffer + i_offset, i_size ) != i_size )
+        {
+            block_Release( p_block );
+            break;
+        }
+        block_ChainLastAppend( &pp_last, p_block );
+    }
+
+    /* the parser skips the rest of the block by position, but may have read
+     * past it already */
+    if( i_pos < i_end - (int64_t)block.GetSize() || i_pos > i_end )
+        io.setFilePointer( i_pos, seek_beginning );
+    return p_frames;
+}
+
 void matroska_segment_c::ComputeTrackPriority()
 {
     bool b_has_default_video = false;
@@ -1174,6 +1249,33 @@ bool matroska_segment_c::Select( mtime_t i_start_time )
     delete ep;
     ep = new EbmlParser( &es, segment, &sys.demuxer );
 
+    /* Without cues, seeks only know the clusters already read: index all of
+     * them in the background, when the file is cheap to read from */
+    bool b_fastseek;
+    if( !b_cues && p_scanner == NULL &&
+        var_InheritBool( &sys.demuxer, "mkv-index-clusters" ) &&
+        !stream_Control( sys.demuxer.s, STREAM_CAN_FASTSEEK, &b_fastseek ) &&
+        b_fastseek )
+    {
+        unsigned i_key_track = 0;
+        for( size_t i_track = 0; i_track < tracks.size(); i_track++ )
+            if( tracks[i_track]->fmt.i_cat == VIDEO_ES )
+            {
+                i_key_track = tracks[i_track]->i_number;
+                break;
+            }
+
+        p_scanner = new cluster_scanner_c( &sys.demuxer, i_start_pos,
+                                           segment->IsFiniteSize() ? (int64_t)segment->GetEndPosition() : -1,
+                                           i_timescale, i_key_track, p_segment_uid,
+                                           var_InheritBool( &sys.demuxer, "mkv-index-cache" ) );
+        if( !p_scanner->Start() )
+        {
+            delete p_scanner;
+            p_scanner = NULL;
+        }
+    }
+
     return true;
 }
 
@@ -1232,18 +1334,18 @@ int matroska_segment_c::BlockGet( KaxBlock * & pp_block, KaxSimpleBlock * & pp_s
                 {
                     case VLC_CODEC_THEORA:
                         {
-                            DataBuffer *p_data = &pp_block->GetBuffer(0);
-                            size_t sz = p_data->Size();
-                            const uint8_t * p_buff = p_data->Buffer();
+                            block_t *p_frames = BlockFrames( *pp_block, 0 );
                             /* if the second bit of a Theora frame is 1 
                                it's not a keyframe */
-                            if( sz && p_buff )
+                            if( p_frames && p_frames->i_buffer )
                             {
-                                if( p_buff[0] & 0x40 )
+                                if( p_frames->p_buffer[0] & 0x40 )
                                     *pb_key_picture = false;
                             }
                             else
                                 *pb_key_picture = false;
+                            if( p_frames )
+                                block_ChainRelease( p_frames );
                             break;
                         }
                 }
@@ -1352,7 +1454,8 @@ int matroska_segment_c::BlockGet( KaxBlock * & pp_block, KaxSimpleBlock * & pp_s
                     {
                         pp_simpleblock = (KaxSimpleBlock*)el;
 
-                        pp_simpleblock->ReadData( es.I_O() );
+                        /* only the header, the frames are read by BlockFrames() */
+                        pp_simpleblock->ReadData( es.I_O(), SCOPE_PARTIAL_DATA );
                         pp_simpleblock->SetParent( *cluster );
                     }
                     break;
@@ -1367,7 +1470,7 @@ int matroska_segment_c::BlockGet( KaxBlock * & pp_block, KaxSimpleBlock * & pp_s
                     {
                         pp_block = (KaxBlock*)el;
 
-                        pp_block->ReadData( es.I_O() );
+                        pp_block->ReadData( es.I_O(), SCOPE_PARTIAL_DATA );
                         pp_block->SetParent( *cluster );
 
                         ep->Keep();
@@ -28,6 +28,7 @@
 #include "mkv.hpp"
 
 class EbmlParser;
+class cluster_scanner_c;
 
 class chapter_edition_c;
 class chapter_translation_c;
@@ -110,6 +111,7 @@ public:
     int                     i_index;
     int                     i_index_max;
     mkv_index_t             *p_indexes;
+    cluster_scanner_c       *p_scanner;
 
     /* info */
     char                    *psz_muxing_application;
@@ -137,7 +139,9 @@ public:
     bool PreloadFamily( const matroska_segment_c & segment );
     void InformationCreate();
     void Seek( mtime_t i_date, mtime_t i_time_offset, int64_t i_global_position );
+    void IndexUpdate();
     int BlockGet( KaxBlock * &, KaxSimpleBlock * &, bool *, bool *, int64_t *);
+    block_t *BlockFrames( KaxInternalBlock &, size_t i_offset );
 
     int BlockFindTrackIndex( size_t *pi_track,
                              const KaxBlock *, const KaxSimpleBlock * );
@@ -70,6 +70,14 @@ vlc_module_begin ()
             N_("Dummy Elements"),
             N_("Read and discard unknown EBML elements (not good for broken files)."), true );
 
+    add_bool( "mkv-index-clusters", true,
+            N_("Index clusters of files without cues"),
+            N_("Index all the clusters of local files without cues in the background, for fast and precise seeking."), true );
+
+    add_bool( "mkv-index-cache", false,
+            N_("Cache cluster indexes"),
+            N_("Keep the cluster indexes of files without cues in the cache directory, so that they are only built once."), true );
+
     add_shortcut( "mka", "mkv" )
 vlc_module_end ()
 
@@ -448,6 +456,8 @@ static void Seek( demux_t *p_demux, mtime_t i_date, double f_percent, virtual_ch
         return;
     }
 
+    p_segment->IndexUpdate();
+
     /* seek without index or without date */
     if( f_percent >= 0 && (var_InheritBool( p_demux, "mkv-seek-percent" ) || !p_segment->b_cues || i_date < 0 ))
     {
@@ -531,47 +541,43 @@ void BlockDecode( demux_t *p_demux, KaxBlock *block, KaxSimpleBlock *simpleblock
     tk->b_inited = true;
 
 
-    size_t frame_size = 0;
-    size_t block_size = 0;
+    size_t i_offset = 0;
+    if( tk->i_compression_type == MATROSKA_COMPRESSION_HEADER &&
+        tk->p_compression_data != NULL &&
+        tk->i_encoding_scope & MATROSKA_ENCODING_SCOPE_ALL_FRAMES )
+        i_offset = tk->p_compression_data->GetSize();
 
+    /* the frames are read into their blocks from the stream, with room for
+     * the stripped header */
+    block_t *p_frames;
     if( simpleblock != NULL )
-        block_size = simpleblock->GetSize();
+    {
+        p_frames = p_segment->BlockFrames( *simpleblock, i_offset );
+        // condition when the DTS is correct (keyframe or B frame == NOT P frame)
+        f_mandatory = simpleblock->IsDiscardable() || simpleblock->IsKeyframe();
+    }
     else
-        block_size = block->GetSize();
- 
-    for( unsigned int i = 0;
-         ( block != NULL && i < block->NumberFrames()) || ( simpleblock != NULL && i < simpleblock->NumberFrames() );
-         i++ )
+        p_frames = p_segment->BlockFrames( *block, i_offset );
+
+    if( p_frames == NULL )
     {
-        block_t *p_block;
-        DataBuffer *data;
-        if( simpleblock != NULL )
-        {
-            data = &simpleblock->GetBuffer(i);
-            // condition when the DTS is correct (keyframe or B frame == NOT P frame)
-            f_mandatory = simpleblock->IsDiscardable() || simpleblock->IsKeyframe();
-        }
-        else
-        {
-            data = &block->GetBuffer(i);
-            // condition when the DTS is correct (keyframe or B frame == NOT P frame)
-        }
-        frame_size += data->Size();
-        if( !data->Buffer() || data->Size() > SIZE_MAX || frame_size > block_size  )
+        msg_Warn( p_demux, "Cannot read frame (too long or no frame)" );
+        return;
+    }
+
+    for( unsigned int i = 0; p_frames != NULL; i++ )
+    {
+        block_t *p_block = p_frames;
+        p_frames = p_block->p_next;
+        p_block->p_next = NULL;
+
+        if( i_offset == 0 && unlikely( tk->fmt.i_codec == VLC_CODEC_WAVPACK ) )
         {
-            msg_Warn( p_demux, "Cannot read frame (too long or no frame)" );
-            break;
+            block_t *p_packet = packetize_wavpack(tk, p_block->p_buffer, p_block->i_buffer);
+            block_Release( p_block );
+            p_block = p_packet;
         }
 
-        if( tk->i_compression_type == MATROSKA_COMPRESSION_HEADER &&
-            tk->p_compression_data != NULL &&
-            tk->i_encoding_scope & MATROSKA_ENCODING_SCOPE_ALL_FRAMES )
-            p_block = MemToBlock( data->Buffer(), data->Size(), tk->p_compression_data->GetSize() );
-        else if( unlikely( tk->fmt.i_codec == VLC_CODEC_WAVPACK ) )
-            p_block = packetize_wavpack(tk, data->Buffer(), data->Size());
-        else
-            p_block = MemToBlock( data->Buffer(), data->Size(), 0 );
-
         if( p_block == NULL )
         {
             break;
@@ -587,10 +593,9 @@ void BlockDecode( demux_t *p_demux, KaxBlock *block, KaxSimpleBlock *simpleblock
         }
         else
 #endif
-        if( tk->i_compression_type == MATROSKA_COMPRESSION_HEADER &&
-            tk->i_encoding_scope & MATROSKA_ENCODING_SCOPE_ALL_FRAMES )
+        if( i_offset > 0 )
         {
-            memcpy( p_block->p_buffer, tk->p_compression_data->GetBuffer(), tk->p_compression_data->GetSize() );
+            memcpy( p_block->p_buffer, tk->p_compression_data->GetBuffer(), i_offset );
         }
 
         if( tk->fmt.i_codec == VLC_CODEC_COOK ||
@@ -609,7 +614,7 @@ void BlockDecode( demux_t *p_demux, KaxBlock *block, KaxSimpleBlock *simpleblock
             // TODO handle the start/stop times of this packet
             p_sys->p_ev->SetPci( (const pci_t *)&p_block->p_buffer[1]);
             block_Release( p_block );
-            return;
+            break;
         }
         // correct timestamping when B frames are used
         if( tk->fmt.i_cat != VIDEO_ES )
@@ -661,6 +666,8 @@ msg_Dbg( p_demux, "block i_dts: %"PRId64" / i_pts: %"PRId64, p_block->i_dts, p_b
                  i_pts + ( mtime_t )( tk->i_default_duration / 1000 ):
                  VLC_TS_INVALID;
     }
+    if( p_frames != NULL )
+        block_ChainRelease( p_frames );
 }
 
 /*****************************************************************************
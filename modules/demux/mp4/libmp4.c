@@ -34,6 +34,7 @@
 
 #include "libmp4.h"
 #include <math.h>
+#include <limits.h>
 
 /* Some assumptions:
  * The input method HAS to be seekable
@@ -96,6 +97,8 @@ int MP4_ReadBoxCommon( stream_t *p_stream, MP4_Box_t *p_box )
     p_box->p_first  = NULL;
     p_box->p_last  = NULL;
     p_box->p_next   = NULL;
+    p_box->p_raw    = NULL;
+    p_box->p_stream = NULL;
 
     MP4_GET4BYTES( p_box->i_shortsize );
     MP4_GETFOURCC( p_box->i_type );
@@ -3375,6 +3378,72 @@ static const struct
 };
 
 
+/*****************************************************************************
+ * Delayed decoding
+ *****************************************************************************
+ * The sample tables are the bulk of a moov, and some are never used: they
+ * are only read at first, and decoded when MP4_BoxGet first reaches them.
+ * Their readers must not use the stream beyond MP4_READBOX_ENTER.
+ *****************************************************************************/
+static bool MP4_BoxIsLazy( const MP4_Box_t *p_box )
+{
+    const MP4_Box_t *p_root = p_box;
+
+    switch( p_box->i_type )
+    {
+        case ATOM_stts: case ATOM_ctts: case ATOM_stsz: case ATOM_stsc:
+        case ATOM_stco: case ATOM_co64: case ATOM_stss: case ATOM_stsh:
+        case ATOM_stdp: case ATOM_padb: case ATOM_sdtp: case ATOM_elst:
+            break;
+        default:
+            return false;
+    }
+
+    /* only in trees that outlive no stream, i.e. not from cmov */
+    while( p_root->p_father )
+        p_root = p_root->p_father;
+    return p_root->p_stream != NULL;
+}
+
+static unsigned int MP4_BoxFunctionIndex( uint32_t i_type )
+{
+    unsigned int i_index;
+
+    for( i_index = 0; ; i_index++ )
+    {
+        if( ( MP4_Box_Function[i_index].i_type == i_type )||
+            ( MP4_Box_Function[i_index].i_type == 0 ) )
+        {
+            return i_index;
+        }
+    }
+}
+
+/* Decodes a box kept raw, returns false if that fails */
+static bool MP4_BoxLoad( MP4_Box_t *p_box )
+{
+    const MP4_Box_t *p_root = p_box;
+    unsigned int i_index;
+
+    if( !p_box->p_raw )
+        return true;
+
+    while( p_root->p_father )
+        p_root = p_root->p_father;
+
+    i_index = MP4_BoxFunctionIndex( p_box->i_type );
+    if( !(MP4_Box_Function[i_index].MP4_ReadBox_function)( p_root->p_stream, p_box ) )
+    {
+        /* as if it had not been read */
+        if( p_box->data.p_data )
+            MP4_Box_Function[i_index].MP4_FreeBox_function( p_box );
+        FREENULL( p_box->data.p_data );
+        p_box->i_type = ATOM_skip;
+        return false;
+    }
+    return true;
+}
+
 /*****************************************************************************
  * MP4_ReadBox : parse the actual box and the children
  *  XXX : Do not go to the next box
@@ -3401,16 +3470,22 @@ static MP4_Box_t *MP4_ReadBox( stream_t *p_stream, MP4_Box_t *p_father )
     }
     p_box->p_father = p_father;
 
-    /* Now search function to call */
-    for( i_index = 0; ; i_index++ )
+    if( MP4_BoxIsLazy( p_box ) && p_box->i_size <= INT_MAX )
     {
-        if( ( MP4_Box_Function[i_index].i_type == p_box->i_type )||
-            ( MP4_Box_Function[i_index].i_type == 0 ) )
+        p_box->p_raw = (uint8_t *)malloc( p_box->i_size );			// sunqueen modify
+        if( p_box->p_raw == NULL ||
+            stream_Read( p_stream, p_box->p_raw, p_box->i_size ) < (int)p_box->i_size )
         {
-            break;
+            msg_Warn( p_stream, "cannot read box content" );
+            MP4_BoxFree( p_stream, p_box );
+            return NULL;
         }
+        return p_box;
     }
 
+    /* Now search function to call */
+    i_index = MP4_BoxFunctionIndex( p_box->i_type );
+
     if( !(MP4_Box_Function[i_index].MP4_ReadBox_function)( p_stream, p_box ) )
     {
         MP4_BoxFree( p_stream, p_box );
@@ -3441,17 +3516,12 @@ void MP4_BoxFree( stream_t *s, MP4_Box_t *p_box )
         p_child = p_next;
     }
 
+    free( p_box->p_raw );
+
     /* Now search function to call */
     if( p_box->data.p_data )
     {
-        for( i_index = 0; ; i_index++ )
-        {
-            if( ( MP4_Box_Function[i_index].i_type == p_box->i_type )||
-                ( MP4_Box_Function[i_index].i_type == 0 ) )
-            {
-                break;
-            }
-        }
+        i_index = MP4_BoxFunctionIndex( p_box->i_type );
         if( MP4_Box_Function[i_index].MP4_FreeBox_function == NULL )
         {
             /* Should not happen */
@@ -3544,10 +3614,11 @@ MP4_Box_t *MP4_BoxGetNextChunk( stream_t *s )
 }
 
 /*****************************************************************************
- * MP4_BoxGetRoot : Parse the entire file, and create all boxes in memory
+ * MP4_BoxGetRoot : Parse the file up to the moov, and create its boxes
  *****************************************************************************
  *  The first box is a virtual box "root" and is the father for all first
- *  level boxes for the file, a sort of virtual contener
+ *  level boxes for the file, a sort of virtual contener. Nothing past the
+ *  moov is read: a trailing moov costs a single seek over the mdat.
  *****************************************************************************/
 MP4_Box_t *MP4_BoxGetRoot( stream_t *s )
 {
@@ -3571,6 +3642,8 @@ MP4_Box_t *MP4_BoxGetRoot( stream_t *s )
     p_root->p_first     = NULL;
     p_root->p_last      = NULL;
     p_root->p_next      = NULL;
+    p_root->p_raw       = NULL;
+    p_root->p_stream    = s;
 
     p_stream = s;
 
@@ -3584,14 +3657,6 @@ MP4_Box_t *MP4_BoxGetRoot( stream_t *s )
         return p_root;
 
     p_root->i_size = stream_Size( s );
-    if( stream_Tell( s ) + 8 < stream_Size( s ) )
-    {
-        /* Get the rest of the file */
-        i_result = MP4_ReadBoxContainerRaw( p_stream, p_root );
-
-        if( !i_result )
-            goto error;
-    }
 
     MP4_Box_t *p_moov;
     MP4_Box_t *p_cmov;
@@ -3761,7 +3826,8 @@ static void MP4_BoxGet_Internal( MP4_Box_t **pp_result,
         if( !psz_token )
         {
             free( psz_dup );
-            *pp_result = p_box;
+            /* decode it now if it was only read */
+            *pp_result = MP4_BoxLoad( p_box ) ? p_box : NULL;
             return;
         }
         else
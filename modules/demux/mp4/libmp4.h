@@ -1261,6 +1261,9 @@ typedef struct MP4_Box_s
 
     struct MP4_Box_s *p_next;   /* pointer on the next boxes at the same level */
 
+    uint8_t      *p_raw;     /* content not decoded yet, see MP4_BoxGet */
+    stream_t     *p_stream;  /* root only, set if decoding can be delayed */
+
 } MP4_Box_t;
 
 /* Contain all information about a chunk */
@@ -1291,6 +1294,31 @@ typedef struct
 
 } mp4_chunk_t;
 
+/* Position of one run out of MP4_RUNS_MARK in a sample table */
+typedef struct
+{
+    uint64_t     i_sample; /* first sample of the run */
+    uint64_t     i_dts;    /* its dts, meaningful for stts only */
+
+} mp4_sample_mark_t;
+
+/* Run-length sample table (stts or ctts), the runs are not expanded: they
+ * point into the box data. Lookups move a cursor, so that sequential access
+ * costs O(1) and random access O(log n) using the marks. */
+typedef struct
+{
+    uint32_t     i_runs;
+    uint32_t     *p_count;  /* samples in each run */
+    int32_t      *p_value;  /* dts delta or pts-dts offset of each run */
+    mp4_sample_mark_t *p_mark;
+
+    /* cursor */
+    uint32_t     i_run;
+    uint64_t     i_run_sample; /* first sample of i_run */
+    uint64_t     i_run_dts;    /* dts of that sample */
+
+} mp4_sample_runs_t;
+
  /* Contain all needed information for read all track with vlc */
 typedef struct
 {
@@ -1328,14 +1356,21 @@ typedef struct
     uint32_t         i_chunk_count;
     uint32_t         i_sample_count;
 
-    mp4_chunk_t    *chunk; /* always defined  for each chunk */
+    mp4_chunk_t    *chunk; /* filled on first access, see TrackChunk() */
     mp4_chunk_t    *cchunk; /* current chunk if b_fragmented is true */
 
+    /* sample tables, they point into the stbl boxes */
+    MP4_Box_data_co64_t *p_co64;    /* chunk offsets (stco or co64) */
+    MP4_Box_data_stsc_t *p_stsc;
+    uint32_t         i_stsc_count;  /* stsc entries within i_chunk_count */
+    uint32_t         *p_stsc_sample; /* first sample of each stsc entry */
+    mp4_sample_runs_t dts_runs;     /* stts */
+    mp4_sample_runs_t pts_runs;     /* ctts, no run if there is none */
+
     /* sample size, p_sample_size defined only if i_sample_size == 0
         else i_sample_size is size for all sample */
     uint32_t         i_sample_size;
-    uint32_t         *p_sample_size; /* XXX perhaps add file offset if take
-                                    too much time to do sumations each time*/
+    uint32_t         *p_sample_size; /* stsz entries, not owned */
 
     uint32_t     i_sample_first; /* i_sample_first value
                                                    of the next chunk */
@@ -1403,17 +1438,26 @@ static inline size_t mp4_box_headersize( MP4_Box_t *p_box )
     int64_t  i_read = p_box->i_size; \
     uint8_t *p_peek, *p_buff; \
     int i_actually_read; \
-    if( !( p_peek = p_buff = (uint8_t *)malloc( i_read ) ) ) \
+    if( p_box->p_raw ) \
     { \
-        return( 0 ); \
+        /* already read by MP4_ReadBox */ \
+        p_peek = p_buff = p_box->p_raw; \
+        p_box->p_raw = NULL; \
     } \
-    i_actually_read = stream_Read( p_stream, p_peek, i_read ); \
-    if( i_actually_read < 0 || (int64_t)i_actually_read < i_read )\
+    else \
     { \
-        msg_Warn( p_stream, "MP4_READBOX_ENTER: I got %i bytes, "\
-        "but I requested %"PRId64"", i_actually_read, i_read );\
-        free( p_buff ); \
-        return( 0 ); \
+        if( !( p_peek = p_buff = (uint8_t *)malloc( i_read ) ) ) \
+        { \
+            return( 0 ); \
+        } \
+        i_actually_read = stream_Read( p_stream, p_peek, i_read ); \
+        if( i_actually_read < 0 || (int64_t)i_actually_read < i_read )\
+        { \
+            msg_Warn( p_stream, "MP4_READBOX_ENTER: I got %i bytes, "\
+            "but I requested %"PRId64"", i_actually_read, i_read );\
+            free( p_buff ); \
+            return( 0 ); \
+        } \
     } \
     p_peek += mp4_box_headersize( p_box ); \
     i_read -= mp4_box_headersize( p_box ); \
@@ -1491,10 +1535,10 @@ MP4_Box_t *MP4_BoxGetSmooBox( stream_t * );
 MP4_Box_t *MP4_BoxGetNextChunk( stream_t * );
 
 /*****************************************************************************
- * MP4_BoxGetRoot : Parse the entire file, and create all boxes in memory
+ * MP4_BoxGetRoot : Parse the file up to the moov, and create its boxes
  *****************************************************************************
  *  The first box is a virtual box "root" and is the father for all first
- *  level boxes
+ *  level boxes. Sample tables are decoded when MP4_BoxGet first returns them.
  *****************************************************************************/
 MP4_Box_t *MP4_BoxGetRoot( stream_t * );
 
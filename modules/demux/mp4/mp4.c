@@ -109,35 +109,41 @@ static void     MP4_TrackSetELST( demux_t *, mp4_track_t *, int64_t );
 static void     MP4_UpdateSeekpoint( demux_t * );
 static const char *MP4_ConvertMacCode( uint16_t );
 
+static bool         SampleRunsSeek( mp4_sample_runs_t *, uint64_t );
+static uint64_t     TrackSampleDTS( mp4_track_t *, uint32_t );
+static mp4_chunk_t *TrackChunk( mp4_track_t *, uint32_t );
+
 /* Return time in microsecond of a track */
 static inline int64_t MP4_TrackGetDTS( demux_t *p_demux, mp4_track_t *p_track )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
-    mp4_chunk_t chunk;
-    if( p_sys->b_fragmented )
-        chunk = *p_track->cchunk;
-    else
-        chunk = p_track->chunk[p_track->i_chunk];
-
-    unsigned int i_index = 0;
-    unsigned int i_sample = p_track->i_sample - chunk.i_sample_first;
-    int64_t i_dts = chunk.i_first_dts;
+    int64_t i_dts;
 
-    while( i_sample > 0 )
+    if( p_sys->b_fragmented )
     {
-        if( i_sample > chunk.p_sample_count_dts[i_index] )
-        {
-            i_dts += chunk.p_sample_count_dts[i_index] *
-                chunk.p_sample_delta_dts[i_index];
-            i_sample -= chunk.p_sample_count_dts[i_index];
-            i_index++;
-        }
-        else
+        mp4_chunk_t chunk = *p_track->cchunk;
+        unsigned int i_index = 0;
+        unsigned int i_sample = p_track->i_sample - chunk.i_sample_first;
+
+        i_dts = chunk.i_first_dts;
+        while( i_sample > 0 )
         {
-            i_dts += i_sample * chunk.p_sample_delta_dts[i_index];
-            break;
+            if( i_sample > chunk.p_sample_count_dts[i_index] )
+            {
+                i_dts += chunk.p_sample_count_dts[i_index] *
+                    chunk.p_sample_delta_dts[i_index];
+                i_sample -= chunk.p_sample_count_dts[i_index];
+                i_index++;
+            }
+            else
+            {
+                i_dts += i_sample * chunk.p_sample_delta_dts[i_index];
+                break;
+            }
         }
     }
+    else
+        i_dts = TrackSampleDTS( p_track, p_track->i_sample );
 
     /* now handle elst */
     if( p_track->p_elst )
@@ -166,12 +172,17 @@ static inline int64_t MP4_TrackGetDTS( demux_t *p_demux, mp4_track_t *p_track )
 static inline int64_t MP4_TrackGetPTSDelta( demux_t *p_demux, mp4_track_t *p_track )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
-    mp4_chunk_t *ck;
-    if( p_sys->b_fragmented )
-        ck = p_track->cchunk;
-    else
-        ck = &p_track->chunk[p_track->i_chunk];
+    if( !p_sys->b_fragmented )
+    {
+        mp4_sample_runs_t *p_runs = &p_track->pts_runs;
 
+        if( !SampleRunsSeek( p_runs, p_track->i_sample ) )
+            return -1;
+        return p_runs->p_value[p_runs->i_run] * INT64_C(1000000) /
+               (int64_t)p_track->i_timescale;
+    }
+
+    mp4_chunk_t *ck = p_track->cchunk;
     unsigned int i_index = 0;
     unsigned int i_sample = p_track->i_sample - ck->i_sample_first;
 
@@ -1236,9 +1247,12 @@ static void LoadChapterApple( demux_t  *p_demux, mp4_track_t *tk )
                 TAB_APPEND( (seekpoint_t **), p_sys->p_title->i_seekpoint, p_sys->p_title->seekpoint, s );			// sunqueen modify
             }
         }
-        if( tk->i_sample+1 >= tk->chunk[tk->i_chunk].i_sample_first +
-                              tk->chunk[tk->i_chunk].i_sample_count )
-            tk->i_chunk++;
+        if( tk->i_chunk + 1 < tk->i_chunk_count )
+        {
+            const mp4_chunk_t *ck = TrackChunk( tk, tk->i_chunk );
+            if( tk->i_sample+1 >= ck->i_sample_first + ck->i_sample_count )
+                tk->i_chunk++;
+        }
     }
 }
 static void LoadChapter( demux_t  *p_demux )
@@ -1281,7 +1295,215 @@ static void LoadChapter( demux_t  *p_demux )
     }
 }
 
-/* now create basic chunk data, the rest will be filled by MP4_CreateSamplesIndex */
+/*****************************************************************************
+ * Sample tables
+ *****************************************************************************
+ * stts and ctts are kept as runs, with a mark every MP4_RUNS_MARK runs to
+ * bisect them. Chunks are only filled from stco/co64, stsc and stts when
+ * first accessed, so that opening a long file does not walk all of them.
+ *****************************************************************************/
+#define MP4_RUNS_MARK 64
+
+static int SampleRunsInit( mp4_sample_runs_t *p_runs, uint32_t i_runs,
+                           uint32_t *p_count, int32_t *p_value )
+{
+    uint64_t i_sample = 0;
+    uint64_t i_dts = 0;
+
+    p_runs->p_mark = (mp4_sample_mark_t *)malloc( ( i_runs / MP4_RUNS_MARK + 1 ) *
+                                                  sizeof( mp4_sample_mark_t ) );			// sunqueen modify
+    if( p_runs->p_mark == NULL )
+        return VLC_ENOMEM;
+
+    p_runs->i_runs  = i_runs;
+    p_runs->p_count = p_count;
+    p_runs->p_value = p_value;
+    for( uint32_t i = 0; i < i_runs; i++ )
+    {
+        if( i % MP4_RUNS_MARK == 0 )
+        {
+            p_runs->p_mark[i / MP4_RUNS_MARK].i_sample = i_sample;
+            p_runs->p_mark[i / MP4_RUNS_MARK].i_dts    = i_dts;
+        }
+        i_sample += p_count[i];
+        i_dts    += (uint64_t)p_count[i] * (uint32_t)p_value[i];
+    }
+
+    p_runs->i_run        = 0;
+    p_runs->i_run_sample = 0;
+    p_runs->i_run_dts    = 0;
+    return VLC_SUCCESS;
+}
+
+static void SampleRunsClean( mp4_sample_runs_t *p_runs )
+{
+    FREENULL( p_runs->p_mark );
+    p_runs->i_runs = 0;
+}
+
+static void SampleRunsJump( mp4_sample_runs_t *p_runs, uint32_t i_mark )
+{
+    p_runs->i_run        = i_mark * MP4_RUNS_MARK;
+    p_runs->i_run_sample = p_runs->p_mark[i_mark].i_sample;
+    p_runs->i_run_dts    = p_runs->p_mark[i_mark].i_dts;
+}
+
+static void SampleRunsNext( mp4_sample_runs_t *p_runs )
+{
+    p_runs->i_run_sample += p_runs->p_count[p_runs->i_run];
+    p_runs->i_run_dts    += (uint64_t)p_runs->p_count[p_runs->i_run] *
+                            (uint32_t)p_runs->p_value[p_runs->i_run];
+    p_runs->i_run++;
+}
+
+/* Moves the cursor to the run holding i_sample, or to the last run.
+ * Returns false if the table does not cover i_sample */
+static bool SampleRunsSeek( mp4_sample_runs_t *p_runs, uint64_t i_sample )
+{
+    if( p_runs->i_runs == 0 )
+        return false;
+
+    if( i_sample < p_runs->i_run_sample ||
+        i_sample - p_runs->i_run_sample >= p_runs->p_count[p_runs->i_run] )
+    {
+        /* last mark not after i_sample */
+        uint32_t i_low = 0, i_high = ( p_runs->i_runs - 1 ) / MP4_RUNS_MARK + 1;
+        while( i_high - i_low > 1 )
+        {
+            uint32_t i_mid = ( i_low + i_high ) / 2;
+            if( p_runs->p_mark[i_mid].i_sample <= i_sample )
+                i_low = i_mid;
+            else
+                i_high = i_mid;
+        }
+        if( i_sample < p_runs->i_run_sample ||
+            i_low * MP4_RUNS_MARK > p_runs->i_run )
+            SampleRunsJump( p_runs, i_low );
+
+        while( p_runs->i_run + 1 < p_runs->i_runs &&
+               i_sample >= p_runs->i_run_sample + p_runs->p_count[p_runs->i_run] )
+            SampleRunsNext( p_runs );
+    }
+    return i_sample - p_runs->i_run_sample < p_runs->p_count[p_runs->i_run];
+}
+
+/* Returns the sample at i_dts in a stts table, it can be past its end */
+static uint64_t SampleRunsFindDTS( mp4_sample_runs_t *p_runs, uint64_t i_dts )
+{
+    if( p_runs->i_runs == 0 )
+        return 0;
+
+    /* last mark not after i_dts */
+    uint32_t i_low = 0, i_high = ( p_runs->i_runs - 1 ) / MP4_RUNS_MARK + 1;
+    while( i_high - i_low > 1 )
+    {
+        uint32_t i_mid = ( i_low + i_high ) / 2;
+        if( p_runs->p_mark[i_mid].i_dts <= i_dts )
+            i_low = i_mid;
+        else
+            i_high = i_mid;
+    }
+    if( i_dts < p_runs->i_run_dts || i_low * MP4_RUNS_MARK > p_runs->i_run )
+        SampleRunsJump( p_runs, i_low );
+
+    while( p_runs->i_run + 1 < p_runs->i_runs &&
+           i_dts >= p_runs->i_run_dts +
+                    (uint64_t)p_runs->p_count[p_runs->i_run] *
+                    (uint32_t)p_runs->p_value[p_runs->i_run] )
+        SampleRunsNext( p_runs );
+
+    uint32_t i_delta = p_runs->p_value[p_runs->i_run];
+    return p_runs->i_run_sample +
+           ( i_delta > 0 ? ( i_dts - p_runs->i_run_dts ) / i_delta : 0 );
+}
+
+static uint64_t TrackSampleDTS( mp4_track_t *p_track, uint32_t i_sample )
+{
+    mp4_sample_runs_t *p_runs = &p_track->dts_runs;
+
+    if( p_runs->i_runs == 0 )
+        return 0;
+
+    /* past the end of the table, the last delta goes on */
+    SampleRunsSeek( p_runs, i_sample );
+    return p_runs->i_run_dts + ( i_sample - p_runs->i_run_sample ) *
+                               (uint32_t)p_runs->p_value[p_runs->i_run];
+}
+
+/* Returns the stsc entry describing i_chunk, -1 if there is none */
+static int TrackChunkEntry( const mp4_track_t *p_track, uint32_t i_chunk )
+{
+    const uint32_t *p_first_chunk = p_track->p_stsc->i_first_chunk;
+    uint32_t i_low = 0, i_high = p_track->i_stsc_count;
+
+    if( p_first_chunk[0] - 1 > i_chunk )
+        return -1;
+
+    while( i_high - i_low > 1 )
+    {
+        uint32_t i_mid = ( i_low + i_high ) / 2;
+        if( p_first_chunk[i_mid] - 1 <= i_chunk )
+            i_low = i_mid;
+        else
+            i_high = i_mid;
+    }
+    return i_low;
+}
+
+/* Returns the chunk holding i_sample, the last one if past the end */
+static uint32_t TrackSampleChunk( const mp4_track_t *p_track, uint32_t i_sample )
+{
+    const MP4_Box_data_stsc_t *stsc = p_track->p_stsc;
+    uint32_t i_low = 0, i_high = p_track->i_stsc_count;
+
+    while( i_high - i_low > 1 )
+    {
+        uint32_t i_mid = ( i_low + i_high ) / 2;
+        if( p_track->p_stsc_sample[i_mid] <= i_sample )
+            i_low = i_mid;
+        else
+            i_high = i_mid;
+    }
+
+    uint64_t i_chunk = stsc->i_first_chunk[i_low] - 1;
+    uint32_t i_end = i_low + 1 < p_track->i_stsc_count ?
+                     stsc->i_first_chunk[i_low + 1] - 1 : p_track->i_chunk_count;
+    if( stsc->i_samples_per_chunk[i_low] > 0 )
+        i_chunk += ( i_sample - p_track->p_stsc_sample[i_low] ) /
+                   stsc->i_samples_per_chunk[i_low];
+
+    return __MIN( i_chunk, i_end - 1 );
+}
+
+/* Returns i_chunk, filling it on first access. i_chunk must be valid. */
+static mp4_chunk_t *TrackChunk( mp4_track_t *p_track, uint32_t i_chunk )
+{
+    const MP4_Box_data_stsc_t *stsc = p_track->p_stsc;
+    mp4_chunk_t *ck = &p_track->chunk[i_chunk];
+
+    /* 0 is not a valid index, such chunks are merely filled again */
+    if( ck->i_sample_description_index != 0 )
+        return ck;
+
+    ck->i_offset = p_track->p_co64->i_chunk_offset[i_chunk];
+
+    int i_entry = TrackChunkEntry( p_track, i_chunk );
+    if( i_entry < 0 )
+        return ck;
+
+    ck->i_sample_description_index = stsc->i_sample_description_index[i_entry];
+    ck->i_sample_count = stsc->i_samples_per_chunk[i_entry];
+    ck->i_sample_first = p_track->p_stsc_sample[i_entry] +
+        ( i_chunk - ( stsc->i_first_chunk[i_entry] - 1 ) ) * ck->i_sample_count;
+
+    ck->i_first_dts = TrackSampleDTS( p_track, ck->i_sample_first );
+    ck->i_last_dts  = ck->i_sample_count == 0 ? ck->i_first_dts :
+        TrackSampleDTS( p_track, ck->i_sample_first + ck->i_sample_count - 1 );
+
+    return ck;
+}
+
+/* now check the chunk table, chunks are filled by TrackChunk() */
 static int TrackCreateChunksIndex( demux_t *p_demux,
                                    mp4_track_t *p_demux_track )
 {
@@ -1291,9 +1513,9 @@ static int TrackCreateChunksIndex( demux_t *p_demux,
 
     MP4_Box_t *p_co64; /* give offset for each chunk, same for stco and co64 */
     MP4_Box_t *p_stsc;
+    MP4_Box_data_stsc_t *stsc;
 
-    unsigned int i_chunk;
-    unsigned int i_index, i_last;
+    unsigned int i_index;
 
     if( ( !(p_co64 = MP4_BoxGet( p_demux_track->p_stbl, "stco" ) )&&
           !(p_co64 = MP4_BoxGet( p_demux_track->p_stbl, "co64" ) ) )||
@@ -1308,64 +1530,53 @@ static int TrackCreateChunksIndex( demux_t *p_demux,
         msg_Warn( p_demux, "no chunk defined" );
         return( VLC_EGENERIC );
     }
-    p_demux_track->chunk = (mp4_chunk_t *)calloc( p_demux_track->i_chunk_count,
-                                   sizeof( mp4_chunk_t ) );			// sunqueen modify
-    if( p_demux_track->chunk == NULL )
-    {
-        return VLC_ENOMEM;
-    }
 
-    /* first we read chunk offset */
-    for( i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
+    /* now we check index for SampleEntry( soun vide mp4a mp4v ...)
+        to be used for the sample XXX begin to 1, entries past the last
+        chunk are ignored */
+    stsc = p_stsc->data.p_stsc;
+    for( i_index = 0; i_index < stsc->i_entry_count; i_index++ )
     {
-        mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
-
-        ck->i_offset = p_co64->data.p_co64->i_chunk_offset[i_chunk];
-
-        ck->i_first_dts = 0;
-        ck->p_sample_count_dts = NULL;
-        ck->p_sample_delta_dts = NULL;
-        ck->p_sample_count_pts = NULL;
-        ck->p_sample_offset_pts = NULL;
+        if( stsc->i_first_chunk[i_index] == 0 ||
+            ( i_index > 0 &&
+              stsc->i_first_chunk[i_index] < stsc->i_first_chunk[i_index - 1] ) )
+        {
+            msg_Warn( p_demux, "corrupted chunk table" );
+            return VLC_EGENERIC;
+        }
+        if( stsc->i_first_chunk[i_index] > p_demux_track->i_chunk_count )
+            break;
     }
-
-    /* now we read index for SampleEntry( soun vide mp4a mp4v ...)
-        to be used for the sample XXX begin to 1
-        We construct it begining at the end */
-    i_last = p_demux_track->i_chunk_count; /* last chunk proceded */
-    i_index = p_stsc->data.p_stsc->i_entry_count;
     if( !i_index )
     {
         msg_Warn( p_demux, "cannot read chunk table or table empty" );
         return( VLC_EGENERIC );
     }
+    p_demux_track->i_stsc_count = i_index;
 
-    while( i_index-- )
-    {
-        for( i_chunk = p_stsc->data.p_stsc->i_first_chunk[i_index] - 1;
-             i_chunk < i_last; i_chunk++ )
-        {
-            if( i_chunk >= p_demux_track->i_chunk_count )
-            {
-                msg_Warn( p_demux, "corrupted chunk table" );
-                return VLC_EGENERIC;
-            }
+    p_demux_track->p_stsc_sample =
+        (uint32_t *)malloc( p_demux_track->i_stsc_count * sizeof( uint32_t ) );			// sunqueen modify
+    if( p_demux_track->p_stsc_sample == NULL )
+        return VLC_ENOMEM;
 
-            p_demux_track->chunk[i_chunk].i_sample_description_index =
-                    p_stsc->data.p_stsc->i_sample_description_index[i_index];
-            p_demux_track->chunk[i_chunk].i_sample_count =
-                    p_stsc->data.p_stsc->i_samples_per_chunk[i_index];
-        }
-        i_last = p_stsc->data.p_stsc->i_first_chunk[i_index] - 1;
+    p_demux_track->p_stsc_sample[0] = 0;
+    for( i_index = 1; i_index < p_demux_track->i_stsc_count; i_index++ )
+    {
+        p_demux_track->p_stsc_sample[i_index] =
+            p_demux_track->p_stsc_sample[i_index - 1] +
+            ( stsc->i_first_chunk[i_index] - stsc->i_first_chunk[i_index - 1] ) *
+                stsc->i_samples_per_chunk[i_index - 1];
     }
 
-    p_demux_track->chunk[0].i_sample_first = 0;
-    for( i_chunk = 1; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
+    /* zeroed pages are only committed once the chunks are filled */
+    p_demux_track->chunk = (mp4_chunk_t *)calloc( p_demux_track->i_chunk_count,
+                                   sizeof( mp4_chunk_t ) );			// sunqueen modify
+    if( p_demux_track->chunk == NULL )
     {
-        p_demux_track->chunk[i_chunk].i_sample_first =
-            p_demux_track->chunk[i_chunk-1].i_sample_first +
-                p_demux_track->chunk[i_chunk-1].i_sample_count;
+        return VLC_ENOMEM;
     }
+    p_demux_track->p_co64 = p_co64->data.p_co64;
+    p_demux_track->p_stsc = stsc;
 
     msg_Dbg( p_demux, "track[Id 0x%x] read %d chunk",
              p_demux_track->i_track_ID, p_demux_track->i_chunk_count );
@@ -1385,13 +1596,6 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
     MP4_Box_data_stts_t *stts;
     /* TODO use also stss and stsh table for seeking */
     /* FIXME use edit table */
-    int64_t i_sample;
-    int64_t i_chunk;
-
-    int64_t i_index;
-    int64_t i_index_sample_used;
-
-    int64_t i_next_dts;
 
     /* Find stsz
      *  Gives the sample size for each samples. There is also a stz2 table
@@ -1416,7 +1620,7 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
     }
     stts = p_box->data.p_stts;
 
-    /* Use stsz table to create a sample number -> sample size table */
+    /* Use stsz table as sample number -> sample size table */
     p_demux_track->i_sample_count = stsz->i_sample_count;
     if( stsz->i_sample_size )
     {
@@ -1428,84 +1632,13 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
     {
         /* 2: each sample can have a different size */
         p_demux_track->i_sample_size = 0;
-        p_demux_track->p_sample_size =
-            (uint32_t *)calloc( p_demux_track->i_sample_count, sizeof( uint32_t ) );			// sunqueen modify
-        if( p_demux_track->p_sample_size == NULL )
-            return VLC_ENOMEM;
-
-        for( i_sample = 0; i_sample < p_demux_track->i_sample_count; i_sample++ )
-        {
-            p_demux_track->p_sample_size[i_sample] =
-                    stsz->i_entry_size[i_sample];
-        }
+        p_demux_track->p_sample_size = stsz->i_entry_size;
     }
 
-    /* Use stts table to create a sample number -> dts table.
-     * XXX: if we don't want to waste too much memory, we can't expand
-     *  the box! so each chunk will contain an "extract" of this table
-     *  for fast research (problem with raw stream where a sample is sometime
-     *  just channels*bits_per_sample/8 */
-
-    i_next_dts = 0;
-    i_index = 0; i_index_sample_used = 0;
-    for( i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
-    {
-        mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
-        int64_t i_entry, i_sample_count, i;
-
-        /* save first dts */
-        ck->i_first_dts = i_next_dts;
-        ck->i_last_dts  = i_next_dts;
-
-        /* count how many entries are needed for this chunk
-         * for p_sample_delta_dts and p_sample_count_dts */
-        i_sample_count = ck->i_sample_count;
-
-        i_entry = 0;
-        while( i_sample_count > 0 )
-        {
-            i_sample_count -= stts->i_sample_count[i_index+i_entry];
-            /* don't count already used sample in this entry */
-            if( i_entry == 0 )
-                i_sample_count += i_index_sample_used;
-
-            i_entry++;
-        }
-
-        /* allocate them */
-        ck->p_sample_count_dts = (uint32_t *)calloc( i_entry, sizeof( uint32_t ) );			// sunqueen modify
-        ck->p_sample_delta_dts = (uint32_t *)calloc( i_entry, sizeof( uint32_t ) );			// sunqueen modify
-
-        if( !ck->p_sample_count_dts || !ck->p_sample_delta_dts )
-            return VLC_ENOMEM;
-
-        /* now copy */
-        i_sample_count = ck->i_sample_count;
-        for( i = 0; i < i_entry; i++ )
-        {
-            int64_t i_used;
-            int64_t i_rest;
-
-            i_rest = stts->i_sample_count[i_index] - i_index_sample_used;
-
-            i_used = __MIN( i_rest, i_sample_count );
-
-            i_index_sample_used += i_used;
-            i_sample_count -= i_used;
-            i_next_dts += i_used * stts->i_sample_delta[i_index];
-
-            ck->p_sample_count_dts[i] = i_used;
-            ck->p_sample_delta_dts[i] = stts->i_sample_delta[i_index];
-            if( i_used > 0 )
-                ck->i_last_dts = i_next_dts - ck->p_sample_delta_dts[i];
-
-            if( i_index_sample_used >= stts->i_sample_count[i_index] )
-            {
-                i_index++;
-                i_index_sample_used = 0;
-            }
-        }
-    }
+    /* Use stts table as sample number -> dts table, without expanding it */
+    if( SampleRunsInit( &p_demux_track->dts_runs, stts->i_entry_count,
+                        stts->i_sample_count, stts->i_sample_delta ) )
+        return VLC_ENOMEM;
 
     /* Find ctts
      *  Gives the delta between decoding time (dts) and composition table (pts)
@@ -1517,65 +1650,15 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
 
         msg_Warn( p_demux, "CTTS table" );
 
-        /* Create pts-dts table per chunk */
-        i_index = 0; i_index_sample_used = 0;
-        for( i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
-        {
-            mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
-            int64_t i_entry, i_sample_count, i;
-
-            /* count how many entries are needed for this chunk
-             * for p_sample_delta_dts and p_sample_count_dts */
-            i_sample_count = ck->i_sample_count;
-
-            i_entry = 0;
-            while( i_sample_count > 0 )
-            {
-                i_sample_count -= ctts->i_sample_count[i_index+i_entry];
-
-                /* don't count already used sample in this entry */
-                if( i_entry == 0 )
-                    i_sample_count += i_index_sample_used;
-
-                i_entry++;
-            }
-
-            /* allocate them */
-            ck->p_sample_count_pts = (uint32_t *)calloc( i_entry, sizeof( uint32_t ) );			// sunqueen modify
-            ck->p_sample_offset_pts = (int32_t *)calloc( i_entry, sizeof( int32_t ) );			// sunqueen modify
-            if( !ck->p_sample_count_pts || !ck->p_sample_offset_pts )
-                return VLC_ENOMEM;
-
-            /* now copy */
-            i_sample_count = ck->i_sample_count;
-            for( i = 0; i < i_entry; i++ )
-            {
-                int64_t i_used;
-                int64_t i_rest;
-
-                i_rest = ctts->i_sample_count[i_index] -
-                    i_index_sample_used;
-
-                i_used = __MIN( i_rest, i_sample_count );
-
-                i_index_sample_used += i_used;
-                i_sample_count -= i_used;
-
-                ck->p_sample_count_pts[i] = i_used;
-                ck->p_sample_offset_pts[i] = ctts->i_sample_offset[i_index];
-
-                if( i_index_sample_used >= ctts->i_sample_count[i_index] )
-                {
-                    i_index++;
-                    i_index_sample_used = 0;
-                }
-            }
-        }
+        if( SampleRunsInit( &p_demux_track->pts_runs, ctts->i_entry_count,
+                            ctts->i_sample_count, ctts->i_sample_offset ) )
+            return VLC_ENOMEM;
     }
 
     msg_Dbg( p_demux, "track[Id 0x%x] read %d samples length:%"PRId64"s",
              p_demux_track->i_track_ID, p_demux_track->i_sample_count,
-             i_next_dts / p_demux_track->i_timescale );
+             (int64_t)( TrackSampleDTS( p_demux_track, p_demux_track->i_sample_count ) /
+                        p_demux_track->i_timescale ) );
 
     return VLC_SUCCESS;
 }
@@ -1585,35 +1668,40 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
  * description index
  */
 static void TrackGetESSampleRate( unsigned *pi_num, unsigned *pi_den,
-                                  const mp4_track_t *p_track,
+                                  mp4_track_t *p_track,
                                   unsigned i_sd_index,
                                   unsigned i_chunk )
 {
+    const MP4_Box_data_stsc_t *stsc = p_track->p_stsc;
+
     *pi_num = 0;
     *pi_den = 0;
 
     if( p_track->i_chunk_count <= 0 )
         return;
 
-    /* */
-    const mp4_chunk_t *p_chunk = &p_track->chunk[i_chunk];
-    while( p_chunk > &p_track->chunk[0] &&
-           p_chunk[-1].i_sample_description_index == i_sd_index )
+    /* widen to the neighbour stsc entries with the same description */
+    uint32_t i_begin = i_chunk;
+    uint32_t i_end   = i_chunk + 1;
+    while( i_begin > 0 &&
+           TrackChunk( p_track, i_begin - 1 )->i_sample_description_index == i_sd_index )
     {
-        p_chunk--;
+        i_begin = stsc->i_first_chunk[TrackChunkEntry( p_track, i_begin - 1 )] - 1;
     }
-
-    uint64_t i_sample = 0;
-    uint64_t i_first_dts = p_chunk->i_first_dts;
-    uint64_t i_last_dts;
-    do
+    while( i_end < p_track->i_chunk_count &&
+           TrackChunk( p_track, i_end )->i_sample_description_index == i_sd_index )
     {
-        i_sample += p_chunk->i_sample_count;
-        i_last_dts = p_chunk->i_last_dts;
-        p_chunk++;
+        uint32_t i_next = TrackChunkEntry( p_track, i_end ) + 1;
+        i_end = i_next < p_track->i_stsc_count ? stsc->i_first_chunk[i_next] - 1
+                                               : p_track->i_chunk_count;
     }
-    while( p_chunk < &p_track->chunk[p_track->i_chunk_count] &&
-           p_chunk->i_sample_description_index == i_sd_index );
+
+    const mp4_chunk_t *p_first = TrackChunk( p_track, i_begin );
+    const mp4_chunk_t *p_last  = TrackChunk( p_track, i_end - 1 );
+    uint64_t i_sample = p_last->i_sample_first + p_last->i_sample_count -
+                        p_first->i_sample_first;
+    uint64_t i_first_dts = p_first->i_first_dts;
+    uint64_t i_last_dts  = p_last->i_last_dts;
 
     if( i_sample > 1 && i_first_dts < i_last_dts )
         vlc_ureduce( pi_num, pi_den,
@@ -1636,7 +1724,7 @@ static int TrackCreateES( demux_t *p_demux, mp4_track_t *p_track,
         i_sample_description_index = 1; /* XXX */
     else
         i_sample_description_index =
-                p_track->chunk[i_chunk].i_sample_description_index;
+                TrackChunk( p_track, i_chunk )->i_sample_description_index;
 
     MP4_Box_t   *p_sample;
     MP4_Box_t   *p_esds;
@@ -2251,10 +2339,8 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
 {
     demux_sys_t *p_sys = p_demux->p_sys;
     MP4_Box_t   *p_box_stss;
-    uint64_t     i_dts;
     unsigned int i_sample;
     unsigned int i_chunk;
-    int          i_index;
 
     /* FIXME see if it's needed to check p_track->i_chunk_count */
     if( p_track->i_chunk_count == 0 )
@@ -2298,54 +2384,12 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
         i_start = i_start * p_track->i_timescale / (int64_t)1000000;
     }
 
-    /* we start from sample 0/chunk 0, hope it won't take too much time */
-    /* *** find good chunk *** */
-    for( i_chunk = 0; ; i_chunk++ )
-    {
-        if( i_chunk + 1 >= p_track->i_chunk_count )
-        {
-            /* at the end and can't check if i_start in this chunk,
-               it will be check while searching i_sample */
-            i_chunk = p_track->i_chunk_count - 1;
-            break;
-        }
-
-        if( (uint64_t)i_start >= p_track->chunk[i_chunk].i_first_dts &&
-            (uint64_t)i_start <  p_track->chunk[i_chunk + 1].i_first_dts )
-        {
-            break;
-        }
-    }
+    /* *** find the sample, then its chunk *** */
+    uint64_t i_found = SampleRunsFindDTS( &p_track->dts_runs, (uint64_t)i_start );
+    i_sample = __MIN( i_found, UINT32_MAX );
+    i_chunk  = TrackSampleChunk( p_track, i_sample );
 
-    /* *** find sample in the chunk *** */
-    i_sample = p_track->chunk[i_chunk].i_sample_first;
-    i_dts    = p_track->chunk[i_chunk].i_first_dts;
-    for( i_index = 0; i_sample < p_track->chunk[i_chunk].i_sample_count; )
-    {
-        if( i_dts +
-            p_track->chunk[i_chunk].p_sample_count_dts[i_index] *
-            p_track->chunk[i_chunk].p_sample_delta_dts[i_index] < (uint64_t)i_start )
-        {
-            i_dts    +=
-                p_track->chunk[i_chunk].p_sample_count_dts[i_index] *
-                p_track->chunk[i_chunk].p_sample_delta_dts[i_index];
-
-            i_sample += p_track->chunk[i_chunk].p_sample_count_dts[i_index];
-            i_index++;
-        }
-        else
-        {
-            if( p_track->chunk[i_chunk].p_sample_delta_dts[i_index] <= 0 )
-            {
-                break;
-            }
-            i_sample += ( i_start - i_dts ) /
-                p_track->chunk[i_chunk].p_sample_delta_dts[i_index];
-            break;
-        }
-    }
-
-    if( i_sample >= p_track->i_sample_count )
+    if( i_found >= p_track->i_sample_count )
     {
         msg_Warn( p_demux, "track[Id 0x%x] will be disabled "
                   "(seeking too far) chunk=%d sample=%d",
@@ -2355,37 +2399,30 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
 
 
     /* *** Try to find nearest sync points *** */
-    if( ( p_box_stss = MP4_BoxGet( p_track->p_stbl, "stss" ) ) )
+    if( ( p_box_stss = MP4_BoxGet( p_track->p_stbl, "stss" ) ) &&
+        p_box_stss->data.p_stss->i_entry_count > 0 )
     {
         MP4_Box_data_stss_t *p_stss = p_box_stss->data.p_stss;
         msg_Dbg( p_demux, "track[Id 0x%x] using Sync Sample Box (stss)",
                  p_track->i_track_ID );
-        for( unsigned i_index = 0; i_index < p_stss->i_entry_count; i_index++ )
-        {
-            if( i_index >= p_stss->i_entry_count - 1 ||
-                i_sample < p_stss->i_sample_number[i_index+1] )
-            {
-                unsigned i_sync_sample = p_stss->i_sample_number[i_index];
-                msg_Dbg( p_demux, "stts gives %d --> %d (sample number)",
-                         i_sample, i_sync_sample );
 
-                if( i_sync_sample <= i_sample )
-                {
-                    while( i_chunk > 0 &&
-                           i_sync_sample < p_track->chunk[i_chunk].i_sample_first )
-                        i_chunk--;
-                }
-                else
-                {
-                    while( i_chunk < p_track->i_chunk_count - 1 &&
-                           i_sync_sample >= p_track->chunk[i_chunk].i_sample_first +
-                                            p_track->chunk[i_chunk].i_sample_count )
-                        i_chunk++;
-                }
-                i_sample = i_sync_sample;
-                break;
-            }
+        /* last sync sample not after i_sample, or the first one */
+        unsigned i_low = 0, i_high = p_stss->i_entry_count;
+        while( i_high - i_low > 1 )
+        {
+            unsigned i_mid = ( i_low + i_high ) / 2;
+            if( p_stss->i_sample_number[i_mid] <= i_sample )
+                i_low = i_mid;
+            else
+                i_high = i_mid;
         }
+
+        unsigned i_sync_sample = p_stss->i_sample_number[i_low];
+        msg_Dbg( p_demux, "stts gives %d --> %d (sample number)",
+                 i_sample, i_sync_sample );
+
+        i_sample = i_sync_sample;
+        i_chunk  = TrackSampleChunk( p_track, i_sample );
     }
     else
     {
@@ -2404,10 +2441,13 @@ static int TrackGotoChunkSample( demux_t *p_demux, mp4_track_t *p_track,
 {
     bool b_reselect = false;
 
+    if( i_chunk >= p_track->i_chunk_count )
+        return VLC_EGENERIC;
+
     /* now see if actual es is ok */
     if( p_track->i_chunk >= p_track->i_chunk_count ||
-        p_track->chunk[p_track->i_chunk].i_sample_description_index !=
-            p_track->chunk[i_chunk].i_sample_description_index )
+        TrackChunk( p_track, p_track->i_chunk )->i_sample_description_index !=
+            TrackChunk( p_track, i_chunk )->i_sample_description_index )
     {
         msg_Warn( p_demux, "recreate ES for track[Id 0x%x]",
                   p_track->i_track_ID );
@@ -2667,8 +2707,8 @@ static void MP4_TrackCreate( demux_t *p_demux, mp4_track_t *p_track,
         for( i = 0; i < p_track->i_chunk_count; i++ )
         {
             fprintf( stderr, "%-5d sample_count=%d pts=%lld\n",
-                     i, p_track->chunk[i].i_sample_count,
-                     p_track->chunk[i].i_first_dts );
+                     i, TrackChunk( p_track, i )->i_sample_count,
+                     TrackChunk( p_track, i )->i_first_dts );
 
         }
     }
@@ -2695,35 +2735,23 @@ static void FreeAndResetChunk( mp4_chunk_t *ck )
  ****************************************************************************/
 static void MP4_TrackDestroy( mp4_track_t *p_track )
 {
-    unsigned int i_chunk;
-
     p_track->b_ok = false;
     p_track->b_enable   = false;
     p_track->b_selected = false;
 
     es_format_Clean( &p_track->fmt );
 
-    for( i_chunk = 0; i_chunk < p_track->i_chunk_count; i_chunk++ )
-    {
-        if( p_track->chunk )
-        {
-           FREENULL(p_track->chunk[i_chunk].p_sample_count_dts);
-           FREENULL(p_track->chunk[i_chunk].p_sample_delta_dts );
-
-           FREENULL(p_track->chunk[i_chunk].p_sample_count_pts);
-           FREENULL(p_track->chunk[i_chunk].p_sample_offset_pts );
-        }
-    }
+    /* the sample tables point into boxes that may already be freed */
     FREENULL( p_track->chunk );
+    FREENULL( p_track->p_stsc_sample );
+    SampleRunsClean( &p_track->dts_runs );
+    SampleRunsClean( &p_track->pts_runs );
+    p_track->p_sample_size = NULL;
+
     if( p_track->cchunk ) {
         FreeAndResetChunk( p_track->cchunk );
         FREENULL( p_track->cchunk );
     }
-
-    if( !p_track->i_sample_size )
-    {
-        FREENULL( p_track->p_sample_size );
-    }
 }
 
 static int MP4_TrackSelect( demux_t *p_demux, mp4_track_t *p_track,
@@ -2816,9 +2844,10 @@ static int MP4_TrackSampleSize( mp4_track_t *p_track )
 
     p_soun = p_track->p_sample->data.p_sample_soun;
 
+    const mp4_chunk_t *ck = TrackChunk( p_track, p_track->i_chunk );
     if( p_soun->i_qt_version == 1 )
     {
-        int i_samples = p_track->chunk[p_track->i_chunk].i_sample_count;
+        int i_samples = ck->i_sample_count;
         if( p_track->fmt.audio.i_blockalign > 1 )
             i_samples = p_soun->i_sample_per_packet;
 
@@ -2833,9 +2862,8 @@ static int MP4_TrackSampleSize( mp4_track_t *p_track )
     else
     {
         /* Read a bunch of samples at once */
-        int i_samples = p_track->chunk[p_track->i_chunk].i_sample_count -
-            ( p_track->i_sample -
-              p_track->chunk[p_track->i_chunk].i_sample_first );
+        int i_samples = ck->i_sample_count -
+            ( p_track->i_sample - ck->i_sample_first );
 
         i_samples = __MIN( QT_V0_MAX_SAMPLES, i_samples );
         i_size = i_samples * p_track->i_sample_size;
@@ -2847,10 +2875,11 @@ static int MP4_TrackSampleSize( mp4_track_t *p_track )
 
 static uint64_t MP4_TrackGetPos( mp4_track_t *p_track )
 {
+    const mp4_chunk_t *ck = TrackChunk( p_track, p_track->i_chunk );
     unsigned int i_sample;
     uint64_t i_pos;
 
-    i_pos = p_track->chunk[p_track->i_chunk].i_offset;
+    i_pos = ck->i_offset;
 
     if( p_track->i_sample_size )
     {
@@ -2859,21 +2888,20 @@ static uint64_t MP4_TrackGetPos( mp4_track_t *p_track )
 
         if( p_track->fmt.i_cat != AUDIO_ES || p_soun->i_qt_version == 0 )
         {
-            i_pos += ( p_track->i_sample -
-                       p_track->chunk[p_track->i_chunk].i_sample_first ) *
+            i_pos += ( p_track->i_sample - ck->i_sample_first ) *
                      p_track->i_sample_size;
         }
         else
         {
             /* we read chunk by chunk unless a blockalign is requested */
             if( p_track->fmt.audio.i_blockalign > 1 )
-                i_pos += ( p_track->i_sample - p_track->chunk[p_track->i_chunk].i_sample_first ) /
+                i_pos += ( p_track->i_sample - ck->i_sample_first ) /
                                 p_soun->i_sample_per_packet * p_soun->i_bytes_per_frame;
         }
     }
     else
     {
-        for( i_sample = p_track->chunk[p_track->i_chunk].i_sample_first;
+        for( i_sample = ck->i_sample_first;
              i_sample < p_track->i_sample; i_sample++ )
         {
             i_pos += p_track->p_sample_size[i_sample];
@@ -2885,6 +2913,8 @@ static uint64_t MP4_TrackGetPos( mp4_track_t *p_track )
 
 static int MP4_TrackNextSample( demux_t *p_demux, mp4_track_t *p_track )
 {
+    const mp4_chunk_t *ck = TrackChunk( p_track, p_track->i_chunk );
+
     if( p_track->fmt.i_cat == AUDIO_ES && p_track->i_sample_size != 0 )
     {
         MP4_Box_data_sample_soun_t *p_soun;
@@ -2897,7 +2927,7 @@ static int MP4_TrackNextSample( demux_t *p_demux, mp4_track_t *p_track )
             if( p_track->fmt.audio.i_blockalign > 1 )
                 p_track->i_sample += p_soun->i_sample_per_packet;
             else
-                p_track->i_sample += p_track->chunk[p_track->i_chunk].i_sample_count;
+                p_track->i_sample += ck->i_sample_count;
         }
         else if( p_track->i_sample_size > 256 )
         {
@@ -2909,13 +2939,9 @@ static int MP4_TrackNextSample( demux_t *p_demux, mp4_track_t *p_track )
         {
             /* FIXME */
             p_track->i_sample += QT_V0_MAX_SAMPLES;
-            if( p_track->i_sample >
-                p_track->chunk[p_track->i_chunk].i_sample_first +
-                p_track->chunk[p_track->i_chunk].i_sample_count )
+            if( p_track->i_sample > ck->i_sample_first + ck->i_sample_count )
             {
-                p_track->i_sample =
-                    p_track->chunk[p_track->i_chunk].i_sample_first +
-                    p_track->chunk[p_track->i_chunk].i_sample_count;
+                p_track->i_sample = ck->i_sample_first + ck->i_sample_count;
             }
         }
     }
@@ -2928,9 +2954,7 @@ static int MP4_TrackNextSample( demux_t *p_demux, mp4_track_t *p_track )
         return VLC_EGENERIC;
 
     /* Have we changed chunk ? */
-    if( p_track->i_sample >=
-            p_track->chunk[p_track->i_chunk].i_sample_first +
-            p_track->chunk[p_track->i_chunk].i_sample_count )
+    if( p_track->i_sample >= ck->i_sample_first + ck->i_sample_count )
     {
         if( TrackGotoChunkSample( p_demux, p_track, p_track->i_chunk + 1,
                                   p_track->i_sample ) )
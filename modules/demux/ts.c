@@ -42,6 +42,7 @@
 #include <vlc_meta.h>
 #include <vlc_epg.h>
 #include <vlc_charset.h>   /* FromCharset, for EIT */
+#include <vlc_fs.h>
 
 #include <vlc_network.h>   /* net_ for ts-out mode */
 
@@ -129,11 +130,29 @@ static void Close ( vlc_object_t * );
     "Separate teletex/dvbs pages into independent ES. " \
     "It can be useful to turn off this option when using stream output." )
 
+#define WORKERS_TEXT N_("PES worker threads")
+#define WORKERS_LONGTEXT N_( \
+    "Number of threads reassembling and sending the elementary stream " \
+    "packets, so that demuxing big multiplexes can use several cores. " \
+    "With 0, everything is done by the demuxer thread." )
+
+#define BATCH_TEXT N_("Packets read at once")
+#define BATCH_LONGTEXT N_( \
+    "Number of TS packets read from the stream in one go. The packets are " \
+    "then parsed in place, and only the payloads of the elementary streams " \
+    "being decoded are copied out, a whole PES at once when possible. " \
+    "With 0, packets are read one by one." )
+
 #define SEEK_PERCENT_TEXT N_("Seek based on percent not time")
 #define SEEK_PERCENT_LONGTEXT N_( \
     "Seek and position based on a percent byte position, not a PCR generated " \
     "time position. If seeking doesn't work property, turn on this option." )
 
+#define SEEK_INDEX_TEXT N_("Save the seek index")
+#define SEEK_INDEX_LONGTEXT N_( \
+    "Store the PCR positions found while playing a local file in a .tsidx " \
+    "file next to it, so that it opens and seeks faster the next time." )
+
 
 vlc_module_begin ()
     set_description( N_("MPEG Transport Stream demuxer") )
@@ -157,6 +176,11 @@ vlc_module_begin ()
 
     add_bool( "ts-split-es", true, SPLIT_ES_TEXT, SPLIT_ES_LONGTEXT, false )
     add_bool( "ts-seek-percent", false, SEEK_PERCENT_TEXT, SEEK_PERCENT_LONGTEXT, true )
+    add_bool( "ts-seek-index", false, SEEK_INDEX_TEXT, SEEK_INDEX_LONGTEXT, true )
+    add_integer( "ts-workers", 0, WORKERS_TEXT, WORKERS_LONGTEXT, true )
+        change_integer_range( 0, 16 )
+    add_integer( "ts-batch", 0, BATCH_TEXT, BATCH_LONGTEXT, true )
+        change_integer_range( 0, 1024 )
 
     add_obsolete_bool( "ts-silent" );
 
@@ -249,6 +273,12 @@ typedef struct
     block_t     *p_data;
     block_t     **pp_last;
 
+    /* Batched reading: last block of p_data, where the payloads go while
+     * there is room, and the size of the previous PES */
+    block_t     *p_gather;
+    int         i_gather_room;
+    int         i_gather_hint;
+
     es_mpeg4_descriptor_t *p_mpeg4desc;
 
 } ts_es_t;
@@ -274,8 +304,66 @@ typedef struct
     ts_es_t     **extra_es;
     int         i_extra_es;
 
+    /* PES worker, -1 if not assigned yet */
+    int         i_worker;
+
 } ts_pid_t;
 
+/* A program clock reference, queued to every worker: it is sent by the last
+ * worker to reach it, once all the PES queued before it are sent */
+typedef struct
+{
+    int                  i_pending; /* workers yet to reach it, under pcr_lock */
+    int                  i_group;
+    mtime_t              i_pcr;
+} ts_pcr_job_t;
+
+/* A complete PES to parse and send, or a PCR */
+typedef struct ts_pes_job_t
+{
+    struct ts_pes_job_t *p_next;
+    ts_pid_t            *pid;
+    block_t             *p_pes;
+    mtime_t              i_pcr;
+    ts_pcr_job_t        *p_pcr_job;
+} ts_pes_job_t;
+
+/* How many PES may be waiting for a worker */
+#define TS_WORKER_QUEUE 64
+
+/* Parses and sends the PES of the PIDs assigned to it, in order.
+ * Everything else, including anything changing the ES of the PIDs,
+ * stays in the demuxer thread, after the workers are drained. */
+typedef struct
+{
+    demux_t         *p_demux;
+    vlc_thread_t    thread;
+    vlc_mutex_t     lock;
+    vlc_cond_t      wait;      /* For the worker */
+    vlc_cond_t      wait_done; /* For the demuxer */
+    ts_pes_job_t    *p_first;
+    ts_pes_job_t    **pp_last;
+    int             i_queued;
+    bool            b_busy;
+    bool            b_exit;
+} ts_worker_t;
+
+/* A reference PCR and the position of its packet. The PCR is adjusted for
+ * wrap around, so that it grows with the position. */
+typedef struct
+{
+    mtime_t         i_pcr;
+    int64_t         i_pos;
+} ts_index_entry_t;
+
+/* Minimum PCR distance between two index entries (500ms) */
+#define TS_INDEX_INTERVAL 45000
+
+/* Smallest block gathering the payloads of a PES of unknown size, and
+ * largest one allocated up front from the size of the previous PES */
+#define TS_GATHER_MIN (8 * 184)
+#define TS_GATHER_HINT_MAX (256 * 1024)
+
 struct demux_sys_t
 {
     vlc_mutex_t     csa_lock;
@@ -296,6 +384,14 @@ struct demux_sys_t
     mtime_t     *p_pcrs;
     int64_t     *p_pos;
 
+    /* Seek index, sorted by position */
+    bool        b_index;
+    int         i_index;
+    int         i_index_alloc;
+    ts_index_entry_t *p_index;
+    bool        b_index_dirty;
+    char        *psz_index_file; /* NULL if not saved */
+
     /* All pid */
     ts_pid_t    pid[8192];
 
@@ -331,6 +427,18 @@ struct demux_sys_t
 
     /* */
     bool        b_start_record;
+
+    /* PES workers */
+    int         i_workers;
+    ts_worker_t *workers;
+    int         i_next_worker;
+    vlc_mutex_t pcr_lock;
+
+    /* Batched packet reading */
+    int         i_batch;       /* packets per read, 0 if disabled */
+    uint8_t     *p_batch;
+    int         i_batch_pos;   /* next packet in p_batch */
+    int         i_batch_end;   /* end of the data in p_batch */
 };
 
 static int Demux    ( demux_t *p_demux );
@@ -352,21 +460,35 @@ static void PSINewTableCallBack( demux_t *, dvbpsi_handle,
 
 static int ChangeKeyCallback( vlc_object_t *, char const *, vlc_value_t, vlc_value_t, void * );
 
-static inline int PIDGet( block_t *p )
+static inline int PIDGet( const uint8_t *p )
 {
-    return ( (p->p_buffer[1]&0x1f)<<8 )|p->p_buffer[2];
+    return ( (p[1]&0x1f)<<8 )|p[2];
 }
 
-static bool GatherData( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk );
+static bool GatherData( demux_t *p_demux, ts_pid_t *pid, uint8_t *p_data,
+                        block_t *p_bk );
+
+static void WorkersStart( demux_t *p_demux, int i_count );
+static void WorkersStop( demux_t *p_demux );
+static void WorkersDrain( demux_t *p_demux );
+static void WorkerQueue( demux_t *p_demux, ts_pid_t *pid, block_t *p_pes,
+                         mtime_t i_pcr );
+static void WorkersQueuePCR( demux_t *p_demux, int i_group, mtime_t i_pcr );
 
 static block_t* ReadTSPacket( demux_t *p_demux );
-static mtime_t GetPCR( block_t *p_pkt );
+static uint8_t *ReadTSPacketBatch( demux_t *p_demux );
+static void BatchFlush( demux_t *p_demux );
+static int64_t TSTell( demux_t *p_demux );
+static mtime_t GetPCR( const uint8_t *p );
 static int SeekToPCR( demux_t *p_demux, int64_t i_pos );
+static void IndexAdd( demux_t *p_demux, mtime_t i_pcr, int64_t i_pos );
+static int IndexLoad( demux_t *p_demux );
+static void IndexSave( demux_t *p_demux );
 static int Seek( demux_t *p_demux, double f_percent );
 static void GetFirstPCR( demux_t *p_demux );
 static void GetLastPCR( demux_t *p_demux );
 static void CheckPCR( demux_t *p_demux );
-static void PCRHandle( demux_t *p_demux, ts_pid_t *, block_t * );
+static void PCRHandle( demux_t *p_demux, ts_pid_t *, const uint8_t * );
 
 static void              IODFree( iod_descriptor_t * );
 
@@ -598,6 +720,10 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_ts_read = 50;
     p_sys->csa = NULL;
     p_sys->b_start_record = false;
+    p_sys->i_batch = var_InheritInteger( p_demux, "ts-batch" );
+    p_sys->p_batch = NULL;
+    p_sys->i_batch_pos = 0;
+    p_sys->i_batch_end = 0;
 
 #if (DVBPSI_VERSION_INT >= DVBPSI_VERSION_WANTED(1,0,0))
 # define VLC_DVBPSI_DEMUX_TABLE_INIT(table,obj) \
@@ -795,7 +921,18 @@ static int Open( vlc_object_t *p_this )
 
     bool can_seek = false;
     stream_Control( p_demux->s, STREAM_CAN_FASTSEEK, &can_seek );
-    if( can_seek  )
+    p_sys->b_index = can_seek;
+    p_sys->i_index = 0;
+    p_sys->i_index_alloc = 0;
+    p_sys->p_index = NULL;
+    p_sys->b_index_dirty = false;
+    p_sys->psz_index_file = NULL;
+    if( can_seek && p_demux->psz_file &&
+        var_InheritBool( p_demux, "ts-seek-index" ) &&
+        asprintf( &p_sys->psz_index_file, "%s.tsidx", p_demux->psz_file ) < 0 )
+        p_sys->psz_index_file = NULL;
+
+    if( can_seek && IndexLoad( p_demux ) )
     {
         GetFirstPCR( p_demux );
         CheckPCR( p_demux );
@@ -806,6 +943,8 @@ static int Open( vlc_object_t *p_this )
         p_sys->b_force_seek_per_percent = true;
     }
 
+    WorkersStart( p_demux, var_InheritInteger( p_demux, "ts-workers" ) );
+
     while( p_sys->i_pmt_es <= 0 && vlc_object_alive( p_demux ) )
     {
         if( p_demux->pf_demux( p_demux ) != 1 )
@@ -823,6 +962,8 @@ static void Close( vlc_object_t *p_this )
     demux_t     *p_demux = (demux_t*)p_this;
     demux_sys_t *p_sys = p_demux->p_sys;
 
+    WorkersStop( p_demux );
+
     msg_Dbg( p_demux, "pid list:" );
     for( int i = 0; i < 8192; i++ )
     {
@@ -899,6 +1040,11 @@ static void Close( vlc_object_t *p_this )
     }
 
     free( p_sys->buffer );
+    free( p_sys->p_batch );
+
+    IndexSave( p_demux );
+    free( p_sys->psz_index_file );
+    free( p_sys->p_index );
 
     free( p_sys->p_pcrs );
     free( p_sys->p_pos );
@@ -941,10 +1087,21 @@ static int Demux( demux_t *p_demux )
     for( int i_pkt = 0; i_pkt < p_sys->i_ts_read; i_pkt++ )
     {
         bool         b_frame = false;
-        block_t     *p_pkt;
-        if( !(p_pkt = ReadTSPacket( p_demux )) )
+        block_t     *p_pkt = NULL;
+        uint8_t     *p_data;
+
+        /* In batched mode, the packet stays in the read buffer, and only its
+         * payload is copied by GatherData(), if needed */
+        if( p_sys->i_batch > 0 )
+        {
+            if( !(p_data = ReadTSPacketBatch( p_demux )) )
+                return 0;
+        }
+        else
         {
-            return 0;
+            if( !(p_pkt = ReadTSPacket( p_demux )) )
+                return 0;
+            p_data = p_pkt->p_buffer;
         }
 
         if( p_sys->b_start_record )
@@ -957,11 +1114,11 @@ static int Demux( demux_t *p_demux )
         if( p_sys->b_udp_out )
         {
             memcpy( &p_sys->buffer[i_pkt * p_sys->i_packet_size],
-                    p_pkt->p_buffer, p_sys->i_packet_size );
+                    p_data, p_sys->i_packet_size );
         }
 
         /* Parse the TS packet */
-        ts_pid_t *p_pid = &p_sys->pid[PIDGet( p_pkt )];
+        ts_pid_t *p_pid = &p_sys->pid[PIDGet( p_data )];
 
         if( p_pid->b_valid )
         {
@@ -969,26 +1126,28 @@ static int Demux( demux_t *p_demux )
             {
                 if( p_pid->i_pid == 0 || ( p_sys->b_dvb_meta && ( p_pid->i_pid == 0x11 || p_pid->i_pid == 0x12 || p_pid->i_pid == 0x14 ) ) )
                 {
-                    dvbpsi_PushPacket( p_pid->psi->handle, p_pkt->p_buffer );
+                    dvbpsi_PushPacket( p_pid->psi->handle, p_data );
                 }
                 else
                 {
                     for( int i_prg = 0; i_prg < p_pid->psi->i_prg; i_prg++ )
                     {
                         dvbpsi_PushPacket( p_pid->psi->prg[i_prg]->handle,
-                                           p_pkt->p_buffer );
+                                           p_data );
                     }
                 }
-                block_Release( p_pkt );
+                if( p_pkt )
+                    block_Release( p_pkt );
             }
             else if( !p_sys->b_udp_out )
             {
-                b_frame = GatherData( p_demux, p_pid, p_pkt );
+                b_frame = GatherData( p_demux, p_pid, p_data, p_pkt );
             }
             else
             {
-                PCRHandle( p_demux, p_pid, p_pkt );
-                block_Release( p_pkt );
+                PCRHandle( p_demux, p_pid, p_data );
+                if( p_pkt )
+                    block_Release( p_pkt );
             }
         }
         else
@@ -998,8 +1157,9 @@ static int Demux( demux_t *p_demux )
                 msg_Dbg( p_demux, "pid[%d] unknown", p_pid->i_pid );
             }
             /* We have to handle PCR if present */
-            PCRHandle( p_demux, p_pid, p_pkt );
-            block_Release( p_pkt );
+            PCRHandle( p_demux, p_pid, p_data );
+            if( p_pkt )
+                block_Release( p_pkt );
         }
         p_pid->b_seen = true;
 
@@ -1067,7 +1227,7 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
             if( !DVBEventInformation( p_demux, &i_time, &i_length ) && i_length > 0 )
                 *pf = (double)i_time/(double)i_length;
             else if( (i64 = stream_Size( p_demux->s) ) > 0 )
-                *pf = (double)stream_Tell( p_demux->s ) / (double)i64;
+                *pf = (double)TSTell( p_demux ) / (double)i64;
             else
                 *pf = 0.0;
         }
@@ -1080,6 +1240,9 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
     case DEMUX_SET_POSITION:
         f = (double) va_arg( args, double );
 
+        WorkersDrain( p_demux );
+        BatchFlush( p_demux );
+
         if( p_sys->b_force_seek_per_percent ||
             (p_sys->b_dvb_meta && p_sys->b_access_control) ||
             p_sys->i_last_pcr - p_sys->i_first_pcr <= 0 )
@@ -1418,6 +1581,7 @@ static void PIDInit( ts_pid_t *pid, bool b_psi, ts_psi_t *p_owner )
     pid->b_scrambled = false;
     pid->p_owner    = p_owner;
     pid->i_owner_number = 0;
+    pid->i_worker   = -1;
 
     TAB_INIT( pid->i_extra_es, pid->extra_es );
 
@@ -1542,7 +1706,8 @@ static void PIDClean( demux_t *p_demux, ts_pid_t *pid )
 /****************************************************************************
  * gathering stuff
  ****************************************************************************/
-static void ParsePES( demux_t *p_demux, ts_pid_t *pid, block_t *p_pes )
+static void ParsePES( demux_t *p_demux, ts_pid_t *pid, block_t *p_pes,
+                      mtime_t i_pcr )
 {
     uint8_t header[34];
     unsigned i_pes_size = 0;
@@ -1733,16 +1898,8 @@ static void ParsePES( demux_t *p_demux, ts_pid_t *pid, block_t *p_pes )
             {
                 /* Teletext may have missing PTS (ETSI EN 300 472 Annexe A)
                  * In this case use the last PCR + 40ms */
-                for( int i = 0; pid->p_owner && i < pid->p_owner->i_prg; i++ )
-                {
-                    if( pid->i_owner_number == pid->p_owner->prg[i]->i_number )
-                    {
-                        mtime_t i_pcr = pid->p_owner->prg[i]->i_pcr_value;
-                        if( i_pcr > VLC_TS_INVALID )
-                            p_block->i_pts = VLC_TS_0 + i_pcr * 100 / 9 + 40000;
-                        break;
-                    }
-                }
+                if( i_pcr > VLC_TS_INVALID )
+                    p_block->i_pts = VLC_TS_0 + i_pcr * 100 / 9 + 40000;
             }
         }
 
@@ -1813,14 +1970,32 @@ static void ParseData( demux_t *p_demux, ts_pid_t *pid )
     block_t *p_data = pid->es->p_data;
 
     /* remove the pes from pid */
+    pid->es->i_gather_hint = __MIN( pid->es->i_data_gathered,
+                                    TS_GATHER_HINT_MAX );
     pid->es->p_data = NULL;
     pid->es->i_data_size = 0;
     pid->es->i_data_gathered = 0;
     pid->es->pp_last = &pid->es->p_data;
+    pid->es->p_gather = NULL;
+    pid->es->i_gather_room = 0;
 
     if( pid->es->data_type == TS_ES_DATA_PES )
     {
-        ParsePES( p_demux, pid, p_data );
+        /* The PCR of the program, when the PES was completed */
+        mtime_t i_pcr = -1;
+        for( int i = 0; pid->p_owner && i < pid->p_owner->i_prg; i++ )
+        {
+            if( pid->i_owner_number == pid->p_owner->prg[i]->i_number )
+            {
+                i_pcr = pid->p_owner->prg[i]->i_pcr_value;
+                break;
+            }
+        }
+
+        if( p_demux->p_sys->i_workers > 0 )
+            WorkerQueue( p_demux, pid, p_data, i_pcr );
+        else
+            ParsePES( p_demux, pid, p_data, i_pcr );
     }
     else if( pid->es->data_type == TS_ES_DATA_TABLE_SECTION )
     {
@@ -1832,6 +2007,233 @@ static void ParseData( demux_t *p_demux, ts_pid_t *pid )
     }
 }
 
+/*****************************************************************************
+ * PES workers
+ *****************************************************************************/
+static void WorkerPCR( demux_t *p_demux, ts_pcr_job_t *p_pcr_job )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    vlc_mutex_lock( &p_sys->pcr_lock );
+    bool b_last = --p_pcr_job->i_pending == 0;
+    vlc_mutex_unlock( &p_sys->pcr_lock );
+
+    if( b_last )
+    {
+        es_out_Control( p_demux->out, ES_OUT_SET_GROUP_PCR,
+                        p_pcr_job->i_group, (int64_t)p_pcr_job->i_pcr );
+        free( p_pcr_job );
+    }
+}
+
+static void *WorkerThread( void *data )
+{
+    ts_worker_t *p_worker = (ts_worker_t *)data;
+
+    vlc_mutex_lock( &p_worker->lock );
+    for( ;; )
+    {
+        while( p_worker->p_first == NULL && !p_worker->b_exit )
+            vlc_cond_wait( &p_worker->wait, &p_worker->lock );
+
+        /* Pending PES are sent before leaving */
+        ts_pes_job_t *p_job = p_worker->p_first;
+        if( p_job == NULL )
+            break;
+
+        p_worker->p_first = p_job->p_next;
+        if( p_worker->p_first == NULL )
+            p_worker->pp_last = &p_worker->p_first;
+        p_worker->i_queued--;
+        p_worker->b_busy = true;
+        vlc_mutex_unlock( &p_worker->lock );
+
+        if( p_job->p_pcr_job != NULL )
+            WorkerPCR( p_worker->p_demux, p_job->p_pcr_job );
+        else
+            ParsePES( p_worker->p_demux, p_job->pid, p_job->p_pes, p_job->i_pcr );
+        free( p_job );
+
+        vlc_mutex_lock( &p_worker->lock );
+        p_worker->b_busy = false;
+        vlc_cond_broadcast( &p_worker->wait_done );
+    }
+    vlc_mutex_unlock( &p_worker->lock );
+    return NULL;
+}
+
+static void WorkersStart( demux_t *p_demux, int i_count )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    p_sys->i_workers = 0;
+    p_sys->i_next_worker = 0;
+    if( i_count <= 0 || p_sys->b_udp_out )
+        return;
+
+    p_sys->workers = (ts_worker_t *)calloc( i_count, sizeof(*p_sys->workers) );
+    if( !p_sys->workers )
+        return;
+    vlc_mutex_init( &p_sys->pcr_lock );
+
+    for( int i = 0; i < i_count; i++ )
+    {
+        ts_worker_t *p_worker = &p_sys->workers[p_sys->i_workers];
+
+        p_worker->p_demux = p_demux;
+        vlc_mutex_init( &p_worker->lock );
+        vlc_cond_init( &p_worker->wait );
+        vlc_cond_init( &p_worker->wait_done );
+        p_worker->p_first = NULL;
+        p_worker->pp_last = &p_worker->p_first;
+        p_worker->i_queued = 0;
+        p_worker->b_busy = false;
+        p_worker->b_exit = false;
+
+        if( vlc_clone( &p_worker->thread, WorkerThread, p_worker,
+                       VLC_THREAD_PRIORITY_INPUT ) )
+        {
+            vlc_cond_destroy( &p_worker->wait_done );
+            vlc_cond_destroy( &p_worker->wait );
+            vlc_mutex_destroy( &p_worker->lock );
+            break;
+        }
+        p_sys->i_workers++;
+    }
+    msg_Dbg( p_demux, "using %d PES worker threads", p_sys->i_workers );
+}
+
+static void WorkersStop( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    for( int i = 0; i < p_sys->i_workers; i++ )
+    {
+        ts_worker_t *p_worker = &p_sys->workers[i];
+
+        vlc_mutex_lock( &p_worker->lock );
+        p_worker->b_exit = true;
+        vlc_cond_signal( &p_worker->wait );
+        vlc_mutex_unlock( &p_worker->lock );
+
+        vlc_join( p_worker->thread, NULL );
+        vlc_cond_destroy( &p_worker->wait_done );
+        vlc_cond_destroy( &p_worker->wait );
+        vlc_mutex_destroy( &p_worker->lock );
+    }
+    if( p_sys->workers )
+        vlc_mutex_destroy( &p_sys->pcr_lock );
+    free( p_sys->workers );
+    p_sys->workers = NULL;
+    p_sys->i_workers = 0;
+}
+
+/**
+ * Waits until all the queued PES are sent.
+ */
+static void WorkersDrain( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    for( int i = 0; i < p_sys->i_workers; i++ )
+    {
+        ts_worker_t *p_worker = &p_sys->workers[i];
+
+        vlc_mutex_lock( &p_worker->lock );
+        while( p_worker->p_first != NULL || p_worker->b_busy )
+            vlc_cond_wait( &p_worker->wait_done, &p_worker->lock );
+        vlc_mutex_unlock( &p_worker->lock );
+    }
+}
+
+static void WorkerPush( ts_worker_t *p_worker, ts_pes_job_t *p_job )
+{
+    vlc_mutex_lock( &p_worker->lock );
+    while( p_worker->i_queued >= TS_WORKER_QUEUE )
+        vlc_cond_wait( &p_worker->wait_done, &p_worker->lock );
+    *p_worker->pp_last = p_job;
+    p_worker->pp_last = &p_job->p_next;
+    p_worker->i_queued++;
+    vlc_cond_signal( &p_worker->wait );
+    vlc_mutex_unlock( &p_worker->lock );
+}
+
+static void WorkerQueue( demux_t *p_demux, ts_pid_t *pid, block_t *p_pes,
+                         mtime_t i_pcr )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    /* A PID always uses the same worker, to keep its PES ordered */
+    if( pid->i_worker < 0 )
+        pid->i_worker = p_sys->i_next_worker++ % p_sys->i_workers;
+    ts_worker_t *p_worker = &p_sys->workers[pid->i_worker];
+
+    ts_pes_job_t *p_job = (ts_pes_job_t *)malloc( sizeof(*p_job) );
+    if( !p_job )
+    {
+        block_ChainRelease( p_pes );
+        return;
+    }
+    p_job->p_next = NULL;
+    p_job->pid = pid;
+    p_job->p_pes = p_pes;
+    p_job->i_pcr = i_pcr;
+    p_job->p_pcr_job = NULL;
+
+    WorkerPush( p_worker, p_job );
+}
+
+/**
+ * Sets the PCR of a program group after the PES already queued, so that the
+ * clock never runs ahead of the data it covers.
+ */
+static void WorkersQueuePCR( demux_t *p_demux, int i_group, mtime_t i_pcr )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    ts_pes_job_t *p_jobs = NULL;
+    int i;
+
+    ts_pcr_job_t *p_pcr_job = (ts_pcr_job_t *)malloc( sizeof(*p_pcr_job) );
+    for( i = 0; p_pcr_job && i < p_sys->i_workers; i++ )
+    {
+        ts_pes_job_t *p_job = (ts_pes_job_t *)malloc( sizeof(*p_job) );
+        if( !p_job )
+            break;
+        p_job->p_next = p_jobs;
+        p_job->pid = NULL;
+        p_job->p_pes = NULL;
+        p_job->i_pcr = -1;
+        p_job->p_pcr_job = p_pcr_job;
+        p_jobs = p_job;
+    }
+    if( i < p_sys->i_workers )
+    {
+        while( p_jobs )
+        {
+            ts_pes_job_t *p_next = p_jobs->p_next;
+            free( p_jobs );
+            p_jobs = p_next;
+        }
+        free( p_pcr_job );
+
+        WorkersDrain( p_demux );
+        es_out_Control( p_demux->out, ES_OUT_SET_GROUP_PCR, i_group,
+                        (int64_t)i_pcr );
+        return;
+    }
+
+    p_pcr_job->i_pending = p_sys->i_workers;
+    p_pcr_job->i_group = i_group;
+    p_pcr_job->i_pcr = i_pcr;
+    for( i = 0; i < p_sys->i_workers; i++ )
+    {
+        ts_pes_job_t *p_job = p_jobs;
+        p_jobs = p_job->p_next;
+        p_job->p_next = NULL;
+        WorkerPush( &p_sys->workers[i], p_job );
+    }
+}
+
 static block_t* ReadTSPacket( demux_t *p_demux )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
@@ -1889,6 +2291,99 @@ static block_t* ReadTSPacket( demux_t *p_demux )
     return p_pkt;
 }
 
+/* Drops the packets read ahead, e.g. before seeking */
+static void BatchFlush( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    p_sys->i_batch_pos = 0;
+    p_sys->i_batch_end = 0;
+}
+
+/* Reads the next batch, after the unused end of the current one */
+static int BatchFill( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    const int i_left = p_sys->i_batch_end - p_sys->i_batch_pos;
+    const int i_size = p_sys->i_batch * p_sys->i_packet_size;
+
+    /* Nothing points into the buffer, the payloads are copied out */
+    if( p_sys->p_batch == NULL )
+    {
+        p_sys->p_batch = (uint8_t *)malloc( i_size );			// sunqueen modify
+        if( unlikely(p_sys->p_batch == NULL) )
+            return VLC_ENOMEM;
+    }
+    if( i_left > 0 )
+        memmove( p_sys->p_batch, &p_sys->p_batch[p_sys->i_batch_pos], i_left );
+    p_sys->i_batch_pos = 0;
+
+    int i_read = stream_Read( p_demux->s, &p_sys->p_batch[i_left],
+                              i_size - i_left );
+    p_sys->i_batch_end = i_left + __MAX( i_read, 0 );
+    return i_read > 0 ? VLC_SUCCESS : VLC_EGENERIC;
+}
+
+static uint8_t *ReadTSPacketBatch( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    const int i_packet_size = p_sys->i_packet_size;
+    bool b_lost = false;
+
+    for( ;; )
+    {
+        if( p_sys->i_batch_end - p_sys->i_batch_pos < i_packet_size )
+        {
+            if( BatchFill( p_demux ) ||
+                p_sys->i_batch_end < i_packet_size )
+            {
+                msg_Dbg( p_demux, "eof ?" );
+                return NULL;
+            }
+        }
+
+        uint8_t *p_buffer = p_sys->p_batch;
+        uint8_t *p = &p_buffer[p_sys->i_batch_pos];
+        if( p[0] == 0x47 )
+        {
+            p_sys->i_batch_pos += i_packet_size;
+            return p;
+        }
+
+        /* Re-sync on two sync bytes one packet apart, within the batch */
+        if( !b_lost )
+            msg_Warn( p_demux, "lost synchro" );
+        b_lost = true;
+
+        const int i_start = p_sys->i_batch_pos;
+        int i_skip = i_start + 1;
+        while( i_skip < p_sys->i_batch_end - i_packet_size )
+        {
+            if( p_buffer[i_skip] == 0x47 &&
+                p_buffer[i_skip + i_packet_size] == 0x47 )
+                break;
+            i_skip++;
+        }
+        /* Otherwise keep the last packet worth of data for the next batch */
+        msg_Dbg( p_demux, "skipping %d bytes of garbage", i_skip - i_start );
+        p_sys->i_batch_pos = i_skip;
+
+        if( !vlc_object_alive( p_demux ) )
+            return NULL;
+    }
+}
+
+/* Stream position of the demuxer, not counting the packets read ahead */
+static int64_t TSTell( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    return stream_Tell( p_demux->s ) -
+           ( p_sys->i_batch_end - p_sys->i_batch_pos );
+}
+
 static mtime_t AdjustPCRWrapAround( demux_t *p_demux, mtime_t i_pcr )
 {
     demux_sys_t   *p_sys = p_demux->p_sys;
@@ -1897,7 +2392,7 @@ static mtime_t AdjustPCRWrapAround( demux_t *p_demux, mtime_t i_pcr )
      * So, need to add 0x1FFFFFFFF, for calculating duration or current position.
      */
     mtime_t i_adjust = 0;
-    int64_t i_pos = stream_Tell( p_demux->s );
+    int64_t i_pos = TSTell( p_demux );
     int i;
     for( i = 1; i < p_sys->i_pcrs_num && p_sys->p_pos[i] <= i_pos; ++i )
     {
@@ -1910,10 +2405,8 @@ static mtime_t AdjustPCRWrapAround( demux_t *p_demux, mtime_t i_pcr )
     return i_pcr + i_adjust;
 }
 
-static mtime_t GetPCR( block_t *p_pkt )
+static mtime_t GetPCR( const uint8_t *p )
 {
-    const uint8_t *p = p_pkt->p_buffer;
-
     mtime_t i_pcr = -1;
 
     if( ( p[3]&0x20 ) && /* adaptation */
@@ -1930,6 +2423,186 @@ static mtime_t GetPCR( block_t *p_pkt )
     return i_pcr;
 }
 
+static void IndexAdd( demux_t *p_demux, mtime_t i_pcr, int64_t i_pos )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( !p_sys->b_index || i_pos < 0 )
+        return;
+
+    /* First entry after the position */
+    int i_lo = 0, i_hi = p_sys->i_index;
+    while( i_lo < i_hi )
+    {
+        int i_mid = ( i_lo + i_hi ) / 2;
+        if( p_sys->p_index[i_mid].i_pos <= i_pos )
+            i_lo = i_mid + 1;
+        else
+            i_hi = i_mid;
+    }
+
+    /* Keep the entries apart, and the PCR growing with the position */
+    if( i_lo > 0 &&
+        i_pcr - p_sys->p_index[i_lo-1].i_pcr < TS_INDEX_INTERVAL )
+        return;
+    if( i_lo < p_sys->i_index &&
+        p_sys->p_index[i_lo].i_pcr - i_pcr < TS_INDEX_INTERVAL )
+        return;
+
+    if( p_sys->i_index >= p_sys->i_index_alloc )
+    {
+        int i_alloc = __MAX( 256, 2 * p_sys->i_index_alloc );
+        ts_index_entry_t *p_index = (ts_index_entry_t *)
+            realloc( p_sys->p_index, i_alloc * sizeof(*p_index) );
+        if( unlikely(p_index == NULL) )
+            return;
+        p_sys->p_index = p_index;
+        p_sys->i_index_alloc = i_alloc;
+    }
+    memmove( &p_sys->p_index[i_lo + 1], &p_sys->p_index[i_lo],
+             ( p_sys->i_index - i_lo ) * sizeof(*p_sys->p_index) );
+    p_sys->p_index[i_lo].i_pcr = i_pcr;
+    p_sys->p_index[i_lo].i_pos = i_pos;
+    p_sys->i_index++;
+    p_sys->b_index_dirty = true;
+}
+
+/* Index file: a header, the CheckPCR() table and the index entries, all
+ * big endian. It is only used for a file of the same size. */
+#define TS_INDEX_MAGIC "VLCTSIX1"
+#define TS_INDEX_HEADER_SIZE (8 + 8 + 4 + 4 + 8 + 8 + 4 + 4)
+
+static int IndexLoad( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( p_sys->psz_index_file == NULL )
+        return VLC_EGENERIC;
+
+    FILE *file = vlc_fopen( p_sys->psz_index_file, "rb" );
+    if( file == NULL )
+        return VLC_EGENERIC;
+
+    ts_index_entry_t *p_index = NULL;
+    int i_count = 0;
+    const int64_t i_size = stream_Size( p_demux->s );
+    uint8_t p_header[TS_INDEX_HEADER_SIZE];
+    if( fread( p_header, 1, sizeof(p_header), file ) != sizeof(p_header) ||
+        memcmp( p_header, TS_INDEX_MAGIC, 8 ) ||
+        (int64_t)GetQWBE( &p_header[8] ) != i_size ||
+        (int)GetDWBE( &p_header[16] ) != p_sys->i_packet_size ||
+        (int)GetDWBE( &p_header[40] ) != p_sys->i_pcrs_num ||
+        GetDWBE( &p_header[44] ) > INT_MAX / sizeof(*p_index)
+                                   - p_sys->i_pcrs_num )
+        goto error;
+
+    /* The CheckPCR() table comes first, it is only copied once the whole
+     * file is known to be valid */
+    i_count = GetDWBE( &p_header[44] );
+    p_index = (ts_index_entry_t *)malloc( ( p_sys->i_pcrs_num + i_count )
+                                          * sizeof(*p_index) );
+    if( unlikely(p_index == NULL) )
+        goto error;
+
+    for( int i = 0; i < p_sys->i_pcrs_num + i_count; i++ )
+    {
+        uint8_t p_entry[16];
+        if( fread( p_entry, 1, sizeof(p_entry), file ) != sizeof(p_entry) )
+            goto error;
+        p_index[i].i_pcr = GetQWBE( &p_entry[0] );
+        p_index[i].i_pos = GetQWBE( &p_entry[8] );
+        if( p_index[i].i_pos < 0 || p_index[i].i_pos >= i_size )
+            goto error;
+
+        /* IndexAdd() keeps both the PCR and the position growing */
+        if( i > p_sys->i_pcrs_num &&
+            ( p_index[i].i_pcr <= p_index[i-1].i_pcr ||
+              p_index[i].i_pos <= p_index[i-1].i_pos ) )
+            goto error;
+    }
+    fclose( file );
+
+    for( int i = 0; i < p_sys->i_pcrs_num; i++ )
+    {
+        p_sys->p_pcrs[i] = p_index[i].i_pcr;
+        p_sys->p_pos[i] = p_index[i].i_pos;
+    }
+    memmove( p_index, &p_index[p_sys->i_pcrs_num], i_count * sizeof(*p_index) );
+    if( i_count == 0 )
+    {
+        free( p_index );
+        p_index = NULL;
+    }
+
+    p_sys->i_pid_ref_pcr = (int32_t)GetDWBE( &p_header[20] );
+    p_sys->i_first_pcr = GetQWBE( &p_header[24] );
+    p_sys->i_current_pcr = p_sys->i_first_pcr;
+    p_sys->i_last_pcr = GetQWBE( &p_header[32] );
+    p_sys->p_index = p_index;
+    p_sys->i_index = p_sys->i_index_alloc = i_count;
+    msg_Dbg( p_demux, "loaded %d seek index entries from %s",
+             i_count, p_sys->psz_index_file );
+    return VLC_SUCCESS;
+
+error:
+    msg_Dbg( p_demux, "cannot use seek index %s", p_sys->psz_index_file );
+    free( p_index );
+    fclose( file );
+    return VLC_EGENERIC;
+}
+
+static void IndexSave( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( p_sys->psz_index_file == NULL || !p_sys->b_index_dirty ||
+        p_sys->i_first_pcr < 0 || p_sys->i_last_pcr < 0 )
+        return;
+
+    FILE *file = vlc_fopen( p_sys->psz_index_file, "wb" );
+    if( file == NULL )
+    {
+        msg_Warn( p_demux, "cannot write seek index %s",
+                  p_sys->psz_index_file );
+        return;
+    }
+
+    uint8_t p_header[TS_INDEX_HEADER_SIZE];
+    memcpy( p_header, TS_INDEX_MAGIC, 8 );
+    SetQWBE( &p_header[8], stream_Size( p_demux->s ) );
+    SetDWBE( &p_header[16], p_sys->i_packet_size );
+    SetDWBE( &p_header[20], p_sys->i_pid_ref_pcr );
+    SetQWBE( &p_header[24], p_sys->i_first_pcr );
+    SetQWBE( &p_header[32], p_sys->i_last_pcr );
+    SetDWBE( &p_header[40], p_sys->i_pcrs_num );
+    SetDWBE( &p_header[44], p_sys->i_index );
+    bool b_error = fwrite( p_header, 1, sizeof(p_header), file )
+                       != sizeof(p_header);
+
+    for( int i = 0; i < p_sys->i_pcrs_num + p_sys->i_index && !b_error; i++ )
+    {
+        uint8_t p_entry[16];
+        if( i < p_sys->i_pcrs_num )
+        {
+            SetQWBE( &p_entry[0], p_sys->p_pcrs[i] );
+            SetQWBE( &p_entry[8], p_sys->p_pos[i] );
+        }
+        else
+        {
+            SetQWBE( &p_entry[0], p_sys->p_index[i - p_sys->i_pcrs_num].i_pcr );
+            SetQWBE( &p_entry[8], p_sys->p_index[i - p_sys->i_pcrs_num].i_pos );
+        }
+        b_error = fwrite( p_entry, 1, sizeof(p_entry), file ) != sizeof(p_entry);
+    }
+
+    if( fclose( file ) || b_error )
+    {
+        msg_Warn( p_demux, "cannot write seek index %s",
+                  p_sys->psz_index_file );
+        vlc_unlink( p_sys->psz_index_file );
+    }
+}
+
 static int SeekToPCR( demux_t *p_demux, int64_t i_pos )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
@@ -1956,9 +2629,9 @@ static int SeekToPCR( demux_t *p_demux, int64_t i_pos )
         {
             break;
         }
-        if( PIDGet( p_pkt ) == p_sys->i_pid_ref_pcr )
+        if( PIDGet( p_pkt->p_buffer ) == p_sys->i_pid_ref_pcr )
         {
-            i_pcr = GetPCR( p_pkt );
+            i_pcr = GetPCR( p_pkt->p_buffer );
         }
         block_Release( p_pkt );
         if( i_pcr >= 0 )
@@ -2005,6 +2678,41 @@ static int Seek( demux_t *p_demux, double f_percent )
         i_head_pos = p_sys->p_pos[i-1];
         i_tail_pos = ( i < p_sys->i_pcrs_num ) ?  p_sys->p_pos[i] : stream_Size( p_demux->s );
     }
+    if( p_sys->i_index > 0 )
+    {
+        /* First index entry after the target */
+        const ts_index_entry_t *p_index = p_sys->p_index;
+        int i_lo = 0, i_hi = p_sys->i_index;
+        while( i_lo < i_hi )
+        {
+            int i_mid = ( i_lo + i_hi ) / 2;
+            if( p_index[i_mid].i_pcr <= i_target_pcr )
+                i_lo = i_mid + 1;
+            else
+                i_hi = i_mid;
+        }
+
+        /* An entry within the 500ms accepted below only needs one read */
+        int i_near = -1;
+        if( i_lo > 0 && i_target_pcr - p_index[i_lo-1].i_pcr <= 45000 )
+            i_near = i_lo - 1;
+        else if( i_lo < p_sys->i_index &&
+                 p_index[i_lo].i_pcr - i_target_pcr <= 45000 )
+            i_near = i_lo;
+
+        if( i_near >= 0 && !SeekToPCR( p_demux, p_index[i_near].i_pos ) )
+        {
+            p_sys->i_current_pcr = AdjustPCRWrapAround( p_demux, p_sys->i_current_pcr );
+            msg_Dbg( p_demux, "Seek():found in the index" );
+            return VLC_SUCCESS;
+        }
+
+        /* Otherwise, it still narrows the search */
+        if( i_lo > 0 && p_index[i_lo-1].i_pos > i_head_pos )
+            i_head_pos = p_index[i_lo-1].i_pos;
+        if( i_lo < p_sys->i_index && p_index[i_lo].i_pos < i_tail_pos )
+            i_tail_pos = p_index[i_lo].i_pos;
+    }
     msg_Dbg( p_demux, "Seek():i_head_pos:%"PRId64", i_tail_pos:%"PRId64, i_head_pos, i_tail_pos);
 
     bool b_found = false;
@@ -2015,6 +2723,8 @@ static int Seek( demux_t *p_demux, double f_percent )
         if( SeekToPCR( p_demux, i_pos ) )
             break;
         p_sys->i_current_pcr = AdjustPCRWrapAround( p_demux, p_sys->i_current_pcr );
+        IndexAdd( p_demux, p_sys->i_current_pcr,
+                  stream_Tell( p_demux->s ) - p_sys->i_packet_size );
         int64_t i_diff_msec = (p_sys->i_current_pcr - i_target_pcr) * 100 / 9 / 1000;
         if( i_diff_msec > 500 )
         {
@@ -2062,10 +2772,10 @@ static void GetFirstPCR( demux_t *p_demux )
         {
             break;
         }
-        mtime_t i_pcr = GetPCR( p_pkt );
+        mtime_t i_pcr = GetPCR( p_pkt->p_buffer );
         if( i_pcr >= 0 )
         {
-            p_sys->i_pid_ref_pcr = PIDGet( p_pkt );
+            p_sys->i_pid_ref_pcr = PIDGet( p_pkt->p_buffer );
             p_sys->i_first_pcr = i_pcr;
             p_sys->i_current_pcr = i_pcr;
         }
@@ -2150,19 +2860,23 @@ static void CheckPCR( demux_t *p_demux )
     p_sys->i_current_pcr = i_initial_pcr;
 }
 
-static void PCRHandle( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
+static void PCRHandle( demux_t *p_demux, ts_pid_t *pid, const uint8_t *p )
 {
     demux_sys_t   *p_sys = p_demux->p_sys;
 
     if( p_sys->i_pmt_es <= 0 )
         return;
 
-    mtime_t i_pcr = GetPCR( p_bk );
+    mtime_t i_pcr = GetPCR( p );
     if( i_pcr < 0 )
         return;
 
     if( p_sys->i_pid_ref_pcr == pid->i_pid )
+    {
         p_sys->i_current_pcr = AdjustPCRWrapAround( p_demux, i_pcr );
+        IndexAdd( p_demux, p_sys->i_current_pcr,
+                  TSTell( p_demux ) - p_sys->i_packet_size );
+    }
 
     /* Search program and set the PCR */
     for( int i = 0; i < p_sys->i_pmt; i++ )
@@ -2170,15 +2884,21 @@ static void PCRHandle( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
             if( pid->i_pid == p_sys->pmt[i]->psi->prg[i_prg]->i_pid_pcr )
             {
                 p_sys->pmt[i]->psi->prg[i_prg]->i_pcr_value = i_pcr;
-                es_out_Control( p_demux->out, ES_OUT_SET_GROUP_PCR,
+                if( p_sys->i_workers > 0 )
+                    WorkersQueuePCR( p_demux,
+                                     p_sys->pmt[i]->psi->prg[i_prg]->i_number,
+                                     VLC_TS_0 + i_pcr * 100 / 9 );
+                else
+                    es_out_Control( p_demux->out, ES_OUT_SET_GROUP_PCR,
                                 (int)p_sys->pmt[i]->psi->prg[i_prg]->i_number,
                                 (int64_t)(VLC_TS_0 + i_pcr * 100 / 9) );
             }
 }
 
-static bool GatherData( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
+static bool GatherData( demux_t *p_demux, ts_pid_t *pid, uint8_t *p_data,
+                        block_t *p_bk )
 {
-    const uint8_t *p = p_bk->p_buffer;
+    const uint8_t *p = p_data;
     const bool b_unit_start = p[1]&0x40;
     const bool b_scrambled  = p[3]&0x80;
     const bool b_adaptation = p[3]&0x20;
@@ -2196,10 +2916,6 @@ static bool GatherData( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
              b_payload, i_cc );
 #endif
 
-    /* For now, ignore additional error correction
-     * TODO: handle Reed-Solomon 204,188 error correction */
-    p_bk->i_buffer = TS_PACKET_SIZE_188;
-
     if( p[1]&0x80 )
     {
         msg_Dbg( p_demux, "transport_error_indicator set (pid=%d)",
@@ -2211,7 +2927,7 @@ static bool GatherData( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
     if( p_demux->p_sys->csa )
     {
         vlc_mutex_lock( &p_demux->p_sys->csa_lock );
-        csa_Decrypt( p_demux->p_sys->csa, p_bk->p_buffer, p_demux->p_sys->i_csa_pkt_size );
+        csa_Decrypt( p_demux->p_sys->csa, p_data, p_demux->p_sys->i_csa_pkt_size );
         vlc_mutex_unlock( &p_demux->p_sys->csa_lock );
     }
 
@@ -2277,11 +2993,12 @@ static bool GatherData( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
         }
     }
 
-    PCRHandle( p_demux, pid, p_bk );
+    PCRHandle( p_demux, pid, p );
 
     if( i_skip >= 188 || pid->es->id == NULL || p_demux->p_sys->b_udp_out )
     {
-        block_Release( p_bk );
+        if( p_bk )
+            block_Release( p_bk );
         return i_ret;
     }
 
@@ -2302,6 +3019,60 @@ static bool GatherData( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
                         pid->es->id, b_scrambled );
     }
 
+    /* A packet read in batch has its payload copied out now that it is
+     * needed, after the previous one of the PES when there is room */
+    int i_room = -1;
+    if( p_bk == NULL )
+    {
+        ts_es_t *es = pid->es;
+        const int i_payload = TS_PACKET_SIZE_188 - i_skip;
+
+        if( !b_unit_start )
+        {
+            if( es->p_data == NULL )
+                return i_ret;
+            if( es->i_gather_room < i_payload )
+            {
+                int i_size = ( es->i_data_size > es->i_data_gathered )
+                           ? es->i_data_size - es->i_data_gathered
+                           : __MAX( es->i_data_gathered, TS_GATHER_MIN );
+                i_size = __MAX( i_size, i_payload );
+
+                block_t *p_gather = block_Alloc( i_size );
+                if( unlikely(p_gather == NULL) )
+                    return i_ret;
+                p_gather->i_buffer = 0;
+                block_ChainLastAppend( &es->pp_last, p_gather );
+                es->p_gather = p_gather;
+                es->i_gather_room = i_size;
+            }
+            memcpy( &es->p_gather->p_buffer[es->p_gather->i_buffer],
+                    &p[i_skip], i_payload );
+            es->p_gather->i_buffer += i_payload;
+            es->i_gather_room -= i_payload;
+            es->i_data_gathered += i_payload;
+
+            if( es->i_data_size > 0 &&
+                es->i_data_gathered >= es->i_data_size )
+            {
+                ParseData( p_demux, pid );
+                i_ret = true;
+            }
+            return i_ret;
+        }
+
+        /* Room for a PES as large as the previous one */
+        const int i_size = TS_PACKET_SIZE_188 + es->i_gather_hint;
+        if( ( p_bk = block_Alloc( i_size ) ) == NULL )
+            return i_ret;
+        memcpy( p_bk->p_buffer, p_data, TS_PACKET_SIZE_188 );
+        i_room = i_size - TS_PACKET_SIZE_188;
+    }
+
+    /* For now, ignore additional error correction
+     * TODO: handle Reed-Solomon 204,188 error correction */
+    p_bk->i_buffer = TS_PACKET_SIZE_188;
+
     /* We have to gather it */
     p_bk->p_buffer += i_skip;
     p_bk->i_buffer -= i_skip;
@@ -2328,6 +3099,11 @@ static bool GatherData( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
         }
 
         block_ChainLastAppend( &pid->es->pp_last, p_bk );
+        if( i_room >= 0 )
+        {
+            pid->es->p_gather = p_bk;
+            pid->es->i_gather_room = i_room;
+        }
         if( pid->es->data_type == TS_ES_DATA_PES )
         {
             if( p_bk->i_buffer > 6 )
@@ -3492,6 +4268,9 @@ static void PMTSetupEsTeletext( demux_t *p_demux, ts_pid_t *pid,
                 p_es->i_data_size = 0;
                 p_es->i_data_gathered = 0;
                 p_es->pp_last = &p_es->p_data;
+                p_es->p_gather = NULL;
+                p_es->i_gather_room = 0;
+                p_es->i_gather_hint = 0;
                 p_es->data_type = TS_ES_DATA_PES;
                 p_es->p_mpeg4desc = NULL;
 
@@ -3576,6 +4355,9 @@ static void PMTSetupEsDvbSubtitle( demux_t *p_demux, ts_pid_t *pid,
                 p_es->i_data_size = 0;
                 p_es->i_data_gathered = 0;
                 p_es->pp_last = &p_es->p_data;
+                p_es->p_gather = NULL;
+                p_es->i_gather_room = 0;
+                p_es->i_gather_hint = 0;
                 p_es->data_type = TS_ES_DATA_PES;
                 p_es->p_mpeg4desc = NULL;
 
@@ -3938,6 +4720,9 @@ static void PMTCallBack( void *data, dvbpsi_pmt_t *p_pmt )
 
     msg_Dbg( p_demux, "PMTCallBack called" );
 
+    /* The ES may be changed */
+    WorkersDrain( p_demux );
+
     /* First find this PMT declared in PAT */
     for( int i = 0; !pmt && i < p_sys->i_pmt; i++ )
         for( int i_prg = 0; !pmt && i_prg < p_sys->pmt[i]->psi->i_prg; i_prg++ )
@@ -4199,6 +4984,9 @@ static void PATCallBack( void *data, dvbpsi_pat_t *p_pat )
 
     msg_Dbg( p_demux, "PATCallBack called" );
 
+    /* The ES may be changed */
+    WorkersDrain( p_demux );
+
     if( ( pat->psi->i_pat_version != -1 &&
             ( !p_pat->b_current_next ||
               p_pat->i_version == pat->psi->i_pat_version ) ) ||
@@ -50,6 +50,12 @@
     "Create \"Fast Start\" files. " \
     "\"Fast Start\" files are optimized for downloads and allow the user " \
     "to start previewing the file while it is downloading.")
+#define FRAGDURATION_TEXT N_("Fragment duration")
+#define FRAGDURATION_LONGTEXT N_( \
+    "Create fragmented files, made of moof/mdat fragments of at least " \
+    "this duration (in milliseconds), each starting on a video key frame. " \
+    "They are playable while being written and suitable for streaming. " \
+    "0 disables fragmentation.")
 
 static int  Open   ( vlc_object_t * );
 static void Close  ( vlc_object_t * );
@@ -65,6 +71,9 @@ vlc_module_begin ()
     add_bool( SOUT_CFG_PREFIX "faststart", true,
               FASTSTART_TEXT, FASTSTART_LONGTEXT,
               true )
+    add_integer( SOUT_CFG_PREFIX "frag-duration", 0,
+                 FRAGDURATION_TEXT, FRAGDURATION_LONGTEXT,
+                 true )
     set_capability( "sout mux", 5 )
     add_shortcut( "mp4", "mov", "3gp" )
     set_callbacks( Open, Close )
@@ -74,7 +83,7 @@ vlc_module_end ()
  * Exported prototypes
  *****************************************************************************/
 static const char *const ppsz_sout_options[] = {
-    "faststart", NULL
+    "faststart", "frag-duration", NULL
 };
 
 static int Control( sout_mux_t *, int, va_list );
@@ -117,6 +126,13 @@ typedef struct
 
     /* for spu */
     int64_t i_last_dts;
+    bool    b_started;
+
+    /* for fragmented files: samples of the current fragment */
+    block_t  *p_frag;
+    block_t  **pp_frag_last;
+    int64_t  i_frag_dts;            /* decoding time of the fragment */
+    int      i_trun_pos;            /* data offset to fix in the moof */
 
 } mp4_stream_t;
 
@@ -132,6 +148,13 @@ struct sout_mux_sys_t
 
     int64_t  i_dts_start;
 
+    /* fragmented files */
+    mtime_t  i_frag_duration;
+    mtime_t  i_frag_start;
+    uint32_t i_frag_seq;
+    bool     b_frag_video;
+    bool     b_moov_sent;
+
     int          i_nb_streams;
     mp4_stream_t **pp_streams;
 };
@@ -166,10 +189,13 @@ static void  box_free    ( bo_t *box );
 static void  box_gather  ( bo_t *box, bo_t *box2 );
 
 static void box_send( sout_mux_t *p_mux,  bo_t *box );
+static void box_send_header( sout_mux_t *p_mux,  bo_t *box );
 
 static block_t *bo_to_sout( bo_t *box );
 
 static bo_t *GetMoovBox( sout_mux_t *p_mux );
+static bo_t *GetMoofBox( sout_mux_t *p_mux );
+static void WriteFragment( sout_mux_t *p_mux );
 
 static block_t *ConvertSUBT( block_t *);
 static block_t *ConvertAVC1( block_t * );
@@ -199,31 +225,57 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_mdat_pos   = 0;
     p_sys->b_mov        = p_mux->psz_mux && !strcmp( p_mux->psz_mux, "mov" );
     p_sys->b_3gp        = p_mux->psz_mux && !strcmp( p_mux->psz_mux, "3gp" );
+    /* FIXME FIXME
+     * Quicktime actually doesn't like the 64 bits extensions !!! */
+    p_sys->b_64_ext     = false;
+    p_sys->b_fast_start = false;
     p_sys->i_dts_start  = 0;
-
+    p_sys->i_frag_start = VLC_TS_INVALID;
+    p_sys->i_frag_seq   = 0;
+    p_sys->b_frag_video = false;
+    p_sys->b_moov_sent  = false;
+
+    p_sys->i_frag_duration = INT64_C(1000) *
+        var_GetInteger( p_mux, SOUT_CFG_PREFIX "frag-duration" );
+    if( p_sys->i_frag_duration < 0 )
+        p_sys->i_frag_duration = 0;
+    if( p_sys->i_frag_duration > 0 && p_sys->b_mov )
+    {
+        msg_Warn( p_mux, "fragmented files are not supported with mov" );
+        p_sys->i_frag_duration = 0;
+    }
 
     if( !p_sys->b_mov )
     {
         /* Now add ftyp header */
         box = box_new( "ftyp" );
         if( p_sys->b_3gp ) bo_add_fourcc( box, "3gp6" );
+        else if( p_sys->i_frag_duration > 0 ) bo_add_fourcc( box, "iso6" );
         else bo_add_fourcc( box, "isom" );
         bo_add_32be  ( box, 0 );
         if( p_sys->b_3gp ) bo_add_fourcc( box, "3gp4" );
+        else if( p_sys->i_frag_duration > 0 ) bo_add_fourcc( box, "iso6" );
         else bo_add_fourcc( box, "mp41" );
         bo_add_fourcc( box, "avc1" );
-        bo_add_fourcc( box, "qt  " );
+        if( p_sys->i_frag_duration > 0 )
+            bo_add_fourcc( box, "isom" );
+        else
+            bo_add_fourcc( box, "qt  " );
         box_fix( box );
 
         p_sys->i_pos += box->i_buffer;
         p_sys->i_mdat_pos = p_sys->i_pos;
 
-        box_send( p_mux, box );
+        /* With the moov, the init data of a fragmented file */
+        if( p_sys->i_frag_duration > 0 )
+            box_send_header( p_mux, box );
+        else
+            box_send( p_mux, box );
     }
 
-    /* FIXME FIXME
-     * Quicktime actually doesn't like the 64 bits extensions !!! */
-    p_sys->b_64_ext = false;
+    /* The moov and the fragments are written as the samples come */
+    if( p_sys->i_frag_duration > 0 )
+        return VLC_SUCCESS;
 
     /* Now add mdat header */
     box = box_new( "mdat" );
@@ -252,6 +304,18 @@ static void Close( vlc_object_t * p_this )
 
     msg_Dbg( p_mux, "Close" );
 
+    if( p_sys->i_frag_duration > 0 )
+    {
+        /* Nothing to fix up, only the last fragment is left */
+        if( !p_sys->b_moov_sent )
+        {
+            box_send_header( p_mux, GetMoovBox( p_mux ) );
+            p_sys->b_moov_sent = true;
+        }
+        WriteFragment( p_mux );
+        goto cleanup;
+    }
+
     /* Update mdat size */
     bo_init( &bo, 0, NULL, true );
     if( p_sys->i_pos - p_sys->i_mdat_pos >= (((uint64_t)1)<<32) )
@@ -350,11 +414,13 @@ static void Close( vlc_object_t * p_this )
     sout_AccessOutSeek( p_mux->p_access, i_moov_pos );
     box_send( p_mux, moov );
 
+cleanup:
     /* Clean-up */
     for( i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++ )
     {
         mp4_stream_t *p_stream = p_sys->pp_streams[i_trak];
 
+        block_ChainRelease( p_stream->p_frag );
         es_format_Clean( &p_stream->fmt );
         free( p_stream->entry );
         free( p_stream );
@@ -368,8 +434,8 @@ static void Close( vlc_object_t * p_this )
  *****************************************************************************/
 static int Control( sout_mux_t *p_mux, int i_query, va_list args )
 {
-    VLC_UNUSED(p_mux);
     bool *pb_bool;
+    char **ppsz;
 
     switch( i_query )
     {
@@ -383,7 +449,13 @@ static int Control( sout_mux_t *p_mux, int i_query, va_list args )
             *pb_bool = true;
             return VLC_SUCCESS;
 
-        case MUX_GET_MIME:   /* Not needed, as not streamable */
+        case MUX_GET_MIME:   /* Only fragmented files are streamable */
+            if( p_mux->p_sys->i_frag_duration <= 0 )
+                return VLC_EGENERIC;
+            ppsz = (char**)va_arg( args, char ** );
+            *ppsz = strdup( "video/mp4" );
+            return VLC_SUCCESS;
+
         default:
             return VLC_EGENERIC;
     }
@@ -435,6 +507,11 @@ static int AddStream( sout_mux_t *p_mux, sout_input_t *p_input )
         calloc( p_stream->i_entry_max, sizeof( mp4_entry_t ) );			// sunqueen modify
     p_stream->i_dts_start   = 0;
     p_stream->i_duration    = 0;
+    p_stream->b_started     = false;
+    p_stream->p_frag        = NULL;
+    p_stream->pp_frag_last  = &p_stream->p_frag;
+    p_stream->i_frag_dts    = 0;
+    p_stream->i_trun_pos    = 0;
 
     p_input->p_sys          = p_stream;
 
@@ -474,6 +551,21 @@ static int Mux( sout_mux_t *p_mux )
             return( VLC_SUCCESS );
         }
 
+        /* All the streams are known now: describe them before the first
+         * fragment */
+        if( p_sys->i_frag_duration > 0 && !p_sys->b_moov_sent )
+        {
+            bo_t *moov = GetMoovBox( p_mux );
+
+            p_sys->i_pos += moov->i_buffer;
+            box_send_header( p_mux, moov );
+            p_sys->b_moov_sent = true;
+
+            for( int i = 0; i < p_sys->i_nb_streams; i++ )
+                if( p_sys->pp_streams[i]->fmt.i_cat == VIDEO_ES )
+                    p_sys->b_frag_video = true;
+        }
+
         p_input  = p_mux->pp_inputs[i_stream];
         p_stream = (mp4_stream_t*)p_input->p_sys;
 
@@ -518,8 +610,9 @@ again:
         }
 
         /* Save starting time */
-        if( p_stream->i_entry_count == 0 )
+        if( !p_stream->b_started )
         {
+            p_stream->b_started   = true;
             p_stream->i_dts_start = p_data->i_dts;
 
             /* Update global dts_start */
@@ -528,6 +621,9 @@ again:
             {
                 p_sys->i_dts_start = p_stream->i_dts_start;
             }
+
+            /* Fragments are timed from the earliest stream */
+            p_stream->i_frag_dts = p_stream->i_dts_start - p_sys->i_dts_start;
         }
 
         if( p_stream->fmt.i_cat == SPU_ES && p_stream->i_entry_count > 0 )
@@ -547,6 +643,21 @@ again:
             }
         }
 
+        /* Start a new fragment once long enough, on a video key frame if
+         * there is any video */
+        if( p_sys->i_frag_duration > 0 )
+        {
+            if( p_sys->i_frag_start != VLC_TS_INVALID &&
+                p_data->i_dts - p_sys->i_frag_start >= p_sys->i_frag_duration &&
+                ( p_stream->fmt.i_cat == VIDEO_ES ?
+                  ( p_data->i_flags & BLOCK_FLAG_TYPE_I ) != 0 :
+                  !p_sys->b_frag_video ) )
+            {
+                WriteFragment( p_mux );
+            }
+            if( p_sys->i_frag_start == VLC_TS_INVALID )
+                p_sys->i_frag_start = p_data->i_dts;
+        }
 
         /* add index entry */
         p_stream->entry[p_stream->i_entry_count].i_pos    = p_sys->i_pos;
@@ -572,8 +683,11 @@ again:
         /* Save the DTS */
         p_stream->i_last_dts = p_data->i_dts;
 
-        /* write data */
-        sout_AccessOutWrite( p_mux->p_access, p_data );
+        /* write data, or keep it until its fragment is complete */
+        if( p_sys->i_frag_duration > 0 )
+            block_ChainLastAppend( &p_stream->pp_frag_last, p_data );
+        else
+            sout_AccessOutWrite( p_mux->p_access, p_data );
 
         if( p_stream->fmt.i_cat == SPU_ES )
         {
@@ -605,7 +719,10 @@ again:
 
                 p_sys->i_pos += p_data->i_buffer;
 
-                sout_AccessOutWrite( p_mux->p_access, p_data );
+                if( p_sys->i_frag_duration > 0 )
+                    block_ChainLastAppend( &p_stream->pp_frag_last, p_data );
+                else
+                    sout_AccessOutWrite( p_mux->p_access, p_data );
             }
 
             /* Fix duration */
@@ -1661,50 +1778,54 @@ static bo_t *GetMoovBox( sout_mux_t *p_mux )
         box_gather( trak, tkhd );
 
         /* *** add /moov/trak/edts and elst */
-        edts = box_new( "edts" );
-        elst = box_full_new( "elst", p_sys->b_64_ext ? 1 : 0, 0 );
-        if( p_stream->i_dts_start > p_sys->i_dts_start )
+        /* fragmented files carry the start offset in their decoding times */
+        if( p_sys->i_frag_duration <= 0 )
         {
-            bo_add_32be( elst, 2 );
+            edts = box_new( "edts" );
+            elst = box_full_new( "elst", p_sys->b_64_ext ? 1 : 0, 0 );
+            if( p_stream->i_dts_start > p_sys->i_dts_start )
+            {
+                bo_add_32be( elst, 2 );
 
+                if( p_sys->b_64_ext )
+                {
+                    bo_add_64be( elst, (p_stream->i_dts_start-p_sys->i_dts_start) *
+                                 i_movie_timescale / INT64_C(1000000) );
+                    bo_add_64be( elst, -1 );
+                }
+                else
+                {
+                    bo_add_32be( elst, (p_stream->i_dts_start-p_sys->i_dts_start) *
+                                 i_movie_timescale / INT64_C(1000000) );
+                    bo_add_32be( elst, -1 );
+                }
+                bo_add_16be( elst, 1 );
+                bo_add_16be( elst, 0 );
+            }
+            else
+            {
+                bo_add_32be( elst, 1 );
+            }
             if( p_sys->b_64_ext )
             {
-                bo_add_64be( elst, (p_stream->i_dts_start-p_sys->i_dts_start) *
+                bo_add_64be( elst, p_stream->i_duration *
                              i_movie_timescale / INT64_C(1000000) );
-                bo_add_64be( elst, -1 );
+                bo_add_64be( elst, 0 );
             }
             else
             {
-                bo_add_32be( elst, (p_stream->i_dts_start-p_sys->i_dts_start) *
+                bo_add_32be( elst, p_stream->i_duration *
                              i_movie_timescale / INT64_C(1000000) );
-                bo_add_32be( elst, -1 );
+                bo_add_32be( elst, 0 );
             }
             bo_add_16be( elst, 1 );
             bo_add_16be( elst, 0 );
-        }
-        else
-        {
-            bo_add_32be( elst, 1 );
-        }
-        if( p_sys->b_64_ext )
-        {
-            bo_add_64be( elst, p_stream->i_duration *
-                         i_movie_timescale / INT64_C(1000000) );
-            bo_add_64be( elst, 0 );
-        }
-        else
-        {
-            bo_add_32be( elst, p_stream->i_duration *
-                         i_movie_timescale / INT64_C(1000000) );
-            bo_add_32be( elst, 0 );
-        }
-        bo_add_16be( elst, 1 );
-        bo_add_16be( elst, 0 );
 
-        box_fix( elst );
-        box_gather( edts, elst );
-        box_fix( edts );
-        box_gather( trak, edts );
+            box_fix( elst );
+            box_gather( edts, elst );
+            box_fix( edts );
+            box_gather( trak, edts );
+        }
 
         /* *** add /moov/trak/mdia *** */
         mdia = box_new( "mdia" );
@@ -1884,6 +2005,27 @@ static bo_t *GetMoovBox( sout_mux_t *p_mux )
         box_gather( moov, trak );
     }
 
+    /* *** add /moov/mvex: samples are in the fragments *** */
+    if( p_sys->i_frag_duration > 0 )
+    {
+        bo_t *mvex = box_new( "mvex" );
+
+        for( i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++ )
+        {
+            bo_t *trex = box_full_new( "trex", 0, 0 );
+
+            bo_add_32be( trex, p_sys->pp_streams[i_trak]->i_track_id );
+            bo_add_32be( trex, 1 );     // sample-description-index
+            bo_add_32be( trex, 0 );     // default sample duration
+            bo_add_32be( trex, 0 );     // default sample size
+            bo_add_32be( trex, 0 );     // default sample flags
+            box_fix( trex );
+            box_gather( mvex, trex );
+        }
+        box_fix( mvex );
+        box_gather( moov, mvex );
+    }
+
     /* Add user data tags */
     box_gather( moov, GetUdtaTag( p_mux ) );
 
@@ -1891,6 +2033,179 @@ static bo_t *GetMoovBox( sout_mux_t *p_mux )
     return moov;
 }
 
+/* Describe the samples of the current fragment. Every trun points to the
+ * data of its track, which follows in the mdat in the order of the trafs. */
+static bo_t *GetMoofBox( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    bo_t           *moof, *mfhd;
+    uint32_t       i_data_offset;
+    int            i_trak;
+    unsigned int   i;
+
+    moof = box_new( "moof" );
+
+    /* *** add /moof/mfhd *** */
+    mfhd = box_full_new( "mfhd", 0, 0 );
+    bo_add_32be( mfhd, ++p_sys->i_frag_seq );  // sequence number
+    box_fix( mfhd );
+    box_gather( moof, mfhd );
+
+    for( i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++ )
+    {
+        mp4_stream_t *p_stream = p_sys->pp_streams[i_trak];
+        bo_t         *traf, *tfhd, *tfdt, *trun;
+        uint32_t     i_timescale, i_flags;
+        int64_t      i_dts;
+
+        if( p_stream->i_entry_count == 0 )
+            continue;
+
+        if( p_stream->fmt.i_cat == AUDIO_ES )
+            i_timescale = p_stream->fmt.audio.i_rate;
+        else
+            i_timescale = CLOCK_FREQ;
+
+        /* *** add /moof/traf *** */
+        traf = box_new( "traf" );
+
+        tfhd = box_full_new( "tfhd", 0, 0x020000 ); // default-base-is-moof
+        bo_add_32be( tfhd, p_stream->i_track_id );
+        box_fix( tfhd );
+        box_gather( traf, tfhd );
+
+        tfdt = box_full_new( "tfdt", 1, 0 );
+        bo_add_64be( tfdt, p_stream->i_frag_dts * (int64_t)i_timescale /
+                           INT64_C(1000000) );   // base media decode time
+        box_fix( tfdt );
+        box_gather( traf, tfdt );
+
+        /* data offset, durations, sizes, flags, and composition offsets
+         * if any */
+        i_flags = 0x000701;
+        for( i = 0; i < p_stream->i_entry_count; i++ )
+            if( p_stream->entry[i].i_pts_dts > 0 )
+                i_flags |= 0x000800;
+
+        trun = box_full_new( "trun", 0, i_flags );
+        bo_add_32be( trun, p_stream->i_entry_count );
+        bo_add_32be( trun, 0 );     // data offset (fixed later)
+
+        /* durations are quantified from the start of the track, so that
+         * rounding errors do not add up */
+        for( i = 0, i_dts = p_stream->i_frag_dts;
+             i < p_stream->i_entry_count; i++ )
+        {
+            mp4_entry_t *entry = &p_stream->entry[i];
+            int64_t i_length = __MAX( entry->i_length, 0 );
+
+            bo_add_32be( trun, ( i_dts + i_length ) * i_timescale / INT64_C(1000000) -
+                               i_dts * i_timescale / INT64_C(1000000) );
+            bo_add_32be( trun, entry->i_size );
+            if( p_stream->fmt.i_cat != VIDEO_ES ||
+                ( entry->i_flags & BLOCK_FLAG_TYPE_I ) )
+                bo_add_32be( trun, 0x02000000 );  // does not depend on others
+            else
+                bo_add_32be( trun, 0x01010000 );  // depends on others, non sync
+            if( i_flags & 0x000800 )
+                bo_add_32be( trun, entry->i_pts_dts * i_timescale /
+                                   INT64_C(1000000) );
+            i_dts += i_length;
+        }
+        box_fix( trun );
+
+        p_stream->i_trun_pos = traf->i_buffer + 16;
+        box_gather( traf, trun );
+
+        box_fix( traf );
+        p_stream->i_trun_pos += moof->i_buffer;
+        box_gather( moof, traf );
+    }
+    box_fix( moof );
+
+    /* Now that the moof size is known, point to the data behind the mdat
+     * header */
+    i_data_offset = moof->i_buffer + 8;
+    for( i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++ )
+    {
+        mp4_stream_t *p_stream = p_sys->pp_streams[i_trak];
+
+        if( p_stream->i_entry_count == 0 )
+            continue;
+
+        bo_fix_32be( moof, p_stream->i_trun_pos, i_data_offset );
+        for( i = 0; i < p_stream->i_entry_count; i++ )
+            i_data_offset += p_stream->entry[i].i_size;
+    }
+
+    return moof;
+}
+
+/* Write the pending samples as a moof and its mdat, and start a new
+ * fragment. Only one fragment is ever kept in memory. */
+static void WriteFragment( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    block_t        *p_moof, *p_data;
+    bo_t           *moof, bo;
+    uint64_t       i_size = 0;
+    int64_t        i_length = 0;
+    int            i_trak;
+    unsigned int   i, i_count = 0;
+
+    for( i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++ )
+    {
+        mp4_stream_t *p_stream = p_sys->pp_streams[i_trak];
+        int64_t      i_stream_length = 0;
+
+        for( i = 0; i < p_stream->i_entry_count; i++ )
+        {
+            i_size += p_stream->entry[i].i_size;
+            i_stream_length += __MAX( p_stream->entry[i].i_length, 0 );
+        }
+        i_length = __MAX( i_length, i_stream_length );
+        i_count += p_stream->i_entry_count;
+    }
+    if( i_count == 0 )
+        return;
+
+    moof = GetMoofBox( p_mux );
+    p_sys->i_pos += moof->i_buffer + 8;
+
+    /* Fragments can be cut out from the moof, the headers being the ftyp
+     * and moov only */
+    p_moof = bo_to_sout( moof );
+    box_free( moof );
+    p_moof->i_flags |= BLOCK_FLAG_SEGMENT_START;
+    p_moof->i_dts    = p_sys->i_frag_start;
+    p_moof->i_length = i_length;
+    sout_AccessOutWrite( p_mux->p_access, p_moof );
+
+    bo_init( &bo, 8, NULL, false );
+    bo_add_32be  ( &bo, 8 + i_size );
+    bo_add_fourcc( &bo, "mdat" );
+    sout_AccessOutWrite( p_mux->p_access, bo_to_sout( &bo ) );
+    free( bo.p_buffer );
+
+    for( i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++ )
+    {
+        mp4_stream_t *p_stream = p_sys->pp_streams[i_trak];
+
+        while( ( p_data = p_stream->p_frag ) != NULL )
+        {
+            p_stream->p_frag = p_data->p_next;
+            p_data->p_next = NULL;
+            sout_AccessOutWrite( p_mux->p_access, p_data );
+        }
+        p_stream->pp_frag_last = &p_stream->p_frag;
+
+        for( i = 0; i < p_stream->i_entry_count; i++ )
+            p_stream->i_frag_dts += __MAX( p_stream->entry[i].i_length, 0 );
+        p_stream->i_entry_count = 0;
+    }
+    p_sys->i_frag_start = VLC_TS_INVALID;
+}
+
 /****************************************************************************/
 
 static void bo_init( bo_t *p_bo, int i_size, uint8_t *p_buffer,
@@ -2064,6 +2379,18 @@ static void box_send( sout_mux_t *p_mux,  bo_t *box )
     sout_AccessOutWrite( p_mux->p_access, p_buf );
 }
 
+/* Sends a box that access outputs keep for the clients joining late */
+static void box_send_header( sout_mux_t *p_mux,  bo_t *box )
+{
+    block_t *p_buf;
+
+    p_buf = bo_to_sout( box );
+    box_free( box );
+
+    p_buf->i_flags |= BLOCK_FLAG_HEADER;
+    sout_AccessOutWrite( p_mux->p_access, p_buf );
+}
+
 static int64_t get_timestamp(void)
 {
     int64_t i_timestamp = time(NULL);
@@ -35,49 +35,256 @@ using namespace dash::logic;
 using namespace dash::buffer;
 
 
-DASHDownloader::DASHDownloader  (HTTPConnectionManager *conManager, BlockBuffer *buffer)
+DASHDownloader::DASHDownloader  (HTTPConnectionManager *conManager, BlockBuffer *buffer, stream_t *stream) :
+                conManager      (conManager),
+                buffer          (buffer),
+                busy            (0),
+                exhausted       (false),
+                stopped         (false),
+                dashDLStarted   (false)
 {
-    this->t_sys                     = (thread_sys_t *) malloc(sizeof(thread_sys_t));
-    this->t_sys->conManager         = conManager;
-    this->t_sys->buffer             = buffer;
+    this->connections   = VLC_CLIP(var_InheritInteger(stream, "dash-connections"), 1, MAXCONNECTIONS);
+    this->pipeline      = VLC_CLIP(var_InheritInteger(stream, "dash-pipeline"), 1, MAXPIPELINE);
+    this->capacity      = var_InheritInteger(stream, "dash-buffersize") * 1000000;
+
+    if(this->capacity <= 0)
+        this->capacity = DEFAULTBUFFERLENGTH;
+
+    vlc_mutex_init(&this->lock);
+    vlc_cond_init(&this->wait);
 }
 DASHDownloader::~DASHDownloader ()
 {
-    this->t_sys->buffer->setEOF(true);
-    vlc_join(this->dashDLThread, NULL);
-    free(this->t_sys);
+    vlc_mutex_lock(&this->lock);
+    this->stopped = true;
+    vlc_cond_broadcast(&this->wait);
+    vlc_mutex_unlock(&this->lock);
+
+    this->buffer->setEOF(true);
+
+    if(this->dashDLStarted)
+        vlc_join(this->dashDLThread, NULL);
+    for(size_t i = 0; i < this->fetchThreads.size(); i++)
+        vlc_join(this->fetchThreads.at(i), NULL);
+
+    while(!this->queue.empty())
+    {
+        this->release(this->queue.front());
+        this->queue.pop_front();
+    }
+
+    vlc_cond_destroy(&this->wait);
+    vlc_mutex_destroy(&this->lock);
 }
 
 bool        DASHDownloader::start       ()
 {
-    if(vlc_clone(&(this->dashDLThread), download, (void*)this->t_sys, VLC_THREAD_PRIORITY_LOW))
+    if(vlc_clone(&(this->dashDLThread), download, (void*)this, VLC_THREAD_PRIORITY_LOW))
         return false;
+    this->dashDLStarted = true;
+
+    for(size_t i = 0; i < this->connections; i++)
+    {
+        vlc_thread_t thread;
+
+        if(vlc_clone(&thread, fetch, (void*)this, VLC_THREAD_PRIORITY_LOW))
+            break;
+        this->fetchThreads.push_back(thread);
+    }
+
+    return !this->fetchThreads.empty();
+}
+/* Called with the lock held: queues the next chunk if the window allows */
+download_t* DASHDownloader::claim       ()
+{
+    if(this->stopped || this->exhausted ||
+       this->queue.size() >= this->connections * this->pipeline)
+        return NULL;
+
+    Chunk *chunk = this->conManager->getNextChunk();
 
-    return true;
+    if(chunk == NULL)
+    {
+        this->exhausted = true;
+        vlc_cond_broadcast(&this->wait);
+        return NULL;
+    }
+
+    download_t *dl  = new download_t;
+    dl->chunk       = chunk;
+    dl->blocks      = NULL;
+    dl->last        = &dl->blocks;
+    dl->requested   = false;
+    dl->done        = false;
+    dl->bytes       = 0;
+    dl->queued      = 0;
+    dl->time        = 0;
+
+    /* the buffer duration at the chunk bitrate, shared by the window */
+    dl->limit       = this->capacity * chunk->getBitrate() / 8 / 1000000 /
+                      (int64_t)(this->connections * this->pipeline);
+    if(dl->limit < BLOCKSIZE)
+        dl->limit = BLOCKSIZE;
+
+    this->queue.push_back(dl);
+    return dl;
 }
-void*       DASHDownloader::download    (void *thread_sys)
+void        DASHDownloader::release     (download_t *dl)
 {
-    thread_sys_t            *t_sys              = (thread_sys_t *) thread_sys;
-    HTTPConnectionManager   *conManager         = t_sys->conManager;
-    BlockBuffer             *buffer             = t_sys->buffer;
-    block_t                 *block              = block_Alloc(BLOCKSIZE);
-    int                     ret                 = 0;
+    block_ChainRelease(dl->blocks);
+    delete dl->chunk;
+    delete dl;
+}
+void*       DASHDownloader::download    (void *data)
+{
+    DASHDownloader  *d = (DASHDownloader *) data;
 
-    do
+    vlc_mutex_lock(&d->lock);
+    for(;;)
     {
-        ret = conManager->read(block);
-        if(ret > 0)
+        while(!d->stopped && (d->queue.empty() ? !d->exhausted :
+              d->queue.front()->blocks == NULL && !d->queue.front()->done))
+            vlc_cond_wait(&d->wait, &d->lock);
+
+        if(d->stopped || d->queue.empty())
+            break;
+
+        download_t  *dl     = d->queue.front();
+        block_t     *block  = dl->blocks;
+        bool        done    = dl->done;
+
+        dl->blocks  = NULL;
+        dl->last    = &dl->blocks;
+        dl->queued  = 0;
+        if(done)
+            d->queue.pop_front();
+        vlc_cond_broadcast(&d->wait);
+        vlc_mutex_unlock(&d->lock);
+
+        while(block != NULL)
+        {
+            block_t *next = block->p_next;
+
+            block->p_next = NULL;
+            d->buffer->put(block);
+            block = next;
+        }
+        if(done)
+            d->release(dl);
+
+        vlc_mutex_lock(&d->lock);
+    }
+    vlc_mutex_unlock(&d->lock);
+
+    d->buffer->setEOF(true);
+
+    return NULL;
+}
+void*       DASHDownloader::fetch       (void *data)
+{
+    DASHDownloader          *d      = (DASHDownloader *) data;
+    PersistentConnection    *con    = NULL;
+    std::deque<download_t *> mine;
+    uint8_t                 *buf    = new uint8_t[BLOCKSIZE];
+
+    vlc_mutex_lock(&d->lock);
+    while(!d->stopped)
+    {
+        /* Requests are sent ahead, in order, as long as they share the host of
+         * the connection; the others wait for their turn to reconnect. */
+        download_t *dl;
+        while(mine.size() < d->pipeline && (dl = d->claim()) != NULL)
+        {
+            if(mine.empty())
+                d->busy++;
+            mine.push_back(dl);
+            vlc_mutex_unlock(&d->lock);
+
+            if(mine.size() == 1 || mine.at(mine.size() - 2)->requested)
+            {
+                if(con == NULL)
+                    con = d->conManager->openConnection();
+                dl->requested = con->addChunk(dl->chunk);
+            }
+
+            vlc_mutex_lock(&d->lock);
+        }
+
+        if(mine.empty())
+        {
+            if(d->exhausted)
+                break;
+            vlc_cond_wait(&d->wait, &d->lock);
+            continue;
+        }
+
+        dl = mine.front();
+        if(dl->queued >= dl->limit)
+        {   /* wait for the download thread to take the blocks */
+            vlc_cond_wait(&d->wait, &d->lock);
+            continue;
+        }
+        vlc_mutex_unlock(&d->lock);
+
+        if(!dl->requested)
+        {
+            if(con != NULL)
+                d->conManager->closeConnection(con);
+            con = d->conManager->openConnection();
+            for(size_t i = 0; i < mine.size() && (i == 0 || mine.at(i - 1)->requested); i++)
+                mine.at(i)->requested = con->addChunk(mine.at(i)->chunk);
+        }
+
+        int     ret     = -1;
+        mtime_t start   = mdate();
+        if(dl->requested)
+            ret = con->read(buf, BLOCKSIZE);
+        double  time    = ((double)(mdate() - start)) / 1000000;
+
+        block_t *block  = (ret > 0) ? block_Alloc(ret) : NULL;
+
+        vlc_mutex_lock(&d->lock);
+        /* concurrent downloads share the link */
+        time /= d->busy;
+
+        if(block != NULL)
+        {
+            memcpy(block->p_buffer, buf, ret);
+            block->i_length = (mtime_t)((ret * 8) / ((float)dl->chunk->getBitrate() / 1000000));
+
+            *dl->last   = block;
+            dl->last    = &block->p_next;
+            dl->bytes  += ret;
+            dl->queued += ret;
+            dl->time   += time;
+
+            d->conManager->updateStatistics(ret, time);
+        }
+        else
         {
-            block_t *bufBlock = block_Alloc(ret);
-            memcpy(bufBlock->p_buffer, block->p_buffer, ret);
+            if(ret == 0)
+                d->conManager->chunkDownloaded(dl->bytes, dl->time);
+            else if(con != NULL)
+            {
+                /* the pipelined requests went down with the connection */
+                d->conManager->closeConnection(con);
+                con = NULL;
+                for(size_t i = 0; i < mine.size(); i++)
+                    mine.at(i)->requested = false;
+            }
 
-            bufBlock->i_length = block->i_length;
-            buffer->put(bufBlock);
+            dl->done = true;
+            mine.pop_front();
+            if(mine.empty())
+                d->busy--;
         }
-    }while(ret && !buffer->getEOF());
+        vlc_cond_broadcast(&d->wait);
+    }
+    if(!mine.empty())
+        d->busy--;
+    vlc_mutex_unlock(&d->lock);
 
-    buffer->setEOF(true);
-    block_Release(block);
+    delete[] buf;
 
     return NULL;
 }
@@ -31,29 +31,65 @@
 
 #define BLOCKSIZE           32768
 #define CHUNKDEFAULTBITRATE 1
+#define MAXCONNECTIONS      8
+#define MAXPIPELINE         8
 
 #include <iostream>
+#include <deque>
+#include <vector>
 
 namespace dash
 {
-    struct thread_sys_t
+    /* A chunk being downloaded, and what was not yet put in the buffer */
+    struct download_t
     {
-        dash::http::HTTPConnectionManager   *conManager;
-        buffer::BlockBuffer                 *buffer;
+        http::Chunk *chunk;
+        block_t     *blocks;
+        block_t     **last;
+        bool        requested;
+        bool        done;
+        int64_t     bytes;
+        int64_t     queued;     /* bytes in blocks */
+        int64_t     limit;      /* queued bytes the fetch thread may reach */
+        double      time;
     };
 
+    /*
+     * The fetch threads each own a persistent connection. They request up to
+     * "dash-pipeline" chunks ahead on it, and append what they read to the
+     * chunk in the download queue. The download thread moves the blocks to
+     * the BlockBuffer, following the queue, so that they stay in order.
+     * Each chunk may only queue its share of "dash-buffersize" meanwhile.
+     */
     class DASHDownloader
     {
         public:
-            DASHDownloader          (http::HTTPConnectionManager *conManager, buffer::BlockBuffer *buffer);
+            DASHDownloader          (http::HTTPConnectionManager *conManager, buffer::BlockBuffer *buffer,
+                                     stream_t *stream);
             virtual ~DASHDownloader ();
 
             bool            start       ();
             static void*    download    (void *);
+            static void*    fetch       (void *);
 
         private:
-            thread_sys_t    *t_sys;
-            vlc_thread_t    dashDLThread;
+            http::HTTPConnectionManager *conManager;
+            buffer::BlockBuffer         *buffer;
+            vlc_mutex_t                 lock;
+            vlc_cond_t                  wait;
+            std::deque<download_t *>    queue;
+            size_t                      connections;
+            size_t                      pipeline;
+            mtime_t                     capacity;
+            size_t                      busy;
+            bool                        exhausted;
+            bool                        stopped;
+            bool                        dashDLStarted;
+            vlc_thread_t                dashDLThread;
+            std::vector<vlc_thread_t>   fetchThreads;
+
+            download_t*     claim       ();
+            void            release     (download_t *dl);
     };
 }
 
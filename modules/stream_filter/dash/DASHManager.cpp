@@ -72,7 +72,7 @@ bool    DASHManager::start()
 
     this->conManager = new dash::http::HTTPConnectionManager(this->adaptationLogic, this->stream);
     this->buffer     = new BlockBuffer(this->stream);
-    this->downloader = new DASHDownloader(this->conManager, this->buffer);
+    this->downloader = new DASHDownloader(this->conManager, this->buffer, this->stream);
 
     this->conManager->attach(this->adaptationLogic);
     this->buffer->attach(this->adaptationLogic);
@@ -69,3 +69,7 @@ int AbstractAdaptationLogic::getBufferPercent        () const
 {
     return this->bufferedPercent;
 }
+mtime_t AbstractAdaptationLogic::getBufferedMicroSec () const
+{
+    return this->bufferedMicroSec;
+}
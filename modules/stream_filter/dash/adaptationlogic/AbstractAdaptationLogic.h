@@ -52,6 +52,7 @@ namespace dash
                 uint64_t                    getBpsAvg               () const;
                 uint64_t                    getBpsLastChunk         () const;
                 int                         getBufferPercent        () const;
+                mtime_t                     getBufferedMicroSec     () const;
 
             private:
                 int                     bpsAvg;
@@ -0,0 +1,215 @@
+/*
+ * BufferBasedAdaptationLogic.cpp
+ *****************************************************************************
+ * Copyright (C) 2010 - 2011 Klagenfurt University
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#include "stdafx.h"
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "BufferBasedAdaptationLogic.h"
+#include "buffer/BlockBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace dash::logic;
+using namespace dash::http;
+using namespace dash::mpd;
+
+static bool compareBandwidth (const Representation *a, const Representation *b)
+{
+    return a->getBandwidth() < b->getBandwidth();
+}
+
+BufferBasedAdaptationLogic::BufferBasedAdaptationLogic  (IMPDManager *mpdManager, stream_t *stream) :
+                            AbstractAdaptationLogic     (mpdManager, stream),
+                            mpdManager                  (mpdManager),
+                            count                       (0),
+                            currentPeriod               (mpdManager->getFirstPeriod()),
+                            currentRepresentation       (NULL),
+                            width                       (0),
+                            height                      (0),
+                            bpsEstimate                 (0),
+                            bpsLastSample               (0),
+                            startup                     (true)
+{
+    this->width     = var_InheritInteger(stream, "dash-prefwidth");
+    this->height    = var_InheritInteger(stream, "dash-prefheight");
+    this->capacity  = var_InheritInteger(stream, "dash-buffersize");
+
+    if(this->capacity <= 0)
+        this->capacity = DEFAULTBUFFERLENGTH / 1000000;
+}
+
+size_t  BufferBasedAdaptationLogic::bolaIndex       (const std::vector<uint64_t> &bitrates,
+                                                     double buffered, double capacity)
+{
+    if(bitrates.size() <= 1)
+        return 0;
+
+    double minBuffer = std::min((double)BOLA_MINBUFFER, capacity / 3);
+    double uMax      = log((double)bitrates.back() / bitrates.front()) + 1;
+    double gp        = (uMax - 1) / (capacity / minBuffer - 1);
+    double V         = minBuffer / gp;
+
+    size_t  best        = 0;
+    double  bestScore   = 0;
+    for(size_t i = 0; i < bitrates.size(); i++)
+    {
+        double u     = log((double)bitrates.at(i) / bitrates.front()) + 1;
+        double score = (V * (u + gp) - buffered) / bitrates.at(i);
+
+        if(i == 0 || score >= bestScore)
+        {
+            best      = i;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+size_t  BufferBasedAdaptationLogic::throughputIndex (const std::vector<uint64_t> &bitrates,
+                                                     uint64_t bps)
+{
+    size_t best = 0;
+
+    for(size_t i = 0; i < bitrates.size(); i++)
+        if(bitrates.at(i) <= bps * BOLA_SAFETY)
+            best = i;
+    return best;
+}
+
+void    BufferBasedAdaptationLogic::bufferLevelChanged  (mtime_t bufferedMicroSec, int bufferedPercent)
+{
+    AbstractAdaptationLogic::bufferLevelChanged(bufferedMicroSec, bufferedPercent);
+
+    /* rebuffering: start over */
+    if(bufferedMicroSec == 0)
+        this->startup = true;
+}
+
+std::vector<Representation *>   BufferBasedAdaptationLogic::getCandidates   () const
+{
+    std::vector<AdaptationSet *>    adaptationSets = this->currentPeriod->getAdaptationSets();
+    std::vector<Representation *>   all, resMatch;
+
+    for(size_t i = 0; i < adaptationSets.size(); i++)
+    {
+        std::vector<Representation *> reps = adaptationSets.at(i)->getRepresentations();
+        for(size_t j = 0; j < reps.size(); j++)
+        {
+            all.push_back(reps.at(j));
+            if(reps.at(j)->getWidth() == this->width && reps.at(j)->getHeight() == this->height)
+                resMatch.push_back(reps.at(j));
+        }
+    }
+
+    std::vector<Representation *> &candidates = resMatch.empty() ? all : resMatch;
+    std::stable_sort(candidates.begin(), candidates.end(), compareBandwidth);
+    return candidates;
+}
+
+Representation* BufferBasedAdaptationLogic::select  ()
+{
+    std::vector<Representation *> reps = this->getCandidates();
+    if(reps.empty())
+        return NULL;
+
+    std::vector<uint64_t> bitrates;
+    for(size_t i = 0; i < reps.size(); i++)
+        bitrates.push_back(reps.at(i)->getBandwidth());
+
+    /* average the throughput over the last chunks */
+    uint64_t sample = this->getBpsLastChunk();
+    if(sample != 0 && sample != this->bpsLastSample)
+    {
+        if(this->bpsEstimate == 0)
+            this->bpsEstimate = sample;
+        else
+            this->bpsEstimate = BOLA_EWMA_ALPHA * sample + (1 - BOLA_EWMA_ALPHA) * this->bpsEstimate;
+        this->bpsLastSample = sample;
+    }
+    uint64_t bps = (this->bpsEstimate != 0) ? this->bpsEstimate : this->getBpsAvg();
+
+    double  buffered    = (double)this->getBufferedMicroSec() / 1000000;
+    size_t  rateIndex   = throughputIndex(bitrates, bps);
+
+    if(this->startup)
+    {
+        if(buffered < std::min((double)BOLA_MINBUFFER, this->capacity / 3))
+            return reps.at(rateIndex);
+        this->startup = false;
+    }
+
+    size_t index = bolaIndex(bitrates, buffered, this->capacity);
+
+    /* do not switch up beyond what the link sustains */
+    size_t previous = 0;
+    while(previous < reps.size() && reps.at(previous) != this->currentRepresentation)
+        previous++;
+    if(previous < reps.size() && index > previous)
+        index = std::max(previous, std::min(index, rateIndex));
+
+    return reps.at(index);
+}
+
+Chunk*  BufferBasedAdaptationLogic::getNextChunk()
+{
+    if(this->mpdManager == NULL)
+        return NULL;
+
+    if(this->currentPeriod == NULL)
+        return NULL;
+
+    Representation *rep = this->select();
+
+    if ( rep == NULL )
+        return NULL;
+
+    this->currentRepresentation = rep;
+
+    std::vector<Segment *> segments = this->mpdManager->getSegments(rep);
+
+    if ( this->count == segments.size() )
+    {
+        this->currentPeriod = this->mpdManager->getNextPeriod(this->currentPeriod);
+        this->count = 0;
+        return this->getNextChunk();
+    }
+
+    if ( segments.size() > this->count )
+    {
+        Segment *seg = segments.at( this->count );
+        Chunk *chunk = seg->toChunk();
+        //In case of UrlTemplate, we must stay on the same segment.
+        if ( seg->isSingleShot() == true )
+            this->count++;
+        seg->done();
+        return chunk;
+    }
+    return NULL;
+}
+
+const Representation *BufferBasedAdaptationLogic::getCurrentRepresentation() const
+{
+    if(this->currentRepresentation != NULL)
+        return this->currentRepresentation;
+    return this->mpdManager->getRepresentation( this->currentPeriod, this->getBpsAvg() );
+}
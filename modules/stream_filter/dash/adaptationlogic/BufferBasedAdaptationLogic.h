@@ -0,0 +1,92 @@
+/*
+ * BufferBasedAdaptationLogic.h
+ *****************************************************************************
+ * Copyright (C) 2010 - 2011 Klagenfurt University
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef BUFFERBASEDADAPTATIONLOGIC_H_
+#define BUFFERBASEDADAPTATIONLOGIC_H_
+
+#include "adaptationlogic/AbstractAdaptationLogic.h"
+#include "mpd/IMPDManager.h"
+#include "http/Chunk.h"
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+
+#include <vector>
+
+/* seconds of buffer under which the lowest representation is chosen */
+#define BOLA_MINBUFFER      10
+/* fraction of the measured throughput a representation may use */
+#define BOLA_SAFETY         0.9
+/* weight of the last chunk in the throughput average */
+#define BOLA_EWMA_ALPHA     0.3
+
+namespace dash
+{
+    namespace logic
+    {
+        /*
+         * BOLA: the representation maximizing (V * (utility + gp) - buffer)
+         * / bitrate is chosen, with the logarithm of the bitrate as utility.
+         * The less is buffered, the more low bitrates are favoured. During
+         * startup, and after rebuffering, the throughput decides alone until
+         * enough is buffered. Up-switches are capped by the throughput.
+         */
+        class BufferBasedAdaptationLogic : public AbstractAdaptationLogic
+        {
+            public:
+                BufferBasedAdaptationLogic          (dash::mpd::IMPDManager *mpdManager, stream_t *stream);
+
+                dash::http::Chunk*                  getNextChunk            ();
+                const dash::mpd::Representation*    getCurrentRepresentation() const;
+                virtual void                        bufferLevelChanged      (mtime_t bufferedMicroSec, int bufferedPercent);
+
+                /**
+                 *  \param  bitrates    ascending bitrates in bits per second
+                 *  \param  buffered    buffer level in seconds
+                 *  \param  capacity    buffer size in seconds
+                 *  \return index of the BOLA choice
+                 */
+                static size_t                       bolaIndex               (const std::vector<uint64_t> &bitrates,
+                                                                             double buffered, double capacity);
+                /**
+                 *  \return index of the highest bitrate the throughput sustains
+                 */
+                static size_t                       throughputIndex         (const std::vector<uint64_t> &bitrates,
+                                                                             uint64_t bps);
+
+            private:
+                dash::mpd::IMPDManager              *mpdManager;
+                size_t                              count;
+                dash::mpd::Period                   *currentPeriod;
+                dash::mpd::Representation           *currentRepresentation;
+                int                                 width;
+                int                                 height;
+                double                              capacity;
+                uint64_t                            bpsEstimate;
+                uint64_t                            bpsLastSample;
+                bool                                startup;
+
+                std::vector<dash::mpd::Representation *>    getCandidates   () const;
+                dash::mpd::Representation*                  select          ();
+        };
+    }
+}
+
+#endif /* BUFFERBASEDADAPTATIONLOGIC_H_ */
@@ -59,6 +59,24 @@ static void Close   (vlc_object_t *);
 #define DASH_BUFFER_TEXT N_("Buffer Size (Seconds)")
 #define DASH_BUFFER_LONGTEXT N_("Buffer size in seconds")
 
+#define DASH_CONNECTIONS_TEXT N_("Connections")
+#define DASH_CONNECTIONS_LONGTEXT N_("Number of chunks downloaded at once, " \
+    "each over its own persistent connection")
+
+#define DASH_PIPELINE_TEXT N_("Pipelined requests")
+#define DASH_PIPELINE_LONGTEXT N_("Number of chunks requested ahead on " \
+    "each connection")
+
+#define DASH_LOGIC_TEXT N_("Adaptation logic")
+#define DASH_LOGIC_LONGTEXT N_("Rate based follows the download rate, " \
+    "buffer based also weighs the buffer level.")
+
+static const int pi_logic_values[] = {
+    dash::logic::IAdaptationLogic::RateBased,
+    dash::logic::IAdaptationLogic::BufferBased };
+static const char *const ppsz_logic_descriptions[] = {
+    N_("Rate based"), N_("Buffer based") };
+
 vlc_module_begin ()
         set_shortname( N_("DASH"))
         set_description( N_("Dynamic Adaptive Streaming over HTTP") )
@@ -68,6 +86,13 @@ vlc_module_begin ()
         add_integer( "dash-prefwidth",  480, DASH_WIDTH_TEXT,  DASH_WIDTH_LONGTEXT,  true )
         add_integer( "dash-prefheight", 360, DASH_HEIGHT_TEXT, DASH_HEIGHT_LONGTEXT, true )
         add_integer( "dash-buffersize", 30, DASH_BUFFER_TEXT, DASH_BUFFER_LONGTEXT, true )
+        add_integer_with_range( "dash-connections", 1, 1, MAXCONNECTIONS,
+                                DASH_CONNECTIONS_TEXT, DASH_CONNECTIONS_LONGTEXT, true )
+        add_integer_with_range( "dash-pipeline", 2, 1, MAXPIPELINE,
+                                DASH_PIPELINE_TEXT, DASH_PIPELINE_LONGTEXT, true )
+        add_integer( "dash-logic", dash::logic::IAdaptationLogic::RateBased,
+                     DASH_LOGIC_TEXT, DASH_LOGIC_LONGTEXT, true )
+            change_integer_list( pi_logic_values, ppsz_logic_descriptions )
         set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -114,9 +139,14 @@ static int Open(vlc_object_t *p_obj)
     if (unlikely(p_sys == NULL))
         return VLC_ENOMEM;
 
+    dash::logic::IAdaptationLogic::LogicType logic =
+        (dash::logic::IAdaptationLogic::LogicType) var_InheritInteger(p_stream, "dash-logic");
+    if(logic != dash::logic::IAdaptationLogic::BufferBased)
+        logic = dash::logic::IAdaptationLogic::RateBased;
+
     p_sys->p_mpd = mpd;
     dash::DASHManager*p_dashManager = new dash::DASHManager(p_sys->p_mpd,
-                                          dash::logic::IAdaptationLogic::RateBased,
+                                          logic,
                                           p_stream);
 
     if(!p_dashManager->start())
@@ -33,70 +33,62 @@
 using namespace dash::http;
 using namespace dash::logic;
 
-const size_t    HTTPConnectionManager::PIPELINE               = 80;
-const size_t    HTTPConnectionManager::PIPELINELENGTH         = 2;
 const uint64_t  HTTPConnectionManager::CHUNKDEFAULTBITRATE    = 1;
 
 HTTPConnectionManager::HTTPConnectionManager    (dash::logic::IAdaptationLogic *adaptationLogic, stream_t *stream) :			// sunqueen modify
                        adaptationLogic          (adaptationLogic),
                        stream                   (stream),
-                       chunkCount               (0),
                        bpsAvg                   (0),
                        bpsLastChunk             (0),
-                       bpsCurrentChunk          (0),
                        bytesReadSession         (0),
-                       bytesReadChunk           (0),
-                       timeSession              (0),
-                       timeChunk                (0)
+                       timeSession              (0)
 {
+    vlc_mutex_init(&this->lock);
 }
 HTTPConnectionManager::~HTTPConnectionManager   ()
 {
     this->closeAllConnections();
+    vlc_mutex_destroy(&this->lock);
 }
 
 void                                HTTPConnectionManager::closeAllConnections      ()
 {
+    vlc_mutex_locker lock(&this->lock);
+
     vlc_delete_all(this->connectionPool);
-    vlc_delete_all(this->downloadQueue);
 }
-int                                 HTTPConnectionManager::read                     (block_t *block)
+Chunk*                              HTTPConnectionManager::getNextChunk             ()
 {
-    if(this->downloadQueue.size() == 0)
-        if(!this->addChunk(this->adaptationLogic->getNextChunk()))
-            return 0;
-
-    if(this->downloadQueue.front()->getPercentDownloaded() > HTTPConnectionManager::PIPELINE &&
-       this->downloadQueue.size() < HTTPConnectionManager::PIPELINELENGTH)
-        this->addChunk(this->adaptationLogic->getNextChunk());
+    vlc_mutex_locker lock(&this->lock);
 
-    int ret = 0;
+    Chunk *chunk = this->adaptationLogic->getNextChunk();
 
-    mtime_t start = mdate();
-    ret = this->downloadQueue.front()->getConnection()->read(block->p_buffer, block->i_buffer);
-    mtime_t end = mdate();
-
-    block->i_length = (mtime_t)((ret * 8) / ((float)this->downloadQueue.front()->getBitrate() / 1000000));
+    if(chunk != NULL && chunk->getBitrate() <= 0)
+        chunk->setBitrate(HTTPConnectionManager::CHUNKDEFAULTBITRATE);
 
-    double time = ((double)(end - start)) / 1000000;
+    return chunk;
+}
+PersistentConnection*               HTTPConnectionManager::openConnection           ()
+{
+    vlc_mutex_locker lock(&this->lock);
 
-    if(ret <= 0)
-    {
-        this->bpsLastChunk   = this->bpsCurrentChunk;
-        this->bytesReadChunk = 0;
-        this->timeChunk      = 0;
+    PersistentConnection *con = new PersistentConnection(this->stream);
+    this->connectionPool.push_back(con);
 
-        delete(this->downloadQueue.front());
-        this->downloadQueue.pop_front();
+    return con;
+}
+void                                HTTPConnectionManager::closeConnection          (PersistentConnection *con)
+{
+    vlc_mutex_locker lock(&this->lock);
 
-        return this->read(block);
-    }
-    else
-    {
-        this->updateStatistics(ret, time);
-    }
+    for(size_t i = 0; i < this->connectionPool.size(); i++)
+        if(this->connectionPool.at(i) == con)
+        {
+            this->connectionPool.erase(this->connectionPool.begin() + i);
+            break;
+        }
 
-    return ret;
+    delete con;
 }
 void                                HTTPConnectionManager::attach                   (IDownloadRateObserver *observer)
 {
@@ -109,60 +101,24 @@ void                                HTTPConnectionManager::notify
     for(size_t i = 0; i < this->rateObservers.size(); i++)
         this->rateObservers.at(i)->downloadRateChanged(this->bpsAvg, this->bpsLastChunk);
 }
-std::vector<PersistentConnection *> HTTPConnectionManager::getConnectionsForHost    (const std::string &hostname)
-{
-    std::vector<PersistentConnection *> cons;
-
-    for(size_t i = 0; i < this->connectionPool.size(); i++)
-        if(!this->connectionPool.at(i)->getHostname().compare(hostname) || !this->connectionPool.at(i)->isConnected())
-            cons.push_back(this->connectionPool.at(i));
-
-    return cons;
-}
 void                                HTTPConnectionManager::updateStatistics         (int bytes, double time)
 {
+    vlc_mutex_locker lock(&this->lock);
+
     this->bytesReadSession  += bytes;
-    this->bytesReadChunk    += bytes;
     this->timeSession       += time;
-    this->timeChunk         += time;
 
     this->bpsAvg            = (int64_t) ((this->bytesReadSession * 8) / this->timeSession);
-    this->bpsCurrentChunk   = (int64_t) ((this->bytesReadChunk * 8) / this->timeChunk);
 
     if(this->bpsAvg < 0)
         this->bpsAvg = 0;
 
-    if(this->bpsCurrentChunk < 0)
-        this->bpsCurrentChunk = 0;
-
     this->notify();
 }
-bool                                HTTPConnectionManager::addChunk                 (Chunk *chunk)
+void                                HTTPConnectionManager::chunkDownloaded          (int64_t bytes, double time)
 {
-    if(chunk == NULL)
-        return false;
-
-    this->downloadQueue.push_back(chunk);
-
-    std::vector<PersistentConnection *> cons = this->getConnectionsForHost(chunk->getHostname());
-
-    if(cons.size() == 0)
-    {
-        PersistentConnection *con = new PersistentConnection(this->stream);
-        this->connectionPool.push_back(con);
-        cons.push_back(con);
-    }
-
-    size_t pos = this->chunkCount % cons.size();
-
-    cons.at(pos)->addChunk(chunk);
-
-    chunk->setConnection(cons.at(pos));
-
-    this->chunkCount++;
-
-    if(chunk->getBitrate() <= 0)
-        chunk->setBitrate(HTTPConnectionManager::CHUNKDEFAULTBITRATE);
+    vlc_mutex_locker lock(&this->lock);
 
-    return true;
+    if(time > 0)
+        this->bpsLastChunk = (int64_t) ((bytes * 8) / time);
 }
@@ -29,7 +29,6 @@
 
 #include <string>
 #include <vector>
-#include <deque>
 #include <iostream>
 #include <ctime>
 #include <limits.h>
@@ -47,34 +46,33 @@ namespace dash
                 HTTPConnectionManager           (dash::logic::IAdaptationLogic *adaptationLogic, stream_t *stream);			// sunqueen modify
                 virtual ~HTTPConnectionManager  ();
 
-                void    closeAllConnections ();
-                bool    addChunk            (Chunk *chunk);
-                int     read                (block_t *block);
-                void    attach              (dash::logic::IDownloadRateObserver *observer);
-                void    notify              ();
+                /* All of the following may be called from several download
+                 * threads at once */
+                void                    closeAllConnections ();
+                Chunk*                  getNextChunk        ();
+                PersistentConnection*   openConnection      ();
+                void                    closeConnection     (PersistentConnection *con);
+                /**
+                 *  \param  time    seconds, divided by the number of concurrent downloads
+                 */
+                void                    updateStatistics    (int bytes, double time);
+                void                    chunkDownloaded     (int64_t bytes, double time);
+                void                    attach              (dash::logic::IDownloadRateObserver *observer);
 
             private:
                 std::vector<dash::logic::IDownloadRateObserver *>   rateObservers;
-                std::deque<Chunk *>                                 downloadQueue;
                 std::vector<PersistentConnection *>                 connectionPool;
                 logic::IAdaptationLogic                             *adaptationLogic;
                 stream_t                                            *stream;
-                int                                                 chunkCount;
+                vlc_mutex_t                                         lock;
                 int64_t                                             bpsAvg;
                 int64_t                                             bpsLastChunk;
-                int64_t                                             bpsCurrentChunk;
                 int64_t                                             bytesReadSession;
-                int64_t                                             bytesReadChunk;
                 double                                              timeSession;
-                double                                              timeChunk;
 
-                static const size_t     PIPELINE;
-                static const size_t     PIPELINELENGTH;
                 static const uint64_t   CHUNKDEFAULTBITRATE;
 
-                std::vector<PersistentConnection *>     getConnectionsForHost   (const std::string &hostname);
-                void                                    updateStatistics        (int bytes, double time);
-
+                void                                    notify                  ();
         };
     }
 }
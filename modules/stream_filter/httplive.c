@@ -40,6 +40,7 @@
 #include <gcrypt.h>
 
 #include <vlc_threads.h>
+#include <vlc_atomic.h>
 #include <vlc_arrays.h>
 #include <vlc_stream.h>
 #include <vlc_memory.h>
@@ -51,11 +52,24 @@
 static int  Open (vlc_object_t *);
 static void Close(vlc_object_t *);
 
+#define HLS_MAX_THREADS 16
+
+#define THREADS_TEXT N_("Concurrent segment downloads")
+#define THREADS_LONGTEXT N_("Number of segments downloaded at the same " \
+    "time. More connections help sustaining high bitrates over links " \
+    "with a long round trip time.")
+#define BUFFER_TEXT N_("Prefetch memory limit (MiB)")
+#define BUFFER_LONGTEXT N_("Segments are not downloaded further ahead of " \
+    "playback than this amount of memory allows.")
+
 vlc_module_begin()
     set_category(CAT_INPUT)
     set_subcategory(SUBCAT_INPUT_STREAM_FILTER)
     set_description(N_("Http Live Streaming stream filter"))
     set_capability("stream_filter", 20)
+    add_integer_with_range("hls-segment-threads", 1, 1, HLS_MAX_THREADS,
+                           THREADS_TEXT, THREADS_LONGTEXT, true)
+    add_integer("hls-prefetch-size", 128, BUFFER_TEXT, BUFFER_LONGTEXT, true)
     set_callbacks(Open, Close)
 vlc_module_end()
 
@@ -103,7 +117,7 @@ struct stream_sys_t
 {
     char         *m3u8;         /* M3U8 url */
     vlc_thread_t  reload;       /* HLS m3u8 reload thread */
-    vlc_thread_t  thread;       /* HLS segment download thread */
+    vlc_thread_t  thread[HLS_MAX_THREADS]; /* HLS segment download threads */
 
     block_t      *peeked;
 
@@ -115,10 +129,16 @@ struct stream_sys_t
     struct hls_download_s
     {
         int         stream;     /* current hls_stream  */
-        int         segment;    /* current segment for downloading */
+        int         segment;    /* segments before this one are downloaded */
+        int         next;       /* next segment to start downloading */
         int         seek;       /* segment requested by seek (default -1) */
+        int         threads;    /* number of download threads */
+        int         busy[HLS_MAX_THREADS]; /* segments in progress, or -1 */
+        uint64_t    buffer;     /* memory limit for segments ahead (bytes) */
+        vlc_atomic_t generation;/* bumped on seek to abort transfers */
         vlc_mutex_t lock_wait;  /* protect segment download counter */
         vlc_cond_t  wait;       /* some condition to wait on */
+        vlc_mutex_t lock_key;   /* serializes AES key loading */
     } download;
 
     /* Playback */
@@ -166,8 +186,9 @@ static int  Control(stream_t *, int i_query, va_list);
 static ssize_t read_M3U8_from_stream(stream_t *s, uint8_t **buffer);
 static ssize_t read_M3U8_from_url(stream_t *s, const char *psz_url, uint8_t **buffer);
 static char *ReadLine(uint8_t *buffer, uint8_t **pos, size_t len);
+static uint8_t *SkipLine(uint8_t *buffer, const size_t len);
 
-static int hls_Download(stream_t *s, segment_t *segment);
+static int hls_Download(stream_t *s, segment_t *segment, uintptr_t generation);
 
 static void* hls_Thread(void *);
 static void* hls_Reload(void *);
@@ -330,23 +351,6 @@ static hls_stream_t *hls_GetLast(vlc_array_t *hls_stream)
     return hls_Get(hls_stream, count);
 }
 
-static hls_stream_t *hls_Find(vlc_array_t *hls_stream, hls_stream_t *hls_new)
-{
-    int count = vlc_array_count(hls_stream);
-    for (int n = 0; n < count; n++)
-    {
-        hls_stream_t *hls = hls_Get(hls_stream, n);
-        if (hls)
-        {
-            /* compare */
-            if ((hls->id == hls_new->id) &&
-                ((hls->bandwidth == hls_new->bandwidth)||(hls_new->bandwidth==0)))
-                return hls;
-        }
-    }
-    return NULL;
-}
-
 static uint64_t hls_GetStreamSize(hls_stream_t *hls)
 {
     /* NOTE: Stream size is calculated based on segment duration and
@@ -422,19 +426,36 @@ static segment_t *segment_GetSegment(hls_stream_t *hls, const int wanted)
     return (segment_t *) vlc_array_item_at_index(hls->segments, wanted);
 }
 
+/* Segments are kept in increasing sequence order, seldom with gaps: look at
+ * the expected index first, and bisect if it is not there */
 static segment_t *segment_Find(hls_stream_t *hls, const int sequence)
 {
     assert(hls);
 
     int count = vlc_array_count(hls->segments);
     if (count <= 0) return NULL;
-    for (int n = 0; n < count; n++)
+
+    segment_t *segment = segment_GetSegment(hls, 0);
+    int n = sequence - segment->sequence;
+    if (n >= 0 && n < count)
     {
-        segment_t *segment = segment_GetSegment(hls, n);
-        if (segment == NULL) break;
+        segment = segment_GetSegment(hls, n);
         if (segment->sequence == sequence)
             return segment;
     }
+
+    int low = 0, high = count - 1;
+    while (low <= high)
+    {
+        n = low + (high - low) / 2;
+        segment = segment_GetSegment(hls, n);
+        if (segment->sequence == sequence)
+            return segment;
+        if (segment->sequence < sequence)
+            low = n + 1;
+        else
+            high = n - 1;
+    }
     return NULL;
 }
 
@@ -1194,6 +1215,7 @@ static int hls_DownloadSegmentKey(stream_t *s, segment_t *seg)
     return VLC_SUCCESS;
 }
 
+/* Must be called with download.lock_key held */
 static int hls_ManageSegmentKeys(stream_t *s, hls_stream_t *hls)
 {
     segment_t   *seg = NULL;
@@ -1232,12 +1254,33 @@ static int hls_DecodeSegmentData(stream_t *s, hls_stream_t *hls, segment_t *segm
     if (segment->psz_key_path == NULL)
         return VLC_SUCCESS;
 
-    /* Do we have loaded the key ? */
+    /* Do we have loaded the key ? The keys of all the segments are loaded
+     * together, under the lock, while other threads decode */
+    stream_sys_t *p_sys = s->p_sys;
+    uint8_t key[sizeof(segment->aes_key)];
+    int val = VLC_SUCCESS;
+
+    vlc_mutex_lock(&p_sys->download.lock_key);
     if (!segment->b_key_loaded)
-    {
         /* No ? try to download it now */
-        if (hls_ManageSegmentKeys(s, hls) != VLC_SUCCESS)
-            return VLC_EGENERIC;
+        val = hls_ManageSegmentKeys(s, hls);
+    if (val == VLC_SUCCESS)
+        memcpy(key, segment->aes_key, sizeof(key));
+    vlc_mutex_unlock(&p_sys->download.lock_key);
+    if (val != VLC_SUCCESS)
+        return VLC_EGENERIC;
+
+    /* The IV of this segment only, segments are decoded concurrently */
+    uint8_t iv[AES_BLOCK_SIZE];
+    if (hls->b_iv_loaded)
+        memcpy(iv, hls->psz_AES_IV, AES_BLOCK_SIZE);
+    else
+    {
+        memset(iv, 0, AES_BLOCK_SIZE);
+        iv[15] = segment->sequence & 0xff;
+        iv[14] = (segment->sequence >> 8)& 0xff;
+        iv[13] = (segment->sequence >> 16)& 0xff;
+        iv[12] = (segment->sequence >> 24)& 0xff;
     }
 
     /* For now, we only decode AES-128 data */
@@ -1254,8 +1297,7 @@ static int hls_DecodeSegmentData(stream_t *s, hls_stream_t *hls, segment_t *segm
     }
 
     /* Set key */
-    i_gcrypt_err = gcry_cipher_setkey(aes_ctx, segment->aes_key,
-                                       sizeof(segment->aes_key));
+    i_gcrypt_err = gcry_cipher_setkey(aes_ctx, key, sizeof(key));
     if (i_gcrypt_err)
     {
         msg_Err(s, "gcry_cipher_setkey failed: %s", gpg_strerror(i_gcrypt_err));
@@ -1263,17 +1305,7 @@ static int hls_DecodeSegmentData(stream_t *s, hls_stream_t *hls, segment_t *segm
         return VLC_EGENERIC;
     }
 
-    if (hls->b_iv_loaded == false)
-    {
-        memset(hls->psz_AES_IV, 0, AES_BLOCK_SIZE);
-        hls->psz_AES_IV[15] = segment->sequence & 0xff;
-        hls->psz_AES_IV[14] = (segment->sequence >> 8)& 0xff;
-        hls->psz_AES_IV[13] = (segment->sequence >> 16)& 0xff;
-        hls->psz_AES_IV[12] = (segment->sequence >> 24)& 0xff;
-    }
-
-    i_gcrypt_err = gcry_cipher_setiv(aes_ctx, hls->psz_AES_IV,
-                                      sizeof(hls->psz_AES_IV));
+    i_gcrypt_err = gcry_cipher_setiv(aes_ctx, iv, sizeof(iv));
 
     if (i_gcrypt_err)
     {
@@ -1317,42 +1349,9 @@ static int hls_DecodeSegmentData(stream_t *s, hls_stream_t *hls, segment_t *segm
     return VLC_SUCCESS;
 }
 
-static int get_HTTPLiveMetaPlaylist(stream_t *s, vlc_array_t **streams)
-{
-    stream_sys_t *p_sys = s->p_sys;
-    assert(*streams);
-    int err = VLC_EGENERIC;
-
-    /* Duplicate HLS stream META information */
-    for (int i = 0; i < vlc_array_count(p_sys->hls_stream); i++)
-    {
-        hls_stream_t *src, *dst;
-        src = hls_Get(p_sys->hls_stream, i);
-        if (src == NULL)
-            return VLC_EGENERIC;
-
-        dst = hls_Copy(src, false);
-        if (dst == NULL)
-            return VLC_ENOMEM;
-        vlc_array_append(*streams, dst);
-
-        /* Download playlist file from server */
-        uint8_t *buf = NULL;
-        ssize_t len = read_M3U8_from_url(s, dst->url, &buf);
-        if (len < 0)
-            err = VLC_EGENERIC;
-        else
-        {
-            /* Parse HLS m3u8 content. */
-            err = parse_M3U8(s, *streams, buf, len);
-            free(buf);
-        }
-    }
-    return err;
-}
-
 /* Update hls_old (an existing member of p_sys->hls_stream) to match hls_new
-   (which represents a downloaded, perhaps newer version of the same playlist) */
+   (which represents a downloaded, perhaps newer version of the same playlist).
+   The segments of hls_new are either moved to hls_old or freed. */
 static int hls_UpdatePlaylist(stream_t *s, hls_stream_t *hls_new, hls_stream_t *hls_old, bool *stream_appended)
 {
     int count = vlc_array_count(hls_new->segments);
@@ -1364,11 +1363,7 @@ static int hls_UpdatePlaylist(stream_t *s, hls_stream_t *hls_new, hls_stream_t *
     for (int n = 0; n < count; n++)
     {
         segment_t *p = segment_GetSegment(hls_new, n);
-        if (p == NULL)
-        {
-            vlc_mutex_unlock(&hls_old->lock);
-            return VLC_EGENERIC;
-        }
+        assert(p);
 
         segment_t *segment = segment_Find(hls_old, p->sequence);
         if (segment)
@@ -1410,20 +1405,24 @@ static int hls_UpdatePlaylist(stream_t *s, hls_stream_t *hls_new, hls_stream_t *
                 }
                 free(segment->psz_key_path);
                 segment->psz_key_path = p->psz_key_path ? strdup(p->psz_key_path) : NULL;
-                segment_Free(p);
             }
+            segment_Free(p);
             vlc_mutex_unlock(&segment->lock);
         }
         else
         {
             int last = vlc_array_count(hls_old->segments) - 1;
             segment_t *l = segment_GetSegment(hls_old, last);
-            if (l == NULL) {
-                vlc_mutex_unlock(&hls_old->lock);
-                return VLC_EGENERIC;
+            if (l != NULL && p->sequence < l->sequence)
+            {
+                /* segment_Find() needs the segments in sequence order */
+                msg_Warn(s, "- segment %d older than the last one %d - dropped",
+                         p->sequence, l->sequence);
+                segment_Free(p);
+                continue;
             }
 
-            if ((l->sequence + 1) != p->sequence)
+            if (l != NULL && (l->sequence + 1) != p->sequence)
             {
                 msg_Err(s, "gap in sequence numbers found: new=%d expected %d",
                         p->sequence, l->sequence+1);
@@ -1436,6 +1435,8 @@ static int hls_UpdatePlaylist(stream_t *s, hls_stream_t *hls_new, hls_stream_t *
         }
     }
 
+    vlc_array_clear(hls_new->segments);
+
     /* update meta information */
     hls_old->sequence = hls_new->sequence;
     hls_old->duration = (hls_new->duration == -1) ? hls_old->duration : hls_new->duration;
@@ -1445,67 +1446,236 @@ static int hls_UpdatePlaylist(stream_t *s, hls_stream_t *hls_new, hls_stream_t *
 
 }
 
-static int hls_ReloadPlaylist(stream_t *s)
+/* Parses a reloaded playlist in full, and merges it into hls */
+static int hls_MergePlaylist(stream_t *s, hls_stream_t *hls, uint8_t *buffer, const ssize_t len, bool *stream_appended)
 {
-    stream_sys_t *p_sys = s->p_sys;
+    vlc_array_t *streams = vlc_array_new();
+    if (streams == NULL)
+        return VLC_ENOMEM;
 
-    // Flag to indicate if we should signal download thread
-    bool stream_appended = false;
+    int err = VLC_ENOMEM;
+    hls_stream_t *hls_new = hls_Copy(hls, false);
+    if (hls_new != NULL)
+    {
+        vlc_array_append(streams, hls_new);
+        err = parse_M3U8(s, streams, buffer, len);
+    }
+
+    for (int n = 0; n < vlc_array_count(streams); n++)
+    {
+        hls_new = hls_Get(streams, n);
+        if (err == VLC_SUCCESS)
+            err = hls_UpdatePlaylist(s, hls_new, hls, stream_appended);
+        hls_Free(hls_new);
+    }
+    vlc_array_destroy(streams);
+    return err;
+}
+
+/* A live playlist normally only grows at the end between two reloads: skip
+ * what comes before the last segment known, and append the segments that
+ * follow it. Returns VLC_EGENERIC if the playlist changed otherwise, so that
+ * it gets merged in full. */
+static int hls_AppendPlaylist(stream_t *s, hls_stream_t *hls, uint8_t *buffer, const ssize_t len, bool *stream_appended)
+{
+    vlc_mutex_lock(&hls->lock);
+    segment_t *last = segment_GetSegment(hls, vlc_array_count(hls->segments) - 1);
+    vlc_mutex_unlock(&hls->lock);
+    if (last == NULL)
+        return VLC_EGENERIC;
 
-    vlc_array_t *hls_streams = vlc_array_new();
-    if (hls_streams == NULL)
+    /* Parser state, and the new segments */
+    hls_stream_t *hls_new = hls_Copy(hls, false);
+    if (hls_new == NULL)
         return VLC_ENOMEM;
+    hls_new->sequence = 0;
 
-    msg_Dbg(s, "Reloading HLS live meta playlist");
+    uint8_t *p_begin = buffer, *p_end = buffer + len, *p_read;
+    int err = VLC_SUCCESS;
+    int index = 0; /* of the next segment in the playlist */
+    int segment_duration = -1;
+    bool media_sequence_loaded = false;
+    bool b_found = false;
+
+    if (strncmp((const char *)buffer, "#EXTM3U", 7) != 0)
+        err = VLC_EGENERIC;
+    else
+        p_begin = SkipLine(p_begin, p_end - p_begin);
 
-    if (get_HTTPLiveMetaPlaylist(s, &hls_streams) != VLC_SUCCESS)
+    while (err == VLC_SUCCESS && p_begin < p_end)
     {
-        /* Free hls streams */
-        for (int i = 0; i < vlc_array_count(hls_streams); i++)
+        const char *psz = (const char *)p_begin;
+        int sequence = hls_new->sequence + index;
+
+        if (*psz == '\r' || *psz == '\n')
         {
-            hls_stream_t *hls;
-            hls = hls_Get(hls_streams, i);
-            if (hls) hls_Free(hls);
+            p_begin = SkipLine(p_begin, p_end - p_begin);
+            continue;
         }
-        vlc_array_destroy(hls_streams);
 
-        msg_Err(s, "reloading playlist failed");
-        return VLC_EGENERIC;
+        if (*psz == '#')
+        {
+            /* Only tags that apply to the following segments matter */
+            if ((strncmp(psz, "#EXTINF", 7) == 0) ? sequence <= last->sequence
+                                                  : strncmp(psz, "#EXT-X-", 7) != 0)
+            {
+                p_begin = SkipLine(p_begin, p_end - p_begin);
+                continue;
+            }
+
+            char *line = ReadLine(p_begin, &p_read, p_end - p_begin);
+            if (line == NULL)
+            {
+                err = VLC_ENOMEM;
+                break;
+            }
+            p_begin = p_read;
+
+            if (strncmp(line, "#EXTINF", 7) == 0)
+                err = parse_SegmentInformation(hls_new, line, &segment_duration);
+            else if (strncmp(line, "#EXT-X-TARGETDURATION", 21) == 0)
+                err = parse_TargetDuration(s, hls_new, line);
+            else if (strncmp(line, "#EXT-X-MEDIA-SEQUENCE", 21) == 0)
+            {
+                if (!media_sequence_loaded)
+                {
+                    err = parse_MediaSequence(s, hls_new, line);
+                    media_sequence_loaded = true;
+                }
+            }
+            else if (strncmp(line, "#EXT-X-KEY", 10) == 0)
+                err = parse_Key(s, hls_new, line);
+            else if (strncmp(line, "#EXT-X-ALLOW-CACHE", 18) == 0)
+                err = parse_AllowCache(s, hls_new, line);
+            else if (strncmp(line, "#EXT-X-VERSION", 14) == 0)
+                err = parse_Version(s, hls_new, line);
+            else if (strncmp(line, "#EXT-X-ENDLIST", 14) == 0)
+                err = parse_EndList(s, hls_new);
+            else if (strncmp(line, "#EXT-X-STREAM-INF", 17) == 0)
+                err = VLC_EGENERIC;
+
+            free(line);
+            continue;
+        }
+
+        /* Segment URI */
+        index++;
+        if (sequence < last->sequence)
+        {
+            p_begin = SkipLine(p_begin, p_end - p_begin);
+            continue;
+        }
+
+        char *line = ReadLine(p_begin, &p_read, p_end - p_begin);
+        if (line == NULL)
+        {
+            err = VLC_ENOMEM;
+            break;
+        }
+        p_begin = p_read;
+
+        char *psz_uri = relative_URI(hls_new->url, line);
+        const char *uri = psz_uri ? psz_uri : line;
+        if (sequence == last->sequence)
+        {
+            b_found = true;
+            if (strcmp(uri, last->url) != 0)
+            {
+                msg_Warn(s, "segment %d changed in playlist", sequence);
+                err = VLC_EGENERIC;
+            }
+        }
+        else
+        {
+            segment_t *segment = segment_New(hls_new, segment_duration, uri);
+            if (segment)
+                segment->sequence = sequence;
+            else
+                err = VLC_ENOMEM;
+        }
+        segment_duration = -1; /* reset duration */
+        free(psz_uri);
+        free(line);
     }
 
-    /* merge playlists */
-    int count = vlc_array_count(hls_streams);
-    for (int n = 0; n < count; n++)
+    /* The playlist went back in time, it must be merged */
+    if (err == VLC_SUCCESS && !b_found && hls_new->sequence + index <= last->sequence)
+        err = VLC_EGENERIC;
+
+    if (err == VLC_SUCCESS)
     {
-        hls_stream_t *hls_new = hls_Get(hls_streams, n);
-        if (hls_new == NULL)
-            continue;
+        int count = vlc_array_count(hls_new->segments);
+
+        vlc_mutex_lock(&hls->lock);
+        if (count > 0)
+        {
+            segment_t *first = segment_GetSegment(hls_new, 0);
+            if (first->sequence != last->sequence + 1)
+                msg_Err(s, "gap in sequence numbers found: new=%d expected %d",
+                        first->sequence, last->sequence + 1);
 
-        hls_stream_t *hls_old = hls_Find(p_sys->hls_stream, hls_new);
-        if (hls_old == NULL)
-        {   /* new hls stream - append */
-            vlc_array_append(p_sys->hls_stream, hls_new);
-            msg_Dbg(s, "new HLS stream appended (id=%d, bandwidth=%"PRIu64")",
-                     hls_new->id, hls_new->bandwidth);
+            for (int n = 0; n < count; n++)
+                vlc_array_append(hls->segments, segment_GetSegment(hls_new, n));
+            vlc_array_clear(hls_new->segments);
+            msg_Dbg(s, "- %d segments appended", count);
 
-            // New segment available -  signal download thread
-            stream_appended = true;
+            // Signal download thread otherwise the segments will not get downloaded
+            *stream_appended = true;
         }
-        else if (hls_UpdatePlaylist(s, hls_new, hls_old, &stream_appended) != VLC_SUCCESS)
+
+        /* update meta information */
+        hls->sequence = hls_new->sequence;
+        hls->duration = (hls_new->duration == -1) ? hls->duration : hls_new->duration;
+        hls->b_cache = hls_new->b_cache;
+        vlc_mutex_unlock(&hls->lock);
+    }
+
+    hls_Free(hls_new);
+    return err;
+}
+
+static int hls_ReloadPlaylist(stream_t *s)
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    // Flag to indicate if we should signal download thread
+    bool stream_appended = false;
+    int err = VLC_SUCCESS;
+
+    msg_Dbg(s, "Reloading HLS live meta playlist");
+
+    for (int n = 0; n < vlc_array_count(p_sys->hls_stream); n++)
+    {
+        hls_stream_t *hls = hls_Get(p_sys->hls_stream, n);
+
+        /* Download playlist file from server */
+        uint8_t *buf = NULL;
+        ssize_t len = read_M3U8_from_url(s, hls->url, &buf);
+        if (len < 0)
+        {
+            err = VLC_EGENERIC;
+            continue;
+        }
+
+        if (hls_AppendPlaylist(s, hls, buf, len, &stream_appended) != VLC_SUCCESS &&
+            hls_MergePlaylist(s, hls, buf, len, &stream_appended) != VLC_SUCCESS)
             msg_Warn(s, "failed updating HLS stream (id=%d, bandwidth=%"PRIu64")",
-                     hls_new->id, hls_new->bandwidth);
+                     hls->id, hls->bandwidth);
+        free(buf);
     }
-    vlc_array_destroy(hls_streams);
+
+    if (err != VLC_SUCCESS)
+        msg_Err(s, "reloading playlist failed");
 
     // Must signal the download thread otherwise new segments will not be downloaded at all!
     if (stream_appended == true)
     {
         vlc_mutex_lock(&p_sys->download.lock_wait);
-        vlc_cond_signal(&p_sys->download.wait);
+        vlc_cond_broadcast(&p_sys->download.wait);
         vlc_mutex_unlock(&p_sys->download.lock_wait);
     }
 
-    return VLC_SUCCESS;
+    return err;
 }
 
 /****************************************************************************
@@ -1541,7 +1711,33 @@ static int BandwidthAdaptation(stream_t *s, int progid, uint64_t *bandwidth)
     return candidate;
 }
 
-static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *segment, int *cur_stream)
+/* How many segments may be downloaded ahead of playback */
+static int hls_Window(stream_sys_t *p_sys, hls_stream_t *hls)
+{
+    int window = __MAX(6, p_sys->download.threads);
+
+    /* estimated segment size */
+    uint64_t size = (uint64_t)hls->duration * hls->bandwidth / 8;
+    if ((size > 0) && (p_sys->download.buffer / size < (uint64_t)window))
+        window = __MAX(1, (int)(p_sys->download.buffer / size));
+    return window;
+}
+
+/* Segments before the first one still in progress are complete.
+ * Must be called with download.lock_wait held. */
+static void hls_UpdateDownloaded(stream_sys_t *p_sys)
+{
+    int segment = p_sys->download.next;
+
+    for (int i = 0; i < HLS_MAX_THREADS; i++)
+        if ((p_sys->download.busy[i] >= 0) &&
+            (p_sys->download.busy[i] < segment))
+            segment = p_sys->download.busy[i];
+    p_sys->download.segment = segment;
+}
+
+static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *segment,
+                                   int *cur_stream, uintptr_t generation)
 {
     stream_sys_t *p_sys = s->p_sys;
 
@@ -1569,10 +1765,14 @@ static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *se
     }
 
     mtime_t start = mdate();
-    if (hls_Download(s, segment) != VLC_SUCCESS)
+    if (hls_Download(s, segment, generation) != VLC_SUCCESS)
     {
-        msg_Err(s, "downloading segment %d from stream %d failed",
-                    segment->sequence, *cur_stream);
+        if (vlc_atomic_get(&p_sys->download.generation) != generation)
+            msg_Dbg(s, "downloading segment %d from stream %d aborted",
+                        segment->sequence, *cur_stream);
+        else
+            msg_Err(s, "downloading segment %d from stream %d failed",
+                        segment->sequence, *cur_stream);
         vlc_mutex_unlock(&segment->lock);
         return VLC_EGENERIC;
     }
@@ -1595,7 +1795,15 @@ static int hls_DownloadSegmentData(stream_t *s, hls_stream_t *hls, segment_t *se
     msg_Dbg(s, "downloaded segment %d from stream %d",
                 segment->sequence, *cur_stream);
 
-    uint64_t bw = segment->size * 8 * 1000000 / __MAX(1, duration); /* bits / s */
+    /* Concurrent downloads share the link */
+    int active = 0;
+    vlc_mutex_lock(&p_sys->download.lock_wait);
+    for (int i = 0; i < HLS_MAX_THREADS; i++)
+        if (p_sys->download.busy[i] >= 0)
+            active++;
+    vlc_mutex_unlock(&p_sys->download.lock_wait);
+
+    uint64_t bw = __MAX(1, active) * segment->size * 8 * 1000000 / __MAX(1, duration); /* bits / s */
     p_sys->bandwidth = bw;
     if (p_sys->b_meta && (hls->bandwidth != bw))
     {
@@ -1621,22 +1829,24 @@ static void* hls_Thread(void *p_this)
 
     while (vlc_object_alive(s))
     {
-        hls_stream_t *hls = hls_Get(p_sys->hls_stream, p_sys->download.stream);
+        int stream = p_sys->download.stream;
+        hls_stream_t *hls = hls_Get(p_sys->hls_stream, stream);
         assert(hls);
 
         /* Sliding window (~60 seconds worth of movie) */
         vlc_mutex_lock(&hls->lock);
         int count = vlc_array_count(hls->segments);
         vlc_mutex_unlock(&hls->lock);
+        int window = hls_Window(p_sys, hls);
 
         /* Is there a new segment to process? */
-        if ((!p_sys->b_live && (p_sys->playback.segment < (count - 6))) ||
-            (p_sys->download.segment >= count))
+        vlc_mutex_lock(&p_sys->download.lock_wait);
+        if ((!p_sys->b_live && (p_sys->playback.segment < (count - window))) ||
+            (p_sys->download.next >= count))
         {
             /* wait */
-            vlc_mutex_lock(&p_sys->download.lock_wait);
-            while (((p_sys->download.segment - p_sys->playback.segment > 6) ||
-                    (p_sys->download.segment >= count)) &&
+            while (((p_sys->download.next - p_sys->playback.segment > window) ||
+                    (p_sys->download.next >= count)) &&
                    (p_sys->download.seek == -1))
             {
                 vlc_cond_wait(&p_sys->download.wait, &p_sys->download.lock_wait);
@@ -1645,27 +1855,43 @@ static void* hls_Thread(void *p_this)
                 if (!vlc_object_alive(s))
                     break;
             }
-            /* */
-            if (p_sys->download.seek >= 0)
-            {
-                p_sys->download.segment = p_sys->download.seek;
-                p_sys->download.seek = -1;
-            }
-            vlc_mutex_unlock(&p_sys->download.lock_wait);
         }
+        /* */
+        if (p_sys->download.seek >= 0)
+        {
+            p_sys->download.next = p_sys->download.seek;
+            p_sys->download.seek = -1;
+        }
+
+        /* claim the next segment */
+        int slot = -1, wanted = p_sys->download.next;
+        if (vlc_object_alive(s) && (wanted < count))
+        {
+            for (slot = 0; p_sys->download.busy[slot] >= 0; slot++)
+                assert(slot < HLS_MAX_THREADS - 1);
+            p_sys->download.busy[slot] = wanted;
+            p_sys->download.next++;
+        }
+        hls_UpdateDownloaded(p_sys);
+        uintptr_t generation = vlc_atomic_get(&p_sys->download.generation);
+        vlc_mutex_unlock(&p_sys->download.lock_wait);
 
         if (!vlc_object_alive(s)) break;
+        if (slot < 0) continue;
 
         vlc_mutex_lock(&hls->lock);
-        segment_t *segment = segment_GetSegment(hls, p_sys->download.segment);
+        segment_t *segment = segment_GetSegment(hls, wanted);
         vlc_mutex_unlock(&hls->lock);
 
+        int new_stream = stream;
         if ((segment != NULL) &&
-            (hls_DownloadSegmentData(s, hls, segment, &p_sys->download.stream) != VLC_SUCCESS))
+            (hls_DownloadSegmentData(s, hls, segment, &new_stream, generation) != VLC_SUCCESS))
         {
             if (!vlc_object_alive(s)) break;
 
-            if (!p_sys->b_live)
+            /* a transfer aborted by seek is no error */
+            if (!p_sys->b_live &&
+                (vlc_atomic_get(&p_sys->download.generation) == generation))
             {
                 p_sys->b_error = true;
                 break;
@@ -1673,16 +1899,12 @@ static void* hls_Thread(void *p_this)
         }
 
         /* download succeeded */
-        /* determine next segment to download */
         vlc_mutex_lock(&p_sys->download.lock_wait);
-        if (p_sys->download.seek >= 0)
-        {
-            p_sys->download.segment = p_sys->download.seek;
-            p_sys->download.seek = -1;
-        }
-        else if (p_sys->download.segment < count)
-            p_sys->download.segment++;
-        vlc_cond_signal(&p_sys->download.wait);
+        p_sys->download.busy[slot] = -1;
+        if (new_stream != stream)
+            p_sys->download.stream = new_stream;
+        hls_UpdateDownloaded(p_sys);
+        vlc_cond_broadcast(&p_sys->download.wait);
         vlc_mutex_unlock(&p_sys->download.lock_wait);
 
         // In case of a successful download signal the read thread that data is available
@@ -1765,6 +1987,10 @@ static int Prefetch(stream_t *s, int *current)
 
     /* Download ~10s worth of segments of this HLS stream if they exist */
     unsigned segment_amount = (0.5f + 10/hls->duration);
+    /* or only the first one, the download threads will fetch the next
+     * ones concurrently */
+    if (p_sys->download.threads > 1)
+        segment_amount = 1;
     for (int i = 0; i < __MIN(vlc_array_count(hls->segments), segment_amount); i++)
     {
         segment_t *segment = segment_GetSegment(hls, p_sys->download.segment);
@@ -1779,7 +2005,7 @@ static int Prefetch(stream_t *s, int *current)
             continue;
         }
 
-        if (hls_DownloadSegmentData(s, hls, segment, current) != VLC_SUCCESS)
+        if (hls_DownloadSegmentData(s, hls, segment, current, 0) != VLC_SUCCESS)
             return VLC_EGENERIC;
 
         p_sys->download.segment++;
@@ -1801,7 +2027,7 @@ static int Prefetch(stream_t *s, int *current)
 /****************************************************************************
  *
  ****************************************************************************/
-static int hls_Download(stream_t *s, segment_t *segment)
+static int hls_Download(stream_t *s, segment_t *segment, uintptr_t generation)
 {
     stream_sys_t *p_sys = s->p_sys;
     assert(segment);
@@ -1856,6 +2082,15 @@ static int hls_Download(stream_t *s, segment_t *segment)
         if (length <= 0)
             break;
         curlen += length;
+
+        /* seeking elsewhere aborts the transfer */
+        if (vlc_atomic_get(&p_sys->download.generation) != generation)
+        {
+            stream_Delete(p_ts);
+            block_Release(segment->data);
+            segment->data = NULL;
+            return VLC_EGENERIC;
+        }
     } while (vlc_object_alive(s));
 
     stream_Delete(p_ts);
@@ -1960,6 +2195,22 @@ static char *ReadLine(uint8_t *buffer, uint8_t **pos, const size_t len)
     return line;
 }
 
+/* Same as ReadLine(), without copying the line */
+static uint8_t *SkipLine(uint8_t *buffer, const size_t len)
+{
+    uint8_t *p = buffer;
+    uint8_t *end = p + len;
+
+    while ((p < end) && (*p != '\r') && (*p != '\n') && (*p != '\0'))
+        p++;
+    while ((p < end) && ((*p == '\r') || (*p == '\n')))
+        p++;
+    if ((p < end) && (*p == '\0'))
+        p = end;
+
+    return p;
+}
+
 /****************************************************************************
  * Open
  ****************************************************************************/
@@ -2022,6 +2273,23 @@ static int Open(vlc_object_t *p_this)
     vlc_cond_init(&p_sys->wait);
     vlc_mutex_init(&p_sys->lock);
 
+    p_sys->download.threads = var_InheritInteger(s, "hls-segment-threads");
+    if (p_sys->download.threads < 1)
+        p_sys->download.threads = 1;
+    else if (p_sys->download.threads > HLS_MAX_THREADS)
+        p_sys->download.threads = HLS_MAX_THREADS;
+    p_sys->download.buffer = (uint64_t)__MAX(1, var_InheritInteger(s, "hls-prefetch-size")) << 20;
+    for (int i = 0; i < HLS_MAX_THREADS; i++)
+        p_sys->download.busy[i] = -1;
+    vlc_atomic_set(&p_sys->download.generation, 0);
+
+    vlc_mutex_init(&p_sys->download.lock_wait);
+    vlc_cond_init(&p_sys->download.wait);
+    vlc_mutex_init(&p_sys->download.lock_key);
+
+    vlc_mutex_init(&p_sys->read.lock_wait);
+    vlc_cond_init(&p_sys->read.wait);
+
     /* Parse HLS m3u8 content. */
     uint8_t *buffer = NULL;
     ssize_t len = read_M3U8_from_stream(s->p_source, &buffer);
@@ -2043,7 +2311,9 @@ static int Open(vlc_object_t *p_this)
     p_sys->playback.segment = p_sys->download.segment = ChooseSegment(s, current);
 
     /* manage encryption key if needed */
+    vlc_mutex_lock(&p_sys->download.lock_key);
     hls_ManageSegmentKeys(s, hls_Get(p_sys->hls_stream, current));
+    vlc_mutex_unlock(&p_sys->download.lock_key);
 
     if (Prefetch(s, &current) != VLC_SUCCESS)
     {
@@ -2052,15 +2322,10 @@ static int Open(vlc_object_t *p_this)
     }
 
     p_sys->download.stream = current;
+    p_sys->download.next = p_sys->download.segment;
     p_sys->playback.stream = current;
     p_sys->download.seek = -1;
 
-    vlc_mutex_init(&p_sys->download.lock_wait);
-    vlc_cond_init(&p_sys->download.wait);
-
-    vlc_mutex_init(&p_sys->read.lock_wait);
-    vlc_cond_init(&p_sys->read.wait);
-
     /* Initialize HLS live stream */
     if (p_sys->b_live)
     {
@@ -2071,27 +2336,37 @@ static int Open(vlc_object_t *p_this)
 
         if (vlc_clone(&p_sys->reload, hls_Reload, s, VLC_THREAD_PRIORITY_LOW))
         {
-            goto fail_thread;
+            goto fail;
         }
     }
 
-    if (vlc_clone(&p_sys->thread, hls_Thread, s, VLC_THREAD_PRIORITY_INPUT))
+    for (int i = 0; i < p_sys->download.threads; i++)
     {
-        if (p_sys->b_live)
-            vlc_join(p_sys->reload, NULL);
-        goto fail_thread;
+        if (vlc_clone(&p_sys->thread[i], hls_Thread, s, VLC_THREAD_PRIORITY_INPUT))
+        {
+            if (i > 0)
+            {   /* carry on with fewer concurrent downloads */
+                vlc_mutex_lock(&p_sys->download.lock_wait);
+                p_sys->download.threads = i;
+                vlc_mutex_unlock(&p_sys->download.lock_wait);
+                break;
+            }
+            if (p_sys->b_live)
+                vlc_join(p_sys->reload, NULL);
+            goto fail;
+        }
     }
 
     return VLC_SUCCESS;
 
-fail_thread:
+fail:
     vlc_mutex_destroy(&p_sys->download.lock_wait);
     vlc_cond_destroy(&p_sys->download.wait);
+    vlc_mutex_destroy(&p_sys->download.lock_key);
 
     vlc_mutex_destroy(&p_sys->read.lock_wait);
     vlc_cond_destroy(&p_sys->read.wait);
 
-fail:
     /* Free hls streams */
     for (int i = 0; i < vlc_array_count(p_sys->hls_stream); i++)
     {
@@ -2121,23 +2396,27 @@ static void Close(vlc_object_t *p_this)
 
     vlc_mutex_lock(&p_sys->lock);
     p_sys->paused = false;
-    vlc_cond_signal(&p_sys->wait);
+    vlc_cond_broadcast(&p_sys->wait);
     vlc_mutex_unlock(&p_sys->lock);
 
     /* */
     vlc_mutex_lock(&p_sys->download.lock_wait);
     /* negate the condition variable's predicate */
     p_sys->download.segment = p_sys->playback.segment = 0;
+    p_sys->download.next = 0;
     p_sys->download.seek = 0; /* better safe than sorry */
-    vlc_cond_signal(&p_sys->download.wait);
+    vlc_atomic_inc(&p_sys->download.generation);
+    vlc_cond_broadcast(&p_sys->download.wait);
     vlc_mutex_unlock(&p_sys->download.lock_wait);
 
     /* */
     if (p_sys->b_live)
         vlc_join(p_sys->reload, NULL);
-    vlc_join(p_sys->thread, NULL);
+    for (int i = 0; i < p_sys->download.threads; i++)
+        vlc_join(p_sys->thread[i], NULL);
     vlc_mutex_destroy(&p_sys->download.lock_wait);
     vlc_cond_destroy(&p_sys->download.wait);
+    vlc_mutex_destroy(&p_sys->download.lock_key);
 
     vlc_mutex_destroy(&p_sys->read.lock_wait);
     vlc_cond_destroy(&p_sys->read.wait);
@@ -2296,7 +2575,7 @@ static ssize_t hls_Read(stream_t *s, uint8_t *p_read, unsigned int i_read)
             /* signal download thread */
             vlc_mutex_lock(&p_sys->download.lock_wait);
             p_sys->playback.segment++;
-            vlc_cond_signal(&p_sys->download.wait);
+            vlc_cond_broadcast(&p_sys->download.wait);
             vlc_mutex_unlock(&p_sys->download.lock_wait);
             continue;
         }
@@ -2607,7 +2886,9 @@ static int segment_Seek(stream_t *s, const uint64_t pos)
         /* Wake up download thread */
         vlc_mutex_lock(&p_sys->download.lock_wait);
         p_sys->download.seek = p_sys->playback.segment;
-        vlc_cond_signal(&p_sys->download.wait);
+        /* abort the transfers in progress */
+        vlc_atomic_inc(&p_sys->download.generation);
+        vlc_cond_broadcast(&p_sys->download.wait);
 
         /* Wait for download to be finished */
         msg_Dbg(s, "seek to segment %d", p_sys->playback.segment);
@@ -2652,7 +2933,7 @@ static int Control(stream_t *s, int i_query, va_list args)
 
             vlc_mutex_lock(&p_sys->lock);
             p_sys->paused = paused;
-            vlc_cond_signal(&p_sys->wait);
+            vlc_cond_broadcast(&p_sys->wait);
             vlc_mutex_unlock(&p_sys->lock);
             break;
         }
@@ -214,8 +214,8 @@ void SendRTCP (rtcp_sender_t *__restrict rtcp, const block_t *rtp)			// sunqueen
 
     /* Updates statistics */
     rtcp->packets++;
-    rtcp->bytes += rtp->i_buffer;
-    rtcp->counter += rtp->i_buffer;
+    rtcp->bytes += rtp_packet_size (rtp);
+    rtcp->counter += rtp_packet_size (rtp);
 
     /* 1.25% rate limit */
     if ((rtcp->counter / 80) < rtcp->length)
@@ -42,6 +42,7 @@
 #include <vlc_network.h>
 #include <vlc_fs.h>
 #include <vlc_rand.h>
+#include <vlc_atomic.h>
 #ifdef HAVE_SRTP
 # include <srtp.h>
 # include <gcrypt.h>
@@ -71,6 +72,17 @@
 #include <errno.h>
 #include <assert.h>
 
+#if defined( __linux__ ) && defined( MSG_WAITFORONE )
+/* sendmmsg() is declared along MSG_WAITFORONE */
+# define RTP_MMSG 1
+#endif
+#ifndef _WIN32
+# include <sys/uio.h>
+#endif
+
+/* packets sent to each sink in a single call, at most */
+#define RTP_BATCH 64
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -143,6 +155,12 @@
     "Default caching value for outbound RTP streams. This " \
     "value should be set in milliseconds." )
 
+#define ZEROCOPY_TEXT N_("Zero-copy packetization")
+#define ZEROCOPY_LONGTEXT N_( \
+    "RTP packets reference their payload in the original frame instead " \
+    "of copying it, and each frame is sent as one train of packets. " \
+    "Not used with SRTP." )
+
 #define PROTO_TEXT N_("Transport protocol")
 #define PROTO_LONGTEXT N_( \
     "This selects which transport protocol to use for RTP." )
@@ -234,6 +252,8 @@ vlc_module_begin ()
               RTCP_MUX_TEXT, RTCP_MUX_LONGTEXT, false )
     add_integer( SOUT_CFG_PREFIX "caching", DEFAULT_PTS_DELAY / 1000,
                  CACHING_TEXT, CACHING_LONGTEXT, true )
+    add_bool( SOUT_CFG_PREFIX "zerocopy", false, ZEROCOPY_TEXT,
+              ZEROCOPY_LONGTEXT, true )
 
 #ifdef HAVE_SRTP
     add_string( SOUT_CFG_PREFIX "key", "",
@@ -270,7 +290,7 @@ vlc_module_end ()
 static const char *const ppsz_sout_options[] = {
     "dst", "name", "cat", "port", "port-audio", "port-video", "*sdp", "ttl",
     "mux", "sap", "description", "url", "email", "phone",
-    "proto", "rtcp-mux", "caching",
+    "proto", "rtcp-mux", "caching", "zerocopy",
 #ifdef HAVE_SRTP
     "key", "salt",
 #endif
@@ -355,6 +375,27 @@ typedef struct rtp_sink_t
     rtcp_sender_t *rtcp;
 } rtp_sink_t;
 
+/* zero-copy packet: the headers are in the block, the payload in the frame */
+struct rtp_au_t
+{
+    vlc_atomic_t refs;
+    block_t     *p_block;
+};
+
+#define RTP_SLICE_HEADER_MAX 32
+
+/* p_buffer and i_buffer of the block only cover the headers */
+typedef struct rtp_slice_t
+{
+    block_t        self;
+    rtp_au_t      *p_au;
+    const uint8_t *p_payload;
+    size_t         i_payload;
+    uint8_t        header[RTP_SLICE_HEADER_MAX];
+} rtp_slice_t;
+
+static const rtp_slice_t *rtp_slice( const block_t * );
+
 struct sout_stream_id_t
 {
     sout_stream_t *p_stream;
@@ -391,6 +432,10 @@ struct sout_stream_id_t
 
     block_fifo_t     *p_fifo;
     int64_t           i_caching;
+
+    /* zero-copy packetization */
+    bool              b_zerocopy;
+    rtp_au_t         *p_au; /* frame being packetized, if any */
 };
 
 /*****************************************************************************
@@ -988,6 +1033,8 @@ static sout_stream_id_t *Add( sout_stream_t *p_stream, es_format_t *p_fmt )
     id->b_first_packet = true;
     id->i_caching =
         (int64_t)1000 * var_GetInteger( p_stream, SOUT_CFG_PREFIX "caching");
+    id->b_zerocopy = var_GetBool( p_stream, SOUT_CFG_PREFIX "zerocopy" );
+    id->p_au = NULL;
 
     vlc_rand_bytes (&id->i_sequence, sizeof (id->i_sequence));
     vlc_rand_bytes (id->ssrc, sizeof (id->ssrc));
@@ -1188,7 +1235,7 @@ static sout_stream_id_t *Add( sout_stream_t *p_stream, es_format_t *p_fmt )
         id->rtsp_id = RtspAddId( p_sys->rtsp, id, GetDWBE( id->ssrc ),
                                  id->rtp_fmt.clock_rate, mcast_fd );
 
-    id->p_fifo = block_FifoNew();
+    id->p_fifo = block_FifoNewSPSC();
     if( unlikely(id->p_fifo == NULL) )
         goto error;
     if( vlc_clone( &id->thread, ThreadSend, id, VLC_THREAD_PRIORITY_HIGHEST ) )
@@ -1292,10 +1339,18 @@ static int Send( sout_stream_t *p_stream, sout_stream_id_t *id,
                                           p_buffer->i_pts);
         }
 
-        if( id->rtp_fmt.pf_packetize( id, p_buffer ) )
-            break;
+        /* Packets may keep references to the frame */
+        id->p_au = rtp_au_New( id, p_buffer );
 
-        block_Release( p_buffer );
+        int val = id->rtp_fmt.pf_packetize( id, p_buffer );
+
+        if( id->p_au != NULL )
+            rtp_au_Release( id->p_au );
+        else
+            block_Release( p_buffer );
+        id->p_au = NULL;
+        if( val )
+            break;
         p_buffer = p_next;
     }
     return VLC_SUCCESS;
@@ -1401,13 +1456,120 @@ static int  HttpCallback( httpd_file_sys_t *p_args,
 /****************************************************************************
  * RTP send
  ****************************************************************************/
-static void* ThreadSend( void *data )
-{
 #ifdef _WIN32
 # define ENOBUFS      WSAENOBUFS
 # define EAGAIN       WSAEWOULDBLOCK
 # define EWOULDBLOCK  WSAEWOULDBLOCK
 #endif
+
+#ifndef _WIN32
+/* Points at the headers and payload of a packet, returns the count */
+static unsigned rtp_packet_iov( const block_t *out, struct iovec *iov )
+{
+    const rtp_slice_t *slice = rtp_slice( out );
+
+    if( slice == NULL )
+    {
+        iov[0].iov_base = out->p_buffer;
+        iov[0].iov_len  = out->i_buffer;
+        return 1;
+    }
+    iov[0].iov_base = out->p_buffer;
+    iov[0].iov_len  = out->i_buffer;
+    iov[1].iov_base = (void *)slice->p_payload;
+    iov[1].iov_len  = slice->i_payload;
+    return 2;
+}
+#endif
+
+static ssize_t rtp_send_packet( int fd, const block_t *out )
+{
+    const rtp_slice_t *slice = rtp_slice( out );
+
+    if( slice == NULL )
+        return send( fd, (const char *)out->p_buffer, out->i_buffer, 0 );			// sunqueen modify
+#ifdef _WIN32
+    WSABUF buf[2];
+    DWORD sent;
+
+    buf[0].buf = (char *)out->p_buffer;
+    buf[0].len = out->i_buffer;
+    buf[1].buf = (char *)slice->p_payload;
+    buf[1].len = slice->i_payload;
+    if( WSASend( fd, buf, 2, &sent, 0, NULL, NULL ) )
+        return -1;
+    return sent;
+#else
+    struct iovec iov[2];
+    struct msghdr hdr;
+
+    memset( &hdr, 0, sizeof( hdr ) );
+    hdr.msg_iov    = iov;
+    hdr.msg_iovlen = rtp_packet_iov( out, iov );
+    return sendmsg( fd, &hdr, 0 );
+#endif
+}
+
+/* Handles a failed send, returns true if the socket is broken */
+static bool rtp_send_failed( int fd, const block_t *out )
+{
+    if( net_errno == EAGAIN || net_errno == EWOULDBLOCK
+     || net_errno == ENOBUFS || net_errno == ENOMEM )
+        return false;
+
+    int type;
+	// sunqueen modify start
+	socklen_t typeSize = sizeof(type);
+    getsockopt( fd, SOL_SOCKET, SO_TYPE,
+    //            &type, &(socklen_t){ sizeof(type) });
+	            (char*)&type, &typeSize);
+	// sunqueen modify end
+    if( type != SOCK_DGRAM )
+        return true; /* Broken connection */
+
+    /* ICMP soft error: ignore and retry */
+    rtp_send_packet( fd, out );
+    return false;
+}
+
+/* Sends a train of packets to one sink, returns -1 if the socket is broken */
+static int rtp_send_train( int fd, block_t *const *pktv, unsigned pktc )
+{
+#ifdef RTP_MMSG
+    struct mmsghdr msgv[RTP_BATCH];
+    struct iovec   iov[RTP_BATCH][2];
+
+    memset( msgv, 0, pktc * sizeof( *msgv ) );
+    for( unsigned i = 0; i < pktc; i++ )
+    {
+        msgv[i].msg_hdr.msg_iov    = iov[i];
+        msgv[i].msg_hdr.msg_iovlen = rtp_packet_iov( pktv[i], iov[i] );
+    }
+
+    for( unsigned i = 0; i < pktc; )
+    {
+        int val = sendmmsg( fd, msgv + i, pktc - i, 0 );
+        if( val > 0 )
+        {
+            i += val;
+            continue;
+        }
+        /* the error is about the first packet */
+        if( rtp_send_failed( fd, pktv[i] ) )
+            return -1;
+        i++;
+    }
+#else
+    for( unsigned i = 0; i < pktc; i++ )
+        if( rtp_send_packet( fd, pktv[i] ) == -1
+         && rtp_send_failed( fd, pktv[i] ) )
+            return -1;
+#endif
+    return 0;
+}
+
+static void* ThreadSend( void *data )
+{
     sout_stream_id_t *id = (sout_stream_id_t *)data;			// sunqueen modify
     unsigned i_caching = id->i_caching;
 
@@ -1441,14 +1603,36 @@ static void* ThreadSend( void *data )
         vlc_cleanup_pop ();
         if (out == NULL)
             continue;
+        /* packets are encrypted one at a time */
+        const unsigned i_train_max = id->srtp ? 1 : RTP_BATCH;
 #else
         mwait (out->i_dts + i_caching);
         vlc_cleanup_pop ();
+        const unsigned i_train_max = RTP_BATCH;
 #endif
 
-        ssize_t len = out->i_buffer;
         int canc = vlc_savecancel ();
 
+        /* Send along the packets that are due as well, and the rest of a
+         * zero-copy frame */
+        block_t *trainv[RTP_BATCH];
+        unsigned trainc = 0;
+        const rtp_slice_t *slice = rtp_slice( out );
+        mtime_t now = mdate();
+
+        trainv[trainc++] = out;
+        while( trainc < i_train_max && block_FifoCount( id->p_fifo ) > 0 )
+        {
+            block_t *next = block_FifoShow( id->p_fifo );
+            const rtp_slice_t *next_slice = rtp_slice( next );
+
+            if( next->i_dts + i_caching > now
+             && ( slice == NULL || next_slice == NULL
+               || next_slice->p_au != slice->p_au ) )
+                break;
+            trainv[trainc++] = block_FifoGet( id->p_fifo );
+        }
+
         vlc_mutex_lock( &id->lock_sink );
         unsigned deadc = 0; /* How many dead sockets? */
 		// sunqueen modify start
@@ -1461,30 +1645,17 @@ static void* ThreadSend( void *data )
 #ifdef HAVE_SRTP
             if( !id->srtp ) /* FIXME: SRTCP support */
 #endif
-                SendRTCP( id->sinkv[i].rtcp, out );
+                for( unsigned j = 0; j < trainc; j++ )
+                    SendRTCP( id->sinkv[i].rtcp, trainv[j] );
 
-            if( send( id->sinkv[i].rtp_fd, (const char *)out->p_buffer, len, 0 ) == -1			// sunqueen modify
-             && net_errno != EAGAIN && net_errno != EWOULDBLOCK
-             && net_errno != ENOBUFS && net_errno != ENOMEM )
-            {
-                int type;
-				// sunqueen modify start
-				socklen_t typeSize = sizeof(type);
-                getsockopt( id->sinkv[i].rtp_fd, SOL_SOCKET, SO_TYPE,
-                //            &type, &(socklen_t){ sizeof(type) });
-				            (char*)&type, &typeSize);
-				// sunqueen modify end
-                if( type == SOCK_DGRAM )
-                    /* ICMP soft error: ignore and retry */
-                    send( id->sinkv[i].rtp_fd, (const char *)out->p_buffer, len, 0 );			// sunqueen modify
-                else
-                    /* Broken connection */
-                    deadv[deadc++] = id->sinkv[i].rtp_fd;
-            }
+            if( rtp_send_train( id->sinkv[i].rtp_fd, trainv, trainc ) )
+                deadv[deadc++] = id->sinkv[i].rtp_fd;
         }
-        id->i_seq_sent_next = ntohs(((uint16_t *) out->p_buffer)[1]) + 1;
+        id->i_seq_sent_next =
+            ntohs(((uint16_t *) trainv[trainc - 1]->p_buffer)[1]) + 1;
         vlc_mutex_unlock( &id->lock_sink );
-        block_Release( out );
+        for( unsigned j = 0; j < trainc; j++ )
+            block_Release( trainv[j] );
 
         for( unsigned i = 0; i < deadc; i++ )
         {
@@ -1675,6 +1846,97 @@ void rtp_packetize_send( sout_stream_id_t *id, block_t *out )
     block_FifoPut( id->p_fifo, out );
 }
 
+rtp_au_t *rtp_au_New( sout_stream_id_t *id, block_t *frame )
+{
+    if( !id->b_zerocopy )
+        return NULL;
+#ifdef HAVE_SRTP
+    if( id->srtp != NULL ) /* encrypts packets in place */
+        return NULL;
+#endif
+
+    rtp_au_t *au = (rtp_au_t *)malloc( sizeof( *au ) );			// sunqueen modify
+    if( unlikely(au == NULL) )
+        return NULL;
+    vlc_atomic_set( &au->refs, 1 );
+    au->p_block = frame;
+    return au;
+}
+
+void rtp_au_Release( rtp_au_t *au )
+{
+    if( vlc_atomic_dec( &au->refs ) == 0 )
+    {
+        block_Release( au->p_block );
+        free( au );
+    }
+}
+
+static void rtp_slice_Release( block_t *block )
+{
+    rtp_slice_t *slice = (rtp_slice_t *)block;
+
+    rtp_au_Release( slice->p_au );
+    free( slice );
+}
+
+static const rtp_slice_t *rtp_slice( const block_t *block )
+{
+    if( block->pf_release != rtp_slice_Release )
+        return NULL;
+    return (const rtp_slice_t *)block;
+}
+
+block_t *rtp_packetize_alloc( sout_stream_id_t *id, size_t i_header,
+                              const uint8_t *p_payload, size_t i_payload )
+{
+    rtp_au_t *au = id->p_au;
+
+    if( au != NULL && i_header <= RTP_SLICE_HEADER_MAX
+     && p_payload >= au->p_block->p_buffer
+     && p_payload + i_payload <= au->p_block->p_buffer
+                                 + au->p_block->i_buffer )
+    {
+        rtp_slice_t *slice = (rtp_slice_t *)malloc( sizeof( *slice ) );			// sunqueen modify
+        if( likely(slice != NULL) )
+        {
+            block_Init( &slice->self, slice->header, i_header );
+            slice->self.pf_release = rtp_slice_Release;
+            vlc_atomic_inc( &au->refs );
+            slice->p_au      = au;
+            slice->p_payload = p_payload;
+            slice->i_payload = i_payload;
+            return &slice->self;
+        }
+    }
+
+    block_t *out = block_Alloc( i_header + i_payload );
+    if( likely(out != NULL) )
+        memcpy( out->p_buffer + i_header, p_payload, i_payload );
+    return out;
+}
+
+void rtp_packetize_length( block_t *out, size_t i_header, size_t i_payload )
+{
+    const rtp_slice_t *slice = rtp_slice( out );
+
+    if( slice != NULL )
+    {
+        assert( i_header <= RTP_SLICE_HEADER_MAX );
+        assert( i_payload == slice->i_payload );
+        out->i_buffer = i_header;
+    }
+    else
+        out->i_buffer = i_header + i_payload;
+}
+
+size_t rtp_packet_size( const block_t *out )
+{
+    const rtp_slice_t *slice = rtp_slice( out );
+
+    return out->i_buffer + ( slice != NULL ? slice->i_payload : 0 );
+}
+
 /**
  * @return configured max RTP payload size (including payload type-specific
  * headers, excluding RTP and transport headers)
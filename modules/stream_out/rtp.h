@@ -59,6 +59,22 @@ void rtp_packetize_common (sout_stream_id_t *id, block_t *out,
 void rtp_packetize_send (sout_stream_id_t *id, block_t *out);
 size_t rtp_mtu (const sout_stream_id_t *id);
 
+/* Frame shared by zero-copy packets */
+typedef struct rtp_au_t rtp_au_t;
+rtp_au_t *rtp_au_New (sout_stream_id_t *id, block_t *frame);
+void rtp_au_Release (rtp_au_t *au);
+
+/* Packet with room for the RTP header and i_header - 12 bytes of payload
+ * header, followed by the payload. With zero-copy packetization, the payload
+ * is only referenced if it lies in the frame being packetized: p_buffer and
+ * i_buffer then only cover the headers. */
+block_t *rtp_packetize_alloc (sout_stream_id_t *id, size_t i_header,
+                              const uint8_t *p_payload, size_t i_payload);
+/* Sets i_buffer of such a packet, instead of i_header + i_payload */
+void rtp_packetize_length (block_t *out, size_t i_header, size_t i_payload);
+/* Size of a packet on the wire, payload included */
+size_t rtp_packet_size (const block_t *out);
+
 int rtp_packetize_xiph_config( sout_stream_id_t *id, const char *fmtp,
                                int64_t i_pts );
 
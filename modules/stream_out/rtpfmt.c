@@ -859,14 +859,13 @@ static int rtp_packetize_split( sout_stream_id_t *id, block_t *in )
     for( i = 0; i < i_count; i++ )
     {
         int           i_payload = __MIN( i_max, i_data );
-        block_t *out = block_Alloc( 12 + i_payload );
+        block_t *out = rtp_packetize_alloc( id, 12, p_data, i_payload );
 
         /* rtp common header */
         rtp_packetize_common( id, out, (i == i_count - 1),
                       (in->i_pts > VLC_TS_INVALID ? in->i_pts : in->i_dts) );
-        memcpy( &out->p_buffer[12], p_data, i_payload );
 
-        out->i_buffer   = 12 + i_payload;
+        rtp_packetize_length( out, 12, i_payload );
         out->i_dts    = in->i_dts + i * in->i_length / i_count;
         out->i_length = in->i_length / i_count;
 
@@ -1090,15 +1089,13 @@ rtp_packetize_h264_nal( sout_stream_id_t *id,
     if( i_data <= i_max )
     {
         /* Single NAL unit packet */
-        block_t *out = block_Alloc( 12 + i_data );
+        block_t *out = rtp_packetize_alloc( id, 12, p_data, i_data );
         out->i_dts    = i_dts;
         out->i_length = i_length;
 
         /* */
         rtp_packetize_common( id, out, b_last, i_pts );
-        out->i_buffer = 12 + i_data;
-
-        memcpy( &out->p_buffer[12], p_data, i_data );
+        rtp_packetize_length( out, 12, i_data );
 
         rtp_packetize_send( id, out );
     }
@@ -1114,20 +1111,19 @@ rtp_packetize_h264_nal( sout_stream_id_t *id,
         for( i = 0; i < i_count; i++ )
         {
             const int i_payload = __MIN( i_data, i_max-2 );
-            block_t *out = block_Alloc( 12 + 2 + i_payload );
+            block_t *out = rtp_packetize_alloc( id, 12 + 2, p_data, i_payload );
             out->i_dts    = i_dts + i * i_length / i_count;
             out->i_length = i_length / i_count;
 
             /* */
             rtp_packetize_common( id, out, (b_last && i_payload == i_data),
                                     i_pts );
-            out->i_buffer = 14 + i_payload;
+            rtp_packetize_length( out, 14, i_payload );
 
             /* FU indicator */
             out->p_buffer[12] = 0x00 | (i_nal_hdr & 0x60) | 28;
             /* FU header */
             out->p_buffer[13] = ( i == 0 ? 0x80 : 0x00 ) | ( (i == i_count-1) ? 0x40 : 0x00 )  | i_nal_type;
-            memcpy( &out->p_buffer[14], p_data, i_payload );
 
             rtp_packetize_send( id, out );
 
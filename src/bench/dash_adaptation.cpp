@@ -0,0 +1,202 @@
+/*****************************************************************************
+ * dash_adaptation.cpp: DASH adaptation logic simulation
+ *****************************************************************************
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Usage: dash_adaptation <mpd file> <trace file> [rate|buffer|best]
+ *                        [segment seconds] [segments]
+ * The trace holds "<seconds> <kbit/s>" lines, replayed in a loop. Segment
+ * downloads are simulated against it on a virtual clock, with a 30 seconds
+ * buffer drained in real time, so that runs are reproducible. Build against
+ * libvlc and the sources of modules/stream_filter/dash. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc/vlc.h>
+#include "../../lib/libvlc_internal.h"
+#include <vlc_common.h>
+#include <vlc_stream.h>
+#include <vlc_url.h>
+
+#include "xml/DOMParser.h"
+#include "mpd/MPDFactory.h"
+#include "mpd/MPDManagerFactory.h"
+#include "adaptationlogic/AdaptationLogicFactory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#undef NDEBUG
+#include <assert.h>
+
+#define CAPACITY 30.
+
+using namespace dash;
+
+struct trace_t
+{
+    std::vector<double> duration; /* seconds */
+    std::vector<double> rate;     /* bits per second */
+    double              period;
+};
+
+static void trace_Load (trace_t *trace, const char *path)
+{
+    FILE *file = fopen (path, "r");
+    double seconds, kbps;
+
+    assert (file != NULL);
+    trace->period = 0.;
+    while (fscanf (file, "%lf %lf", &seconds, &kbps) == 2)
+        if (seconds > 0.)
+        {
+            trace->duration.push_back (seconds);
+            trace->rate.push_back (kbps * 1000.);
+            trace->period += seconds;
+        }
+    fclose (file);
+    assert (!trace->duration.empty ());
+}
+
+/* Time to transfer bits from date on, the trace being looped */
+static double trace_Transfer (const trace_t *trace, double date, double bits)
+{
+    double spent = 0., offset = date - trace->period * (long)(date / trace->period);
+    size_t i = 0;
+
+    while (offset >= trace->duration[i])
+        offset -= trace->duration[i++];
+
+    for (;;)
+    {
+        double left = trace->duration[i] - offset;
+        if (trace->rate[i] * left >= bits)
+            return spent + bits / trace->rate[i];
+        bits -= trace->rate[i] * left;
+        spent += left;
+        offset = 0.;
+        i = (i + 1) % trace->duration.size ();
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        fprintf (stderr, "usage: %s <mpd file> <trace file> "
+                 "[rate|buffer|best] [segment seconds] [segments]\n", argv[0]);
+        return 1;
+    }
+
+    logic::IAdaptationLogic::LogicType type = logic::IAdaptationLogic::BufferBased;
+    if (argc > 3 && !strcmp (argv[3], "rate"))
+        type = logic::IAdaptationLogic::RateBased;
+    else if (argc > 3 && !strcmp (argv[3], "best"))
+        type = logic::IAdaptationLogic::AlwaysBest;
+    double seglen = (argc > 4) ? atof (argv[4]) : 2.;
+    unsigned segments = (argc > 5) ? strtoul (argv[5], NULL, 0) : 300;
+
+    trace_t trace;
+    trace_Load (&trace, argv[2]);
+
+    const char *args[] = { "--quiet" };
+    libvlc_instance_t *vlc = libvlc_new (1, args);
+    assert (vlc != NULL);
+
+    char *uri = vlc_path2uri (argv[1], NULL);
+    assert (uri != NULL);
+    stream_t *s = stream_UrlNew (vlc->p_libvlc_int, uri);
+    free (uri);
+    assert (s != NULL);
+
+    xml::DOMParser parser (s);
+    assert (parser.parse ());
+    mpd::MPD *mpd = mpd::MPDFactory::create (parser.getRootNode (), s,
+                                             parser.getProfile ());
+    assert (mpd != NULL);
+    mpd::IMPDManager *manager = mpd::MPDManagerFactory::create (mpd);
+    assert (manager != NULL);
+    logic::IAdaptationLogic *adaptation =
+        logic::AdaptationLogicFactory::create (type, manager, s);
+    assert (adaptation != NULL);
+
+    double clock = 0., buffered = 0., stalled = 0., startup = -1.;
+    double bits_total = 0.;
+    unsigned count = 0, switches = 0, rebuffers = 0;
+    int last = -1;
+
+    for (http::Chunk *chunk; count < segments
+                          && (chunk = adaptation->getNextChunk ()) != NULL; )
+    {
+        double bits = (double)chunk->getBitrate () * seglen;
+        delete chunk;
+
+        double spent = trace_Transfer (&trace, clock, bits);
+        clock += spent;
+
+        /* play out what was buffered while downloading */
+        if (startup >= 0.)
+        {
+            if (spent > buffered)
+            {
+                stalled += spent - buffered;
+                rebuffers++;
+                buffered = 0.;
+                adaptation->bufferLevelChanged (0, 0);
+            }
+            else
+                buffered -= spent;
+        }
+
+        buffered += seglen;
+        if (startup < 0.)
+            startup = clock;
+        bits_total += bits;
+
+        int bitrate = (int)(bits / seglen);
+        if (last != -1 && bitrate != last)
+            switches++;
+        last = bitrate;
+
+        uint64_t bps = (uint64_t)(bits / spent);
+        adaptation->downloadRateChanged ((uint64_t)(bits_total / clock), bps);
+
+        /* wait for room in the buffer, as BlockBuffer does */
+        if (buffered > CAPACITY - seglen)
+        {
+            clock += buffered - (CAPACITY - seglen);
+            buffered = CAPACITY - seglen;
+        }
+        adaptation->bufferLevelChanged ((mtime_t)(buffered * CLOCK_FREQ),
+                                        (int)(buffered * 100 / CAPACITY));
+        count++;
+    }
+
+    assert (count > 0);
+    printf ("%u segments: average %.0f kbit/s, %u switches, %u rebuffers "
+            "(%.1f s stalled), startup %.2f s\n", count,
+            bits_total / (count * seglen) / 1000., switches, rebuffers,
+            stalled, startup);
+
+    delete adaptation;
+    delete manager;
+    stream_Delete (s);
+    libvlc_release (vlc);
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*****************************************************************************
+ * httpd_load.c: HTTP server load test
+ *****************************************************************************
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Usage: httpd_load [clients] [threads] [seconds]
+ * Serves one stream and connects as many local clients to it, then reports
+ * how many of them got data and the aggregate throughput. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc/vlc.h>
+#include "../../lib/libvlc_internal.h"
+#include <vlc_common.h>
+#include <vlc_httpd.h>
+#include <vlc_network.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#undef NDEBUG
+#include <assert.h>
+
+#define PORT  18080
+#define CHUNK 4096
+
+static int connect_client (vlc_object_t *obj)
+{
+    static const char req[] = "GET /load HTTP/1.0\r\n\r\n";
+    int fd = net_ConnectTCP (obj, "127.0.0.1", PORT);
+    if (fd == -1)
+        return -1;
+
+    if (net_Write (obj, fd, NULL, req, sizeof (req) - 1)
+                                            != (ssize_t)(sizeof (req) - 1))
+    {
+        net_Close (fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main (int argc, char *argv[])
+{
+    unsigned clients = (argc > 1) ? strtoul (argv[1], NULL, 0) : 2000;
+    unsigned threads = (argc > 2) ? strtoul (argv[2], NULL, 0) : 4;
+    unsigned seconds = (argc > 3) ? strtoul (argv[3], NULL, 0) : 5;
+    char port_arg[32], threads_arg[32];
+
+    snprintf (port_arg, sizeof (port_arg), "--http-port=%d", PORT);
+    snprintf (threads_arg, sizeof (threads_arg), "--http-threads=%u", threads);
+    const char *args[] = { "--quiet", "--http-host=127.0.0.1",
+                           port_arg, threads_arg };
+
+    libvlc_instance_t *vlc = libvlc_new (sizeof (args) / sizeof (args[0]),
+                                         args);
+    assert (vlc != NULL);
+
+    httpd_host_t *host = vlc_http_HostNew (VLC_OBJECT(vlc->p_libvlc_int));
+    assert (host != NULL);
+    httpd_stream_t *stream = httpd_StreamNew (host, "/load",
+                                              "application/octet-stream",
+                                              NULL, NULL);
+    assert (stream != NULL);
+
+    struct pollfd *ufd = (struct pollfd *)calloc (clients, sizeof (*ufd));
+    uint64_t *received = (uint64_t *)calloc (clients, sizeof (*received));
+    assert (ufd != NULL && received != NULL);
+
+    unsigned connected = 0;
+    for (unsigned i = 0; i < clients; i++)
+    {
+        int fd = connect_client (VLC_OBJECT(vlc->p_libvlc_int));
+        if (fd == -1)
+        {
+            fprintf (stderr, "connection %u failed, stopping there\n", i);
+            break;
+        }
+        ufd[connected].fd = fd;
+        ufd[connected].events = POLLIN;
+        connected++;
+    }
+
+    uint8_t chunk[CHUNK], buf[65536];
+    memset (chunk, 0x47, sizeof (chunk));
+
+    uint64_t total = 0;
+    mtime_t start = mdate (), deadline = start + seconds * CLOCK_FREQ;
+    while (mdate () < deadline)
+    {
+        httpd_StreamSend (stream, chunk, sizeof (chunk));
+
+        int n = poll (ufd, connected, 1);
+        for (unsigned i = 0; n > 0 && i < connected; i++)
+        {
+            if (ufd[i].revents == 0)
+                continue;
+            n--;
+
+            ssize_t len = recv (ufd[i].fd, (char *)buf, sizeof (buf), 0);
+            if (len <= 0)
+            {
+                ufd[i].events = 0; /* closed by the server */
+                continue;
+            }
+            received[i] += len;
+            total += len;
+        }
+    }
+    mtime_t elapsed = mdate () - start;
+
+    unsigned served = 0;
+    for (unsigned i = 0; i < connected; i++)
+    {
+        if (received[i] > 0)
+            served++;
+        net_Close (ufd[i].fd);
+    }
+
+    printf ("%u threads: %u/%u connections, %u served, %.1f MiB/s\n",
+            threads, connected, clients, served,
+            (double)total * CLOCK_FREQ / elapsed / (1 << 20));
+
+    httpd_StreamDelete (stream);
+    httpd_HostDelete (host);
+    free (received);
+    free (ufd);
+    libvlc_release (vlc);
+
+    assert (served > 0);
+    return 0;
+}
@@ -0,0 +1,225 @@
+/*****************************************************************************
+ * mkv_block_read.c: Matroska demuxer throughput on large frames
+ *****************************************************************************
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Usage: mkv_block_read [frames] [frame kiB] [laced frames] [file]
+ * Writes a 25 fps Motion JPEG track of as many frames, in SimpleBlocks of
+ * one frame or in Xiph laced blocks, with a cluster every second, then
+ * times how long demuxing it to a dummy stream output takes. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc/vlc.h>
+#include <vlc_common.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#undef NDEBUG
+#include <assert.h>
+
+#define FPS 25
+
+static void w8 (FILE *f, uint8_t v)
+{
+    assert (fputc (v, f) != EOF);
+}
+
+static void wid (FILE *f, uint32_t id)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        if ((id >> shift) || !shift)
+            w8 (f, id >> shift);
+}
+
+/* sizes are always coded on 8 bytes, so that they can be patched */
+static void wsize (FILE *f, uint64_t size)
+{
+    w8 (f, 0x01);
+    for (int shift = 48; shift >= 0; shift -= 8)
+        w8 (f, size >> shift);
+}
+
+static void wuint (FILE *f, uint32_t id, uint64_t v)
+{
+    wid (f, id);
+    wsize (f, 8);
+    for (int shift = 56; shift >= 0; shift -= 8)
+        w8 (f, v >> shift);
+}
+
+static void wstring (FILE *f, uint32_t id, const char *str)
+{
+    wid (f, id);
+    wsize (f, strlen (str));
+    assert (fwrite (str, strlen (str), 1, f) == 1);
+}
+
+static long master_open (FILE *f, uint32_t id)
+{
+    wid (f, id);
+    long pos = ftell (f);
+    wsize (f, 0);
+    return pos;
+}
+
+static void master_close (FILE *f, long pos)
+{
+    long end = ftell (f);
+    fseek (f, pos, SEEK_SET);
+    wsize (f, end - pos - 8);
+    fseek (f, end, SEEK_SET);
+}
+
+static void write_file (const char *path, unsigned frames, size_t size,
+                        unsigned lace)
+{
+    FILE *f = fopen (path, "wb");
+    assert (f != NULL);
+
+    uint8_t *payload = (uint8_t *)malloc (size);
+    assert (payload != NULL);
+    for (size_t i = 0; i < size; i++)
+        payload[i] = i * 7;
+
+    long b = master_open (f, 0x1A45DFA3);
+    wuint (f, 0x4286, 1);
+    wuint (f, 0x42F7, 1);
+    wuint (f, 0x42F2, 4);
+    wuint (f, 0x42F3, 8);
+    wstring (f, 0x4282, "matroska");
+    wuint (f, 0x4287, 2);
+    wuint (f, 0x4285, 2);
+    master_close (f, b);
+
+    long segment = master_open (f, 0x18538067);
+    b = master_open (f, 0x1549A966);
+    wuint (f, 0x2AD7B1, 1000000);
+    wstring (f, 0x4D80, "mkv_block_read");
+    wstring (f, 0x5741, "mkv_block_read");
+    master_close (f, b);
+
+    long tracks = master_open (f, 0x1654AE6B);
+    long entry = master_open (f, 0xAE);
+    wuint (f, 0xD7, 1);
+    wuint (f, 0x73C5, 1);
+    wuint (f, 0x83, 1);
+    wstring (f, 0x86, "V_MJPEG");
+    wuint (f, 0x23E383, 1000000000 / FPS);
+    b = master_open (f, 0xE0);
+    wuint (f, 0xB0, 3840);
+    wuint (f, 0xBA, 2160);
+    master_close (f, b);
+    master_close (f, entry);
+    master_close (f, tracks);
+
+    long cluster = -1;
+    unsigned cluster_tc = 0;
+    for (unsigned i = 0; i < frames; i += lace)
+    {
+        unsigned count = (frames - i < lace) ? frames - i : lace;
+
+        if (i % FPS < lace)
+        {
+            if (cluster >= 0)
+                master_close (f, cluster);
+            cluster = master_open (f, 0x1F43B675);
+            cluster_tc = i * 1000 / FPS;
+            wuint (f, 0xE7, cluster_tc);
+        }
+
+        /* track, timecode, flags, then the Xiph lace sizes but the last */
+        size_t head = 4;
+        if (count > 1)
+            head += 1 + (count - 1) * (size / 255 + 1);
+        wid (f, 0xA3);
+        wsize (f, head + count * size);
+        w8 (f, 0x81);
+        unsigned tc = i * 1000 / FPS - cluster_tc;
+        w8 (f, tc >> 8);
+        w8 (f, tc);
+        w8 (f, ((i % FPS) < lace ? 0x80 : 0x00) | (count > 1 ? 0x02 : 0x00));
+        if (count > 1)
+        {
+            w8 (f, count - 1);
+            for (unsigned j = 0; j < count - 1; j++)
+            {
+                for (size_t n = size; n >= 255; n -= 255)
+                    w8 (f, 255);
+                w8 (f, size % 255);
+            }
+        }
+        for (unsigned j = 0; j < count; j++)
+            assert (fwrite (payload, size, 1, f) == 1);
+    }
+    if (cluster >= 0)
+        master_close (f, cluster);
+    master_close (f, segment);
+
+    free (payload);
+    assert (fclose (f) == 0);
+}
+
+int main (int argc, char *argv[])
+{
+    unsigned frames = (argc > 1) ? strtoul (argv[1], NULL, 0) : 1500;
+    size_t size = ((argc > 2) ? strtoul (argv[2], NULL, 0) : 512) * 1024;
+    unsigned lace = (argc > 3) ? strtoul (argv[3], NULL, 0) : 1;
+    const char *path = (argc > 4) ? argv[4] : "mkv_block_read.mkv";
+
+    assert (frames > 0 && size > 0 && lace > 0 && lace <= FPS);
+    write_file (path, frames, size, lace);
+
+    const char *args[] = { "--quiet", "--no-mkv-index-clusters" };
+    libvlc_instance_t *vlc = libvlc_new (2, args);
+    assert (vlc != NULL);
+
+    libvlc_media_t *md = libvlc_media_new_path (vlc, path);
+    assert (md != NULL);
+    libvlc_media_add_option (md, ":demux=mkv");
+    libvlc_media_add_option (md, ":sout=#dummy");
+
+    libvlc_media_player_t *mp = libvlc_media_player_new_from_media (md);
+    assert (mp != NULL);
+
+    mtime_t start = mdate ();
+    assert (libvlc_media_player_play (mp) == 0);
+
+    libvlc_state_t state;
+    do
+    {
+        msleep (10000);
+        state = libvlc_media_player_get_state (mp);
+    }
+    while (state != libvlc_Ended && state != libvlc_Error);
+    double spent = (double)(mdate () - start) / CLOCK_FREQ;
+
+    printf ("%u frames of %u kiB, %u per block: demuxed in %.2f s, "
+            "%.0f MiB/s\n", frames, (unsigned)(size / 1024), lace, spent,
+            frames * (double)size / (1024 * 1024) / spent);
+
+    libvlc_media_player_release (mp);
+    libvlc_media_release (md);
+    libvlc_release (vlc);
+    remove (path);
+
+    assert (state == libvlc_Ended);
+    return 0;
+}
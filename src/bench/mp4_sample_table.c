@@ -0,0 +1,284 @@
+/*****************************************************************************
+ * mp4_sample_table.c: MP4 demuxer open time and memory on long files
+ *****************************************************************************
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Usage: mp4_sample_table [samples] [samples per chunk] [file]
+ * Writes a 30 fps video track with as many one byte samples, an IBP
+ * composition pattern and a key frame every second, then times how long
+ * parsing it takes and reports the peak resident memory. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc/vlc.h>
+#include <vlc_common.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef _WIN32
+# include <windows.h>
+# include <psapi.h>
+#else
+# include <sys/resource.h>
+#endif
+#undef NDEBUG
+#include <assert.h>
+
+#define TIMESCALE 30000
+#define DELTA     1001 /* 29.97 fps */
+#define GOP       30
+
+static void w8 (FILE *f, uint8_t v)
+{
+    assert (fputc (v, f) != EOF);
+}
+
+static void w16 (FILE *f, uint16_t v)
+{
+    w8 (f, v >> 8);
+    w8 (f, v);
+}
+
+static void w32 (FILE *f, uint32_t v)
+{
+    w16 (f, v >> 16);
+    w16 (f, v);
+}
+
+static void wzero (FILE *f, unsigned n)
+{
+    while (n--)
+        w8 (f, 0);
+}
+
+static long box_open (FILE *f, const char *type)
+{
+    long pos = ftell (f);
+    w32 (f, 0);
+    assert (fwrite (type, 4, 1, f) == 1);
+    return pos;
+}
+
+static void box_close (FILE *f, long pos)
+{
+    long end = ftell (f);
+    fseek (f, pos, SEEK_SET);
+    w32 (f, end - pos);
+    fseek (f, end, SEEK_SET);
+}
+
+static void full_box (FILE *f, uint8_t version, uint32_t flags)
+{
+    w32 (f, (version << 24) | flags);
+}
+
+static void write_file (const char *path, uint32_t samples, uint32_t per_chunk)
+{
+    FILE *f = fopen (path, "wb");
+    assert (f != NULL);
+
+    uint32_t chunks = (samples + per_chunk - 1) / per_chunk;
+    uint32_t duration = samples * (uint64_t)DELTA * 1000 / TIMESCALE;
+    long b, moov, trak, mdia, minf, stbl, box;
+
+    b = box_open (f, "ftyp");
+    assert (fwrite ("isom", 4, 1, f) == 1);
+    w32 (f, 0);
+    box_close (f, b);
+
+    moov = box_open (f, "moov");
+    b = box_open (f, "mvhd");
+    full_box (f, 0, 0);
+    w32 (f, 0); w32 (f, 0); w32 (f, 1000); w32 (f, duration);
+    w32 (f, 0x10000); w16 (f, 0x100); wzero (f, 10);
+    w32 (f, 0x10000); wzero (f, 12); w32 (f, 0x10000); wzero (f, 12);
+    w32 (f, 0x40000000);
+    wzero (f, 24); w32 (f, 2);
+    box_close (f, b);
+
+    trak = box_open (f, "trak");
+    b = box_open (f, "tkhd");
+    full_box (f, 0, 3);
+    w32 (f, 0); w32 (f, 0); w32 (f, 1); w32 (f, 0); w32 (f, duration);
+    wzero (f, 8); w16 (f, 0); w16 (f, 0); w16 (f, 0); w16 (f, 0);
+    w32 (f, 0x10000); wzero (f, 12); w32 (f, 0x10000); wzero (f, 12);
+    w32 (f, 0x40000000);
+    w32 (f, 320 << 16); w32 (f, 240 << 16);
+    box_close (f, b);
+
+    mdia = box_open (f, "mdia");
+    b = box_open (f, "mdhd");
+    full_box (f, 0, 0);
+    w32 (f, 0); w32 (f, 0); w32 (f, TIMESCALE);
+    w32 (f, samples * DELTA); w16 (f, 0x55c4); w16 (f, 0);
+    box_close (f, b);
+    b = box_open (f, "hdlr");
+    full_box (f, 0, 0);
+    w32 (f, 0);
+    assert (fwrite ("vide", 4, 1, f) == 1);
+    wzero (f, 12 + 1);
+    box_close (f, b);
+
+    minf = box_open (f, "minf");
+    b = box_open (f, "vmhd");
+    full_box (f, 0, 1);
+    wzero (f, 8);
+    box_close (f, b);
+    b = box_open (f, "dinf");
+    box = box_open (f, "dref");
+    full_box (f, 0, 0);
+    w32 (f, 1);
+    long url = box_open (f, "url ");
+    full_box (f, 0, 1);
+    box_close (f, url);
+    box_close (f, box);
+    box_close (f, b);
+
+    stbl = box_open (f, "stbl");
+    b = box_open (f, "stsd");
+    full_box (f, 0, 0);
+    w32 (f, 1);
+    box = box_open (f, "mp4v");
+    wzero (f, 6); w16 (f, 1); wzero (f, 16);
+    w16 (f, 320); w16 (f, 240); w32 (f, 0x480000); w32 (f, 0x480000);
+    w32 (f, 0); w16 (f, 1); wzero (f, 32); w16 (f, 24); w16 (f, 0xffff);
+    box_close (f, box);
+    box_close (f, b);
+
+    b = box_open (f, "stts");
+    full_box (f, 0, 0);
+    w32 (f, 1);
+    w32 (f, samples); w32 (f, DELTA);
+    box_close (f, b);
+
+    /* I P B B P B B...: one composition offset per sample, as encoders
+     * usually write them */
+    b = box_open (f, "ctts");
+    full_box (f, 0, 0);
+    w32 (f, samples);
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        w32 (f, 1);
+        w32 (f, (i % 3 == 0) ? 2 * DELTA : 0);
+    }
+    box_close (f, b);
+
+    b = box_open (f, "stss");
+    full_box (f, 0, 0);
+    w32 (f, (samples + GOP - 1) / GOP);
+    for (uint32_t i = 0; i < samples; i += GOP)
+        w32 (f, i + 1);
+    box_close (f, b);
+
+    b = box_open (f, "stsz");
+    full_box (f, 0, 0);
+    w32 (f, 0); w32 (f, samples);
+    for (uint32_t i = 0; i < samples; i++)
+        w32 (f, 1);
+    box_close (f, b);
+
+    b = box_open (f, "stsc");
+    full_box (f, 0, 0);
+    if (samples % per_chunk)
+    {
+        w32 (f, 2);
+        w32 (f, 1); w32 (f, per_chunk); w32 (f, 1);
+        w32 (f, chunks); w32 (f, samples % per_chunk); w32 (f, 1);
+    }
+    else
+    {
+        w32 (f, 1);
+        w32 (f, 1); w32 (f, per_chunk); w32 (f, 1);
+    }
+    box_close (f, b);
+
+    /* the mdat follows the moov, the offsets are patched once known */
+    b = box_open (f, "stco");
+    full_box (f, 0, 0);
+    w32 (f, chunks);
+    long stco = ftell (f);
+    wzero (f, 4 * chunks);
+    box_close (f, b);
+
+    box_close (f, stbl);
+    box_close (f, minf);
+    box_close (f, mdia);
+    box_close (f, trak);
+    box_close (f, moov);
+
+    b = box_open (f, "mdat");
+    uint32_t data = ftell (f);
+    wzero (f, samples);
+    box_close (f, b);
+
+    fseek (f, stco, SEEK_SET);
+    for (uint32_t i = 0; i < chunks; i++)
+        w32 (f, data + i * per_chunk);
+    assert (fclose (f) == 0);
+}
+
+static long peak_rss (void) /* kiB */
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo (GetCurrentProcess (), &pmc, sizeof (pmc)))
+        return 0;
+    return pmc.PeakWorkingSetSize / 1024;
+#else
+    struct rusage ru;
+    getrusage (RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+#endif
+}
+
+int main (int argc, char *argv[])
+{
+    uint32_t samples = (argc > 1) ? strtoul (argv[1], NULL, 0) : 3000000;
+    uint32_t per_chunk = (argc > 2) ? strtoul (argv[2], NULL, 0) : 1;
+    const char *path = (argc > 3) ? argv[3] : "mp4_sample_table.mp4";
+
+    assert (samples > 0 && per_chunk > 0);
+    write_file (path, samples, per_chunk);
+
+    const char *args[] = { "--quiet" };
+    libvlc_instance_t *vlc = libvlc_new (1, args);
+    assert (vlc != NULL);
+
+    libvlc_media_t *md = libvlc_media_new_path (vlc, path);
+    assert (md != NULL);
+
+    long rss = peak_rss ();
+    mtime_t start = mdate ();
+    libvlc_media_parse (md);
+    mtime_t spent = mdate () - start;
+
+    libvlc_time_t length = libvlc_media_get_duration (md);
+    printf ("%u samples (%.1f hours), %u per chunk: parsed in %.0f ms, "
+            "peak resident memory +%ld kiB\n", samples,
+            samples * (double)DELTA / TIMESCALE / 3600, per_chunk,
+            (double)spent * 1000 / CLOCK_FREQ, peak_rss () - rss);
+
+    libvlc_media_release (md);
+    libvlc_release (vlc);
+    remove (path);
+
+    assert (length > 0);
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*****************************************************************************
+ * udp_mmsg.c: loopback benchmark of batched UDP system calls
+ *****************************************************************************
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Compares one system call per datagram, as the UDP access and access output
+ * used to do, against recvmmsg()/sendmmsg() batches of BATCH datagrams.
+ * Linux only, as these system calls are; it does not use libvlc. */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#undef NDEBUG
+#include <assert.h>
+
+#define SIZE   1316 /* 7 TS packets */
+#define BATCH  64
+#define ROUNDS 2000
+
+static int64_t now (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * INT64_C(1000000) + ts.tv_nsec / 1000;
+}
+
+static void pair (int *tx, int *rx)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof (addr);
+    int bufsize = 8 << 20;
+
+    *rx = socket (AF_INET, SOCK_DGRAM, 0);
+    *tx = socket (AF_INET, SOCK_DGRAM, 0);
+    assert (*rx != -1 && *tx != -1);
+    setsockopt (*rx, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof (bufsize));
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    assert (bind (*rx, (struct sockaddr *)&addr, sizeof (addr)) == 0);
+    assert (getsockname (*rx, (struct sockaddr *)&addr, &len) == 0);
+    assert (connect (*tx, (struct sockaddr *)&addr, sizeof (addr)) == 0);
+}
+
+static uint8_t bufs[BATCH][65536];
+static struct mmsghdr msgs[BATCH];
+static struct iovec iov[BATCH];
+
+static void setup (size_t size)
+{
+    memset (msgs, 0, sizeof (msgs));
+    for (unsigned i = 0; i < BATCH; i++)
+    {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = size;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+/* Sends one batch, then reads it back; returns the time spent on the
+ * selected side only */
+static int64_t round_trip (int tx, int rx, int batch_tx, int batch_rx)
+{
+    int64_t start, spent = 0;
+
+    setup (SIZE);
+    start = now ();
+    if (batch_tx)
+        assert (sendmmsg (tx, msgs, BATCH, 0) == BATCH);
+    else
+        for (unsigned i = 0; i < BATCH; i++)
+            assert (send (tx, bufs[i], SIZE, 0) == SIZE);
+    spent += (batch_tx >= 0) ? now () - start : 0;
+
+    setup (sizeof (bufs[0]));
+    start = now ();
+    if (batch_rx)
+    {
+        int n = 0;
+        while (n < BATCH)
+        {
+            int ret = recvmmsg (rx, msgs + n, BATCH - n, 0, NULL);
+            assert (ret > 0);
+            for (int i = n; i < n + ret; i++)
+                assert (msgs[i].msg_len == SIZE);
+            n += ret;
+        }
+    }
+    else
+        for (unsigned i = 0; i < BATCH; i++)
+            assert (recv (rx, bufs[i], sizeof (bufs[i]), 0) == SIZE);
+    spent += (batch_rx >= 0) ? now () - start : 0;
+    return spent;
+}
+
+static void bench (const char *name, int batch_tx, int batch_rx)
+{
+    int tx, rx;
+    int64_t spent = 0;
+
+    pair (&tx, &rx);
+    for (unsigned i = 0; i < ROUNDS; i++)
+        spent += round_trip (tx, rx, batch_tx, batch_rx);
+    close (tx);
+    close (rx);
+
+    double mbits = (double)ROUNDS * BATCH * SIZE * 8 / spent;
+    printf ("%-22s %8.0f Mbit/s %8.0f kpackets/s\n", name, mbits,
+            (double)ROUNDS * BATCH * 1000 / spent);
+}
+
+int main (void)
+{
+    /* A negative mode is not timed */
+    bench ("send()", 0, -1);
+    bench ("sendmmsg()", 1, -1);
+    bench ("recv()", -1, 0);
+    bench ("recvmmsg()", -1, 1);
+    return 0;
+}
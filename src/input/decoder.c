@@ -61,12 +61,14 @@ static decoder_t *CreateDecoder( vlc_object_t *, input_thread_t *,
 static void       DeleteDecoder( decoder_t * );
 
 static void      *DecoderThread( void * );
+static void       DecoderRunBlock( decoder_t *, block_t * );
 static void       DecoderProcess( decoder_t *, block_t * );
 static void       DecoderError( decoder_t *p_dec, block_t *p_block );
 static void       DecoderOutputChangePause( decoder_t *, bool b_paused, mtime_t i_date );
 static void       DecoderFlush( decoder_t * );
 static void       DecoderSignalBuffering( decoder_t *, bool );
 static void       DecoderFlushBuffering( decoder_t * );
+static bool       DecoderIsExitRequested( decoder_t * );
 
 static void       DecoderUnsupportedCodec( decoder_t *, vlc_fourcc_t );
 
@@ -81,6 +83,36 @@ static void vout_unlink_picture( decoder_t *, picture_t * );
 static subpicture_t *spu_new_buffer( decoder_t *, const subpicture_updater_t * );
 static void spu_del_buffer( decoder_t *, subpicture_t * );
 
+/* Threads shared by the decoders of all the inputs */
+typedef struct decoder_pool_t decoder_pool_t;
+typedef struct decoder_pool_thread_t decoder_pool_thread_t;
+
+struct decoder_pool_thread_t
+{
+    vlc_thread_t            thread;
+    decoder_pool_t          *p_pool;
+    decoder_pool_thread_t   *p_next;
+};
+
+struct decoder_pool_t
+{
+    vlc_mutex_t     lock;
+    vlc_cond_t      wait;      /* For the pool threads */
+    vlc_cond_t      wait_done; /* For input_DecoderDelete() */
+
+    /* Decoders with something to do */
+    decoder_t       *p_first;
+    decoder_t       **pp_last;
+
+    decoder_pool_thread_t *p_threads;
+    decoder_pool_thread_t *p_retired; /* exited, not joined yet */
+    unsigned        i_threads;
+    unsigned        i_blocked; /* threads waiting inside a decoder */
+    unsigned        i_target;  /* threads not waiting inside a decoder */
+    unsigned        i_refs;
+    bool            b_exit;
+};
+
 struct decoder_owner_sys_t
 {
     int64_t         i_preroll_end;
@@ -99,6 +131,16 @@ struct decoder_owner_sys_t
 
     vlc_thread_t     thread;
 
+    /* Shared pool, NULL if the decoder has its own thread.
+     * The following variables are protected by the pool lock. */
+    decoder_pool_t  *p_pool;
+    decoder_t       *p_pool_next;
+    bool             b_pool_queued;
+    bool             b_pool_running;
+    bool             b_pool_pending; /* woken up while running */
+    bool             b_pool_woken;   /* as with block_FifoWake() */
+    bool             b_pool_dead;
+
     /* Some decoders require already packetized data (ie. not truncated) */
     decoder_t *p_packetizer;
     bool b_packetizer;
@@ -184,6 +226,18 @@ struct decoder_owner_sys_t
 /* */
 #define DECODER_SPU_VOUT_WAIT_DURATION ((int)(0.200*CLOCK_FREQ))
 
+/* Blocks decoded in a row before a pooled decoder lets others run */
+#define DECODER_POOL_SLICE (8)
+
+/* Shared decoder threads never outnumber this, however many decoders wait */
+#define DECODER_POOL_MAX (128)
+
+static decoder_pool_t *DecoderPoolHold( vlc_object_t *, unsigned );
+static void DecoderPoolRelease( decoder_pool_t * );
+static void DecoderPoolWake( decoder_t *, bool b_force );
+static void DecoderPoolDetach( decoder_t * );
+static void DecoderPoolBlocking( decoder_t *, bool b_blocking );
+
 
 /*****************************************************************************
  * Public functions
@@ -297,8 +351,20 @@ static decoder_t *decoder_New( vlc_object_t *p_parent, input_thread_t *p_input,
     else
         i_priority = VLC_THREAD_PRIORITY_VIDEO;
 
-    /* Spawn the decoder thread */
-    if( vlc_clone( &p_dec->p_owner->thread, DecoderThread, p_dec, i_priority ) )
+    /* Spawn the decoder thread, or use the shared ones */
+    unsigned i_pool = var_InheritInteger( p_dec, "decoder-pool" );
+    if( i_pool > 0 )
+    {
+        p_dec->p_owner->p_pool = DecoderPoolHold( VLC_OBJECT(p_dec), i_pool );
+        if( p_dec->p_owner->p_pool == NULL )
+        {
+            msg_Err( p_dec, "cannot spawn decoder threads" );
+            module_unneed( p_dec, p_dec->p_module );
+            DeleteDecoder( p_dec );
+            return NULL;
+        }
+    }
+    else if( vlc_clone( &p_dec->p_owner->thread, DecoderThread, p_dec, i_priority ) )
     {
         msg_Err( p_dec, "cannot spawn decoder thread" );
         module_unneed( p_dec, p_dec->p_module );
@@ -346,7 +412,8 @@ void input_DecoderDelete( decoder_t *p_dec )
 {
     decoder_owner_sys_t *p_owner = p_dec->p_owner;
 
-    vlc_cancel( p_owner->thread );
+    if( p_owner->p_pool == NULL )
+        vlc_cancel( p_owner->thread );
 
     /* Make sure we aren't paused/buffering/waiting/decoding anymore */
     vlc_mutex_lock( &p_owner->lock );
@@ -358,7 +425,10 @@ void input_DecoderDelete( decoder_t *p_dec )
     vlc_cond_signal( &p_owner->wait_request );
     vlc_mutex_unlock( &p_owner->lock );
 
-    vlc_join( p_owner->thread, NULL );
+    if( p_owner->p_pool != NULL )
+        DecoderPoolDetach( p_dec );
+    else
+        vlc_join( p_owner->thread, NULL );
     p_owner->b_paused = b_was_paused;
 
     module_unneed( p_dec, p_dec->p_module );
@@ -409,6 +479,8 @@ void input_DecoderDecode( decoder_t *p_dec, block_t *p_block, bool b_do_pace )
     }
 
     block_FifoPut( p_owner->p_fifo, p_block );
+    if( p_owner->p_pool != NULL )
+        DecoderPoolWake( p_dec, false );
 }
 
 bool input_DecoderIsEmpty( decoder_t * p_dec )
@@ -594,7 +666,10 @@ void input_DecoderWaitBuffering( decoder_t *p_dec )
 
     while( p_owner->b_buffering && !p_owner->buffer.b_full )
     {
-        block_FifoWake( p_owner->p_fifo );
+        if( p_owner->p_pool != NULL )
+            DecoderPoolWake( p_dec, true );
+        else
+            block_FifoWake( p_owner->p_fifo );
         vlc_cond_wait( &p_owner->wait_acknowledge, &p_owner->lock );
     }
 
@@ -783,9 +858,17 @@ static decoder_t * CreateDecoder( vlc_object_t *p_parent,
     p_owner->p_sout_input = NULL;
     p_owner->p_packetizer = NULL;
     p_owner->b_packetizer = b_packetizer;
+    p_owner->p_pool = NULL;
+    p_owner->p_pool_next = NULL;
+    p_owner->b_pool_queued = false;
+    p_owner->b_pool_running = false;
+    p_owner->b_pool_pending = false;
+    p_owner->b_pool_woken = false;
+    p_owner->b_pool_dead = false;
 
     /* decoder fifo */
-    p_owner->p_fifo = block_FifoNew();
+    /* Only the input (or parent decoder) thread queues blocks */
+    p_owner->p_fifo = block_FifoNewSPSC();
     if( unlikely(p_owner->p_fifo == NULL) )
     {
         free( p_owner );
@@ -923,24 +1006,337 @@ static void *DecoderThread( void *p_data )
         if( p_block )
         {
             int canc = vlc_savecancel();
+            DecoderRunBlock( p_dec, p_block );
+            vlc_restorecancel( canc );
+        }
+    }
+    return NULL;
+}
 
-            if( p_block->i_flags & BLOCK_FLAG_CORE_EOS )
+static void DecoderRunBlock( decoder_t *p_dec, block_t *p_block )
+{
+    if( p_block->i_flags & BLOCK_FLAG_CORE_EOS )
+    {
+        /* calling DecoderProcess() with NULL block will make
+         * decoders/packetizers flush their buffers */
+        block_Release( p_block );
+        p_block = NULL;
+    }
+
+    if( p_dec->b_error )
+        DecoderError( p_dec, p_block );
+    else
+        DecoderProcess( p_dec, p_block );
+}
+
+/*****************************************************************************
+ * Shared decoder threads
+ *
+ * A pooled decoder is queued when it gets a block or a wake up request, and
+ * is then run by one pool thread at a time, so its blocks are still decoded
+ * in order. A decoder waiting for the input (pause, buffering) or the video
+ * output ties up its pool thread, so another one is started if needed to
+ * keep the other decoders going. Idle threads exit when they are no longer
+ * needed.
+ *****************************************************************************/
+static vlc_mutex_t pool_lock = VLC_STATIC_MUTEX;
+static decoder_pool_t *p_decoder_pool = NULL;
+
+/* Decodes a few blocks, or signals an empty fifo like DecoderThread() */
+static void DecoderPoolRun( decoder_t *p_dec )
+{
+    decoder_owner_sys_t *p_owner = p_dec->p_owner;
+    decoder_pool_t *p_pool = p_owner->p_pool;
+
+    for( unsigned i = 0; i < DECODER_POOL_SLICE; i++ )
+    {
+        if( DecoderIsExitRequested( p_dec ) )
+            break;
+
+        block_t *p_block = NULL;
+        if( block_FifoCount( p_owner->p_fifo ) > 0 )
+        {
+            p_block = block_FifoGet( p_owner->p_fifo );
+        }
+        else
+        {
+            vlc_mutex_lock( &p_pool->lock );
+            const bool b_woken = p_owner->b_pool_woken;
+            p_owner->b_pool_woken = false;
+            vlc_mutex_unlock( &p_pool->lock );
+            if( !b_woken )
+                break;
+        }
+
+        DecoderSignalBuffering( p_dec, p_block == NULL );
+        if( p_block == NULL )
+            break;
+        DecoderRunBlock( p_dec, p_block );
+    }
+}
+
+static void DecoderPoolQueue( decoder_pool_t *p_pool, decoder_t *p_dec )
+{
+    decoder_owner_sys_t *p_owner = p_dec->p_owner;
+
+    vlc_assert_locked( &p_pool->lock );
+
+    p_owner->p_pool_next = NULL;
+    p_owner->b_pool_queued = true;
+    *p_pool->pp_last = p_dec;
+    p_pool->pp_last = &p_owner->p_pool_next;
+    vlc_cond_signal( &p_pool->wait );
+}
+
+static void *DecoderPoolThread( void *p_data )
+{
+    decoder_pool_thread_t *p_self = (decoder_pool_thread_t *)p_data;
+    decoder_pool_t *p_pool = p_self->p_pool;
+
+    vlc_mutex_lock( &p_pool->lock );
+    for( ;; )
+    {
+        while( p_pool->p_first == NULL && !p_pool->b_exit )
+        {
+            /* The decoders that waited are done: retire this thread */
+            if( p_pool->i_threads > p_pool->i_blocked + p_pool->i_target )
             {
-                /* calling DecoderProcess() with NULL block will make
-                 * decoders/packetizers flush their buffers */
-                block_Release( p_block );
-                p_block = NULL;
+                decoder_pool_thread_t **pp = &p_pool->p_threads;
+                while( *pp != p_self )
+                    pp = &(*pp)->p_next;
+                *pp = p_self->p_next;
+                p_self->p_next = p_pool->p_retired;
+                p_pool->p_retired = p_self;
+                p_pool->i_threads--;
+                vlc_mutex_unlock( &p_pool->lock );
+                return NULL;
             }
+            vlc_cond_wait( &p_pool->wait, &p_pool->lock );
+        }
+        if( p_pool->b_exit )
+            break;
 
-            if( p_dec->b_error )
-                DecoderError( p_dec, p_block );
-            else
-                DecoderProcess( p_dec, p_block );
+        decoder_t *p_dec = p_pool->p_first;
+        decoder_owner_sys_t *p_owner = p_dec->p_owner;
+
+        p_pool->p_first = p_owner->p_pool_next;
+        if( p_pool->p_first == NULL )
+            p_pool->pp_last = &p_pool->p_first;
+        p_owner->b_pool_queued = false;
+        p_owner->b_pool_running = true;
+        p_owner->b_pool_pending = false;
+        vlc_mutex_unlock( &p_pool->lock );
+
+        DecoderPoolRun( p_dec );
+
+        vlc_mutex_lock( &p_pool->lock );
+        p_owner->b_pool_running = false;
+        /* Let the other decoders run before the rest of the fifo */
+        if( !p_owner->b_pool_dead &&
+            ( p_owner->b_pool_pending || p_owner->b_pool_woken ||
+              block_FifoCount( p_owner->p_fifo ) > 0 ) )
+            DecoderPoolQueue( p_pool, p_dec );
+        vlc_cond_broadcast( &p_pool->wait_done );
+    }
+    vlc_mutex_unlock( &p_pool->lock );
+    return NULL;
+}
 
-            vlc_restorecancel( canc );
+/* Joins the threads that exited */
+static void DecoderPoolReap( decoder_pool_thread_t *p_thread )
+{
+    while( p_thread != NULL )
+    {
+        decoder_pool_thread_t *p_next = p_thread->p_next;
+
+        vlc_join( p_thread->thread, NULL );
+        free( p_thread );
+        p_thread = p_next;
+    }
+}
+
+/* Must be called with the pool lock */
+static int DecoderPoolSpawn( decoder_pool_t *p_pool )
+{
+    /* Retired threads no longer take the lock */
+    DecoderPoolReap( p_pool->p_retired );
+    p_pool->p_retired = NULL;
+
+    if( p_pool->i_threads >= DECODER_POOL_MAX )
+        return VLC_EGENERIC;
+
+    decoder_pool_thread_t *p_thread =
+        (decoder_pool_thread_t *)malloc( sizeof(*p_thread) );
+    if( unlikely(p_thread == NULL) )
+        return VLC_ENOMEM;
+
+    p_thread->p_pool = p_pool;
+    if( vlc_clone( &p_thread->thread, DecoderPoolThread, p_thread,
+                   VLC_THREAD_PRIORITY_VIDEO ) )
+    {
+        free( p_thread );
+        return VLC_EGENERIC;
+    }
+    p_thread->p_next = p_pool->p_threads;
+    p_pool->p_threads = p_thread;
+    p_pool->i_threads++;
+    return VLC_SUCCESS;
+}
+
+static decoder_pool_t *DecoderPoolHold( vlc_object_t *p_obj,
+                                        unsigned i_threads )
+{
+    vlc_mutex_lock( &pool_lock );
+    decoder_pool_t *p_pool = p_decoder_pool;
+    if( p_pool == NULL )
+    {
+        p_pool = (decoder_pool_t *)malloc( sizeof(*p_pool) );
+        if( unlikely(p_pool == NULL) )
+            goto out;
+
+        vlc_mutex_init( &p_pool->lock );
+        vlc_cond_init( &p_pool->wait );
+        vlc_cond_init( &p_pool->wait_done );
+        p_pool->p_first = NULL;
+        p_pool->pp_last = &p_pool->p_first;
+        p_pool->p_threads = NULL;
+        p_pool->p_retired = NULL;
+        p_pool->i_threads = 0;
+        p_pool->i_blocked = 0;
+        p_pool->i_target = __MIN( i_threads, DECODER_POOL_MAX );
+        p_pool->i_refs = 0;
+        p_pool->b_exit = false;
+
+        vlc_mutex_lock( &p_pool->lock );
+        while( p_pool->i_threads < p_pool->i_target )
+            if( DecoderPoolSpawn( p_pool ) )
+                break;
+        vlc_mutex_unlock( &p_pool->lock );
+
+        if( p_pool->i_threads == 0 )
+        {
+            vlc_cond_destroy( &p_pool->wait_done );
+            vlc_cond_destroy( &p_pool->wait );
+            vlc_mutex_destroy( &p_pool->lock );
+            free( p_pool );
+            p_pool = NULL;
+            goto out;
         }
+        msg_Dbg( p_obj, "started %u shared decoder threads",
+                 p_pool->i_threads );
+        p_decoder_pool = p_pool;
     }
-    return NULL;
+    p_pool->i_refs++;
+out:
+    vlc_mutex_unlock( &pool_lock );
+    return p_pool;
+}
+
+static void DecoderPoolRelease( decoder_pool_t *p_pool )
+{
+    vlc_mutex_lock( &pool_lock );
+    assert( p_pool == p_decoder_pool );
+    if( --p_pool->i_refs > 0 )
+    {
+        vlc_mutex_unlock( &pool_lock );
+        return;
+    }
+    p_decoder_pool = NULL;
+    vlc_mutex_unlock( &pool_lock );
+
+    vlc_mutex_lock( &p_pool->lock );
+    assert( p_pool->p_first == NULL );
+    p_pool->b_exit = true;
+    vlc_cond_broadcast( &p_pool->wait );
+    vlc_mutex_unlock( &p_pool->lock );
+
+    DecoderPoolReap( p_pool->p_threads );
+    DecoderPoolReap( p_pool->p_retired );
+
+    vlc_cond_destroy( &p_pool->wait_done );
+    vlc_cond_destroy( &p_pool->wait );
+    vlc_mutex_destroy( &p_pool->lock );
+    free( p_pool );
+}
+
+/* Queues the decoder, unless it is already queued or running */
+static void DecoderPoolWake( decoder_t *p_dec, bool b_force )
+{
+    decoder_owner_sys_t *p_owner = p_dec->p_owner;
+    decoder_pool_t *p_pool = p_owner->p_pool;
+
+    vlc_mutex_lock( &p_pool->lock );
+    if( b_force )
+        p_owner->b_pool_woken = true;
+    if( p_owner->b_pool_running )
+        p_owner->b_pool_pending = true;
+    else if( !p_owner->b_pool_queued && !p_owner->b_pool_dead )
+        DecoderPoolQueue( p_pool, p_dec );
+    vlc_mutex_unlock( &p_pool->lock );
+}
+
+/* Removes the decoder from the pool, once the exit is requested */
+static void DecoderPoolDetach( decoder_t *p_dec )
+{
+    decoder_owner_sys_t *p_owner = p_dec->p_owner;
+    decoder_pool_t *p_pool = p_owner->p_pool;
+
+    vlc_mutex_lock( &p_pool->lock );
+    p_owner->b_pool_dead = true;
+    if( p_owner->b_pool_queued )
+    {
+        decoder_t **pp_dec = &p_pool->p_first;
+        while( *pp_dec != p_dec )
+            pp_dec = &(*pp_dec)->p_owner->p_pool_next;
+        *pp_dec = p_owner->p_pool_next;
+        if( p_pool->pp_last == &p_owner->p_pool_next )
+            p_pool->pp_last = pp_dec;
+        p_owner->b_pool_queued = false;
+    }
+    while( p_owner->b_pool_running )
+        vlc_cond_wait( &p_pool->wait_done, &p_pool->lock );
+    vlc_mutex_unlock( &p_pool->lock );
+
+    DecoderPoolRelease( p_pool );
+    p_owner->p_pool = NULL;
+}
+
+/**
+ * Tells the pool that the calling decoder is about to wait (or is done
+ * waiting) for something else than its own decoding, so that a thread is
+ * started if all of them would otherwise be waiting.
+ */
+static void DecoderPoolBlocking( decoder_t *p_dec, bool b_blocking )
+{
+    decoder_pool_t *p_pool = p_dec->p_owner->p_pool;
+
+    if( p_pool == NULL )
+        return;
+
+    vlc_mutex_lock( &p_pool->lock );
+    if( b_blocking )
+    {
+        p_pool->i_blocked++;
+        /* Decoders may also wait from their own threads */
+        if( p_pool->i_threads < p_pool->i_blocked + p_pool->i_target )
+        {
+            if( DecoderPoolSpawn( p_pool ) == VLC_SUCCESS )
+                msg_Dbg( p_dec, "%u shared decoder threads",
+                         p_pool->i_threads );
+            else if( p_pool->i_threads >= DECODER_POOL_MAX )
+                msg_Warn( p_dec, "all %u shared decoder threads are waiting",
+                          p_pool->i_threads );
+        }
+    }
+    else
+    {
+        assert( p_pool->i_blocked > 0 );
+        p_pool->i_blocked--;
+        /* Wake an idle thread up so that it retires */
+        if( p_pool->i_threads > p_pool->i_blocked + p_pool->i_target )
+            vlc_cond_signal( &p_pool->wait );
+    }
+    vlc_mutex_unlock( &p_pool->lock );
 }
 
 static block_t *DecoderBlockFlushNew()
@@ -1017,6 +1413,7 @@ static void DecoderWaitUnblock( decoder_t *p_dec, bool *pb_reject )
 
     vlc_assert_locked( &p_owner->lock );
 
+    bool b_blocked = false;
     for( ;; )
     {
         if( p_owner->b_flushing )
@@ -1036,8 +1433,15 @@ static void DecoderWaitUnblock( decoder_t *p_dec, bool *pb_reject )
             if( !p_owner->b_buffering || !p_owner->buffer.b_full )
                 break;
         }
+        if( !b_blocked )
+        {
+            DecoderPoolBlocking( p_dec, true );
+            b_blocked = true;
+        }
         vlc_cond_wait( &p_owner->wait_request, &p_owner->lock );
     }
+    if( b_blocked )
+        DecoderPoolBlocking( p_dec, false );
 
     if( pb_reject )
         *pb_reject = p_owner->b_flushing;
@@ -1140,6 +1544,7 @@ static void DecoderWaitDate( decoder_t *p_dec,
     if( *pb_reject || i_deadline < 0 )
         return;
 
+    DecoderPoolBlocking( p_dec, true );
     do
     {
         if( p_owner->b_flushing || p_owner->b_exit )
@@ -1150,6 +1555,7 @@ static void DecoderWaitDate( decoder_t *p_dec,
     }
     while( vlc_cond_timedwait( &p_owner->wait_request, &p_owner->lock,
                                i_deadline ) == 0 );
+    DecoderPoolBlocking( p_dec, false );
 }
 
 static void DecoderPlayAudio( decoder_t *p_dec, block_t *p_audio,
@@ -1335,8 +1741,11 @@ static void DecoderGetCc( decoder_t *p_dec, decoder_t *p_dec_cc )
         if( !p_owner->cc.pp_decoder[i] )
             continue;
 
-        block_FifoPut( p_owner->cc.pp_decoder[i]->p_owner->p_fifo,
+        decoder_t *p_ccdec = p_owner->cc.pp_decoder[i];
+        block_FifoPut( p_ccdec->p_owner->p_fifo,
             (i_cc_decoder > 1) ? block_Duplicate(p_cc) : p_cc);
+        if( p_ccdec->p_owner->p_pool != NULL )
+            DecoderPoolWake( p_ccdec, false );
 
         i_cc_decoder--;
         b_processed = true;
@@ -2417,7 +2826,9 @@ static picture_t *vout_new_buffer( decoder_t *p_dec )
         vout_FixLeaks( p_owner->p_vout );
 
         /* FIXME add a vout_WaitPictureAvailable (timedwait) */
+        DecoderPoolBlocking( p_dec, true );
         msleep( VOUT_OUTMEM_SLEEP );
+        DecoderPoolBlocking( p_dec, false );
     }
 }
 
@@ -2453,7 +2864,9 @@ static subpicture_t *spu_new_buffer( decoder_t *p_dec,
         if( p_vout )
             break;
 
+        DecoderPoolBlocking( p_dec, true );
         msleep( DECODER_SPU_VOUT_WAIT_DURATION );
+        DecoderPoolBlocking( p_dec, false );
     }
 
     if( !p_vout )
@@ -29,10 +29,24 @@
 
 #include <dirent.h>
 #include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
+#ifdef _WIN32
+# include <io.h>
+#endif
 
 #include <vlc_common.h>
 #include <vlc_strings.h>
 #include <vlc_memory.h>
+#include <vlc_fs.h>
+#include <vlc_atomic.h>
 
 #include <libvlc.h>
 
@@ -97,6 +111,40 @@
 #define STREAM_READ_ATONCE 1024
 #define STREAM_CACHE_TRACK_SIZE (STREAM_CACHE_SIZE/STREAM_CACHE_TRACK)
 
+/* Method2 can fill the current track from a background thread
+ * (see the "stream-prefetch" option):
+ *  - the thread reads from the access at the end of the current track until
+ *    there is enough unread data, or what the reader is waiting for;
+ *  - the access is only used by the thread while it is reading (b_busy),
+ *    and otherwise by whoever holds the lock. A seek thus only waits for the
+ *    read in progress, whose data is kept in the track it was read for;
+ *  - reads are limited to STREAM_PREFETCH_ATONCE bytes to bound that wait.
+ */
+#define STREAM_PREFETCH_ATONCE (64*1024)
+
+/* Method3: For local files (see the "file-mmap" option)
+ *  - The file is mapped in memory by windows of STREAM_MMAP_WINDOW bytes.
+ *  - Peeking returns a pointer into the current window, and stream_Block()
+ *    returns blocks pointing into it, without any copy. Windows stay mapped
+ *    as long as any block uses them.
+ *  - Past windows kept mapped by blocks are limited to STREAM_MMAP_RETIRED
+ *    bytes for the whole process, so that buffered blocks cannot exhaust
+ *    the address space: beyond that, stream_Block() copies the data.
+ *  - Mappings are copy-on-write, as block users may modify their data.
+ */
+#define STREAM_MMAP_MIN_SIZE  (16*1024*1024)
+#define STREAM_MMAP_WINDOW    (32*1024*1024)
+#define STREAM_MMAP_ALIGN     (64*1024) /* Windows allocation granularity */
+#define STREAM_MMAP_READAHEAD (4*1024*1024)
+#define STREAM_MMAP_RETIRED   (4*STREAM_MMAP_WINDOW)
+
+#if defined( HAVE_MMAP ) || defined( _WIN32 )
+# define STREAM_MMAP 1
+#endif
+#ifndef HAVE_POSIX_MADVISE
+# define posix_madvise(addr, len, adv)
+#endif
+
 typedef struct
 {
     int64_t i_date;
@@ -108,6 +156,18 @@ typedef struct
 
 } stream_track_t;
 
+typedef struct
+{
+    vlc_atomic_t refs;
+
+    uint8_t  *p_base;
+    size_t    i_length;
+    uint64_t  i_start;   /* File offset of p_base */
+    uint64_t  i_served;  /* End offset of the data returned as blocks */
+    bool      b_retired; /* No longer the window of its stream */
+
+} stream_mmap_view_t;
+
 typedef struct
 {
     char     *psz_path;
@@ -118,7 +178,8 @@ typedef struct
 typedef enum
 {
     STREAM_METHOD_BLOCK,
-    STREAM_METHOD_STREAM
+    STREAM_METHOD_STREAM,
+    STREAM_METHOD_MMAP
 } stream_read_method_t;
 
 struct stream_sys_t
@@ -156,8 +217,34 @@ struct stream_sys_t
         unsigned i_used; /* Used since last read */
         unsigned i_read_size;
 
+        /* Prefetching thread */
+        bool         b_prefetch;
+        vlc_thread_t thread;
+        vlc_mutex_t  lock;
+        vlc_cond_t   wait;       /* For the prefetcher */
+        vlc_cond_t   wait_data;  /* For the reader */
+        unsigned     i_prefetch; /* Unread bytes to keep in the track */
+        unsigned     i_demand;   /* Unread bytes the reader is waiting for */
+        bool         b_can_seek; /* From access */
+        bool         b_busy;     /* The prefetcher is using the access */
+        bool         b_eof;
+        bool         b_exit;
+
     } stream;
 
+    /* Method 3: mapped file */
+    struct
+    {
+        int       fd;
+#ifdef _WIN32
+        HANDLE    h_map;
+#endif
+        uint64_t  i_size;
+        uint64_t  i_advised; /* End of the range announced to the kernel */
+        stream_mmap_view_t *p_view; /* Current window */
+
+    } mmap;
+
     /* Peek temporary buffer */
     unsigned int i_peek;
     uint8_t *p_peek;
@@ -198,6 +285,22 @@ static int  AStreamPeekStream( stream_t *s, const uint8_t **pp_peek, unsigned in
 static int  AStreamSeekStream( stream_t *s, uint64_t i_pos );
 static void AStreamPrebufferStream( stream_t *s );
 static int  AReadStream( stream_t *s, void *p_read, unsigned int i_read );
+static bool AStreamStartPrefetch( stream_t *s );
+static void AStreamStopPrefetch( stream_t *s );
+static void AStreamIdlePrefetch( stream_t *s );
+static int  AStreamReadPrefetch( stream_t *s, void *p_read, unsigned int i_read );
+static int  AStreamPeekPrefetch( stream_t *s, const uint8_t **pp_peek, unsigned int i_read );
+
+#ifdef STREAM_MMAP
+/* Method 3 */
+static bool AStreamOpenMmap( stream_t *s );
+static void AStreamCloseMmap( stream_t *s );
+static int  AStreamReadMmap( stream_t *s, void *p_read, unsigned int i_read );
+static int  AStreamPeekMmap( stream_t *s, const uint8_t **pp_peek, unsigned int i_read );
+static int  AStreamSeekMmap( stream_t *s, uint64_t i_pos );
+static block_t *AStreamBlockMmap( stream_t *s, unsigned int i_size );
+static uint64_t AStreamSizeMmap( stream_t *s );
+#endif
 
 /* Common */
 static int AStreamControl( stream_t *s, int i_query, va_list );
@@ -371,6 +474,18 @@ stream_t *stream_AccessNew( access_t *p_access, char **ppsz_list )
     p_sys->i_peek = 0;
     p_sys->p_peek = NULL;
 
+#ifdef STREAM_MMAP
+    if( p_sys->method == STREAM_METHOD_STREAM && p_sys->i_list == 0
+     && AStreamOpenMmap( s ) )
+    {
+        msg_Dbg( s, "Using mmap method for AStream*" );
+        p_sys->method = STREAM_METHOD_MMAP;
+        s->pf_read = AStreamReadMmap;
+        s->pf_peek = AStreamPeekMmap;
+        s->pf_block = AStreamBlockMmap;
+    }
+    else
+#endif
     if( p_sys->method == STREAM_METHOD_BLOCK )
     {
         msg_Dbg( s, "Using block method for AStream*" );
@@ -413,6 +528,7 @@ stream_t *stream_AccessNew( access_t *p_access, char **ppsz_list )
             goto error;
         p_sys->stream.i_used   = 0;
         p_sys->stream.i_read_size = STREAM_READ_ATONCE;
+        p_sys->stream.b_prefetch = false;
 #if STREAM_READ_ATONCE < 256
 #   error "Invalid STREAM_READ_ATONCE value"
 #endif
@@ -434,6 +550,12 @@ stream_t *stream_AccessNew( access_t *p_access, char **ppsz_list )
             msg_Err( s, "cannot pre fill buffer" );
             goto error;
         }
+
+        if( AStreamStartPrefetch( s ) )
+        {
+            s->pf_read = AStreamReadPrefetch;
+            s->pf_peek = AStreamPeekPrefetch;
+        }
     }
 
     return s;
@@ -443,6 +565,10 @@ error:
     {
         /* Nothing yet */
     }
+    else if( p_sys->method == STREAM_METHOD_MMAP )
+    {
+        /* Cannot fail */
+    }
     else
     {
         free( p_sys->stream.p_buffer );
@@ -465,8 +591,15 @@ static void AStreamDestroy( stream_t *s )
 
     if( p_sys->method == STREAM_METHOD_BLOCK )
         block_ChainRelease( p_sys->block.p_first );
+#ifdef STREAM_MMAP
+    else if( p_sys->method == STREAM_METHOD_MMAP )
+        AStreamCloseMmap( s );
+#endif
     else
+    {
+        AStreamStopPrefetch( s );
         free( p_sys->stream.p_buffer );
+    }
 
     free( p_sys->p_peek );
 
@@ -509,12 +642,20 @@ static void AStreamControlReset( stream_t *s )
         /* Do the prebuffering */
         AStreamPrebufferBlock( s );
     }
+#ifdef STREAM_MMAP
+    else if( p_sys->method == STREAM_METHOD_MMAP )
+    {
+        AStreamSeekMmap( s, p_sys->i_pos );
+    }
+#endif
     else
     {
         int i;
 
         assert( p_sys->method == STREAM_METHOD_STREAM );
 
+        AStreamIdlePrefetch( s );
+
         /* Setup our tracks */
         p_sys->stream.i_offset = 0;
         p_sys->stream.i_tk     = 0;
@@ -554,7 +695,26 @@ static void AStreamControlUpdate( stream_t *s )
 /****************************************************************************
  * AStreamControl:
  ****************************************************************************/
+static int AStreamVaControl( stream_t *s, int i_query, va_list args );
+
 static int AStreamControl( stream_t *s, int i_query, va_list args )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    if( p_sys->method != STREAM_METHOD_STREAM || !p_sys->stream.b_prefetch )
+        return AStreamVaControl( s, i_query, args );
+
+    vlc_mutex_lock( &p_sys->stream.lock );
+    /* Seeking waits for the prefetcher only if the access must seek */
+    if( i_query != STREAM_GET_POSITION && i_query != STREAM_GET_SIZE
+     && i_query != STREAM_SET_POSITION )
+        AStreamIdlePrefetch( s );
+    int i_ret = AStreamVaControl( s, i_query, args );
+    vlc_mutex_unlock( &p_sys->stream.lock );
+    return i_ret;
+}
+
+static int AStreamVaControl( stream_t *s, int i_query, va_list args )
 {
     stream_sys_t *p_sys = s->p_sys;
     access_t     *p_access = p_sys->p_access;
@@ -598,6 +758,10 @@ static int AStreamControl( stream_t *s, int i_query, va_list args )
                 return AStreamSeekBlock( s, i_64 );
             case STREAM_METHOD_STREAM:
                 return AStreamSeekStream( s, i_64 );
+#ifdef STREAM_MMAP
+            case STREAM_METHOD_MMAP:
+                return AStreamSeekMmap( s, i_64 );
+#endif
             default:
                 assert(0);
                 return VLC_EGENERIC;
@@ -618,6 +782,14 @@ static int AStreamControl( stream_t *s, int i_query, va_list args )
         }
 
         case STREAM_UPDATE_SIZE:
+#ifdef STREAM_MMAP
+            /* The access is not used for reading: only its size changes */
+            if( p_sys->method == STREAM_METHOD_MMAP )
+            {
+                AStreamSizeMmap( s );
+                return VLC_SUCCESS;
+            }
+#endif
             AStreamControlUpdate( s );
             return VLC_SUCCESS;
 
@@ -1149,8 +1321,12 @@ static int AStreamSeekStream( stream_t *s, uint64_t i_pos )
              p_current->i_end );
 #endif
 
+    /* The access may be in use by the prefetcher */
     bool   b_aseek;
-    access_Control( p_access, ACCESS_CAN_SEEK, &b_aseek );
+    if( p_sys->stream.b_prefetch )
+        b_aseek = p_sys->stream.b_can_seek;
+    else
+        access_Control( p_access, ACCESS_CAN_SEEK, &b_aseek );
     if( !b_aseek && i_pos < p_current->i_start )
     {
         msg_Warn( s, "AStreamSeekStream: can't seek" );
@@ -1158,7 +1334,10 @@ static int AStreamSeekStream( stream_t *s, uint64_t i_pos )
     }
 
     bool   b_afastseek;
-    access_Control( p_access, ACCESS_CAN_FASTSEEK, &b_afastseek );
+    if( p_sys->stream.b_prefetch )
+        b_afastseek = p_sys->stat.b_fastseek;
+    else
+        access_Control( p_access, ACCESS_CAN_FASTSEEK, &b_afastseek );
 
     /* FIXME compute seek cost (instead of static 'stupid' value) */
     uint64_t i_skip_threshold;
@@ -1230,6 +1409,7 @@ static int AStreamSeekStream( stream_t *s, uint64_t i_pos )
             /* Seek at the end of the buffer
              * TODO it is stupid to seek now, it would be better to delay it
              */
+            AStreamIdlePrefetch( s );
             if( ASeek( s, tk->i_end ) )
                 return VLC_EGENERIC;
         }
@@ -1251,6 +1431,7 @@ static int AStreamSeekStream( stream_t *s, uint64_t i_pos )
         msg_Err( s, "AStreamSeekStream: hard seek" );
 #endif
         /* Nothing good, seek and choose oldest segment */
+        AStreamIdlePrefetch( s );
         if( ASeek( s, i_pos ) )
             return VLC_EGENERIC;
 
@@ -1342,11 +1523,16 @@ static int AStreamReadNoSeekStream( stream_t *s, void *p_read, unsigned int i_re
 }
 
 
+static int AStreamWaitPrefetch( stream_t *s );
+
 static int AStreamRefillStream( stream_t *s )
 {
     stream_sys_t *p_sys = s->p_sys;
     stream_track_t *tk = &p_sys->stream.tk[p_sys->stream.i_tk];
 
+    if( p_sys->stream.b_prefetch )
+        return AStreamWaitPrefetch( s );
+
     /* We read but won't increase i_start after initial start + offset */
     int i_toread =
         __MIN( p_sys->stream.i_used, STREAM_CACHE_TRACK_SIZE -
@@ -1468,6 +1654,208 @@ static void AStreamPrebufferStream( stream_t *s )
     }
 }
 
+/****************************************************************************
+ * Method 2 prefetching:
+ ****************************************************************************/
+static void *AStreamPrefetchThread( void *data )
+{
+    stream_t *s = (stream_t *)data;
+    stream_sys_t *p_sys = s->p_sys;
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &p_sys->stream.lock );
+    while( !p_sys->stream.b_exit )
+    {
+        stream_track_t *tk = &p_sys->stream.tk[p_sys->stream.i_tk];
+        const unsigned i_unread =
+            tk->i_end - tk->i_start - p_sys->stream.i_offset;
+        const unsigned i_target =
+            __MIN( __MAX( p_sys->stream.i_prefetch, p_sys->stream.i_demand ),
+                   STREAM_CACHE_TRACK_SIZE );
+
+        if( p_sys->stream.b_eof || i_unread >= i_target )
+        {
+            vlc_cond_wait( &p_sys->stream.wait, &p_sys->stream.lock );
+            continue;
+        }
+
+        /* The data before the read position may be overwritten, but not
+         * the unread data, as i_unread + i_read <= STREAM_CACHE_TRACK_SIZE */
+        const unsigned i_off = tk->i_end % STREAM_CACHE_TRACK_SIZE;
+        int i_read = __MIN( i_target - i_unread,
+                            STREAM_CACHE_TRACK_SIZE - i_off );
+        i_read = __MIN( i_read, STREAM_PREFETCH_ATONCE );
+
+        p_sys->stream.b_busy = true;
+        vlc_mutex_unlock( &p_sys->stream.lock );
+
+        const mtime_t i_start = mdate();
+        i_read = AReadStream( s, &tk->p_buffer[i_off], i_read );
+        const mtime_t i_stop = mdate();
+
+        vlc_mutex_lock( &p_sys->stream.lock );
+        p_sys->stream.b_busy = false;
+
+        /* Nobody changed the track while the access was busy */
+        if( i_read > 0 )
+        {
+            tk->i_end += i_read;
+
+            /* Windows of STREAM_CACHE_TRACK_SIZE */
+            if( tk->i_start + STREAM_CACHE_TRACK_SIZE < tk->i_end )
+            {
+                unsigned i_invalid = tk->i_end - tk->i_start - STREAM_CACHE_TRACK_SIZE;
+
+                tk->i_start += i_invalid;
+                p_sys->stream.i_offset -= i_invalid;
+            }
+
+            p_sys->stat.i_bytes += i_read;
+            p_sys->stat.i_read_count++;
+            p_sys->stat.i_read_time += i_stop - i_start;
+        }
+        else if( i_read == 0 || !vlc_object_alive( s ) )
+        {
+            p_sys->stream.b_eof = true;
+        }
+        vlc_cond_broadcast( &p_sys->stream.wait_data );
+    }
+    vlc_mutex_unlock( &p_sys->stream.lock );
+
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+static bool AStreamStartPrefetch( stream_t *s )
+{
+    stream_sys_t *p_sys = s->p_sys;
+    int64_t i_prefetch = var_InheritInteger( s, "stream-prefetch" );
+
+    p_sys->stream.b_prefetch = false;
+    if( i_prefetch <= 0 )
+        return false;
+
+    /* The prefetched data must fit in the track being read */
+    if( i_prefetch * 1024 > STREAM_CACHE_TRACK_SIZE )
+    {
+        msg_Warn( s, "stream-prefetch limited to %d kB",
+                  STREAM_CACHE_TRACK_SIZE / 1024 );
+        i_prefetch = STREAM_CACHE_TRACK_SIZE / 1024;
+    }
+    p_sys->stream.i_prefetch = i_prefetch * 1024;
+    p_sys->stream.i_demand = 0;
+    access_Control( p_sys->p_access, ACCESS_CAN_SEEK,
+                    &p_sys->stream.b_can_seek );
+    p_sys->stream.b_busy = false;
+    p_sys->stream.b_eof = false;
+    p_sys->stream.b_exit = false;
+    vlc_mutex_init( &p_sys->stream.lock );
+    vlc_cond_init( &p_sys->stream.wait );
+    vlc_cond_init( &p_sys->stream.wait_data );
+
+    if( vlc_clone( &p_sys->stream.thread, AStreamPrefetchThread, s,
+                   VLC_THREAD_PRIORITY_INPUT ) )
+    {
+        vlc_cond_destroy( &p_sys->stream.wait_data );
+        vlc_cond_destroy( &p_sys->stream.wait );
+        vlc_mutex_destroy( &p_sys->stream.lock );
+        return false;
+    }
+
+    msg_Dbg( s, "prefetching up to %u bytes", p_sys->stream.i_prefetch );
+    p_sys->stream.b_prefetch = true;
+    return true;
+}
+
+static void AStreamStopPrefetch( stream_t *s )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    if( !p_sys->stream.b_prefetch )
+        return;
+
+    vlc_mutex_lock( &p_sys->stream.lock );
+    p_sys->stream.b_exit = true;
+    vlc_cond_signal( &p_sys->stream.wait );
+    vlc_mutex_unlock( &p_sys->stream.lock );
+
+    vlc_join( p_sys->stream.thread, NULL );
+    vlc_cond_destroy( &p_sys->stream.wait_data );
+    vlc_cond_destroy( &p_sys->stream.wait );
+    vlc_mutex_destroy( &p_sys->stream.lock );
+    p_sys->stream.b_prefetch = false;
+}
+
+/**
+ * Waits for the read in progress, so that the caller can use the access.
+ * The lock must be held, and the prefetcher will not use the access again
+ * before it is released.
+ */
+static void AStreamIdlePrefetch( stream_t *s )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    if( !p_sys->stream.b_prefetch )
+        return;
+
+    while( p_sys->stream.b_busy )
+        vlc_cond_wait( &p_sys->stream.wait_data, &p_sys->stream.lock );
+    /* The position may change: the end of stream must be checked again */
+    p_sys->stream.b_eof = false;
+}
+
+/**
+ * Replaces AStreamRefillStream() when prefetching: asks the prefetcher for
+ * i_used more bytes, and waits until it has read something.
+ */
+static int AStreamWaitPrefetch( stream_t *s )
+{
+    stream_sys_t *p_sys = s->p_sys;
+    stream_track_t *tk = &p_sys->stream.tk[p_sys->stream.i_tk];
+    const uint64_t i_end = tk->i_end;
+    const unsigned i_unread = i_end - tk->i_start - p_sys->stream.i_offset;
+
+    if( i_unread >= STREAM_CACHE_TRACK_SIZE )
+        return VLC_EGENERIC; /* Full */
+
+    p_sys->stream.i_demand = i_unread + __MAX( p_sys->stream.i_used, 1 );
+    p_sys->stream.b_eof = false;
+    vlc_cond_signal( &p_sys->stream.wait );
+
+    while( tk->i_end == i_end && !p_sys->stream.b_eof )
+        vlc_cond_wait( &p_sys->stream.wait_data, &p_sys->stream.lock );
+    p_sys->stream.i_demand = 0;
+
+    if( tk->i_end == i_end )
+        return VLC_EGENERIC; /* EOF */
+
+    const unsigned i_read = tk->i_end - i_end;
+    p_sys->stream.i_used -= __MIN( p_sys->stream.i_used, i_read );
+    return VLC_SUCCESS;
+}
+
+static int AStreamReadPrefetch( stream_t *s, void *p_read, unsigned int i_read )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    vlc_mutex_lock( &p_sys->stream.lock );
+    int i_ret = AStreamReadStream( s, p_read, i_read );
+    vlc_mutex_unlock( &p_sys->stream.lock );
+    return i_ret;
+}
+
+/* The returned data cannot be overwritten by the prefetcher: it only writes
+ * over data already read */
+static int AStreamPeekPrefetch( stream_t *s, const uint8_t **pp_peek, unsigned int i_read )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    vlc_mutex_lock( &p_sys->stream.lock );
+    int i_ret = AStreamPeekStream( s, pp_peek, i_read );
+    vlc_mutex_unlock( &p_sys->stream.lock );
+    return i_ret;
+}
+
 /****************************************************************************
  * stream_ReadLine:
  ****************************************************************************/
@@ -1659,6 +2047,364 @@ error:
     return NULL;
 }
 
+#ifdef STREAM_MMAP
+/****************************************************************************
+ * Method 3:
+ ****************************************************************************/
+/* Bytes mapped by the views only kept alive by blocks */
+static atomic_size_t stream_mmap_retired = ATOMIC_VAR_INIT(0);
+
+static void MmapViewRelease( stream_mmap_view_t *p_view )
+{
+    if( vlc_atomic_dec( &p_view->refs ) > 0 )
+        return;
+
+#ifdef HAVE_MMAP
+    munmap( p_view->p_base, p_view->i_length );
+#elif defined( _WIN32 )
+    UnmapViewOfFile( p_view->p_base );
+#endif
+    if( p_view->b_retired )
+        atomic_fetch_sub( &stream_mmap_retired, p_view->i_length );
+    free( p_view );
+}
+
+/**
+ * Drops the reference of the stream to its window.
+ */
+static void MmapViewRetire( stream_mmap_view_t *p_view )
+{
+    p_view->b_retired = true;
+    atomic_fetch_add( &stream_mmap_retired, p_view->i_length );
+    MmapViewRelease( p_view );
+}
+
+typedef struct
+{
+    block_t             self;
+    stream_mmap_view_t *p_view;
+} stream_mmap_block_t;
+
+static void MmapBlockRelease( block_t *p_block )
+{
+    stream_mmap_block_t *p_mb = (stream_mmap_block_t *)p_block;
+
+    MmapViewRelease( p_mb->p_view );
+    free( p_mb );
+}
+
+/**
+ * Refreshes the file size, in case the file is still being written.
+ */
+static uint64_t AStreamSizeMmap( stream_t *s )
+{
+    stream_sys_t *p_sys = s->p_sys;
+    struct stat st;
+
+    if( fstat( p_sys->mmap.fd, &st ) == 0
+     && (uint64_t)st.st_size > p_sys->mmap.i_size )
+    {
+#ifdef _WIN32
+        /* A mapping object cannot grow: create a new one. Existing views
+         * keep the previous one alive as long as needed. */
+        HANDLE h_map = CreateFileMapping(
+                            (HANDLE)_get_osfhandle( p_sys->mmap.fd ), NULL,
+                            PAGE_WRITECOPY, 0, 0, NULL );
+        if( h_map == NULL )
+            return p_sys->mmap.i_size;
+        CloseHandle( p_sys->mmap.h_map );
+        p_sys->mmap.h_map = h_map;
+#endif
+        p_sys->mmap.i_size = st.st_size;
+        p_sys->p_access->info.i_size = st.st_size;
+    }
+    return p_sys->mmap.i_size;
+}
+
+/**
+ * Makes sure that the current view maps the file from i_pos, and if possible
+ * the following i_want bytes.
+ * \return the number of bytes mapped from i_pos (0 at end of file or error)
+ */
+static size_t AStreamMapMmap( stream_t *s, uint64_t i_pos, size_t i_want )
+{
+    stream_sys_t *p_sys = s->p_sys;
+    stream_mmap_view_t *p_view = p_sys->mmap.p_view;
+    uint64_t i_size = p_sys->mmap.i_size;
+
+    if( i_pos + i_want > i_size )
+        i_size = AStreamSizeMmap( s );
+    if( i_pos >= i_size )
+        return 0;
+    if( i_want > i_size - i_pos )
+        i_want = i_size - i_pos;
+
+    /* Data before i_served may have been modified by the owner of a block
+     * (the view is copy-on-write): only use it for data never handed out. */
+    if( p_view != NULL && i_pos >= p_view->i_served
+     && i_pos + i_want <= p_view->i_start + p_view->i_length )
+        return p_view->i_start + p_view->i_length - i_pos;
+
+    /* Map a new window */
+    uint64_t i_start = i_pos & ~(uint64_t)(STREAM_MMAP_ALIGN - 1);
+    uint64_t i_length = __MAX( (uint64_t)STREAM_MMAP_WINDOW,
+                               i_pos - i_start + i_want );
+    if( i_length > i_size - i_start )
+        i_length = i_size - i_start;
+    if( i_length > SIZE_MAX )
+        return 0;
+
+    stream_mmap_view_t *p_new = (stream_mmap_view_t *)malloc( sizeof( *p_new ) );
+    if( unlikely(p_new == NULL) )
+        return 0;
+
+#ifdef HAVE_MMAP
+    /* Private writable mapping, as block users may modify their data */
+    void *p_base = mmap( NULL, i_length, PROT_READ|PROT_WRITE, MAP_PRIVATE,
+                         p_sys->mmap.fd, i_start );
+    if( p_base == MAP_FAILED )
+        p_base = NULL;
+    else
+        posix_madvise( p_base, i_length, POSIX_MADV_SEQUENTIAL );
+#elif defined( _WIN32 )
+    void *p_base = MapViewOfFile( p_sys->mmap.h_map, FILE_MAP_COPY,
+                                  (DWORD)(i_start >> 32), (DWORD)i_start,
+                                  (SIZE_T)i_length );
+#endif
+    if( p_base == NULL )
+    {
+        msg_Err( s, "cannot map %"PRIu64" bytes at %"PRIu64, i_length,
+                 i_start );
+        free( p_new );
+        return 0;
+    }
+
+    vlc_atomic_set( &p_new->refs, 1 );
+    p_new->p_base = (uint8_t *)p_base;
+    p_new->i_length = i_length;
+    p_new->i_start = i_start;
+    p_new->i_served = i_start;
+    p_new->b_retired = false;
+    if( p_view != NULL )
+        MmapViewRetire( p_view );
+    p_sys->mmap.p_view = p_new;
+    p_sys->mmap.i_advised = i_pos;
+
+    /* Update read bytes in input */
+    if( s->p_input )
+    {
+        input_thread_t *p_input = s->p_input;
+        uint64_t total;
+
+        vlc_mutex_lock( &p_input->p->counters.counters_lock );
+        stats_Update( p_input->p->counters.p_read_bytes, i_length, &total );
+        stats_Update( p_input->p->counters.p_input_bitrate, total, NULL );
+        stats_Update( p_input->p->counters.p_read_packets, 1, NULL );
+        vlc_mutex_unlock( &p_input->p->counters.counters_lock );
+    }
+    p_sys->stat.i_read_count++;
+    p_sys->stat.i_bytes += i_length;
+
+    return i_start + i_length - i_pos;
+}
+
+/**
+ * Asks the kernel to read ahead of the current position within the view.
+ */
+static void AStreamAdviseMmap( stream_t *s )
+{
+#ifdef HAVE_MMAP
+    stream_sys_t *p_sys = s->p_sys;
+    stream_mmap_view_t *p_view = p_sys->mmap.p_view;
+
+    if( p_view == NULL
+     || p_sys->i_pos + STREAM_MMAP_READAHEAD / 2 < p_sys->mmap.i_advised )
+        return;
+
+    uint64_t i_begin = __MAX( p_sys->mmap.i_advised, p_sys->i_pos );
+    uint64_t i_end = __MIN( p_sys->i_pos + STREAM_MMAP_READAHEAD,
+                            p_view->i_start + p_view->i_length );
+    if( i_begin >= i_end )
+        return;
+
+    /* The address given to madvise() must be page-aligned */
+    uint64_t i_offset = (i_begin - p_view->i_start)
+                      & ~(uint64_t)(STREAM_MMAP_ALIGN - 1);
+    posix_madvise( p_view->p_base + i_offset,
+                   i_end - p_view->i_start - i_offset, POSIX_MADV_WILLNEED );
+    p_sys->mmap.i_advised = i_end;
+#else
+    VLC_UNUSED(s);
+#endif
+}
+
+static int AStreamReadMmap( stream_t *s, void *p_read, unsigned int i_read )
+{
+    stream_sys_t *p_sys = s->p_sys;
+    uint8_t *p_data = (uint8_t *)p_read;
+    unsigned int i_data = 0;
+
+    if( p_data == NULL )
+    {
+        /* Skipping data does not need any mapping */
+        uint64_t i_size = p_sys->mmap.i_size;
+
+        if( p_sys->i_pos + i_read > i_size )
+            i_size = AStreamSizeMmap( s );
+        if( p_sys->i_pos >= i_size )
+            return 0;
+        if( i_read > i_size - p_sys->i_pos )
+            i_read = i_size - p_sys->i_pos;
+        p_sys->i_pos += i_read;
+        return i_read;
+    }
+
+    while( i_data < i_read )
+    {
+        size_t i_avail = AStreamMapMmap( s, p_sys->i_pos,
+                                         __MIN( i_read - i_data,
+                                                STREAM_MMAP_WINDOW ) );
+        if( i_avail == 0 )
+            break;
+
+        stream_mmap_view_t *p_view = p_sys->mmap.p_view;
+        size_t i_copy = __MIN( i_avail, i_read - i_data );
+
+        memcpy( p_data, p_view->p_base + (p_sys->i_pos - p_view->i_start),
+                i_copy );
+        p_data += i_copy;
+        i_data += i_copy;
+        p_sys->i_pos += i_copy;
+    }
+    AStreamAdviseMmap( s );
+    return i_data;
+}
+
+static int AStreamPeekMmap( stream_t *s, const uint8_t **pp_peek,
+                            unsigned int i_read )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    size_t i_avail = AStreamMapMmap( s, p_sys->i_pos, i_read );
+    if( i_avail == 0 )
+        return 0;
+
+    stream_mmap_view_t *p_view = p_sys->mmap.p_view;
+    *pp_peek = p_view->p_base + (p_sys->i_pos - p_view->i_start);
+    return __MIN( i_avail, i_read );
+}
+
+static block_t *AStreamBlockMmap( stream_t *s, unsigned int i_size )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    size_t i_avail = AStreamMapMmap( s, p_sys->i_pos, i_size );
+    if( i_avail == 0 )
+        return NULL;
+
+    stream_mmap_view_t *p_view = p_sys->mmap.p_view;
+    size_t i_block = __MIN( i_avail, i_size );
+    uint8_t *p_data = p_view->p_base + (p_sys->i_pos - p_view->i_start);
+
+    /* Too many past windows are still mapped: do not pin this one too */
+    if( atomic_load( &stream_mmap_retired ) >= STREAM_MMAP_RETIRED )
+    {
+        block_t *p_block = block_Alloc( i_block );
+        if( unlikely(p_block == NULL) )
+            return NULL;
+
+        memcpy( p_block->p_buffer, p_data, i_block );
+        p_sys->i_pos += i_block;
+        AStreamAdviseMmap( s );
+        return p_block;
+    }
+
+    stream_mmap_block_t *p_mb = (stream_mmap_block_t *)malloc( sizeof( *p_mb ) );
+    if( unlikely(p_mb == NULL) )
+        return NULL;
+
+    block_Init( &p_mb->self, p_data, i_block );
+    p_mb->self.pf_release = MmapBlockRelease;
+    p_mb->p_view = p_view;
+    vlc_atomic_inc( &p_view->refs );
+
+    p_sys->i_pos += i_block;
+    p_view->i_served = p_sys->i_pos;
+    AStreamAdviseMmap( s );
+    return &p_mb->self;
+}
+
+static int AStreamSeekMmap( stream_t *s, uint64_t i_pos )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    /* Mapping is done lazily by the next read */
+    p_sys->i_pos = i_pos;
+    p_sys->mmap.i_advised = i_pos;
+    return VLC_SUCCESS;
+}
+
+/**
+ * Tries to map the file of the access directly instead of reading it.
+ */
+static bool AStreamOpenMmap( stream_t *s )
+{
+    stream_sys_t *p_sys = s->p_sys;
+    access_t *p_access = p_sys->p_access;
+    bool b_fastseek;
+
+    if( !var_InheritBool( s, "file-mmap" )
+     || strcmp( p_access->psz_access, "file" )
+     || p_access->psz_filepath == NULL
+     || p_access->info.i_size < STREAM_MMAP_MIN_SIZE )
+        return false;
+    access_Control( p_access, ACCESS_CAN_FASTSEEK, &b_fastseek );
+    if( !b_fastseek )
+        return false;
+
+    int fd = vlc_open( p_access->psz_filepath, O_RDONLY );
+    if( fd == -1 )
+        return false;
+
+    struct stat st;
+    if( fstat( fd, &st ) || !S_ISREG( st.st_mode ) )
+    {
+        close( fd );
+        return false;
+    }
+
+#ifdef _WIN32
+    p_sys->mmap.h_map = CreateFileMapping( (HANDLE)_get_osfhandle( fd ),
+                                           NULL, PAGE_WRITECOPY, 0, 0, NULL );
+    if( p_sys->mmap.h_map == NULL )
+    {
+        close( fd );
+        return false;
+    }
+#endif
+    p_sys->mmap.fd = fd;
+    p_sys->mmap.i_size = st.st_size;
+    p_sys->mmap.p_view = NULL;
+    p_sys->mmap.i_advised = p_sys->i_pos;
+    p_access->info.i_size = st.st_size;
+    return true;
+}
+
+static void AStreamCloseMmap( stream_t *s )
+{
+    stream_sys_t *p_sys = s->p_sys;
+
+    /* Blocks still in use keep their own view mapped */
+    if( p_sys->mmap.p_view != NULL )
+        MmapViewRetire( p_sys->mmap.p_view );
+#ifdef _WIN32
+    CloseHandle( p_sys->mmap.h_map );
+#endif
+    close( p_sys->mmap.fd );
+}
+
+#endif
+
 /****************************************************************************
  * Access reading/seeking wrappers to handle concatenated streams.
  ****************************************************************************/
@@ -1915,6 +2661,10 @@ block_t *stream_Block( stream_t *s, int i_size )
 {
     if( i_size <= 0 ) return NULL;
 
+    /* The stream can provide blocks without copying */
+    if( s->pf_block != NULL )
+        return s->pf_block( s, i_size );
+
     /* emulate block read */
     block_t *p_bk = block_Alloc( i_size );
     if( p_bk )
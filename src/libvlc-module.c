@@ -665,6 +665,18 @@ static const char *const ppsz_prefres[] = {
 #define INPUT_RECORD_PATH_LONGTEXT N_( \
     "Directory or filename where the records will be stored" )
 
+#define FILE_MMAP_TEXT N_("Memory-map local files")
+#define FILE_MMAP_LONGTEXT N_( \
+    "Read large local files through memory mappings instead of copying " \
+    "them into the input cache. This saves memory copies when demuxing " \
+    "big files." )
+
+#define STREAM_PREFETCH_TEXT N_("Stream prefetch size (kB)")
+#define STREAM_PREFETCH_LONGTEXT N_( \
+    "Amount of data to read ahead of the current position from a " \
+    "separate thread, so that slow reads do not block the demuxer. " \
+    "0 disables prefetching." )
+
 #define INPUT_RECORD_NATIVE_TEXT N_("Prefer native stream recording")
 #define INPUT_RECORD_NATIVE_LONGTEXT N_( \
     "When possible, the input stream will be recorded instead of using " \
@@ -812,6 +824,12 @@ static const char *const ppsz_prefres[] = {
     "However allocation of port numbers below 1025 is usually restricted " \
     "by the operating system." )
 
+#define HTTP_THREADS_TEXT N_( "HTTP server threads" )
+#define HTTP_THREADS_LONGTEXT N_( \
+    "Number of threads serving the clients of each HTTP, HTTPS or RTSP " \
+    "server. Each thread takes the connections it accepts. More threads " \
+    "help when streaming to many clients at once." )
+
 #define HTTPS_PORT_TEXT N_( "HTTPS server port" )
 #define HTTPS_PORT_LONGTEXT N_( \
     "The HTTPS server will listen on this TCP port. " \
@@ -902,6 +920,14 @@ static const char *const ppsz_prefres[] = {
     "before trying the other ones. Only advanced users should " \
     "alter this option as it can break playback of all your streams." )
 
+#define DECODER_POOL_TEXT N_("Shared decoder threads")
+#define DECODER_POOL_LONGTEXT N_( \
+    "Number of threads shared by the decoders of all the inputs. " \
+    "Each decoder otherwise has its own thread, which is wasteful when " \
+    "playing many small streams at once. More threads are started when " \
+    "decoders have to wait (paused, buffering or out of pictures). " \
+    "0 gives each decoder its own thread." )
+
 #define ENCODER_TEXT N_("Preferred encoders list")
 #define ENCODER_LONGTEXT N_( \
     "This allows you to select a list of encoders that VLC will use in " \
@@ -1024,6 +1050,13 @@ static const char *const ppsz_prefres[] = {
     "priorities. You can use it to tune VLC priority against other " \
     "programs, or against other VLC instances.")
 
+#define BLOCK_POOL_TEXT N_("Recycle data blocks")
+#define BLOCK_POOL_LONGTEXT N_( \
+    "Keep released data blocks of common sizes in per-thread caches and " \
+    "reuse them instead of allocating new ones. This reduces the heap " \
+    "allocator load with high bitrate or many simultaneous streams, at " \
+    "the cost of some memory.")
+
 #define USE_STREAM_IMMEDIATE_LONGTEXT N_( \
      "This option is useful if you want to lower the latency when " \
      "reading a stream")
@@ -1751,6 +1784,9 @@ vlc_module_begin ()
         change_integer_range( 1, 65535 )
     add_integer( "https-port", 8443, HTTPS_PORT_TEXT, HTTPS_PORT_LONGTEXT, true )
         change_integer_range( 1, 65535 )
+    add_integer( "http-threads", 1, HTTP_THREADS_TEXT, HTTP_THREADS_LONGTEXT,
+                 true )
+        change_integer_range( 1, 64 )
     add_string( "rtsp-host", NULL, RTSP_HOST_TEXT, RTSP_HOST_LONGTEXT, true )
     add_integer( "rtsp-port", 554, RTSP_PORT_TEXT, RTSP_PORT_LONGTEXT, true )
         change_integer_range( 1, 65535 )
@@ -1805,6 +1841,10 @@ vlc_module_begin ()
         change_integer_range( 0, 60000 )
         change_safe()
     add_obsolete_integer( "vdr-caching" ) /* 2.0.0 */
+    add_bool( "file-mmap", false, FILE_MMAP_TEXT, FILE_MMAP_LONGTEXT, true )
+    add_integer( "stream-prefetch", 0,
+                 STREAM_PREFETCH_TEXT, STREAM_PREFETCH_LONGTEXT, true )
+        change_integer_range( 0, 4096 )
     add_integer( "live-caching", DEFAULT_PTS_DELAY / 1000,
                  CAPTURE_CACHING_TEXT, CAPTURE_CACHING_LONGTEXT, true )
         change_integer_range( 0, 60000 )
@@ -1874,6 +1914,9 @@ vlc_module_begin ()
     add_category_hint( N_("Decoders"), CODEC_CAT_LONGTEXT , true )
     add_string( "codec", NULL, CODEC_TEXT,
                 CODEC_LONGTEXT, true )
+    add_integer( "decoder-pool", 0, DECODER_POOL_TEXT,
+                 DECODER_POOL_LONGTEXT, true )
+        change_integer_range( 0, 64 )
     add_string( "encoder",  NULL, ENCODER_TEXT,
                 ENCODER_LONGTEXT, true )
 
@@ -1973,6 +2016,9 @@ vlc_module_begin ()
 
     set_section( N_("Performance options"), NULL )
 
+    add_bool( "block-pool", false, BLOCK_POOL_TEXT,
+              BLOCK_POOL_LONGTEXT, true )
+
 #ifdef LIBVLC_USE_PTHREAD
 # ifndef __APPLE__
     add_bool( "rt-priority", false, RT_PRIORITY_TEXT,
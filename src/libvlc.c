@@ -113,6 +113,7 @@ libvlc_int_t * libvlc_InternalCreate( void )
     priv->p_playlist = NULL;
     priv->p_dialog_provider = NULL;
     priv->p_vlm = NULL;
+    priv->b_block_pool = false;
 
     vlc_ExitInit( &priv->exit );
 
@@ -364,6 +365,9 @@ dbus_out:
 
     priv->b_stats = var_InheritBool( p_libvlc, "stats" );
 
+    priv->b_block_pool = var_InheritBool( p_libvlc, "block-pool" );
+    block_PoolInit( priv->b_block_pool );
+
     /*
      * Initialize hotkey handling
      */
@@ -553,6 +557,8 @@ void libvlc_InternalCleanup( libvlc_int_t *p_libvlc )
         playlist_Destroy( p_playlist );
 
     msg_Dbg( p_libvlc, "removing stats" );
+    block_PoolDump( VLC_OBJECT(p_libvlc) );
+    block_PoolDeinit( priv->b_block_pool );
 
 #if !defined( _WIN32 ) && !defined( __OS2__ )
     char* psz_pidfile = NULL;
@@ -50,6 +50,13 @@ size_t EnumClockSource( vlc_object_t *, const char *, char ***, char *** );
 void vlc_CPU_init(void);
 void vlc_CPU_dump(vlc_object_t *);
 
+/*
+ * Block pool
+ */
+void block_PoolInit(bool);
+void block_PoolDeinit(bool);
+void block_PoolDump(vlc_object_t *);
+
 /*
  * Threads subsystem
  */
@@ -155,6 +162,7 @@ typedef struct libvlc_priv_t
         vlc_rwlock_t lock;
     } log;
     bool               b_stats;     ///< Whether to collect stats
+    bool               b_block_pool; ///< Whether blocks are recycled
 
     /* Singleton objects */
     playlist_t        *p_playlist; ///< the playlist singleton
@@ -41,12 +41,77 @@
 #include <vlc_common.h>
 #include <vlc_block.h>
 #include <vlc_fs.h>
+#include "libvlc.h"
 // sunqueen add start
 #include <io.h>
 
 #define	S_ISDIR(m)	(((m) & S_IFMT) == S_IFDIR)
 // sunqueen add end
 
+/* Native atomic operations on pointer-sized integers. Where vlc_atomic.h
+ * does not know the compiler (MSVC), it emulates them with one global lock,
+ * which would defeat the lock-free code below, so those are mapped to the
+ * Interlocked functions instead. */
+#if defined (_MSC_VER)
+# define BLOCK_ATOMIC 1
+typedef volatile LONG_PTR block_atomic_t;
+
+# define block_atomic_init(obj, value) \
+    do { *(obj) = (LONG_PTR)(value); } while(0)
+
+static inline uintptr_t block_atomic_load (block_atomic_t *obj)
+{
+    uintptr_t value = (uintptr_t)*obj;
+    MemoryBarrier ();
+    return value;
+}
+
+/* Interlocked operations are full barriers */
+static inline void block_atomic_store (block_atomic_t *obj, uintptr_t value)
+{
+    InterlockedExchangePointer ((PVOID volatile *)obj, (PVOID)value);
+}
+
+static inline bool block_atomic_cas (block_atomic_t *obj, uintptr_t *expected,
+                                     uintptr_t desired)
+{
+    uintptr_t old = (uintptr_t)InterlockedCompareExchangePointer (
+                         (PVOID volatile *)obj, (PVOID)desired, (PVOID)*expected);
+    if (old == *expected)
+        return true;
+    *expected = old;
+    return false;
+}
+
+static inline uintptr_t block_atomic_add (block_atomic_t *obj, uintptr_t value)
+{
+    uintptr_t old = block_atomic_load (obj);
+    while (!block_atomic_cas (obj, &old, old + value));
+    return old;
+}
+
+static inline uintptr_t block_atomic_sub (block_atomic_t *obj, uintptr_t value)
+{
+    return block_atomic_add (obj, (uintptr_t)0 - value);
+}
+
+#elif (!defined (__cplusplus) && (__STDC_VERSION__ >= 201112L) \
+        && !defined (__STDC_NO_ATOMICS__)) \
+   || defined (__GCC_HAVE_SYNC_COMPARE_AND_SWAP_4) \
+   || (defined (__clang__) && (defined (__x86_64__) || defined (__i386__)))
+# define BLOCK_ATOMIC 1
+# include <vlc_atomic.h>
+typedef atomic_uintptr_t block_atomic_t;
+
+# define block_atomic_init(obj, value) atomic_init(obj, value)
+# define block_atomic_load(obj) atomic_load(obj)
+# define block_atomic_store(obj, value) atomic_store(obj, value)
+# define block_atomic_cas(obj, expected, desired) \
+    atomic_compare_exchange_weak(obj, expected, desired)
+# define block_atomic_add(obj, value) atomic_fetch_add(obj, value)
+# define block_atomic_sub(obj, value) atomic_fetch_sub(obj, value)
+#endif
+
 /**
  * @section Block handling functions.
  */
@@ -135,11 +200,429 @@ static void BlockMetaCopy( block_t *__restrict out, const block_t *in )			// sun
 /* Maximum size of reserved footer before shrinking with realloc(). */
 #define BLOCK_WASTE_SIZE   2048
 
+/* Heap allocation size of a block_Alloc() block of the given payload size */
+#define BLOCK_ALLOC_SIZE( size ) \
+    (sizeof (block_t) + BLOCK_ALIGN + (2 * BLOCK_PADDING) + (size))
+
+static void block_Setup (block_t *b, size_t alloc, size_t size)
+{
+    block_Init (b, b + 1, alloc - sizeof (*b));
+    static_assert ((BLOCK_PADDING % BLOCK_ALIGN) == 0,
+                   "BLOCK_PADDING must be a multiple of BLOCK_ALIGN");
+    b->p_buffer += BLOCK_PADDING + BLOCK_ALIGN - 1;
+    b->p_buffer = (uint8_t *)(((uintptr_t)b->p_buffer) & ~(BLOCK_ALIGN - 1));			// sunqueen modify
+    b->i_buffer = size;
+}
+
+/**
+ * @section Block pool
+ *
+ * Blocks with a payload size close to one of a few common sizes can be
+ * recycled instead of going back to the heap (see the "block-pool" option).
+ * Each thread keeps a small free list per size class, so that allocation and
+ * release do not normally need any lock. When a thread cache runs dry or
+ * grows too large, half of it is exchanged with a shared depot.
+ */
+#define BLOCK_POOL_CLASSES 5
+
+static const size_t block_pool_sizes[BLOCK_POOL_CLASSES] =
+{
+    188 * 7, /* 7 TS packets, i.e. one UDP/RTP datagram */
+    4096,
+    16384,
+    32768,
+    65536,
+};
+
+/* Bytes of cached payload per class in a thread cache and in the depot */
+#define BLOCK_POOL_CACHE_BYTES (256 << 10)
+#define BLOCK_POOL_DEPOT_BYTES (4 << 20)
+
+typedef struct block_pool_cache_t block_pool_cache_t;
+struct block_pool_cache_t
+{
+    block_t *p_first[BLOCK_POOL_CLASSES];
+    unsigned i_count[BLOCK_POOL_CLASSES];
+    uint64_t i_hits[BLOCK_POOL_CLASSES];
+    uint64_t i_misses[BLOCK_POOL_CLASSES];
+    block_pool_cache_t *p_next; /* in block_pool_caches */
+};
+
+static vlc_mutex_t block_pool_lock = VLC_STATIC_MUTEX;
+static vlc_threadvar_t block_pool_key;
+static bool block_pool_key_created = false;
+/* Number of LibVLC instances using the pool; only written with the lock */
+#ifdef BLOCK_ATOMIC
+static block_atomic_t block_pool_users;
+#else
+static unsigned block_pool_users = 0;
+#endif
+
+/* Caches of all the threads, protected by block_pool_lock.
+ * Not all threads run the TLS destructor, so they are also freed when the
+ * last instance is gone. */
+static block_pool_cache_t *block_pool_caches = NULL;
+
+/* Shared depot, protected by block_pool_lock */
+static block_t *block_pool_depot[BLOCK_POOL_CLASSES];
+static unsigned block_pool_depot_count[BLOCK_POOL_CLASSES];
+static uint64_t block_pool_hits[BLOCK_POOL_CLASSES];
+static uint64_t block_pool_misses[BLOCK_POOL_CLASSES];
+
+static unsigned block_pool_CacheMax (unsigned i)
+{
+    unsigned max = BLOCK_POOL_CACHE_BYTES / block_pool_sizes[i];
+    return (max > 4) ? max : 4;
+}
+
+static unsigned block_pool_DepotMax (unsigned i)
+{
+    unsigned max = BLOCK_POOL_DEPOT_BYTES / block_pool_sizes[i];
+    return (max > 16) ? max : 16;
+}
+
+/**
+ * Finds the size class for a payload size.
+ * Small payloads are not pooled in much larger buffers, to avoid pinning
+ * memory for them.
+ */
+static unsigned block_pool_Class (size_t size)
+{
+    for (unsigned i = 0; i < BLOCK_POOL_CLASSES; i++)
+        if (size <= block_pool_sizes[i])
+            return (size > block_pool_sizes[i] / 4) ? i : BLOCK_POOL_CLASSES;
+    return BLOCK_POOL_CLASSES;
+}
+
+/* Must be called with block_pool_lock held */
+static void block_pool_MergeStats (block_pool_cache_t *cache, unsigned i)
+{
+    block_pool_hits[i] += cache->i_hits[i];
+    block_pool_misses[i] += cache->i_misses[i];
+    cache->i_hits[i] = cache->i_misses[i] = 0;
+}
+
+/* Must be called with block_pool_lock held */
+static bool block_pool_IsEnabledLocked (void)
+{
+#ifdef BLOCK_ATOMIC
+    return block_atomic_load (&block_pool_users) != 0;
+#else
+    return block_pool_users != 0;
+#endif
+}
+
+static bool block_pool_IsEnabled (void)
+{
+#ifdef BLOCK_ATOMIC
+    return block_atomic_load (&block_pool_users) != 0;
+#else
+    vlc_mutex_lock (&block_pool_lock);
+    bool enabled = block_pool_users != 0;
+    vlc_mutex_unlock (&block_pool_lock);
+    return enabled;
+#endif
+}
+
+/* Must be called with block_pool_lock held */
+static void block_pool_DepotPut (unsigned i, block_t *block)
+{
+    /* Once the last instance is gone, cached blocks go back to the heap */
+    if (block_pool_depot_count[i] >= block_pool_DepotMax (i)
+     || !block_pool_IsEnabledLocked ())
+    {
+        free (block);
+        return;
+    }
+    block->p_next = block_pool_depot[i];
+    block_pool_depot[i] = block;
+    block_pool_depot_count[i]++;
+}
+
+static void block_pool_CacheRelease (void *data)
+{
+    block_pool_cache_t *cache = (block_pool_cache_t *)data;
+
+    vlc_mutex_lock (&block_pool_lock);
+    block_pool_cache_t **pp = &block_pool_caches;
+    while (*pp != cache)
+        pp = &(*pp)->p_next;
+    *pp = cache->p_next;
+
+    for (unsigned i = 0; i < BLOCK_POOL_CLASSES; i++)
+    {
+        block_t *block = cache->p_first[i];
+        while (block != NULL)
+        {
+            block_t *next = block->p_next;
+            block_pool_DepotPut (i, block);
+            block = next;
+        }
+        block_pool_MergeStats (cache, i);
+    }
+    vlc_mutex_unlock (&block_pool_lock);
+    free (cache);
+}
+
+static block_pool_cache_t *block_pool_GetCache (void)
+{
+    block_pool_cache_t *cache =
+        (block_pool_cache_t *)vlc_threadvar_get (block_pool_key);
+    if (likely(cache != NULL))
+        return cache;
+
+    cache = (block_pool_cache_t *)calloc (1, sizeof (*cache));
+    if (unlikely(cache == NULL))
+        return NULL;
+    if (vlc_threadvar_set (block_pool_key, cache))
+    {
+        free (cache);
+        return NULL;
+    }
+
+    vlc_mutex_lock (&block_pool_lock);
+    cache->p_next = block_pool_caches;
+    block_pool_caches = cache;
+    vlc_mutex_unlock (&block_pool_lock);
+    return cache;
+}
+
+/* Size class of a block allocated from the pool */
+static unsigned block_pool_BlockClass (const block_t *block)
+{
+    unsigned i = 0;
+
+    while (block->i_size != BLOCK_ALLOC_SIZE (block_pool_sizes[i])
+                                                        - sizeof (block_t))
+        i++;
+    assert (i < BLOCK_POOL_CLASSES);
+    return i;
+}
+
+static void block_pool_Release (block_t *block)
+{
+    unsigned i = block_pool_BlockClass (block);
+
+    assert (block->p_start == (unsigned char *)(block + 1));
+    block_Invalidate (block);
+
+    /* The caches are gone with the last instance */
+    block_pool_cache_t *cache = block_pool_IsEnabled ()
+                              ? block_pool_GetCache () : NULL;
+    if (cache == NULL)
+    {
+        free (block);
+        return;
+    }
+
+    block->p_next = cache->p_first[i];
+    cache->p_first[i] = block;
+    if (++cache->i_count[i] <= block_pool_CacheMax (i))
+        return;
+
+    /* Thread cache is full: move half of it to the depot */
+    vlc_mutex_lock (&block_pool_lock);
+    for (unsigned n = cache->i_count[i] / 2; n > 0; n--)
+    {
+        block = cache->p_first[i];
+        cache->p_first[i] = block->p_next;
+        cache->i_count[i]--;
+        block_pool_DepotPut (i, block);
+    }
+    block_pool_MergeStats (cache, i);
+    vlc_mutex_unlock (&block_pool_lock);
+}
+
+static block_t *block_pool_Get (unsigned i)
+{
+    block_pool_cache_t *cache = block_pool_GetCache ();
+    if (unlikely(cache == NULL))
+        return NULL;
+
+    if (cache->p_first[i] == NULL)
+    {   /* Thread cache is empty: refill half of it from the depot */
+        vlc_mutex_lock (&block_pool_lock);
+        for (unsigned n = block_pool_CacheMax (i) / 2;
+             n > 0 && block_pool_depot[i] != NULL; n--)
+        {
+            block_t *block = block_pool_depot[i];
+            block_pool_depot[i] = block->p_next;
+            block_pool_depot_count[i]--;
+            block->p_next = cache->p_first[i];
+            cache->p_first[i] = block;
+            cache->i_count[i]++;
+        }
+        block_pool_MergeStats (cache, i);
+        vlc_mutex_unlock (&block_pool_lock);
+    }
+
+    block_t *block = cache->p_first[i];
+    if (block == NULL)
+    {
+        cache->i_misses[i]++;
+        return NULL;
+    }
+    cache->p_first[i] = block->p_next;
+    cache->i_count[i]--;
+    cache->i_hits[i]++;
+    return block;
+}
+
+/**
+ * Registers a LibVLC instance with the block pool.
+ * This is called by LibVLC initialization from the "block-pool" option;
+ * blocks are recycled as long as one instance has enabled the pool.
+ */
+void block_PoolInit (bool enable)
+{
+    if (!enable)
+        return;
+
+    vlc_mutex_lock (&block_pool_lock);
+    if (!block_pool_key_created)
+        block_pool_key_created =
+            !vlc_threadvar_create (&block_pool_key, block_pool_CacheRelease);
+    if (block_pool_key_created)
+#ifdef BLOCK_ATOMIC
+        block_atomic_add (&block_pool_users, 1);
+#else
+        block_pool_users++;
+#endif
+    vlc_mutex_unlock (&block_pool_lock);
+}
+
+/**
+ * Unregisters a LibVLC instance from the block pool.
+ * When the last instance is gone, the shared depot and the caches of all the
+ * threads are freed. No thread may then allocate or release blocks
+ * concurrently.
+ */
+void block_PoolDeinit (bool enable)
+{
+    if (!enable)
+        return;
+
+    vlc_mutex_lock (&block_pool_lock);
+    if (!block_pool_key_created || !block_pool_IsEnabledLocked ())
+    {
+        vlc_mutex_unlock (&block_pool_lock);
+        return;
+    }
+#ifdef BLOCK_ATOMIC
+    block_atomic_sub (&block_pool_users, 1);
+#else
+    block_pool_users--;
+#endif
+    if (block_pool_IsEnabledLocked ())
+    {
+        vlc_mutex_unlock (&block_pool_lock);
+        return;
+    }
+
+    for (unsigned i = 0; i < BLOCK_POOL_CLASSES; i++)
+    {
+        block_t *block = block_pool_depot[i];
+        while (block != NULL)
+        {
+            block_t *next = block->p_next;
+            free (block);
+            block = next;
+        }
+        block_pool_depot[i] = NULL;
+        block_pool_depot_count[i] = 0;
+    }
+
+    while (block_pool_caches != NULL)
+    {
+        block_pool_cache_t *cache = block_pool_caches;
+
+        block_pool_caches = cache->p_next;
+        for (unsigned i = 0; i < BLOCK_POOL_CLASSES; i++)
+        {
+            block_t *block = cache->p_first[i];
+            while (block != NULL)
+            {
+                block_t *next = block->p_next;
+                free (block);
+                block = next;
+            }
+            block_pool_MergeStats (cache, i);
+        }
+        free (cache);
+    }
+    /* Threads still holding a freed cache get a new key */
+    vlc_threadvar_delete (&block_pool_key);
+    block_pool_key_created = false;
+    vlc_mutex_unlock (&block_pool_lock);
+}
+
+/**
+ * Prints the block pool statistics as debug messages.
+ */
+void block_PoolDump (vlc_object_t *obj)
+{
+    if (!block_pool_IsEnabled ())
+        return;
+
+    for (unsigned i = 0; i < BLOCK_POOL_CLASSES; i++)
+    {
+        size_t size;
+        uint64_t hits, misses;
+
+        block_PoolStats (i, &size, &hits, &misses);
+        msg_Dbg (obj, "block pool %6zu bytes: %"PRIu64" hits, %"PRIu64
+                 " misses", size, hits, misses);
+    }
+}
+
+/**
+ * Gets the block pool usage statistics for one size class.
+ *
+ * Counters of each thread are merged in whenever that thread accesses the
+ * shared depot or terminates, so they may lag behind slightly.
+ *
+ * @param i size class index (starting from zero)
+ * @param size storage for the payload size of the class [OUT]
+ * @param hits storage for the number of allocations served by the pool [OUT]
+ * @param misses storage for the number of allocations from the heap [OUT]
+ * @return VLC_SUCCESS, or VLC_EGENERIC if there is no such class.
+ */
+int block_PoolStats (unsigned i, size_t *size, uint64_t *hits,
+                     uint64_t *misses)
+{
+    if (i >= BLOCK_POOL_CLASSES)
+        return VLC_EGENERIC;
+
+    vlc_mutex_lock (&block_pool_lock);
+    *size = block_pool_sizes[i];
+    *hits = block_pool_hits[i];
+    *misses = block_pool_misses[i];
+    vlc_mutex_unlock (&block_pool_lock);
+    return VLC_SUCCESS;
+}
+
 block_t *block_Alloc (size_t size)
 {
+    if (block_pool_IsEnabled ())
+    {
+        unsigned i = block_pool_Class (size);
+        if (i < BLOCK_POOL_CLASSES)
+        {
+            const size_t alloc = BLOCK_ALLOC_SIZE (block_pool_sizes[i]);
+            block_t *b = block_pool_Get (i);
+            if (b == NULL)
+                b = (block_t *)malloc (alloc);
+            if (unlikely(b == NULL))
+                return NULL;
+
+            block_Setup (b, alloc, size);
+            b->pf_release = block_pool_Release;
+            return b;
+        }
+    }
+
     /* 2 * BLOCK_PADDING: pre + post padding */
-    const size_t alloc = sizeof (block_t) + BLOCK_ALIGN + (2 * BLOCK_PADDING)
-                       + size;
+    const size_t alloc = BLOCK_ALLOC_SIZE (size);
     if (unlikely(alloc <= size))
         return NULL;
 
@@ -147,12 +630,7 @@ block_t *block_Alloc (size_t size)
     if (unlikely(b == NULL))
         return NULL;
 
-    block_Init (b, b + 1, alloc - sizeof (*b));
-    static_assert ((BLOCK_PADDING % BLOCK_ALIGN) == 0,
-                   "BLOCK_PADDING must be a multiple of BLOCK_ALIGN");
-    b->p_buffer += BLOCK_PADDING + BLOCK_ALIGN - 1;
-    b->p_buffer = (uint8_t *)(((uintptr_t)b->p_buffer) & ~(BLOCK_ALIGN - 1));			// sunqueen modify
-    b->i_buffer = size;
+    block_Setup (b, alloc, size);
     b->pf_release = block_generic_Release;
     return b;
 }
@@ -235,8 +713,12 @@ block_t *block_Realloc( block_t *p_block, ssize_t i_prebody, size_t i_body )
     }
     else
     /* We have a very large reserved footer now? Release some of it.
+     * Pooled blocks are as large as their size class: that is only waste if
+     * the new size belongs to another class.
      * XXX it might not preserve the alignment of p_buffer */
-    if( p_end - (p_block->p_buffer + i_body) > BLOCK_WASTE_SIZE )
+    if( p_end - (p_block->p_buffer + i_body) > BLOCK_WASTE_SIZE
+     && ( p_block->pf_release != block_pool_Release
+       || block_pool_Class( requested ) != block_pool_BlockClass( p_block ) ) )
     {
         block_t *p_rea = block_Alloc( requested );
         if( p_rea )
@@ -511,11 +993,19 @@ block_t *block_FilePath (const char *path)
     close (fd);
     return block;
 }
-
 /**
  * @section Thread-safe block queue functions
  */
 
+/* The single producer/single consumer queue is only worth it with native
+ * atomic operations. Otherwise, the regular locked queue is used instead. */
+#ifdef BLOCK_ATOMIC
+# define BLOCK_FIFO_SPSC 1
+
+/** Number of slots of the lock-free ring (must be a power of two) */
+# define BLOCK_FIFO_RING_SIZE 1024
+#endif
+
 /**
  * Internal state for block queues
  */
@@ -530,6 +1020,21 @@ struct block_fifo_t
     size_t              i_depth;
     size_t              i_size;
     bool          b_force_wake;
+
+#ifdef BLOCK_FIFO_SPSC
+    /* Single producer/single consumer mode: blocks go through a lock-free
+     * ring. The locked list above is only used when the ring is full, and
+     * then for all further blocks until the consumer has drained it. */
+    bool                b_spsc;
+    block_atomic_t     *p_ring;
+    block_atomic_t      i_read;  /**< Next slot to read (consumer) */
+    block_atomic_t      i_write; /**< Next slot to write (producer) */
+    block_atomic_t      b_overflow; /**< Locked list is in use */
+    block_atomic_t      b_wait_data; /**< Consumer waits for data */
+    block_atomic_t      b_wait_room; /**< Producer waits for room */
+    block_atomic_t      i_spsc_depth;
+    block_atomic_t      i_spsc_size;
+#endif
 };
 
 block_fifo_t *block_FifoNew( void )
@@ -545,13 +1050,187 @@ block_fifo_t *block_FifoNew( void )
     p_fifo->pp_last = &p_fifo->p_first;
     p_fifo->i_depth = p_fifo->i_size = 0;
     p_fifo->b_force_wake = false;
+#ifdef BLOCK_FIFO_SPSC
+    p_fifo->b_spsc = false;
+    p_fifo->p_ring = NULL;
+#endif
+
+    return p_fifo;
+}
 
+/**
+ * Creates a block queue for exactly one producer and one consumer thread.
+ *
+ * The queue has the same semantics as one from block_FifoNew(), but
+ * block_FifoPut() must always be called from the same thread, and
+ * block_FifoGet() and block_FifoShow() from one other thread. In return,
+ * queuing and dequeuing do not take any lock, and the other thread is only
+ * signaled when it is actually waiting. block_FifoEmpty() and
+ * block_FifoWake() remain safe to use from any thread, but block_FifoPace()
+ * may only be called by the producer thread.
+ *
+ * If lock-free operations are not available, a regular queue is returned.
+ */
+block_fifo_t *block_FifoNewSPSC( void )
+{
+    block_fifo_t *p_fifo = block_FifoNew();
+#ifdef BLOCK_FIFO_SPSC
+    if( unlikely(p_fifo == NULL) )
+        return NULL;
+
+    p_fifo->p_ring = (block_atomic_t *)malloc( BLOCK_FIFO_RING_SIZE
+                                                 * sizeof( *p_fifo->p_ring ) );
+    if( unlikely(p_fifo->p_ring == NULL) )
+    {
+        block_FifoRelease( p_fifo );
+        return NULL;
+    }
+    p_fifo->b_spsc = true;
+    block_atomic_init( &p_fifo->i_read, 0 );
+    block_atomic_init( &p_fifo->i_write, 0 );
+    block_atomic_init( &p_fifo->b_overflow, false );
+    block_atomic_init( &p_fifo->b_wait_data, false );
+    block_atomic_init( &p_fifo->b_wait_room, false );
+    block_atomic_init( &p_fifo->i_spsc_depth, 0 );
+    block_atomic_init( &p_fifo->i_spsc_size, 0 );
+#endif
     return p_fifo;
 }
 
+#ifdef BLOCK_FIFO_SPSC
+static void block_FifoAccount( block_fifo_t *p_fifo, const block_t *b )
+{
+    block_atomic_sub( &p_fifo->i_spsc_depth, 1 );
+    block_atomic_sub( &p_fifo->i_spsc_size, b->i_buffer );
+
+    /* Wake up the producer if it is pacing */
+    if( block_atomic_load( &p_fifo->b_wait_room ) )
+    {
+        vlc_mutex_lock( &p_fifo->lock );
+        vlc_cond_broadcast( &p_fifo->wait_room );
+        vlc_mutex_unlock( &p_fifo->lock );
+    }
+}
+
+/**
+ * Claims all queued ring slots, so that the consumer skips them.
+ * @return the index of the first claimed slot (*pi_end is the last + 1).
+ */
+static size_t block_FifoClaim( block_fifo_t *p_fifo, size_t *pi_end )
+{
+    uintptr_t r = block_atomic_load( &p_fifo->i_read );
+    uintptr_t end;
+
+    do
+        end = block_atomic_load( &p_fifo->i_write );
+    while( r != end
+        && !block_atomic_cas( &p_fifo->i_read, &r, end ) );
+
+    *pi_end = end;
+    return r;
+}
+
+/**
+ * Dequeues one block, from the ring or else from the overflow list,
+ * without waiting. Consumer only.
+ */
+static block_t *block_FifoPop( block_fifo_t *p_fifo )
+{
+    block_t *b;
+
+    for( ;; )
+    {
+        uintptr_t r = block_atomic_load( &p_fifo->i_read );
+        if( r != block_atomic_load( &p_fifo->i_write ) )
+        {
+            /* If block_FifoEmpty() claims the slot first, the exchange fails
+             * and the (possibly stale) pointer is not used. */
+            b = (block_t *)block_atomic_load(
+                            &p_fifo->p_ring[r & (BLOCK_FIFO_RING_SIZE - 1)] );
+            if( !block_atomic_cas( &p_fifo->i_read, &r, r + 1 ) )
+                continue;
+            break;
+        }
+
+        /* The ring is empty. The producer does not use it while the overflow
+         * list is in use, so the list holds the next blocks, if any. */
+        if( !block_atomic_load( &p_fifo->b_overflow ) )
+            return NULL;
+
+        vlc_mutex_lock( &p_fifo->lock );
+        if( block_atomic_load( &p_fifo->i_read ) != block_atomic_load( &p_fifo->i_write ) )
+        {   /* The producer refilled the ring after block_FifoEmpty() */
+            vlc_mutex_unlock( &p_fifo->lock );
+            continue;
+        }
+        b = p_fifo->p_first;
+        if( b != NULL )
+        {
+            p_fifo->p_first = b->p_next;
+            b->p_next = NULL;
+        }
+        if( p_fifo->p_first == NULL )
+        {
+            p_fifo->pp_last = &p_fifo->p_first;
+            block_atomic_store( &p_fifo->b_overflow, false );
+        }
+        vlc_mutex_unlock( &p_fifo->lock );
+
+        if( b == NULL )
+            return NULL;
+        break;
+    }
+
+    block_FifoAccount( p_fifo, b );
+    return b;
+}
+
+/* Producer only */
+static void block_FifoPush( block_fifo_t *p_fifo, block_t *b )
+{
+    for( ;; )
+    {
+        if( !block_atomic_load( &p_fifo->b_overflow ) )
+        {
+            size_t w = block_atomic_load( &p_fifo->i_write );
+            if( w - block_atomic_load( &p_fifo->i_read ) < BLOCK_FIFO_RING_SIZE )
+            {
+                block_atomic_store( &p_fifo->p_ring[w & (BLOCK_FIFO_RING_SIZE - 1)],
+                              (uintptr_t)b );
+                block_atomic_store( &p_fifo->i_write, w + 1 );
+                return;
+            }
+        }
+
+        vlc_mutex_lock( &p_fifo->lock );
+        if( block_atomic_load( &p_fifo->b_overflow )
+         || block_atomic_load( &p_fifo->i_write ) - block_atomic_load( &p_fifo->i_read )
+                                                     >= BLOCK_FIFO_RING_SIZE )
+        {
+            *p_fifo->pp_last = b;
+            p_fifo->pp_last = &b->p_next;
+            block_atomic_store( &p_fifo->b_overflow, true );
+            vlc_mutex_unlock( &p_fifo->lock );
+            return;
+        }
+        /* The consumer drained the overflow list meanwhile */
+        vlc_mutex_unlock( &p_fifo->lock );
+    }
+}
+
+static bool block_FifoIsEmptySPSC( block_fifo_t *p_fifo )
+{
+    return block_atomic_load( &p_fifo->i_read ) == block_atomic_load( &p_fifo->i_write )
+        && !block_atomic_load( &p_fifo->b_overflow );
+}
+#endif
+
 void block_FifoRelease( block_fifo_t *p_fifo )
 {
     block_FifoEmpty( p_fifo );
+#ifdef BLOCK_FIFO_SPSC
+    free( p_fifo->p_ring );
+#endif
     vlc_cond_destroy( &p_fifo->wait_room );
     vlc_cond_destroy( &p_fifo->wait );
     vlc_mutex_destroy( &p_fifo->lock );
@@ -570,6 +1249,31 @@ void block_FifoEmpty( block_fifo_t *p_fifo )
         p_fifo->p_first = NULL;
         p_fifo->pp_last = &p_fifo->p_first;
     }
+#ifdef BLOCK_FIFO_SPSC
+    if( p_fifo->b_spsc )
+    {
+        /* Ring blocks were queued before the overflow list ones */
+        block_t *p_overflow = block, **pp_last = &block;
+        size_t i_depth = 0, i_size = 0, end;
+
+        block_atomic_store( &p_fifo->b_overflow, false );
+        for( size_t r = block_FifoClaim( p_fifo, &end ); r != end; r++ )
+        {
+            *pp_last = (block_t *)block_atomic_load(
+                            &p_fifo->p_ring[r & (BLOCK_FIFO_RING_SIZE - 1)] );
+            pp_last = &(*pp_last)->p_next;
+        }
+        *pp_last = p_overflow;
+
+        for( block_t *b = block; b != NULL; b = b->p_next )
+        {
+            i_depth++;
+            i_size += b->i_buffer;
+        }
+        block_atomic_sub( &p_fifo->i_spsc_depth, i_depth );
+        block_atomic_sub( &p_fifo->i_spsc_size, i_size );
+    }
+#endif
     vlc_cond_broadcast( &p_fifo->wait_room );
     vlc_mutex_unlock( &p_fifo->lock );
 
@@ -583,6 +1287,16 @@ void block_FifoEmpty( block_fifo_t *p_fifo )
     }
 }
 
+#ifdef BLOCK_FIFO_SPSC
+static void block_FifoPaceCleanup (void *data)
+{
+    block_fifo_t *fifo = (block_fifo_t *)data;			// sunqueen modify
+
+    block_atomic_store (&fifo->b_wait_room, false);
+    vlc_mutex_unlock (&fifo->lock);
+}
+#endif
+
 /**
  * Wait until the FIFO gets below a certain size (if needed).
  *
@@ -591,6 +1305,9 @@ void block_FifoEmpty( block_fifo_t *p_fifo )
  * thread could have refilled it already). This is typically not an issue, as
  * this function is meant for (relaxed) congestion control.
  *
+ * On a queue from block_FifoNewSPSC(), only the producer thread may call this
+ * function, as a single thread at a time can wait for room.
+ *
  * This function may be a cancellation point and it is cancel-safe.
  *
  * @param fifo queue to wait on
@@ -604,6 +1321,29 @@ void block_FifoPace (block_fifo_t *fifo, size_t max_depth, size_t max_size)
 {
     vlc_testcancel ();
 
+#ifdef BLOCK_FIFO_SPSC
+    if (fifo->b_spsc)
+    {
+        if (block_FifoCount (fifo) <= max_depth
+         && block_FifoSize (fifo) <= max_size)
+            return;
+
+        vlc_mutex_lock (&fifo->lock);
+        assert (!block_atomic_load (&fifo->b_wait_room)); /* one producer */
+        block_atomic_store (&fifo->b_wait_room, true);
+        while (block_FifoCount (fifo) > max_depth
+            || block_FifoSize (fifo) > max_size)
+        {
+            vlc_cleanup_push (block_FifoPaceCleanup, fifo);
+            vlc_cond_wait (&fifo->wait_room, &fifo->lock);
+            vlc_cleanup_pop ();
+        }
+        block_atomic_store (&fifo->b_wait_room, false);
+        vlc_mutex_unlock (&fifo->lock);
+        return;
+    }
+#endif
+
     vlc_mutex_lock (&fifo->lock);
     while ((fifo->i_depth > max_depth) || (fifo->i_size > max_size))
     {
@@ -635,6 +1375,33 @@ size_t block_FifoPut( block_fifo_t *p_fifo, block_t *p_block )
             break;
     }
 
+#ifdef BLOCK_FIFO_SPSC
+    if( p_fifo->b_spsc )
+    {
+        /* Account first, so that the consumer never makes counters wrap */
+        block_atomic_add( &p_fifo->i_spsc_depth, i_depth );
+        block_atomic_add( &p_fifo->i_spsc_size, i_size );
+
+        while( p_block != NULL )
+        {
+            block_t *p_next = p_block->p_next;
+
+            p_block->p_next = NULL;
+            block_FifoPush( p_fifo, p_block );
+            p_block = p_next;
+        }
+
+        /* Only signal the consumer if it is (about to be) sleeping */
+        if( block_atomic_load( &p_fifo->b_wait_data ) )
+        {
+            vlc_mutex_lock( &p_fifo->lock );
+            vlc_cond_signal( &p_fifo->wait );
+            vlc_mutex_unlock( &p_fifo->lock );
+        }
+        return i_size;
+    }
+#endif
+
     vlc_mutex_lock (&p_fifo->lock);
     *p_fifo->pp_last = p_block;
     p_fifo->pp_last = &p_last->p_next;
@@ -650,12 +1417,43 @@ size_t block_FifoPut( block_fifo_t *p_fifo, block_t *p_block )
 void block_FifoWake( block_fifo_t *p_fifo )
 {
     vlc_mutex_lock( &p_fifo->lock );
+#ifdef BLOCK_FIFO_SPSC
+    if( p_fifo->b_spsc ? block_FifoIsEmptySPSC( p_fifo )
+                       : p_fifo->p_first == NULL )
+#else
     if( p_fifo->p_first == NULL )
+#endif
         p_fifo->b_force_wake = true;
     vlc_cond_broadcast( &p_fifo->wait );
     vlc_mutex_unlock( &p_fifo->lock );
 }
 
+#ifdef BLOCK_FIFO_SPSC
+/**
+ * Waits until the SPSC queue is not empty, or a forced wake up.
+ * @return true if woken up by block_FifoWake(), false otherwise.
+ */
+static bool block_FifoWaitSPSC( block_fifo_t *p_fifo )
+{
+    bool b_woken;
+
+    vlc_mutex_lock( &p_fifo->lock );
+    mutex_cleanup_push( &p_fifo->lock );
+
+    /* This must be visible before checking the queue, so that either the
+     * producer sees it, or we see the new block (see block_FifoPut()). */
+    block_atomic_store( &p_fifo->b_wait_data, true );
+    while( block_FifoIsEmptySPSC( p_fifo ) && !p_fifo->b_force_wake )
+        vlc_cond_wait( &p_fifo->wait, &p_fifo->lock );
+    block_atomic_store( &p_fifo->b_wait_data, false );
+
+    b_woken = p_fifo->b_force_wake;
+    p_fifo->b_force_wake = false;
+    vlc_cleanup_run();
+    return b_woken;
+}
+#endif
+
 /**
  * Dequeue the first block from the FIFO. If necessary, wait until there is
  * one block in the queue. This function is (always) cancellation point.
@@ -668,6 +1466,21 @@ block_t *block_FifoGet( block_fifo_t *p_fifo )
 
     vlc_testcancel( );
 
+#ifdef BLOCK_FIFO_SPSC
+    if( p_fifo->b_spsc )
+    {
+        bool b_woken = false;
+
+        while( (b = block_FifoPop( p_fifo )) == NULL )
+        {
+            if( b_woken )
+                return NULL; /* Forced wakeup */
+            b_woken = block_FifoWaitSPSC( p_fifo );
+        }
+        return b;
+    }
+#endif
+
     vlc_mutex_lock( &p_fifo->lock );
     mutex_cleanup_push( &p_fifo->lock );
 
@@ -721,6 +1534,27 @@ block_t *block_FifoShow( block_fifo_t *p_fifo )
 
     vlc_testcancel( );
 
+#ifdef BLOCK_FIFO_SPSC
+    if( p_fifo->b_spsc )
+    {
+        for( ;; )
+        {
+            size_t r = block_atomic_load( &p_fifo->i_read );
+            if( r != block_atomic_load( &p_fifo->i_write ) )
+                return (block_t *)block_atomic_load(
+                            &p_fifo->p_ring[r & (BLOCK_FIFO_RING_SIZE - 1)] );
+
+            vlc_mutex_lock( &p_fifo->lock );
+            b = p_fifo->p_first;
+            vlc_mutex_unlock( &p_fifo->lock );
+            if( b != NULL )
+                return b;
+
+            block_FifoWaitSPSC( p_fifo );
+        }
+    }
+#endif
+
     vlc_mutex_lock( &p_fifo->lock );
     mutex_cleanup_push( &p_fifo->lock );
 
@@ -736,11 +1570,19 @@ block_t *block_FifoShow( block_fifo_t *p_fifo )
 /* FIXME: not thread-safe */
 size_t block_FifoSize( const block_fifo_t *p_fifo )
 {
+#ifdef BLOCK_FIFO_SPSC
+    if( p_fifo->b_spsc )
+        return block_atomic_load( &((block_fifo_t *)p_fifo)->i_spsc_size );
+#endif
     return p_fifo->i_size;
 }
 
 /* FIXME: not thread-safe */
 size_t block_FifoCount( const block_fifo_t *p_fifo )
 {
+#ifdef BLOCK_FIFO_SPSC
+    if( p_fifo->b_spsc )
+        return block_atomic_load( &((block_fifo_t *)p_fifo)->i_spsc_depth );
+#endif
     return p_fifo->i_depth;
 }
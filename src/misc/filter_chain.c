@@ -41,6 +41,23 @@ typedef struct
 
 } filter_chain_allocator_t;
 
+/* Maximum number of unused pictures kept by a pool */
+#define CHAINED_POOL_SIZE 4
+
+/* Pictures allocated by the internal video allocator, recycled once released.
+ * The pool lives as long as the filter or any of its pictures, as pictures
+ * can outlive the filter (and the chain) which created them. */
+typedef struct
+{
+    vlc_mutex_t    lock;
+    unsigned       refs;   /* The filter, and each allocated picture */
+    bool           orphan; /* The filter is not using this pool anymore */
+    video_format_t fmt;
+    void         (*pf_destroy)( picture_t * ); /* Original destructor */
+    unsigned       count;
+    picture_t     *free[CHAINED_POOL_SIZE];
+} chained_pool_t;
+
 typedef struct chained_filter_t
 {
     /* Public part of the filter structure */
@@ -49,6 +66,7 @@ typedef struct chained_filter_t
     struct chained_filter_t *prev, *next;
     vlc_mouse_t *mouse;
     picture_t *pending;
+    chained_pool_t *pool; /* For the internal video allocator */
 } chained_filter_t;
 
 /* Only use this with filter objects from _this_ C module */
@@ -594,11 +612,125 @@ static int UpdateBufferFunctions( filter_chain_t *p_chain )
 }
 
 /* Internal video allocator functions */
+static chained_pool_t *PoolNew( const video_format_t *p_fmt )
+{
+    chained_pool_t *p_pool = (chained_pool_t *)malloc( sizeof(*p_pool) );
+    if( !p_pool )
+        return NULL;
+
+    vlc_mutex_init( &p_pool->lock );
+    p_pool->refs = 1;
+    p_pool->orphan = false;
+    p_pool->fmt = *p_fmt;
+    p_pool->pf_destroy = NULL;
+    p_pool->count = 0;
+    return p_pool;
+}
+
+static void PoolPictureDestroy( picture_t *p_picture )
+{
+    chained_pool_t *p_pool = (chained_pool_t *)p_picture->p_sys;
+
+    vlc_mutex_lock( &p_pool->lock );
+    if( !p_pool->orphan && p_pool->count < CHAINED_POOL_SIZE )
+    {
+        p_pool->free[p_pool->count++] = p_picture;
+        vlc_mutex_unlock( &p_pool->lock );
+        return;
+    }
+    void (*pf_destroy)( picture_t * ) = p_pool->pf_destroy;
+    bool b_last = --p_pool->refs == 0;
+    vlc_mutex_unlock( &p_pool->lock );
+
+    p_picture->p_sys = NULL;
+    p_picture->gc.pf_destroy = pf_destroy;
+    pf_destroy( p_picture );
+
+    if( b_last )
+    {
+        vlc_mutex_destroy( &p_pool->lock );
+        free( p_pool );
+    }
+}
+
+/**
+ * Releases the filter's reference to the pool, and the unused pictures.
+ */
+static void PoolOrphan( chained_pool_t *p_pool )
+{
+    picture_t *pp_free[CHAINED_POOL_SIZE];
+
+    vlc_mutex_lock( &p_pool->lock );
+    p_pool->orphan = true;
+    unsigned i_free = p_pool->count;
+    memcpy( pp_free, p_pool->free, i_free * sizeof(*pp_free) );
+    p_pool->count = 0;
+    vlc_mutex_unlock( &p_pool->lock );
+
+    /* Orphaned pools destroy released pictures */
+    for( unsigned i = 0; i < i_free; i++ )
+        PoolPictureDestroy( pp_free[i] );
+
+    vlc_mutex_lock( &p_pool->lock );
+    bool b_last = --p_pool->refs == 0;
+    vlc_mutex_unlock( &p_pool->lock );
+
+    if( b_last )
+    {
+        vlc_mutex_destroy( &p_pool->lock );
+        free( p_pool );
+    }
+}
+
+static picture_t *PoolGet( chained_pool_t *p_pool )
+{
+    picture_t *p_picture = NULL;
+
+    vlc_mutex_lock( &p_pool->lock );
+    if( p_pool->count > 0 )
+        p_picture = p_pool->free[--p_pool->count];
+    vlc_mutex_unlock( &p_pool->lock );
+
+    if( p_picture )
+    {
+        vlc_atomic_set( &p_picture->gc.refcount, 1 );
+        p_picture->p_next = NULL;
+        picture_Reset( p_picture );
+        return p_picture;
+    }
+
+    p_picture = picture_NewFromFormat( &p_pool->fmt );
+    if( !p_picture )
+        return NULL;
+
+    /* p_sys is not used by pictures allocated from a format */
+    assert( p_picture->p_sys == NULL );
+    vlc_mutex_lock( &p_pool->lock );
+    p_pool->pf_destroy = p_picture->gc.pf_destroy;
+    p_pool->refs++;
+    vlc_mutex_unlock( &p_pool->lock );
+
+    p_picture->p_sys = (picture_sys_t *)p_pool;
+    p_picture->gc.pf_destroy = PoolPictureDestroy;
+    return p_picture;
+}
+
 static picture_t *VideoBufferNew( filter_t *p_filter )
 {
+    chained_filter_t *p_chained = chained( p_filter );
     const video_format_t *p_fmt = &p_filter->fmt_out.video;
 
-    picture_t *p_picture = picture_NewFromFormat( p_fmt );
+    /* Rebuild the pool if the output format changed */
+    if( p_chained->pool && !video_format_IsSimilar( &p_chained->pool->fmt, p_fmt ) )
+    {
+        PoolOrphan( p_chained->pool );
+        p_chained->pool = NULL;
+    }
+    if( !p_chained->pool )
+        p_chained->pool = PoolNew( p_fmt );
+
+    picture_t *p_picture = p_chained->pool ? PoolGet( p_chained->pool )
+                                           : picture_NewFromFormat( p_fmt );
     if( !p_picture )
         msg_Err( p_filter, "Failed to allocate picture" );
     return p_picture;
@@ -614,11 +746,18 @@ static int InternalVideoInit( filter_t *p_filter, void *p_data )
 
     p_filter->pf_video_buffer_new = VideoBufferNew;
     p_filter->pf_video_buffer_del = VideoBufferDelete;
+    chained( p_filter )->pool = NULL;
 
     return VLC_SUCCESS;
 }
 static void InternalVideoClean( filter_t *p_filter )
 {
+    chained_filter_t *p_chained = chained( p_filter );
+
+    if( p_chained->pool )
+        PoolOrphan( p_chained->pool );
+    p_chained->pool = NULL;
+
     p_filter->pf_video_buffer_new = NULL;
     p_filter->pf_video_buffer_del = NULL;
 }
@@ -40,6 +40,12 @@
 #include <vlc_image.h>
 #include <vlc_block.h>
 #include <vlc_atomic.h>
+#include <vlc_cpu.h>
+
+#if defined(CAN_COMPILE_SSE2) && (defined(__SSE2__) || defined(_MSC_VER))
+# include <emmintrin.h>
+# define PLANE_COPY_SSE2 1
+#endif
 
 /**
  * Allocate a new picture in the heap.
@@ -281,19 +287,105 @@ bool picture_IsReferenced( picture_t *p_picture )
 /*****************************************************************************
  *
  *****************************************************************************/
+#ifdef PLANE_COPY_SSE2
+/* Planes bigger than this are copied with non-temporal stores: they would
+ * only evict the whole cache, and the copy is rarely read back at once. */
+# define PLANE_COPY_STREAM_MIN (1024*1024)
+
+/* Copies with non-temporal stores. The caller must issue _mm_sfence(). */
+static void CopyStreamSSE2( uint8_t *p_dst, const uint8_t *p_src, size_t i_size )
+{
+    /* Align the destination */
+    size_t i_head = (16 - ((uintptr_t)p_dst & 15)) & 15;
+    if( i_head > i_size )
+        i_head = i_size;
+    memcpy( p_dst, p_src, i_head );
+    p_dst += i_head;
+    p_src += i_head;
+    i_size -= i_head;
+
+    if( ((uintptr_t)p_src & 15) == 0 )
+    {
+        for( ; i_size >= 64; i_size -= 64, p_src += 64, p_dst += 64 )
+        {
+            __m128i x0 = _mm_load_si128( (const __m128i *)(p_src +  0) );
+            __m128i x1 = _mm_load_si128( (const __m128i *)(p_src + 16) );
+            __m128i x2 = _mm_load_si128( (const __m128i *)(p_src + 32) );
+            __m128i x3 = _mm_load_si128( (const __m128i *)(p_src + 48) );
+            _mm_stream_si128( (__m128i *)(p_dst +  0), x0 );
+            _mm_stream_si128( (__m128i *)(p_dst + 16), x1 );
+            _mm_stream_si128( (__m128i *)(p_dst + 32), x2 );
+            _mm_stream_si128( (__m128i *)(p_dst + 48), x3 );
+        }
+    }
+    else
+    {
+        for( ; i_size >= 64; i_size -= 64, p_src += 64, p_dst += 64 )
+        {
+            __m128i x0 = _mm_loadu_si128( (const __m128i *)(p_src +  0) );
+            __m128i x1 = _mm_loadu_si128( (const __m128i *)(p_src + 16) );
+            __m128i x2 = _mm_loadu_si128( (const __m128i *)(p_src + 32) );
+            __m128i x3 = _mm_loadu_si128( (const __m128i *)(p_src + 48) );
+            _mm_stream_si128( (__m128i *)(p_dst +  0), x0 );
+            _mm_stream_si128( (__m128i *)(p_dst + 16), x1 );
+            _mm_stream_si128( (__m128i *)(p_dst + 32), x2 );
+            _mm_stream_si128( (__m128i *)(p_dst + 48), x3 );
+        }
+    }
+    for( ; i_size >= 16; i_size -= 16, p_src += 16, p_dst += 16 )
+        _mm_stream_si128( (__m128i *)p_dst,
+                          _mm_loadu_si128( (const __m128i *)p_src ) );
+
+    memcpy( p_dst, p_src, i_size );
+}
+
+static bool CopyPixelsSSE2( plane_t *p_dst, const plane_t *p_src,
+                            unsigned i_width, unsigned i_height, bool b_full )
+{
+    if( (size_t)i_width * i_height < PLANE_COPY_STREAM_MIN
+     || !vlc_CPU_SSE2() )
+        return false;
+
+    if( b_full )
+        CopyStreamSSE2( p_dst->p_pixels, p_src->p_pixels,
+                        (size_t)p_src->i_pitch * i_height );
+    else
+    {
+        const uint8_t *p_in = p_src->p_pixels;
+        uint8_t *p_out = p_dst->p_pixels;
+
+        for( unsigned i_line = i_height; i_line--; )
+        {
+            CopyStreamSSE2( p_out, p_in, i_width );
+            p_in += p_src->i_pitch;
+            p_out += p_dst->i_pitch;
+        }
+    }
+    /* Make the data visible to other threads */
+    _mm_sfence();
+    return true;
+}
+#endif
+
 void plane_CopyPixels( plane_t *p_dst, const plane_t *p_src )
 {
     const unsigned i_width  = __MIN( p_dst->i_visible_pitch,
                                      p_src->i_visible_pitch );
     const unsigned i_height = __MIN( p_dst->i_visible_lines,
                                      p_src->i_visible_lines );
-
     /* The 2x visible pitch check does two things:
        1) Makes field plane_t's work correctly (see the deinterlacer module)
        2) Moves less data if the pitch and visible pitch differ much.
     */
-    if( p_src->i_pitch == p_dst->i_pitch  &&
-        p_src->i_pitch < 2*p_src->i_visible_pitch )
+    const bool b_full = p_src->i_pitch == p_dst->i_pitch  &&
+                        p_src->i_pitch < 2*p_src->i_visible_pitch;
+
+#ifdef PLANE_COPY_SSE2
+    if( CopyPixelsSSE2( p_dst, p_src, i_width, i_height, b_full ) )
+        return;
+#endif
+
+    if( b_full )
     {
         /* There are margins, but with the same width : perfect ! */
         memcpy( p_dst->p_pixels, p_src->p_pixels,
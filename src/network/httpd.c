@@ -41,6 +41,7 @@
 #include <vlc_charset.h>
 #include <vlc_url.h>
 #include <vlc_mime.h>
+#include <vlc_atomic.h>
 #include "../libvlc.h"
 
 #include <string.h>
@@ -76,9 +77,19 @@ struct pollfd
 #define HTTPD_CL_BUFSIZE 10000
 #endif
 
+#ifdef __linux__
+# include <sys/epoll.h>
+# define HTTPD_EPOLL 1
+# define HTTPD_EPOLL_EVENTS 64
+#endif
+
 static void httpd_ClientClean( httpd_client_t *cl );
 
-/* each host run in his own thread */
+typedef struct httpd_loop_t httpd_loop_t;
+typedef struct httpd_stream_chunk_t httpd_stream_chunk_t;
+
+/* each host runs one or several event loop threads ("http-threads"),
+ * each loop serves the clients it accepted itself */
 struct httpd_host_t
 {
     VLC_COMMON_MEMBERS
@@ -91,7 +102,9 @@ struct httpd_host_t
     unsigned     nfd;
     unsigned     port;
 
-    vlc_thread_t thread;
+    httpd_loop_t *loops;
+    unsigned      i_loops;
+
     vlc_mutex_t lock;
     vlc_cond_t  wait;
 
@@ -102,11 +115,32 @@ struct httpd_host_t
     int         i_url;
     httpd_url_t **url;
 
+    /* TLS data */
+    vlc_tls_creds_t *p_tls;
+};
+
+/* Lock ordering: a loop lock may be held while taking the host lock,
+ * never the other way round. */
+struct httpd_loop_t
+{
+    httpd_host_t *host;
+    vlc_thread_t thread;
+    vlc_mutex_t  lock;
+
+    /* clients served by this loop, only this thread frees them */
     int            i_client;
     httpd_client_t **client;
 
-    /* TLS data */
-    vlc_tls_creds_t *p_tls;
+#ifdef HTTPD_EPOLL
+    int                epfd;
+    struct epoll_event events[HTTPD_EPOLL_EVENTS];
+#else
+    /* poll() set, rebuilt every iteration but never shrunk */
+    unsigned        i_ufd;
+    unsigned        i_ufd_alloc;
+    struct pollfd   *ufd;
+    httpd_client_t  **ufd_client;
+#endif
 };
 
 
@@ -161,6 +195,7 @@ struct httpd_client_t
 
     bool    b_stream_mode;
     uint8_t i_state;
+    unsigned i_events; /* events registered with the loop */
 
     mtime_t i_activity_date;
     mtime_t i_activity_timeout;
@@ -169,6 +204,10 @@ struct httpd_client_t
     int     i_buffer_size;
     int     i_buffer;
     uint8_t *p_buffer;
+    /* shared stream data p_buffer (resp. answer.p_body) points into,
+     * p_buffer is then not owned */
+    httpd_stream_chunk_t *p_chunk;
+    httpd_stream_chunk_t *p_body_chunk;
 
     /* */
     httpd_message_t query;  /* client -> httpd */
@@ -626,6 +665,41 @@ void httpd_RedirectDelete( httpd_redirect_t *rdir )
 /*****************************************************************************
  * High Level Funtions: httpd_stream_t
  *****************************************************************************/
+
+/* The stream data is kept once, in a ring of reference counted chunks.
+ * Clients send straight from the chunks and keep a reference on the one
+ * they are sending, so a slow client pins at most one chunk. */
+#define HTTPD_STREAM_CHUNK_SIZE 65536
+#define HTTPD_STREAM_CHUNKS     256
+
+struct httpd_stream_chunk_t
+{
+    vlc_atomic_t refs;
+    int64_t      i_pos;     /* absolute position of p_data[0] */
+    int          i_size;    /* only grows, under the stream lock */
+    int          i_alloc;
+    uint8_t      *p_data;
+};
+
+static httpd_stream_chunk_t *httpd_StreamChunkNew( int64_t i_pos, int i_alloc )
+{
+    httpd_stream_chunk_t *chunk =
+        (httpd_stream_chunk_t *)xmalloc( sizeof( *chunk ) + i_alloc );			// sunqueen modify
+
+    vlc_atomic_set( &chunk->refs, 1 );
+    chunk->i_pos   = i_pos;
+    chunk->i_size  = 0;
+    chunk->i_alloc = i_alloc;
+    chunk->p_data  = (uint8_t *)(chunk + 1);
+    return chunk;
+}
+
+static void httpd_StreamChunkRelease( httpd_stream_chunk_t *chunk )
+{
+    if( vlc_atomic_dec( &chunk->refs ) == 0 )
+        free( chunk );
+}
+
 struct httpd_stream_t
 {
     vlc_mutex_t lock;
@@ -637,13 +711,46 @@ struct httpd_stream_t
     uint8_t *p_header;
     int     i_header;
 
-    /* circular buffer */
-    int         i_buffer_size;      /* buffer size, can't be reallocated smaller */
-    uint8_t     *p_buffer;          /* buffer */
+    /* ring of chunks, oldest first */
+    httpd_stream_chunk_t *pp_chunk[HTTPD_STREAM_CHUNKS];
+    unsigned    i_chunk_first;
+    unsigned    i_chunks;
+
+    int         i_buffer_size;      /* data kept for late clients */
     int64_t     i_buffer_pos;       /* absolute position from begining */
     int64_t     i_buffer_last_pos;  /* a new connection will start with that */
 };
 
+#define httpd_StreamChunk( stream, i ) \
+    (stream)->pp_chunk[((stream)->i_chunk_first + (i)) % HTTPD_STREAM_CHUNKS]
+
+/* find the chunk holding i_pos, stream lock held */
+static httpd_stream_chunk_t *httpd_StreamChunkFind( httpd_stream_t *stream,
+                                                    int64_t i_pos )
+{
+    unsigned i_low = 0, i_high = stream->i_chunks;
+
+    if( i_high == 0 || i_pos < httpd_StreamChunk( stream, 0 )->i_pos )
+        return NULL;
+
+    while( i_high - i_low > 1 )
+    {
+        unsigned i_mid = ( i_low + i_high ) / 2;
+        if( httpd_StreamChunk( stream, i_mid )->i_pos <= i_pos )
+            i_low = i_mid;
+        else
+            i_high = i_mid;
+    }
+    return httpd_StreamChunk( stream, i_low );
+}
+
+static void httpd_StreamDropChunk( httpd_stream_t *stream )
+{
+    httpd_StreamChunkRelease( httpd_StreamChunk( stream, 0 ) );
+    stream->i_chunk_first = ( stream->i_chunk_first + 1 ) % HTTPD_STREAM_CHUNKS;
+    stream->i_chunks--;
+}
+
 static int httpd_StreamCallBack( httpd_callback_sys_t *p_sys,
                                  httpd_client_t *cl, httpd_message_t *answer,
                                  const httpd_message_t *query )
@@ -657,6 +764,7 @@ static int httpd_StreamCallBack( httpd_callback_sys_t *p_sys,
 
     if( answer->i_body_offset > 0 )
     {
+        httpd_stream_chunk_t *chunk;
         int64_t i_write;
         int     i_pos;
 
@@ -665,44 +773,54 @@ static int httpd_StreamCallBack( httpd_callback_sys_t *p_sys,
                  answer->i_body_offset );
 #endif
 
+        vlc_mutex_lock( &stream->lock );
         if( answer->i_body_offset >= stream->i_buffer_pos )
         {
             /* fprintf( stderr, "httpd_StreamCallBack: no data\n" ); */
+            vlc_mutex_unlock( &stream->lock );
             return VLC_EGENERIC;    /* wait, no data available */
         }
-        if( answer->i_body_offset + stream->i_buffer_size <
-            stream->i_buffer_pos )
+
+        chunk = httpd_StreamChunkFind( stream, answer->i_body_offset );
+        if( chunk == NULL )
         {
-            /* this client isn't fast enough */
+            /* this client isn't fast enough, skip ahead */
 #if 0
             fprintf( stderr, "fixing i_body_offset (old=%lld new=%lld)\n",
                      answer->i_body_offset, stream->i_buffer_last_pos );
 #endif
             answer->i_body_offset = stream->i_buffer_last_pos;
+            chunk = httpd_StreamChunkFind( stream, answer->i_body_offset );
+            if( chunk == NULL )
+            {
+                /* the chunk of the last key frame was dropped already,
+                 * start with the oldest data still kept */
+                assert( stream->i_chunks > 0 );
+                chunk = httpd_StreamChunk( stream, 0 );
+                answer->i_body_offset = chunk->i_pos;
+            }
         }
 
-        i_pos   = answer->i_body_offset % stream->i_buffer_size;
-        i_write = stream->i_buffer_pos - answer->i_body_offset;
-        if( i_write > HTTPD_CL_BUFSIZE )
-        {
-            i_write = HTTPD_CL_BUFSIZE;
-        }
-        else if( i_write <= 0 )
+        i_pos   = answer->i_body_offset - chunk->i_pos;
+        i_write = chunk->i_size - i_pos;
+        if( i_write <= 0 )
         {
+            vlc_mutex_unlock( &stream->lock );
             return VLC_EGENERIC;    /* wait, no data available */
         }
-
-        /* Don't go past the end of the circular buffer */
-        i_write = __MIN( i_write, stream->i_buffer_size - i_pos );
+        vlc_atomic_inc( &chunk->refs );
+        vlc_mutex_unlock( &stream->lock );
 
         /* using HTTPD_MSG_ANSWER -> data available */
         answer->i_proto  = HTTPD_PROTO_HTTP;
         answer->i_version= 0;
         answer->i_type   = HTTPD_MSG_ANSWER;
 
+        /* send from the shared chunk, the bytes before i_size never change */
         answer->i_body = i_write;
-        answer->p_body = (uint8_t *)xmalloc( i_write );			// sunqueen modify
-        memcpy( answer->p_body, &stream->p_buffer[i_pos], i_write );
+        answer->p_body = &chunk->p_data[i_pos];
+        assert( cl->p_body_chunk == NULL );
+        cl->p_body_chunk = chunk;
 
         answer->i_body_offset += i_write;
 
@@ -796,8 +914,9 @@ httpd_stream_t *httpd_StreamNew( httpd_host_t *host,
     }
     stream->i_header = 0;
     stream->p_header = NULL;
+    stream->i_chunk_first = 0;
+    stream->i_chunks = 0;
     stream->i_buffer_size = 5000000;    /* 5 Mo per stream */
-    stream->p_buffer = (uint8_t *)xmalloc( stream->i_buffer_size );			// sunqueen modify
     /* We set to 1 to make life simpler
      * (this way i_body_offset can never be 0) */
     stream->i_buffer_pos = 1;
@@ -832,9 +951,6 @@ int httpd_StreamHeader( httpd_stream_t *stream, uint8_t *p_data, int i_data )
 
 int httpd_StreamSend( httpd_stream_t *stream, uint8_t *p_data, int i_data )
 {
-    int i_count;
-    int i_pos;
-
     if( i_data < 0 || p_data == NULL )
     {
         return VLC_SUCCESS;
@@ -844,23 +960,39 @@ int httpd_StreamSend( httpd_stream_t *stream, uint8_t *p_data, int i_data )
     /* save this pointer (to be used by new connection) */
     stream->i_buffer_last_pos = stream->i_buffer_pos;
 
-    i_pos = stream->i_buffer_pos % stream->i_buffer_size;
-    i_count = i_data;
-    while( i_count > 0)
+    while( i_data > 0 )
     {
+        httpd_stream_chunk_t *chunk = NULL;
         int i_copy;
 
-        i_copy = __MIN( i_count, stream->i_buffer_size - i_pos );
+        if( stream->i_chunks > 0 )
+            chunk = httpd_StreamChunk( stream, stream->i_chunks - 1 );
 
-        /* Ok, we can't go past the end of our buffer */
-        memcpy( &stream->p_buffer[i_pos], p_data, i_copy );
+        if( chunk == NULL || chunk->i_size == chunk->i_alloc )
+        {
+            if( stream->i_chunks == HTTPD_STREAM_CHUNKS )
+                httpd_StreamDropChunk( stream );
+            chunk = httpd_StreamChunkNew( stream->i_buffer_pos,
+                                   __MAX( i_data, HTTPD_STREAM_CHUNK_SIZE ) );
+            httpd_StreamChunk( stream, stream->i_chunks ) = chunk;
+            stream->i_chunks++;
+        }
+
+        /* Clients only read up to i_size, appending is safe */
+        i_copy = __MIN( i_data, chunk->i_alloc - chunk->i_size );
+        memcpy( &chunk->p_data[chunk->i_size], p_data, i_copy );
+        chunk->i_size += i_copy;
 
-        i_pos = ( i_pos + i_copy ) % stream->i_buffer_size;
-        i_count -= i_copy;
-        p_data  += i_copy;
+        stream->i_buffer_pos += i_copy;
+        i_data -= i_copy;
+        p_data += i_copy;
     }
 
-    stream->i_buffer_pos += i_data;
+    /* Forget the oldest data, clients still sending it keep their chunk */
+    while( stream->i_chunks > 1
+        && stream->i_buffer_pos - httpd_StreamChunk( stream, 1 )->i_pos
+             >= stream->i_buffer_size )
+        httpd_StreamDropChunk( stream );
 
     vlc_mutex_unlock( &stream->lock );
     return VLC_SUCCESS;
@@ -872,7 +1004,8 @@ void httpd_StreamDelete( httpd_stream_t *stream )
     vlc_mutex_destroy( &stream->lock );
     free( stream->psz_mime );
     free( stream->p_header );
-    free( stream->p_buffer );
+    while( stream->i_chunks > 0 )
+        httpd_StreamDropChunk( stream );
     free( stream );
 }
 
@@ -880,6 +1013,7 @@ void httpd_StreamDelete( httpd_stream_t *stream )
  * Low level
  *****************************************************************************/
 static void* httpd_HostThread( void * );
+static void httpd_LoopClean( httpd_loop_t * );
 static httpd_host_t *httpd_HostCreate( vlc_object_t *, const char *,
                                        const char *, vlc_tls_creds_t * );
 
@@ -1029,17 +1163,59 @@ static httpd_host_t *httpd_HostCreate( vlc_object_t *p_this,
     host->port     = port;
     host->i_url    = 0;
     host->url      = NULL;
-    host->i_client = 0;
-    host->client   = NULL;
     host->p_tls    = p_tls;
 
-    /* create the thread */
-    if( vlc_clone( &host->thread, httpd_HostThread, host,
-                   VLC_THREAD_PRIORITY_LOW ) )
-    {
-        msg_Err( p_this, "cannot spawn http host thread" );
+    /* create the event loops */
+    unsigned i_loops = var_InheritInteger( p_this, "http-threads" );
+    if( i_loops < 1 )
+        i_loops = 1;
+    host->loops = (httpd_loop_t *)calloc( i_loops, sizeof( *host->loops ) );			// sunqueen modify
+    if( host->loops == NULL )
         goto error;
+
+    for( host->i_loops = 0; host->i_loops < i_loops; host->i_loops++ )
+    {
+        httpd_loop_t *loop = &host->loops[host->i_loops];
+
+        loop->host = host;
+        vlc_mutex_init( &loop->lock );
+#ifdef HTTPD_EPOLL
+        loop->epfd = epoll_create1( EPOLL_CLOEXEC );
+        for( unsigned i = 0; loop->epfd != -1 && i < host->nfd; i++ )
+        {
+            struct epoll_event ev;
+            /* all loops watch the listening sockets, wake only one */
+# ifdef EPOLLEXCLUSIVE
+            ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+# else
+            ev.events = EPOLLIN;
+# endif
+            ev.data.ptr = &host->fds[i];
+            if( epoll_ctl( loop->epfd, EPOLL_CTL_ADD, host->fds[i], &ev ) )
+            {
+                close( loop->epfd );
+                loop->epfd = -1;
+            }
+        }
+        if( loop->epfd == -1 )
+        {
+            msg_Err( p_this, "cannot create event loop: %m" );
+            vlc_mutex_destroy( &loop->lock );
+            break;
+        }
+#endif
+        if( vlc_clone( &loop->thread, httpd_HostThread, loop,
+                       VLC_THREAD_PRIORITY_LOW ) )
+        {
+            msg_Err( p_this, "cannot spawn http host thread" );
+            httpd_LoopClean( loop );
+            break;
+        }
     }
+    if( host->i_loops == 0 )
+        goto error;
+    if( host->i_loops > 1 )
+        msg_Dbg( host, "serving clients from %u threads", host->i_loops );
 
     /* now add it to httpd */
     TAB_APPEND( (httpd_host_t **), httpd.i_host, httpd.host, host );			// sunqueen modify
@@ -1054,6 +1230,7 @@ error:
 
     if( host != NULL )
     {
+        free( host->loops );
         net_ListenClose( host->fds );
         vlc_cond_destroy( &host->wait );
         vlc_mutex_destroy( &host->lock );
@@ -1087,8 +1264,10 @@ void httpd_HostDelete( httpd_host_t *host )
     }
     TAB_REMOVE( httpd.i_host, httpd.host, host );
 
-    vlc_cancel( host->thread );
-    vlc_join( host->thread, NULL );
+    for( unsigned j = 0; j < host->i_loops; j++ )
+        vlc_cancel( host->loops[j].thread );
+    for( unsigned j = 0; j < host->i_loops; j++ )
+        vlc_join( host->loops[j].thread, NULL );
 
     msg_Dbg( host, "HTTP host removed" );
 
@@ -1096,16 +1275,9 @@ void httpd_HostDelete( httpd_host_t *host )
     {
         msg_Err( host, "url still registered: %s", host->url[i]->psz_url );
     }
-    for( i = 0; i < host->i_client; i++ )
-    {
-        httpd_client_t *cl = host->client[i];
-        msg_Warn( host, "client still connected" );
-        httpd_ClientClean( cl );
-        TAB_REMOVE( host->i_client, host->client, cl );
-        free( cl );
-        i--;
-        /* TODO */
-    }
+    for( unsigned j = 0; j < host->i_loops; j++ )
+        httpd_LoopClean( &host->loops[j] );
+    free( host->loops );
 
     vlc_tls_Delete( host->p_tls );
     net_ListenClose( host->fds );
@@ -1115,6 +1287,26 @@ void httpd_HostDelete( httpd_host_t *host )
     vlc_mutex_unlock( &httpd.mutex );
 }
 
+/* release a stopped event loop and the clients it still serves */
+static void httpd_LoopClean( httpd_loop_t *loop )
+{
+    for( int i = 0; i < loop->i_client; i++ )
+    {
+        msg_Warn( loop->host, "client still connected" );
+        httpd_ClientClean( loop->client[i] );
+        free( loop->client[i] );
+        /* TODO */
+    }
+    free( loop->client );
+#ifdef HTTPD_EPOLL
+    close( loop->epfd );
+#else
+    free( loop->ufd );
+    free( loop->ufd_client );
+#endif
+    vlc_mutex_destroy( &loop->lock );
+}
+
 /* register a new url */
 httpd_url_t *httpd_UrlNew( httpd_host_t *host, const char *psz_url,
                            const char *psz_user, const char *psz_password )
@@ -1149,7 +1341,7 @@ httpd_url_t *httpd_UrlNew( httpd_host_t *host, const char *psz_url,
     }
 
     TAB_APPEND( (httpd_url_t **), host->i_url, host->url, url );			// sunqueen modify
-    vlc_cond_signal( &host->wait );
+    vlc_cond_broadcast( &host->wait );
     vlc_mutex_unlock( &host->lock );
 
     return url;
@@ -1175,28 +1367,36 @@ void httpd_UrlDelete( httpd_url_t *url )
 
     vlc_mutex_lock( &host->lock );
     TAB_REMOVE( host->i_url, host->url, url );
+    vlc_mutex_unlock( &host->lock );
 
-    vlc_mutex_destroy( &url->lock );
-    free( url->psz_url );
-    free( url->psz_user );
-    free( url->psz_password );
-
-    for( i = 0; i < host->i_client; i++ )
+    /* No client can pick the url anymore, detach those still using it.
+     * The loops own the clients: only close them, the loop frees them. */
+    for( unsigned j = 0; j < host->i_loops; j++ )
     {
-        httpd_client_t *client = host->client[i];
+        httpd_loop_t *loop = &host->loops[j];
 
-        if( client->url == url )
+        vlc_mutex_lock( &loop->lock );
+        for( i = 0; i < loop->i_client; i++ )
         {
-            /* TODO complete it */
-            msg_Warn( host, "force closing connections" );
-            httpd_ClientClean( client );
-            TAB_REMOVE( host->i_client, host->client, client );
-            free( client );
-            i--;
+            httpd_client_t *client = loop->client[i];
+
+            if( client->url == url )
+            {
+                /* TODO complete it */
+                msg_Warn( host, "force closing connections" );
+                httpd_ClientClean( client );
+                client->url = NULL;
+                client->i_state = HTTPD_CLIENT_DEAD;
+            }
         }
+        vlc_mutex_unlock( &loop->lock );
     }
+
+    vlc_mutex_destroy( &url->lock );
+    free( url->psz_url );
+    free( url->psz_user );
+    free( url->psz_password );
     free( url );
-    vlc_mutex_unlock( &host->lock );
 }
 
 static void httpd_MsgInit( httpd_message_t *msg )
@@ -1300,6 +1500,33 @@ char* httpd_ServerIP( const httpd_client_t *cl, char *ip, int *port )
     return net_GetSockAddress( cl->fd, ip, port ) ? NULL : ip;
 }
 
+/* release the send buffer, which may be shared stream data */
+static void httpd_ClientFreeBuffer( httpd_client_t *cl )
+{
+    if( cl->p_chunk != NULL )
+    {
+        httpd_StreamChunkRelease( cl->p_chunk );
+        cl->p_chunk = NULL;
+    }
+    else
+        free( cl->p_buffer );
+    cl->p_buffer = NULL;
+}
+
+/* use the answer body as the send buffer */
+static void httpd_ClientTakeBody( httpd_client_t *cl )
+{
+    httpd_ClientFreeBuffer( cl );
+    cl->p_buffer      = cl->answer.p_body;
+    cl->p_chunk       = cl->p_body_chunk;
+    cl->i_buffer_size = cl->answer.i_body;
+    cl->i_buffer      = 0;
+
+    cl->p_body_chunk  = NULL;
+    cl->answer.p_body = NULL;
+    cl->answer.i_body = 0;
+}
+
 static void httpd_ClientClean( httpd_client_t *cl )
 {
     if( cl->fd >= 0 )
@@ -1310,11 +1537,16 @@ static void httpd_ClientClean( httpd_client_t *cl )
         cl->fd = -1;
     }
 
+    if( cl->p_body_chunk != NULL )
+    {
+        httpd_StreamChunkRelease( cl->p_body_chunk );
+        cl->p_body_chunk = NULL;
+        cl->answer.p_body = NULL;
+    }
     httpd_MsgClean( &cl->answer );
     httpd_MsgClean( &cl->query );
 
-    free( cl->p_buffer );
-    cl->p_buffer = NULL;
+    httpd_ClientFreeBuffer( cl );
 }
 
 static httpd_client_t *httpd_ClientNew( int fd, vlc_tls_t *p_tls, mtime_t now )
@@ -1327,6 +1559,9 @@ static httpd_client_t *httpd_ClientNew( int fd, vlc_tls_t *p_tls, mtime_t now )
     cl->fd      = fd;
     cl->url     = NULL;
     cl->p_tls = p_tls;
+    cl->i_events = 0;
+    cl->p_chunk = NULL;
+    cl->p_body_chunk = NULL;
 
     httpd_ClientInit( cl, now );
     if( p_tls != NULL )
@@ -1810,10 +2045,10 @@ static void httpd_ClientSend( httpd_client_t *cl )
                       strlen( cl->answer.value[i] ) + 2;
         }
 
-        if( cl->i_buffer_size < i_size )
+        if( cl->i_buffer_size < i_size || cl->p_chunk != NULL )
         {
             cl->i_buffer_size = i_size;
-            free( cl->p_buffer );
+            httpd_ClientFreeBuffer( cl );
             cl->p_buffer = (uint8_t *)xmalloc( i_size );			// sunqueen modify
         }
         p = (char *)cl->p_buffer;
@@ -1860,13 +2095,7 @@ static void httpd_ClientSend( httpd_client_t *cl )
             if( cl->answer.i_body > 0 )
             {
                 /* send the body data */
-                free( cl->p_buffer );
-                cl->p_buffer = cl->answer.p_body;
-                cl->i_buffer_size = cl->answer.i_body;
-                cl->i_buffer = 0;
-
-                cl->answer.i_body = 0;
-                cl->answer.p_body = NULL;
+                httpd_ClientTakeBody( cl );
             }
             else
             {
@@ -1911,434 +2140,535 @@ static void httpd_ClientTlsHandshake( httpd_client_t *cl )
     }
 }
 
-static void* httpd_HostThread( void *data )
+/* Runs the client state machine and returns the events to wait for */
+static unsigned httpd_ClientProcess( httpd_host_t *host, httpd_client_t *cl )
 {
-    httpd_host_t *host = (httpd_host_t *)data;			// sunqueen modify
-    int canc = vlc_savecancel();
-
-    vlc_mutex_lock( &host->lock );
-    while( host->i_ref > 0 )
+    if( cl->i_state == HTTPD_CLIENT_RECEIVE_DONE )
     {
-//        struct pollfd ufd[host->nfd + host->i_client];
-        struct pollfd *ufd = (struct pollfd *)malloc((host->nfd + host->i_client) * sizeof(struct pollfd));			// sunqueen modify
-        unsigned nfd;
-        for( nfd = 0; nfd < host->nfd; nfd++ )
-        {
-            ufd[nfd].fd = host->fds[nfd];
-            ufd[nfd].events = __POLLIN;			// sunqueen modify
-            ufd[nfd].revents = 0;
-        }
+        httpd_message_t *answer = &cl->answer;
+        httpd_message_t *query  = &cl->query;
+        int i_msg = query->i_type;
 
-        /* add all socket that should be read/write and close dead connection */
-        while( host->i_url <= 0 )
+        httpd_MsgInit( answer );
+
+        /* Handle what we received */
+        if( i_msg == HTTPD_MSG_ANSWER )
         {
-            mutex_cleanup_push( &host->lock );
-            vlc_restorecancel( canc );
-            vlc_cond_wait( &host->wait, &host->lock );
-            canc = vlc_savecancel();
-            vlc_cleanup_pop();
+            cl->url     = NULL;
+            cl->i_state = HTTPD_CLIENT_DEAD;
         }
-
-        mtime_t now = mdate();
-        bool b_low_delay = false;
-
-        for(int i_client = 0; i_client < host->i_client; i_client++ )
+        else if( i_msg == HTTPD_MSG_OPTIONS )
         {
-            httpd_client_t *cl = host->client[i_client];
-            if( cl->i_ref < 0 || ( cl->i_ref == 0 &&
-                ( cl->i_state == HTTPD_CLIENT_DEAD ||
-                  ( cl->i_activity_timeout > 0 &&
-                    cl->i_activity_date+cl->i_activity_timeout < now) ) ) )
-            {
-                httpd_ClientClean( cl );
-                TAB_REMOVE( host->i_client, host->client, cl );
-                free( cl );
-                i_client--;
-                continue;
-            }
 
-            struct pollfd *pufd = ufd + nfd;
-            assert (pufd < ufd + (sizeof (ufd) / sizeof (ufd[0])));
+            answer->i_type   = HTTPD_MSG_ANSWER;
+            answer->i_proto  = query->i_proto;
+            answer->i_status = 200;
+            answer->i_body = 0;
+            answer->p_body = NULL;
 
-            pufd->fd = cl->fd;
-            pufd->events = pufd->revents = 0;
+            httpd_MsgAdd( answer, "Server", "VLC/%s", VERSION );
+            httpd_MsgAdd( answer, "Content-Length", "0" );
 
-            if( ( cl->i_state == HTTPD_CLIENT_RECEIVING )
-                  || ( cl->i_state == HTTPD_CLIENT_TLS_HS_IN ) )
+            switch( query->i_proto )
             {
-                pufd->events = __POLLIN;			// sunqueen modify
-            }
-            else if( ( cl->i_state == HTTPD_CLIENT_SENDING )
-                  || ( cl->i_state == HTTPD_CLIENT_TLS_HS_OUT ) )
-            {
-                pufd->events = __POLLOUT;			// sunqueen modify
-            }
-            else if( cl->i_state == HTTPD_CLIENT_RECEIVE_DONE )
-            {
-                httpd_message_t *answer = &cl->answer;
-                httpd_message_t *query  = &cl->query;
-                int i_msg = query->i_type;
-
-                httpd_MsgInit( answer );
+                case HTTPD_PROTO_HTTP:
+                    answer->i_version = 1;
+                    httpd_MsgAdd( answer, "Allow",
+                                  "GET,HEAD,POST,OPTIONS" );
+                    break;
 
-                /* Handle what we received */
-                if( i_msg == HTTPD_MSG_ANSWER )
+                case HTTPD_PROTO_RTSP:
                 {
-                    cl->url     = NULL;
-                    cl->i_state = HTTPD_CLIENT_DEAD;
-                }
-                else if( i_msg == HTTPD_MSG_OPTIONS )
-                {
-
-                    answer->i_type   = HTTPD_MSG_ANSWER;
-                    answer->i_proto  = query->i_proto;
-                    answer->i_status = 200;
-                    answer->i_body = 0;
-                    answer->p_body = NULL;
-
-                    httpd_MsgAdd( answer, "Server", "VLC/%s", VERSION );
-                    httpd_MsgAdd( answer, "Content-Length", "0" );
-
-                    switch( query->i_proto )
+                    const char *p;
+                    answer->i_version = 0;
+
+                    p = httpd_MsgGet( query, "Cseq" );
+                    if( p != NULL )
+                        httpd_MsgAdd( answer, "Cseq", "%s", p );
+                    p = httpd_MsgGet( query, "Timestamp" );
+                    if( p != NULL )
+                        httpd_MsgAdd( answer, "Timestamp", "%s", p );
+
+                    p = httpd_MsgGet( query, "Require" );
+                    if( p != NULL )
                     {
-                        case HTTPD_PROTO_HTTP:
-                            answer->i_version = 1;
-                            httpd_MsgAdd( answer, "Allow",
-                                          "GET,HEAD,POST,OPTIONS" );
-                            break;
-
-                        case HTTPD_PROTO_RTSP:
-                        {
-                            const char *p;
-                            answer->i_version = 0;
-
-                            p = httpd_MsgGet( query, "Cseq" );
-                            if( p != NULL )
-                                httpd_MsgAdd( answer, "Cseq", "%s", p );
-                            p = httpd_MsgGet( query, "Timestamp" );
-                            if( p != NULL )
-                                httpd_MsgAdd( answer, "Timestamp", "%s", p );
-
-                            p = httpd_MsgGet( query, "Require" );
-                            if( p != NULL )
-                            {
-                                answer->i_status = 551;
-                                httpd_MsgAdd( query, "Unsupported", "%s", p );
-                            }
-
-                            httpd_MsgAdd( answer, "Public", "DESCRIBE,SETUP,"
-                                          "TEARDOWN,PLAY,PAUSE,GET_PARAMETER" );
-                            break;
-                        }
+                        answer->i_status = 551;
+                        httpd_MsgAdd( query, "Unsupported", "%s", p );
                     }
 
-                    cl->i_buffer = -1;  /* Force the creation of the answer in
-                                         * httpd_ClientSend */
-                    cl->i_state = HTTPD_CLIENT_SENDING;
+                    httpd_MsgAdd( answer, "Public", "DESCRIBE,SETUP,"
+                                  "TEARDOWN,PLAY,PAUSE,GET_PARAMETER" );
+                    break;
                 }
-                else if( i_msg == HTTPD_MSG_NONE )
-                {
-                    if( query->i_proto == HTTPD_PROTO_NONE )
-                    {
-                        cl->url = NULL;
-                        cl->i_state = HTTPD_CLIENT_DEAD;
-                    }
-                    else
-                    {
-                        char *p;
+            }
+
+            cl->i_buffer = -1;  /* Force the creation of the answer in
+                                 * httpd_ClientSend */
+            cl->i_state = HTTPD_CLIENT_SENDING;
+        }
+        else if( i_msg == HTTPD_MSG_NONE )
+        {
+            if( query->i_proto == HTTPD_PROTO_NONE )
+            {
+                cl->url = NULL;
+                cl->i_state = HTTPD_CLIENT_DEAD;
+            }
+            else
+            {
+                char *p;
 
-                        /* unimplemented */
-                        answer->i_proto  = query->i_proto ;
-                        answer->i_type   = HTTPD_MSG_ANSWER;
-                        answer->i_version= 0;
-                        answer->i_status = 501;
+                /* unimplemented */
+                answer->i_proto  = query->i_proto ;
+                answer->i_type   = HTTPD_MSG_ANSWER;
+                answer->i_version= 0;
+                answer->i_status = 501;
 
-                        answer->i_body = httpd_HtmlError (&p, 501, NULL);
-                        answer->p_body = (uint8_t *)p;
-                        httpd_MsgAdd( answer, "Content-Length", "%d", answer->i_body );
+                answer->i_body = httpd_HtmlError (&p, 501, NULL);
+                answer->p_body = (uint8_t *)p;
+                httpd_MsgAdd( answer, "Content-Length", "%d", answer->i_body );
 
-                        cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
-                        cl->i_state = HTTPD_CLIENT_SENDING;
-                    }
-                }
-                else
-                {
-                    bool b_auth_failed = false;
+                cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
+                cl->i_state = HTTPD_CLIENT_SENDING;
+            }
+        }
+        else
+        {
+            bool b_auth_failed = false;
 
-                    /* Search the url and trigger callbacks */
-                    for(int i = 0; i < host->i_url; i++ )
-                    {
-                        httpd_url_t *url = host->url[i];
+            vlc_mutex_lock( &host->lock );
+            /* Search the url and trigger callbacks */
+            for(int i = 0; i < host->i_url; i++ )
+            {
+                httpd_url_t *url = host->url[i];
 
-                        if( !strcmp( url->psz_url, query->psz_url ) )
+                if( !strcmp( url->psz_url, query->psz_url ) )
+                {
+                    if( url->_catch[i_msg].cb )			// sunqueen modify
+                    {
+                        if( answer && ( *url->psz_user || *url->psz_password ) )
                         {
-                            if( url->_catch[i_msg].cb )			// sunqueen modify
+                            /* create the headers */
+                            const char *b64 = httpd_MsgGet( query, "Authorization" ); /* BASIC id */
+                            char *user = NULL, *pass = NULL;
+
+                            if( b64 != NULL
+                             && !strncasecmp( b64, "BASIC", 5 ) )
                             {
-                                if( answer && ( *url->psz_user || *url->psz_password ) )
-                                {
-                                    /* create the headers */
-                                    const char *b64 = httpd_MsgGet( query, "Authorization" ); /* BASIC id */
-                                    char *user = NULL, *pass = NULL;
-
-                                    if( b64 != NULL
-                                     && !strncasecmp( b64, "BASIC", 5 ) )
-                                    {
-                                        b64 += 5;
-                                        while( *b64 == ' ' )
-                                            b64++;
-
-                                        user = vlc_b64_decode( b64 );
-                                        if (user != NULL)
-                                        {
-                                            pass = strchr (user, ':');
-                                            if (pass != NULL)
-                                                *pass++ = '\0';
-                                        }
-                                    }
-
-                                    if ((user == NULL) || (pass == NULL)
-                                     || strcmp (user, url->psz_user)
-                                     || strcmp (pass, url->psz_password))
-                                    {
-                                        httpd_MsgAdd( answer,
-                                                      "WWW-Authenticate",
-                                                      "Basic realm=\"VLC stream\"" );
-                                        /* We fail for all url */
-                                        b_auth_failed = true;
-                                        free( user );
-                                        break;
-                                    }
-
-                                    free( user );
-                                }
+                                b64 += 5;
+                                while( *b64 == ' ' )
+                                    b64++;
 
-                                if( !url->_catch[i_msg].cb( url->_catch[i_msg].p_sys, cl, answer, query ) )			// sunqueen modify
+                                user = vlc_b64_decode( b64 );
+                                if (user != NULL)
                                 {
-                                    if( answer->i_proto == HTTPD_PROTO_NONE )
-                                    {
-                                        /* Raw answer from a CGI */
-                                        cl->i_buffer = cl->i_buffer_size;
-                                    }
-                                    else
-                                        cl->i_buffer = -1;
-
-                                    /* only one url can answer */
-                                    answer = NULL;
-                                    if( cl->url == NULL )
-                                    {
-                                        cl->url = url;
-                                    }
+                                    pass = strchr (user, ':');
+                                    if (pass != NULL)
+                                        *pass++ = '\0';
                                 }
                             }
-                        }
-                    }
-
-                    if( answer )
-                    {
-                        char *p;
 
-                        answer->i_proto  = query->i_proto;
-                        answer->i_type   = HTTPD_MSG_ANSWER;
-                        answer->i_version= 0;
+                            if ((user == NULL) || (pass == NULL)
+                             || strcmp (user, url->psz_user)
+                             || strcmp (pass, url->psz_password))
+                            {
+                                httpd_MsgAdd( answer,
+                                              "WWW-Authenticate",
+                                              "Basic realm=\"VLC stream\"" );
+                                /* We fail for all url */
+                                b_auth_failed = true;
+                                free( user );
+                                break;
+                            }
 
-                        if( b_auth_failed )
-                        {
-                            answer->i_status = 401;
-                        }
-                        else
-                        {
-                            /* no url registered */
-                            answer->i_status = 404;
+                            free( user );
                         }
 
-                        answer->i_body = httpd_HtmlError (&p,
-                                                          answer->i_status,
-                                                          query->psz_url);
-                        answer->p_body = (uint8_t *)p;
+                        if( !url->_catch[i_msg].cb( url->_catch[i_msg].p_sys, cl, answer, query ) )			// sunqueen modify
+                        {
+                            if( answer->i_proto == HTTPD_PROTO_NONE )
+                            {
+                                /* Raw answer from a CGI */
+                                cl->i_buffer = cl->i_buffer_size;
+                            }
+                            else
+                                cl->i_buffer = -1;
 
-                        cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
-                        httpd_MsgAdd( answer, "Content-Length", "%d", answer->i_body );
-                        httpd_MsgAdd( answer, "Content-Type", "%s", "text/html" );
+                            /* only one url can answer */
+                            answer = NULL;
+                            if( cl->url == NULL )
+                            {
+                                cl->url = url;
+                            }
+                        }
                     }
-
-                    cl->i_state = HTTPD_CLIENT_SENDING;
                 }
             }
-            else if( cl->i_state == HTTPD_CLIENT_SEND_DONE )
+            vlc_mutex_unlock( &host->lock );
+
+            if( answer )
             {
-                if( !cl->b_stream_mode || cl->answer.i_body_offset == 0 )
-                {
-                    const char *psz_connection = httpd_MsgGet( &cl->answer, "Connection" );
-                    const char *psz_query = httpd_MsgGet( &cl->query, "Connection" );
-                    bool b_connection = false;
-                    bool b_keepalive = false;
-                    bool b_query = false;
-
-                    cl->url = NULL;
-                    if( psz_connection )
-                    {
-                        b_connection = ( strcasecmp( psz_connection, "Close" ) == 0 );
-                        b_keepalive = ( strcasecmp( psz_connection, "Keep-Alive" ) == 0 );
-                    }
+                char *p;
 
-                    if( psz_query )
-                    {
-                        b_query = ( strcasecmp( psz_query, "Close" ) == 0 );
-                    }
+                answer->i_proto  = query->i_proto;
+                answer->i_type   = HTTPD_MSG_ANSWER;
+                answer->i_version= 0;
 
-                    if( ( ( cl->query.i_proto == HTTPD_PROTO_HTTP ) &&
-                          ( ( cl->query.i_version == 0 && b_keepalive ) ||
-                            ( cl->query.i_version == 1 && !b_connection ) ) ) ||
-                        ( ( cl->query.i_proto == HTTPD_PROTO_RTSP ) &&
-                          !b_query && !b_connection ) )
-                    {
-                        httpd_MsgClean( &cl->query );
-                        httpd_MsgInit( &cl->query );
-
-                        cl->i_buffer = 0;
-                        cl->i_buffer_size = 1000;
-                        free( cl->p_buffer );
-                        cl->p_buffer = (uint8_t *)xmalloc( cl->i_buffer_size );			// sunqueen modify
-                        cl->i_state = HTTPD_CLIENT_RECEIVING;
-                    }
-                    else
-                    {
-                        cl->i_state = HTTPD_CLIENT_DEAD;
-                    }
-                    httpd_MsgClean( &cl->answer );
+                if( b_auth_failed )
+                {
+                    answer->i_status = 401;
                 }
                 else
                 {
-                    int64_t i_offset = cl->answer.i_body_offset;
-                    httpd_MsgClean( &cl->answer );
+                    /* no url registered */
+                    answer->i_status = 404;
+                }
 
-                    cl->answer.i_body_offset = i_offset;
-                    free( cl->p_buffer );
-                    cl->p_buffer = NULL;
-                    cl->i_buffer = 0;
-                    cl->i_buffer_size = 0;
+                answer->i_body = httpd_HtmlError (&p,
+                                                  answer->i_status,
+                                                  query->psz_url);
+                answer->p_body = (uint8_t *)p;
 
-                    cl->i_state = HTTPD_CLIENT_WAITING;
-                }
+                cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
+                httpd_MsgAdd( answer, "Content-Length", "%d", answer->i_body );
+                httpd_MsgAdd( answer, "Content-Type", "%s", "text/html" );
             }
-            else if( cl->i_state == HTTPD_CLIENT_WAITING )
-            {
-                int64_t i_offset = cl->answer.i_body_offset;
-                int     i_msg = cl->query.i_type;
 
-                httpd_MsgInit( &cl->answer );
-                cl->answer.i_body_offset = i_offset;
+            cl->i_state = HTTPD_CLIENT_SENDING;
+        }
+    }
+    else if( cl->i_state == HTTPD_CLIENT_SEND_DONE )
+    {
+        if( !cl->b_stream_mode || cl->answer.i_body_offset == 0 )
+        {
+            const char *psz_connection = httpd_MsgGet( &cl->answer, "Connection" );
+            const char *psz_query = httpd_MsgGet( &cl->query, "Connection" );
+            bool b_connection = false;
+            bool b_keepalive = false;
+            bool b_query = false;
+
+            cl->url = NULL;
+            if( psz_connection )
+            {
+                b_connection = ( strcasecmp( psz_connection, "Close" ) == 0 );
+                b_keepalive = ( strcasecmp( psz_connection, "Keep-Alive" ) == 0 );
+            }
 
-                cl->url->_catch[i_msg].cb( cl->url->_catch[i_msg].p_sys, cl,
-                                          &cl->answer, &cl->query );			// sunqueen modify
-                if( cl->answer.i_type != HTTPD_MSG_NONE )
-                {
-                    /* we have new data, so re-enter send mode */
-                    cl->i_buffer      = 0;
-                    cl->p_buffer      = cl->answer.p_body;
-                    cl->i_buffer_size = cl->answer.i_body;
-                    cl->answer.p_body = NULL;
-                    cl->answer.i_body = 0;
-                    cl->i_state = HTTPD_CLIENT_SENDING;
-                }
+            if( psz_query )
+            {
+                b_query = ( strcasecmp( psz_query, "Close" ) == 0 );
             }
 
-            if (pufd->events != 0)
-                nfd++;
+            if( ( ( cl->query.i_proto == HTTPD_PROTO_HTTP ) &&
+                  ( ( cl->query.i_version == 0 && b_keepalive ) ||
+                    ( cl->query.i_version == 1 && !b_connection ) ) ) ||
+                ( ( cl->query.i_proto == HTTPD_PROTO_RTSP ) &&
+                  !b_query && !b_connection ) )
+            {
+                httpd_MsgClean( &cl->query );
+                httpd_MsgInit( &cl->query );
+
+                cl->i_buffer = 0;
+                cl->i_buffer_size = 1000;
+                httpd_ClientFreeBuffer( cl );
+                cl->p_buffer = (uint8_t *)xmalloc( cl->i_buffer_size );			// sunqueen modify
+                cl->i_state = HTTPD_CLIENT_RECEIVING;
+            }
             else
-                b_low_delay = true;
+            {
+                cl->i_state = HTTPD_CLIENT_DEAD;
+            }
+            httpd_MsgClean( &cl->answer );
         }
-        vlc_mutex_unlock( &host->lock );
-        vlc_restorecancel( canc );
+        else
+        {
+            int64_t i_offset = cl->answer.i_body_offset;
+            httpd_MsgClean( &cl->answer );
 
-        /* we will wait 20ms (not too big) if HTTPD_CLIENT_WAITING */
-        int ret = poll( ufd, nfd, b_low_delay ? 20 : -1 );
+            cl->answer.i_body_offset = i_offset;
+            httpd_ClientFreeBuffer( cl );
+            cl->i_buffer = 0;
+            cl->i_buffer_size = 0;
 
-        canc = vlc_savecancel();
-        vlc_mutex_lock( &host->lock );
-        switch( ret )
+            cl->i_state = HTTPD_CLIENT_WAITING;
+        }
+    }
+    else if( cl->i_state == HTTPD_CLIENT_WAITING )
+    {
+        int64_t i_offset = cl->answer.i_body_offset;
+        int     i_msg = cl->query.i_type;
+
+        httpd_MsgInit( &cl->answer );
+        cl->answer.i_body_offset = i_offset;
+
+        cl->url->_catch[i_msg].cb( cl->url->_catch[i_msg].p_sys, cl,
+                                  &cl->answer, &cl->query );			// sunqueen modify
+        if( cl->answer.i_type != HTTPD_MSG_NONE )
         {
-            case -1:
-                if (errno != EINTR)
-                {
-                    /* Kernel on low memory or a bug: pace */
-                    msg_Err( host, "polling error: %m" );
-                    msleep( 100000 );
-                }
-            case 0:
-				free(ufd);			// sunqueen add
-                continue;
+            /* we have new data, so re-enter send mode */
+            httpd_ClientTakeBody( cl );
+            cl->i_state = HTTPD_CLIENT_SENDING;
         }
+    }
+
+    if( ( cl->i_state == HTTPD_CLIENT_RECEIVING )
+          || ( cl->i_state == HTTPD_CLIENT_TLS_HS_IN ) )
+        return __POLLIN;
+    if( ( cl->i_state == HTTPD_CLIENT_SENDING )
+          || ( cl->i_state == HTTPD_CLIENT_TLS_HS_OUT ) )
+        return __POLLOUT;
+    return 0;
+}
+
+static void httpd_ClientIO( httpd_client_t *cl, mtime_t now )
+{
+    cl->i_activity_date = now;
+
+    if( cl->i_state == HTTPD_CLIENT_RECEIVING )
+    {
+        httpd_ClientRecv( cl );
+    }
+    else if( cl->i_state == HTTPD_CLIENT_SENDING )
+    {
+        httpd_ClientSend( cl );
+    }
+    else if( cl->i_state == HTTPD_CLIENT_TLS_HS_IN
+          || cl->i_state == HTTPD_CLIENT_TLS_HS_OUT )
+    {
+        httpd_ClientTlsHandshake( cl );
+    }
+}
 
-        /* Handle client sockets */
-        now = mdate();
-        nfd = host->nfd;
+/* accept a new connection on a listening socket, loop lock held */
+static void httpd_LoopAccept( httpd_loop_t *loop, int fd, mtime_t now )
+{
+    httpd_host_t *host = loop->host;
+
+    fd = vlc_accept (fd, NULL, NULL, true);
+    if (fd == -1)
+        return; /* another loop was faster */
+    // sunqueen modify start
+    int opt = 1;
+    setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
+                (char *)&opt /*(int){ 1 }*/, sizeof(int));
+    // sunqueen modify end
+
+    vlc_tls_t *p_tls;
+
+    if( host->p_tls != NULL )
+        p_tls = vlc_tls_SessionCreate( host->p_tls, fd, NULL );
+    else
+        p_tls = NULL;
 
-        for( int i_client = 0; i_client < host->i_client; i_client++ )
+    httpd_client_t *cl = httpd_ClientNew( fd, p_tls, now );
+    if( cl == NULL )
+    {
+        if( p_tls != NULL )
+            vlc_tls_SessionDelete( p_tls );
+        net_Close( fd );
+        return;
+    }
+
+#ifdef HTTPD_EPOLL
+    struct epoll_event ev;
+    ev.events = 0;
+    ev.data.ptr = cl;
+    if( epoll_ctl( loop->epfd, EPOLL_CTL_ADD, fd, &ev ) )
+    {
+        msg_Err( host, "cannot watch client socket: %m" );
+        httpd_ClientClean( cl );
+        free( cl );
+        return;
+    }
+#endif
+    TAB_APPEND( (httpd_client_t **), loop->i_client, loop->client, cl );			// sunqueen modify
+}
+
+/* reap dead clients, run their state machines and set up the events to wait
+ * for; returns true if some client must be polled again soon */
+static bool httpd_LoopPrepare( httpd_loop_t *loop, mtime_t now )
+{
+    httpd_host_t *host = loop->host;
+    bool b_low_delay = false;
+
+#ifndef HTTPD_EPOLL
+    unsigned nfd = host->nfd + loop->i_client;
+    if( nfd > loop->i_ufd_alloc )
+    {
+        struct pollfd *ufd = (struct pollfd *)realloc( loop->ufd, nfd * sizeof( *ufd ) );			// sunqueen modify
+        httpd_client_t **ufd_client = (httpd_client_t **)realloc( loop->ufd_client, nfd * sizeof( *ufd_client ) );			// sunqueen modify
+        if( ufd != NULL )
+            loop->ufd = ufd;
+        if( ufd_client != NULL )
+            loop->ufd_client = ufd_client;
+        if( ufd == NULL || ufd_client == NULL )
         {
-            httpd_client_t *cl = host->client[i_client];
-            const struct pollfd *pufd = &ufd[nfd];
+            loop->i_ufd = 0;
+            return true;
+        }
+        loop->i_ufd_alloc = nfd;
+    }
 
-            assert( pufd < &ufd[sizeof(ufd) / sizeof(ufd[0])] );
+    for( nfd = 0; nfd < host->nfd; nfd++ )
+    {
+        loop->ufd[nfd].fd = host->fds[nfd];
+        loop->ufd[nfd].events = __POLLIN;			// sunqueen modify
+        loop->ufd[nfd].revents = 0;
+    }
+#endif
 
-            if( cl->fd != pufd->fd )
-                continue; // we were not waiting for this client
-            ++nfd;
-            if( pufd->revents == 0 )
-                continue; // no event received
+    for(int i_client = 0; i_client < loop->i_client; i_client++ )
+    {
+        httpd_client_t *cl = loop->client[i_client];
+        if( cl->i_ref < 0 || ( cl->i_ref == 0 &&
+            ( cl->i_state == HTTPD_CLIENT_DEAD ||
+              ( cl->i_activity_timeout > 0 &&
+                cl->i_activity_date+cl->i_activity_timeout < now) ) ) )
+        {
+            /* closing the socket also removes it from the epoll set */
+            httpd_ClientClean( cl );
+            TAB_REMOVE( loop->i_client, loop->client, cl );
+            free( cl );
+            i_client--;
+            continue;
+        }
 
-            cl->i_activity_date = now;
+        unsigned events = httpd_ClientProcess( host, cl );
+        if( cl->i_state == HTTPD_CLIENT_DEAD )
+            events = 0;
+        if( events == 0 )
+            b_low_delay = true;
 
-            if( cl->i_state == HTTPD_CLIENT_RECEIVING )
-            {
-                httpd_ClientRecv( cl );
-            }
-            else if( cl->i_state == HTTPD_CLIENT_SENDING )
-            {
-                httpd_ClientSend( cl );
-            }
-            else if( cl->i_state == HTTPD_CLIENT_TLS_HS_IN
-                  || cl->i_state == HTTPD_CLIENT_TLS_HS_OUT )
-            {
-                httpd_ClientTlsHandshake( cl );
-            }
+#ifdef HTTPD_EPOLL
+        if( events != cl->i_events && cl->fd != -1 )
+        {
+            struct epoll_event ev;
+            ev.events = ( ( events & __POLLIN ) ? EPOLLIN : 0 )
+                      | ( ( events & __POLLOUT ) ? EPOLLOUT : 0 );
+            ev.data.ptr = cl;
+            if( epoll_ctl( loop->epfd, EPOLL_CTL_MOD, cl->fd, &ev ) == 0 )
+                cl->i_events = events;
+        }
+#else
+        if( events != 0 )
+        {
+            loop->ufd[nfd].fd = cl->fd;
+            loop->ufd[nfd].events = events;
+            loop->ufd[nfd].revents = 0;
+            loop->ufd_client[nfd] = cl;
+            nfd++;
         }
+#endif
+    }
+#ifndef HTTPD_EPOLL
+    loop->i_ufd = nfd;
+#endif
+    return b_low_delay;
+}
 
-        /* Handle server sockets (accept new connections) */
-        for( nfd = 0; nfd < host->nfd; nfd++ )
+/* wait for socket events, loop lock not held */
+static int httpd_LoopWait( httpd_loop_t *loop, int timeout )
+{
+#ifdef HTTPD_EPOLL
+    return epoll_wait( loop->epfd, loop->events, HTTPD_EPOLL_EVENTS, timeout );
+#else
+    return poll( loop->ufd, loop->i_ufd, timeout );
+#endif
+}
+
+/* handle the events returned by httpd_LoopWait(), loop lock held */
+static void httpd_LoopDispatch( httpd_loop_t *loop, int ret, mtime_t now )
+{
+    httpd_host_t *host = loop->host;
+
+#ifdef HTTPD_EPOLL
+    for( int i = 0; i < ret; i++ )
+    {
+        void *ptr = loop->events[i].data.ptr;
+
+        if( (int *)ptr >= host->fds && (int *)ptr < host->fds + host->nfd )
         {
-            httpd_client_t *cl;
-            int fd = ufd[nfd].fd;
+            /* Handle server sockets (accept new connections) */
+            httpd_LoopAccept( loop, *(int *)ptr, now );
+            continue;
+        }
 
-            assert (fd == host->fds[nfd]);
+        /* Handle client sockets. A client cannot have been freed since the
+         * wait, only this thread reaps them. */
+        httpd_client_t *cl = (httpd_client_t *)ptr;
+        if( cl->i_state == HTTPD_CLIENT_DEAD )
+            continue; // closed by httpd_UrlDelete() meanwhile
+        httpd_ClientIO( cl, now );
+    }
+#else
+    VLC_UNUSED( ret );
 
-            if( ufd[nfd].revents == 0 )
-                continue;
+    /* Handle client sockets */
+    for( unsigned nfd = host->nfd; nfd < loop->i_ufd; nfd++ )
+    {
+        httpd_client_t *cl = loop->ufd_client[nfd];
 
-            /* */
-            fd = vlc_accept (fd, NULL, NULL, true);
-            if (fd == -1)
-                continue;
-            // sunqueen modify start
-            int opt = 1;
-            setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
-                        (char *)&opt /*(int){ 1 }*/, sizeof(int));
-			// sunqueen modify end
+        if( loop->ufd[nfd].revents == 0 )
+            continue; // no event received
+        if( cl->i_state == HTTPD_CLIENT_DEAD )
+            continue; // closed by httpd_UrlDelete() meanwhile
+        httpd_ClientIO( cl, now );
+    }
 
-            vlc_tls_t *p_tls;
+    /* Handle server sockets (accept new connections) */
+    for( unsigned nfd = 0; nfd < host->nfd; nfd++ )
+    {
+        assert (loop->ufd[nfd].fd == host->fds[nfd]);
 
-            if( host->p_tls != NULL )
-                p_tls = vlc_tls_SessionCreate( host->p_tls, fd, NULL );
-            else
-                p_tls = NULL;
+        if( loop->ufd[nfd].revents != 0 )
+            httpd_LoopAccept( loop, loop->ufd[nfd].fd, now );
+    }
+#endif
+}
 
-            cl = httpd_ClientNew( fd, p_tls, now );
+static void* httpd_HostThread( void *data )
+{
+    httpd_loop_t *loop = (httpd_loop_t *)data;			// sunqueen modify
+    httpd_host_t *host = loop->host;
+    int canc = vlc_savecancel();
 
-            TAB_APPEND( (httpd_client_t **), host->i_client, host->client, cl );			// sunqueen modify
+    vlc_mutex_lock( &host->lock );
+    while( host->i_ref > 0 )
+    {
+        /* add all socket that should be read/write and close dead connection */
+        while( host->i_url <= 0 )
+        {
+            mutex_cleanup_push( &host->lock );
+            vlc_restorecancel( canc );
+            vlc_cond_wait( &host->wait, &host->lock );
+            canc = vlc_savecancel();
+            vlc_cleanup_pop();
         }
+        vlc_mutex_unlock( &host->lock );
+
+        vlc_mutex_lock( &loop->lock );
+        bool b_low_delay = httpd_LoopPrepare( loop, mdate() );
+        vlc_mutex_unlock( &loop->lock );
+        vlc_restorecancel( canc );
 
-		free(ufd);			// sunqueen add
+        /* we will wait 20ms (not too big) if HTTPD_CLIENT_WAITING */
+        int ret = httpd_LoopWait( loop, b_low_delay ? 20 : -1 );
+
+        canc = vlc_savecancel();
+        if( ret > 0 )
+        {
+            vlc_mutex_lock( &loop->lock );
+            httpd_LoopDispatch( loop, ret, mdate() );
+            vlc_mutex_unlock( &loop->lock );
+        }
+        else if( ret == -1 && errno != EINTR )
+        {
+            /* Kernel on low memory or a bug: pace */
+            msg_Err( host, "polling error: %m" );
+            msleep( 100000 );
+        }
+        vlc_mutex_lock( &host->lock );
     }
     vlc_mutex_unlock( &host->lock );
+    vlc_restorecancel( canc );
     return NULL;
 }
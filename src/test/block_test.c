@@ -27,6 +27,7 @@
 #undef NDEBUG
 #include <assert.h>
 
+#include <vlc/vlc.h>
 #include <vlc_common.h>
 #include <vlc_block.h>
 
@@ -84,10 +85,85 @@ static void test_block (void)
     //assert (block == NULL);
 }
 
+static void test_block_PoolStats (void)
+{
+    size_t size, prev = 0;
+    uint64_t hits, misses;
+    unsigned i;
+
+    for (i = 0; block_PoolStats (i, &size, &hits, &misses) == VLC_SUCCESS; i++)
+    {
+        assert (size > prev);
+        prev = size;
+
+        /* Pooled or not, a block of a class size must be usable as usual */
+        block_t *block = block_Alloc (size);
+        assert (block != NULL);
+        assert (block->i_buffer == size);
+        memset (block->p_buffer, 0xAA, size);
+        block = block_Realloc (block, 16, size);
+        assert (block != NULL);
+        assert (block->i_buffer == 16 + size);
+        block_Release (block);
+    }
+    assert (i > 0);
+}
+
+/* Allocates and releases a block of a class size twice, so that the second
+ * allocation is served from the thread cache. The statistics of the thread
+ * are merged when it exits. */
+static void *test_block_PoolThread (void *data)
+{
+    size_t size = *(size_t *)data;
+
+    for (int n = 0; n < 2; n++)
+    {
+        block_t *block = block_Alloc (size);
+        assert (block != NULL);
+        memset (block->p_buffer, 0xAA, size);
+
+        /* Shrinking within the class keeps the buffer */
+        uint8_t *buffer = block->p_buffer;
+        block = block_Realloc (block, 0, size / 2 + 1);
+        assert (block != NULL);
+        assert (block->p_buffer == buffer);
+        assert (block->i_buffer == size / 2 + 1);
+        block_Release (block);
+    }
+    return NULL;
+}
+
+static void test_block_Pool (void)
+{
+    const char *args[] = { "--block-pool" };
+    libvlc_instance_t *vlc = libvlc_new (1, args);
+    assert (vlc != NULL);
+
+    size_t size;
+    uint64_t hits, misses, prev_hits, prev_misses;
+
+    for (unsigned i = 0; block_PoolStats (i, &size, &prev_hits, &prev_misses)
+                                                       == VLC_SUCCESS; i++)
+    {
+        vlc_thread_t th;
+
+        assert (vlc_clone (&th, test_block_PoolThread, &size,
+                           VLC_THREAD_PRIORITY_LOW) == 0);
+        vlc_join (th, NULL);
+
+        assert (block_PoolStats (i, &size, &hits, &misses) == VLC_SUCCESS);
+        assert (hits >= prev_hits + 1);
+        assert (misses >= prev_misses + 1);
+    }
+    libvlc_release (vlc);
+}
+
 int main (void)
 {
     test_block_File ();
     test_block ();
+    test_block_PoolStats ();
+    test_block_Pool ();
     return 0;
 }
 
@@ -0,0 +1,141 @@
+/*****************************************************************************
+ * picture_copy.c: plane_CopyPixels() test and benchmark
+ *****************************************************************************
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_picture.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#undef NDEBUG
+#include <assert.h>
+
+#define LOOPS 50
+
+/* The former implementation, as reference */
+static void plane_CopyPixelsRef( plane_t *p_dst, const plane_t *p_src )
+{
+    const unsigned i_width  = __MIN( p_dst->i_visible_pitch,
+                                     p_src->i_visible_pitch );
+    const unsigned i_height = __MIN( p_dst->i_visible_lines,
+                                     p_src->i_visible_lines );
+
+    if( p_src->i_pitch == p_dst->i_pitch  &&
+        p_src->i_pitch < 2*p_src->i_visible_pitch )
+    {
+        memcpy( p_dst->p_pixels, p_src->p_pixels,
+                p_src->i_pitch * i_height );
+    }
+    else
+    {
+        uint8_t *p_in = p_src->p_pixels;
+        uint8_t *p_out = p_dst->p_pixels;
+
+        for( unsigned i_line = i_height; i_line--; )
+        {
+            memcpy( p_out, p_in, i_width );
+            p_in += p_src->i_pitch;
+            p_out += p_dst->i_pitch;
+        }
+    }
+}
+
+static void fill (picture_t *pic, unsigned seed)
+{
+    for (int i = 0; i < pic->i_planes; i++)
+    {
+        plane_t *p = &pic->p[i];
+        for (int y = 0; y < p->i_lines; y++)
+            for (int x = 0; x < p->i_pitch; x++)
+                p->p_pixels[y * p->i_pitch + x] = (x * 7 + y * 13 + seed);
+    }
+}
+
+static void check (const picture_t *dst, const picture_t *src)
+{
+    for (int i = 0; i < src->i_planes; i++)
+    {
+        const plane_t *d = &dst->p[i], *s = &src->p[i];
+        unsigned width = __MIN (d->i_visible_pitch, s->i_visible_pitch);
+
+        for (int y = 0; y < __MIN (d->i_visible_lines, s->i_visible_lines); y++)
+            assert (!memcmp (&d->p_pixels[y * d->i_pitch],
+                             &s->p_pixels[y * s->i_pitch], width));
+    }
+}
+
+static mtime_t bench (picture_t *dst, picture_t *src,
+                      void (*copy) (plane_t *, const plane_t *))
+{
+    mtime_t start = mdate ();
+    for (unsigned n = 0; n < LOOPS; n++)
+        for (int i = 0; i < src->i_planes; i++)
+            copy (&dst->p[i], &src->p[i]);
+    return (mdate () - start) / LOOPS;
+}
+
+static void test (unsigned width, unsigned height, int dst_offset)
+{
+    /* A wider destination forces line by line copies */
+    picture_t *src = picture_New (VLC_CODEC_I420, width, height, 1, 1);
+    picture_t *dst = picture_New (VLC_CODEC_I420,
+                                  width + (dst_offset ? 64 : 0), height, 1, 1);
+    assert (src != NULL && dst != NULL);
+
+    /* Misalign the destination */
+    for (int i = 0; i < dst->i_planes; i++)
+        dst->p[i].p_pixels += dst_offset;
+
+    fill (src, width);
+    for (int i = 0; i < src->i_planes; i++)
+        plane_CopyPixels (&dst->p[i], &src->p[i]);
+    check (dst, src);
+
+    mtime_t ref = bench (dst, src, plane_CopyPixelsRef);
+    mtime_t cur = bench (dst, src, plane_CopyPixels);
+    check (dst, src);
+
+    printf ("%4ux%-4u %s: memcpy %6"PRId64" us, plane_CopyPixels %6"PRId64
+            " us\n", width, height, dst_offset ? "lines" : "plane",
+            ref, cur);
+
+    for (int i = 0; i < dst->i_planes; i++)
+        dst->p[i].p_pixels -= dst_offset;
+    picture_Release (dst);
+    picture_Release (src);
+}
+
+int main (void)
+{
+    static const unsigned sizes[][2] = {
+        { 1280,  720 },
+        { 1920, 1080 },
+        { 3840, 2160 },
+    };
+
+    for (unsigned i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+    {
+        test (sizes[i][0], sizes[i][1], 0);
+        test (sizes[i][0], sizes[i][1], 3);
+    }
+    return 0;
+}
@@ -362,7 +362,7 @@ void vlc_threadvar_delete (vlc_threadvar_t *p_tls)
 int vlc_threadvar_set (vlc_threadvar_t key, void *value)
 {
     int saved = GetLastError ();
-    int val = TlsSetValue (key->id, value) ? ENOMEM : 0;
+    int val = TlsSetValue (key->id, value) ? 0 : ENOMEM;
 
     if (val == 0)
         SetLastError(saved);